@@ -1,8 +1,25 @@
 #ifndef APP_H
 #define APP_H
 
-#include "Model.h"
+#include "Scene.h"
+#include "SceneFile.h"
+#include "Culling.h"
+#include "DepthPrepass.h"
+#include "DebugViews.h"
+#include "DynamicResolution.h"
+#include "EnvironmentLight.h"
+#include "ShadowMap.h"
+#include "FramePacer.h"
+#include "FramePipeline.h"
+#include "JobSystem.h"
+#include "LightClusters.h"
+#include "PostProcess.h"
+#include "RenderGraph.h"
+#include "TextureStreamer.h"
+#include "ShaderVariants.h"
+#include "TemporalAA.h"
 #include <EGL/egl.h>
+#include <map>
 #include <memory>
 #include <switch.h>
 #include <Shader.h>
@@ -22,43 +39,138 @@ private:
     bool initEgl(NWindow* win);
     void deinitEgl();
 
-    void sceneInit();
-    void sceneUpdate();
+    // Find the scene files and load the default one
+    bool sceneInit();
+    // Replace the scene with the contents of a scene file, pipeline stopped
+    bool loadScene(const std::string& path);
+    void exportScene();
+    // Stage 1: input, camera, animation and CPU culling into 'packet'. Runs
+    // on the simulation thread when pipelined, touches no GL state.
+    void simulate(FramePacket& packet);
+    // Stage 2 (GL thread): toggles that touch GL objects, returns false on exit
+    bool applyControls(const FramePacket& packet);
+    void sceneUpdate(const FramePacket& packet);
     void sceneRender();
     void sceneExit();
 
-    float getTime() const;
+    void startPipeline();
 
-private:
-    EGLDisplay s_display_{nullptr};
-    EGLContext s_context_{nullptr};
-    EGLSurface s_surface_{nullptr};
+    // Hot reload shaders edited in Shader::kOverrideDir, then report the
+    // scene GPU time before and after the swap
+    void pollShaderReload();
 
-    GLuint program_{0};
+    // Time light culling and shading for a sweep of synthetic light counts,
+    // spread out (constant density) and packed into one area. Blocks for a
+    // few seconds, then restores the scene's lights.
+    void runLightBenchmark();
 
-    GLint loc_mdlvMtx{-1};
-    GLint loc_viewMtx{-1};
-    GLint loc_projMtx{-1};
+    // Pan the camera at a few speeds and report the TAA resolve cost and
+    // frame time with TAA off and on, and how much of the resolved frame
+    // is history (ghosting) and how much history the clamp rejected
+    void runTemporalAABenchmark(const FramePacket& packet);
+    // TAA runs this frame: enabled, and no debug view replaces the scene
+    bool temporalAAActive() const;
 
-    GLint loc_cameraPos{-1};
-    GLint loc_lightDir{-1};
-    GLint loc_lightColor{-1};
+    // Post-processing preset; the scene target follows (HDR unless off)
+    void setPostQuality(PostQuality quality);
 
-    std::unique_ptr<Model> model_;
-    std::unique_ptr<Shader> shader_;
+    // Seconds since init, from 64-bit ticks
+    double getTime() const;
 
-    // std::string modelPath_{"romfs:/cat/cat.obj"};
-    // std::string modelPath_{"/switch/models/cat_cube/cat_cube.obj"};
-    std::string modelPath_{"/switch/models/fire_hydrant/FireHydrantMesh.obj"};
+private:
+    EGLDisplay s_display_{nullptr};
+    EGLContext s_context_{nullptr};
+    EGLSurface s_surface_{nullptr};
+    bool srgbSurface_{false}; // window surface encodes linear -> sRGB on write
+
+    // fragment.glsl permutations, one per MaterialFeature mask in use
+    std::unique_ptr<ShaderVariants> materialShaders_;
+
+    // Per-frame uniform locations of a material variant, looked up on link
+    struct MaterialUniforms
+    {
+        GLint view{-1};
+        GLint proj{-1};
+        GLint cameraPos{-1};
+        GLint lightDir{-1};
+        GLint lightColor{-1};
+        ShadowMap::Uniforms shadows;
+        LightClusters::Uniforms lights;
+        EnvironmentLight::Uniforms environment;
+    };
+    std::map<const Shader*, MaterialUniforms> materialUniforms_;
+    std::unique_ptr<Scene> scene_;
+    std::unique_ptr<GpuCuller> culler_;
+    std::unique_ptr<DepthPrepass> prepass_;
+    std::unique_ptr<ShadowMap> shadows_;
+    std::unique_ptr<LightClusters> lights_;
+    std::unique_ptr<EnvironmentLight> environment_;
+    std::unique_ptr<DebugViews> debugViews_;
+    std::unique_ptr<DynamicResolution> dynamicRes_;
+    std::unique_ptr<PostProcess> post_;
+    std::unique_ptr<TemporalAA> taa_;
+    std::unique_ptr<RenderGraph> graph_; // rebuilt every frame, keeps its pool and timers
+    std::unique_ptr<FramePipeline> pipeline_;
+    std::unique_ptr<JobSystem> jobs_;
+    std::unique_ptr<TextureStreamer> streamer_;
+
+    std::string defaultScene_{"romfs:/scenes/hydrant_grid.scene"};
+    std::vector<std::string> sceneFiles_; // romfs:/scenes and /switch/scenes
+    size_t sceneIndex_{0};
+    bool nextScene_{false};
+    SceneDesc sceneDesc_; // current scene with grids expanded, for exportScene()
 
     PadState pad_{};
     Camera camera_;
+    FramePacer pacer_;
 
     u64 s_startTicks{0};
 
     glm::vec3 lightDir_{0.0f, -0.5f, -1.0f}; 
+    glm::vec3 lightColor_{1.0f, 1.0f, 1.0f}; // until a scene sets it
+    bool environmentLoaded_{false};          // sceneDesc_.environment is built
+    std::vector<LightGPU> sceneLights_;      // point and spot lights of the scene
     float lightSpeed_ = 1.0f;
     bool rotateModel_ = true;
+    struct Spinner
+    {
+        Entity entity;
+        float phase;     // fraction of a turn
+        glm::quat base;  // rotation from the scene file
+    };
+    std::vector<Spinner> spinners_;
+
+    glm::mat4 view_{1.0f};
+    glm::mat4 proj_{1.0f};
+    glm::mat4 drawProj_{1.0f}; // proj_ with the TAA jitter, what the scene is drawn with
+    glm::mat4 viewProj_{1.0f};
+    CullMode frameCullMode_ = CullMode_Gpu; // cull mode of the frame being drawn
+    DebugView debugView_ = DebugView_None;
+
+    // Simulation state, owned by whichever thread runs simulate()
+    CullMode cullMode_ = CullMode_Gpu;
+    bool gpuCullAvailable_ = false;
+    u64 simLastTicks_{0};
+    u64 simFrame_{0};
+    FramePacket serialPacket_;
+
+    // Frames the simulation runs ahead of the GL thread, 0 = serial
+    static const int kMaxPipelineLatency = 2;
+    static const int kSimulationCore = 1;
+    static const int kJobWorkers = 3; // one per application core
+    static const int kTextureBudgetMB = 64; // unless the scene sets one
+    static const int kShadowResolution = 1024; // unless the scene sets one
+    static const int kShadowCascades = 3;
+    static const PostQuality kPostQuality = PostQuality_High; // unless the scene sets one
+    int pipelineLatency_ = 1;
+
+    static const int kShaderPollInterval = 30; // frames between mtime checks
+    static const int kShaderCompareFrames = 120; // let the GPU average settle
+    int shaderPollFrames_ = 0;
+    int shaderCompareFrames_ = 0;
+    float shaderCompareBeforeMs_ = 0.0f;
+    int shaderCompareBeforeWidth_ = 0;
+    int shaderCompareBeforeHeight_ = 0;
 };
 
 #endif // APP_H
\ No newline at end of file
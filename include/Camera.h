@@ -12,6 +12,7 @@ public:
 
     void setPosition(const glm::vec3& pos) { position_ = pos; }
     const glm::vec3& position() const { return position_; }
+    void setOrientation(float yaw, float pitch) { yaw_ = yaw; pitch_ = pitch; } // radians
 
     // Update the camera using libnx pad input. 'pad' may be nullptr in tests.
     // dt is seconds elapsed since last update.
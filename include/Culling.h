@@ -0,0 +1,107 @@
+#ifndef CULLING_H
+#define CULLING_H
+
+#include <memory>
+#include <glad/glad.h>
+#include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
+#include <glm/mat4x4.hpp>
+
+#include "Shader.h"
+
+class DrawBatch;
+
+// View frustum as six normalized planes (xyz = normal pointing inside, w = distance)
+struct Frustum
+{
+    glm::vec4 planes[6];
+
+    static Frustum fromMatrix(const glm::mat4& viewProj);
+
+    // Same test as cull.comp: world-space AABB given as center + half extents
+    bool intersectsAabb(const glm::vec3& center, const glm::vec3& extents) const;
+};
+
+// Transform an object-space AABB by 'm' into a world-space center/extents pair
+void transformAabb(const glm::mat4& m, const float bmin[3], const float bmax[3],
+                   glm::vec3& center, glm::vec3& extents);
+
+enum CullMode
+{
+    CullMode_Cpu = 0,      // frustum culling on the CPU, reference path
+    CullMode_Gpu,          // frustum culling in cull.comp
+    CullMode_GpuOcclusion, // frustum + Hi-Z occlusion culling in cull.comp
+    CullMode_Count
+};
+
+const char* cullModeName(CullMode mode);
+
+// Compute-shader culling of DrawBatch records. Writes compacted indirect
+// commands (visible first, the tail zeroed, per DrawGroup range) straight
+// into the batch's indirect buffer. Occlusion uses a Hi-Z pyramid of the previous frame's
+// depth, so anything uncovered this frame may pop in one frame late.
+class GpuCuller
+{
+public:
+    GpuCuller() = default;
+    ~GpuCuller();
+
+    bool init(int width, int height);
+
+    // Frustum (and optionally Hi-Z) cull every record of 'batch'
+    void cull(DrawBatch& batch, const glm::mat4& viewProj, bool occlusion);
+
+    // Frustum cull 'batch' for another view (a shadow cascade) into
+    // 'outBuffer', which holds recordCount() commands and is laid out like
+    // the batch's own indirect buffer. The batch's draw state is untouched.
+    void cull(const DrawBatch& batch, const glm::mat4& viewProj, GLuint outBuffer);
+
+    // Capture the depth of 'srcFbo' (rendered area srcWidth x srcHeight) and
+    // build the Hi-Z pyramid for next frame's occlusion test. Call after the
+    // scene is drawn. The depth is stretched to the pyramid's full size, so a
+    // dynamically scaled viewport maps onto the same UV range.
+    void buildHiZ(GLuint srcFbo, int srcWidth, int srcHeight);
+
+    // Read the last cull result back and compare it with the CPU reference.
+    // Returns the number of records the GPU kept but the CPU frustum test
+    // rejected (must be 0); occlusion may only remove records.
+    size_t verify(const DrawBatch& batch, const glm::mat4& viewProj, bool occlusion);
+
+    bool hasHiZ() const { return hizValid_; }
+    // A frame that doesn't build the pyramid leaves it a frame (or more)
+    // behind the camera: call it then, so occlusion waits for a fresh one
+    void invalidateHiZ() { hizValid_ = false; }
+
+private:
+    void dispatch(const DrawBatch& batch, const glm::mat4& viewProj, bool useHiZ, GLuint outBuffer);
+
+    std::unique_ptr<Shader> cullShader_;
+    std::unique_ptr<Shader> hizShader_;
+
+    int width_{0};
+    int height_{0};
+
+    GLuint depthTex_{0}; // copy of the default framebuffer depth
+    GLuint depthFbo_{0};
+    GLuint hizTex_{0};   // R32F max-depth pyramid, level 0 = half resolution
+    int hizWidth_{0};
+    int hizHeight_{0};
+    int hizLevels_{0};
+    bool hizValid_{false};
+
+    GLuint counterSsbo_{0}; // visible records per DrawGroup of the last cull
+
+    GLint loc_viewProj{-1};
+    GLint loc_planes{-1};
+    GLint loc_recordCount{-1};
+    GLint loc_groupFirst{-1};
+    GLint loc_occlusion{-1};
+    GLint loc_hizSize{-1};
+    GLint loc_hizLevels{-1};
+
+    GLint loc_srcIsDepth{-1};
+    GLint loc_srcSize{-1};
+    GLint loc_dstSize{-1};
+};
+
+#endif // CULLING_H
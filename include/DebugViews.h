@@ -0,0 +1,57 @@
+#ifndef DEBUGVIEWS_H
+#define DEBUGVIEWS_H
+
+#include <memory>
+#include <glad/glad.h>
+#include <glm/mat4x4.hpp>
+
+#include "Shader.h"
+#include "DrawBatch.h"
+
+enum DebugView
+{
+    DebugView_None = 0,
+    DebugView_Overdraw,        // shaded fragments per pixel
+    DebugView_TriangleDensity, // triangle screen area, i.e. quad efficiency
+    DebugView_ShaderCost,      // sum of material fragment cost per pixel
+    DebugView_MipLevel,        // base color mip level actually sampled
+    DebugView_Count
+};
+
+const char* debugViewName(DebugView view);
+
+// Alternate programs drawing the scene to show where a frame's cost goes.
+// Overdraw and shader cost accumulate into an R16F counter target with
+// additive blending, then a full screen pass maps the count to a heat ramp.
+class DebugViews
+{
+public:
+    DebugViews() = default;
+    ~DebugViews();
+
+    bool init(int width, int height);
+
+    // Draw all batches with the debug program for 'view' to the current framebuffer
+    void render(DebugView view, const DrawBatchList& batches, const glm::mat4& viewMtx, const glm::mat4& projMtx);
+
+private:
+    void setMatrices(const Shader& shader, const glm::mat4& viewMtx, const glm::mat4& projMtx) const;
+    void renderCounter(const Shader& shader, const DrawBatchList& batches, const glm::mat4& viewMtx,
+                       const glm::mat4& projMtx, float maxValue);
+
+    std::unique_ptr<Shader> overdrawShader_;
+    std::unique_ptr<Shader> densityShader_;
+    std::unique_ptr<Shader> costShader_;
+    std::unique_ptr<Shader> mipShader_;
+    std::unique_ptr<Shader> heatmapShader_;
+
+    int width_{0};
+    int height_{0};
+
+    GLuint counterTex_{0};
+    GLuint counterDepth_{0};
+    GLuint counterFbo_{0};
+    GLuint emptyVao_{0}; // full screen triangle is generated from gl_VertexID
+};
+
+#endif // DEBUGVIEWS_H
@@ -0,0 +1,12 @@
+#ifndef DECODEBENCHMARK_H
+#define DECODEBENCHMARK_H
+
+class JobSystem;
+
+// Decode throughput of the fast JPEG/PNG path (single-threaded and banded
+// over 'jobs') against stb_image, on romfs:/cat/cat.jpg and synthetic 1K,
+// 2K and 4K textures encoded at startup. Also checks that both decoders
+// agree. Prints the results; blocks the calling thread for a few seconds.
+void runDecodeBenchmarks(JobSystem* jobs);
+
+#endif // DECODEBENCHMARK_H
@@ -0,0 +1,76 @@
+#ifndef DEPTHPREPASS_H
+#define DEPTHPREPASS_H
+
+#include <memory>
+#include <glad/glad.h>
+#include <glm/mat4x4.hpp>
+
+#include "Shader.h"
+#include "DrawBatch.h"
+
+enum PrepassMode
+{
+    PrepassMode_Off = 0, // single forward pass with GL_LESS
+    PrepassMode_On,      // depth-only pass, then shading with GL_EQUAL
+    PrepassMode_Auto,    // pick per scene from the measured overdraw
+    PrepassMode_Count
+};
+
+const char* prepassModeName(PrepassMode mode);
+
+// Optional depth-only pre-pass. The expensive PBR shading then runs once per
+// visible pixel instead of once per rasterized fragment.
+//
+// Overdraw is measured with GL_SAMPLES_PASSED queries: the pre-pass counts
+// every fragment that passes GL_LESS (what a forward pass would shade), the
+// GL_EQUAL pass counts what actually gets shaded. Auto mode keeps the
+// pre-pass while the difference is worth a second geometry pass and probes
+// again every few seconds when it has turned it off.
+class DepthPrepass
+{
+public:
+    DepthPrepass() = default;
+    ~DepthPrepass();
+
+    bool init();
+
+    void setMode(PrepassMode mode);
+    PrepassMode mode() const { return mode_; }
+
+    // Decide whether this frame gets a pre-pass, call once per frame
+    bool beginFrame();
+    bool active() const { return active_; }
+
+    // Depth-only pass of all batches (no-op when inactive this frame)
+    void renderDepth(const DrawBatchList& batches, const glm::mat4& view, const glm::mat4& proj);
+
+    // Wrap the shading pass: GL_EQUAL + no depth writes after a pre-pass
+    void beginShading();
+    void endShading();
+
+    // Redundant (hidden) fragments per screen pixel from the last probe
+    float overdraw() const { return overdraw_; }
+
+private:
+    void collectResults();
+
+    std::unique_ptr<Shader> shader_;
+    GLint loc_viewMtx{-1};
+    GLint loc_projMtx{-1};
+
+    PrepassMode mode_{PrepassMode_Auto};
+    bool active_{false};
+    bool autoUsePrepass_{true};
+    int framesSinceProbe_{0};
+
+    static const int kQueryFrames = 3; // results are read a few frames late
+    GLuint depthQueries_[kQueryFrames]{};
+    GLuint shadeQueries_[kQueryFrames]{};
+    bool pending_[kQueryFrames]{};
+    float pixels_[kQueryFrames]{}; // viewport size of each measured frame
+    int queryIndex_{0};
+
+    float overdraw_{0.0f};
+};
+
+#endif // DEPTHPREPASS_H
@@ -0,0 +1,34 @@
+#ifndef DISKCACHE_H
+#define DISKCACHE_H
+
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <string>
+
+// What the caches on the SD card (shader binaries, mip chains, IBL) have in
+// common: a 64-bit key hashed from everything the content depends on, one
+// file per key, and files that are only ever replaced whole, so a crash or
+// a pulled card mid-write leaves the old file or none, never half of one.
+
+static const uint64_t kCacheHashSeed = 14695981039346656037ull;
+
+// FNV-1a of 'data', continuing from 'hash' (start at kCacheHashSeed)
+void hashBytes(uint64_t& hash, const void* data, size_t size);
+
+// Hash a source file's path, size and modification time. False if it
+// can't be stat'ed.
+bool hashFileStamp(uint64_t& hash, const std::string& path);
+
+// Final key of a hash: never 0, which the caches use for "no key"
+inline uint64_t cacheKey(uint64_t hash) { return hash ? hash : 1; }
+
+// <dir>/<key as 16 hex digits>.<ext>
+std::string cacheFilePath(const char* dir, uint64_t key, const char* ext);
+
+// Create 'dir' if needed, let 'write' fill a temporary file next to
+// 'path' and rename it over 'path'. False when any step fails, printed
+// unless the file couldn't even be created; the temporary file is removed.
+bool writeCacheFile(const char* dir, const std::string& path, const std::function<bool(FILE*)>& write);
+
+#endif // DISKCACHE_H
@@ -0,0 +1,134 @@
+#ifndef DRAWBATCH_H
+#define DRAWBATCH_H
+
+#include <memory>
+#include <vector>
+#include <glad/glad.h>
+#include <glm/mat4x4.hpp>
+
+#include "Model.h"
+
+// std430 layout of one entry in the DrawRecords SSBO (binding 0). There is one
+// record per (instance, submesh) pair; the indirect command drawing it has
+// baseInstance = record index so the shaders can find it again.
+struct DrawRecordGPU
+{
+    GLuint transform; // index into the Transforms SSBO (binding 2)
+    GLuint material;  // index into the Materials SSBO (binding 1)
+    GLuint submesh;   // index into the SubmeshBounds SSBO (binding 3)
+    GLuint group;     // DrawGroup of the record, picks cull.comp's output range
+};
+
+// One group per material shader variant: every feature mask fits
+static const int kMaxDrawGroups = 1 << MaterialFeature_Count;
+
+// Records of one batch that share a shader variant. Records (and their
+// commands) are sorted by group, so each group owns a contiguous range of
+// the indirect buffer and is drawn by its own glMultiDrawElementsIndirect.
+struct DrawGroup
+{
+    unsigned features;  // MaterialFeature mask
+    GLuint firstRecord;
+    GLuint recordCount;
+    GLuint drawFirst;   // first command to submit
+    GLsizei drawCount;  // commands to submit
+};
+
+struct Frustum;
+class JobSystem;
+class ShaderVariants;
+
+// All instances of one Model, drawn with a single glMultiDrawElementsIndirect.
+// The indirect buffer is filled either by the CPU (cullCpu) or by GpuCuller.
+class DrawBatch
+{
+public:
+    explicit DrawBatch(const Model& model);
+    ~DrawBatch();
+
+    DrawBatch(const DrawBatch&) = delete;
+    DrawBatch& operator=(const DrawBatch&) = delete;
+
+    // (Re)build records and commands for 'count' instances
+    void setInstanceCount(size_t count);
+    size_t instanceCount() const { return transforms_.size(); }
+
+    void setTransform(size_t instance, const glm::mat4& transform) { transforms_[instance] = transform; }
+    const glm::mat4& transform(size_t instance) const { return transforms_[instance]; }
+    const std::vector<glm::mat4>& transforms() const { return transforms_; }
+    void setTransforms(const std::vector<glm::mat4>& transforms) { transforms_.assign(transforms.begin(), transforms.end()); }
+
+    // Upload the CPU transforms to the Transforms SSBO
+    void uploadTransforms();
+
+    // Reference path: frustum-cull every record on the CPU and upload the
+    // compacted command list. Returns the number of visible records.
+    size_t cullCpu(const Frustum& frustum);
+
+    // CPU-only part of cullCpu: append the commands of the visible records to
+    // 'visible', using 'transforms' instead of the batch's own. Touches no GL
+    // state, so it can run on the simulation thread. Large batches are
+    // tested in parallel when 'jobs' is given; only one thread may cull a
+    // batch at a time.
+    size_t cullRecords(const Frustum& frustum, const std::vector<glm::mat4>& transforms,
+                       std::vector<DrawElementsIndirectCommand>& visible, JobSystem* jobs = nullptr) const;
+
+    // GL part of cullCpu: upload an already culled command list
+    void uploadVisible(const std::vector<DrawElementsIndirectCommand>& visible);
+
+    // Test record 'i' against the frustum, shared by cullCpu and GPU verification
+    bool recordVisible(size_t i, const Frustum& frustum) const { return recordVisible(i, frustum, transforms_); }
+    bool recordVisible(size_t i, const Frustum& frustum, const std::vector<glm::mat4>& transforms) const;
+
+    // Draw all commands in the indirect buffer. Commands culled by the GPU
+    // have instanceCount = 0, commands culled on the CPU are not submitted.
+    // This one uses the bound program for every group (debug views).
+    void draw() const;
+
+    // Same, with each group drawn by its material shader variant
+    void draw(ShaderVariants& variants) const;
+
+    // Same commands through the model's position-only stream, for depth passes
+    void drawPositionOnly() const;
+
+    // Position-only draw of another view's command list, e.g. a shadow
+    // cascade culled by GpuCuller into its own buffer
+    void drawPositionOnly(GLuint indirectBuffer, GLsizei drawCount) const;
+
+    const Model& model() const { return model_; }
+    size_t recordCount() const { return records_.size(); }
+    const std::vector<DrawGroup>& groups() const { return groups_; }
+
+    GLuint recordBuffer() const { return recordSsbo_; }
+    GLuint transformBuffer() const { return transformSsbo_; }
+    GLuint sourceCommandBuffer() const { return sourceCommandSsbo_; }
+    GLuint indirectBuffer() const { return indirectBuffer_; }
+
+    // Called by GpuCuller after it wrote the indirect buffer: every group
+    // range is compacted in place with its tail zeroed
+    void setGpuCulled();
+
+private:
+    void bindDrawState() const;
+    void submit(GLuint indirectBuffer, GLuint first, GLsizei count) const;
+
+    const Model& model_;
+
+    std::vector<glm::mat4> transforms_;
+    std::vector<DrawRecordGPU> records_;
+    std::vector<DrawElementsIndirectCommand> commands_; // unculled, baseInstance = record
+    std::vector<DrawGroup> groups_;
+    std::vector<DrawElementsIndirectCommand> visible_;  // scratch for cullCpu
+    mutable std::vector<unsigned char> visibleFlags_;   // scratch for parallel cullRecords
+
+    GLuint drawIdVbo_{0};         // 0..N-1, per-instance attribute fed by baseInstance
+    GLuint recordSsbo_{0};
+    GLuint transformSsbo_{0};
+    GLuint sourceCommandSsbo_{0}; // commands_, read by cull.comp
+    GLuint indirectBuffer_{0};    // what actually gets drawn
+    GLsizei drawCount_{0};
+};
+
+typedef std::vector<std::unique_ptr<DrawBatch>> DrawBatchList;
+
+#endif // DRAWBATCH_H
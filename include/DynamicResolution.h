@@ -0,0 +1,111 @@
+#ifndef DYNAMICRESOLUTION_H
+#define DYNAMICRESOLUTION_H
+
+#include <memory>
+#include <glad/glad.h>
+
+#include "Shader.h"
+#include "GpuTimer.h"
+
+// Renders the scene into an offscreen target whose viewport shrinks and
+// grows with the measured GPU time, then upscales it to the window.
+//
+// The target is allocated once at full size; only the viewport changes, so
+// resizing costs nothing. The scale is uniform on both axes so the aspect
+// ratio and projection stay the same.
+//
+// Color stays linear up to the window: the target is GL_SRGB8_ALPHA8 (8 bits
+// spent where the eye needs them, blending in linear light), or
+// GL_R11F_G11F_B10F when post-processing tone maps it (same 32 bits per
+// pixel). The upscale filters the decoded linear values and the final sRGB
+// encode happens either in an sRGB window surface or at the end of the
+// upscale shader.
+class DynamicResolution
+{
+public:
+    DynamicResolution() = default;
+    ~DynamicResolution();
+
+    bool init(int width, int height);
+
+    // Switch the scene color between HDR and sRGB LDR (reallocates)
+    bool setHdr(bool hdr);
+    bool hdr() const { return hdr_; }
+
+    void setEnabled(bool enabled);
+    bool enabled() const { return enabled_; }
+
+    // Frame rate the controller tries to hold (30 or 60)
+    void setTargetFps(int fps) { targetFps_ = fps; }
+    int targetFps() const { return targetFps_; }
+
+    void setScaleBounds(float minScale, float maxScale) { minScale_ = minScale; maxScale_ = maxScale; }
+
+    // GPU time of passes outside the scene target (shadow maps) that comes
+    // out of the same frame budget but doesn't scale with the resolution
+    void setReservedMs(float ms) { reservedMs_ = ms; }
+
+    // 0 = plain bilinear, up to 1 = strong sharpening in the upscale pass
+    void setSharpness(float sharpness) { sharpness_ = sharpness; }
+
+    // Pick this frame's render size from the current scale. The scene
+    // target is bound by whoever renders into it, with that viewport.
+    void beginFrame();
+    // Feed the controller the GPU time of everything that scales with the
+    // render size this frame
+    void updateScale(float gpuMs);
+    // Upscale the scene target, or 'texture' laid out the same way (e.g. the
+    // post-processing output), into the default framebuffer
+    void present(GLuint texture = 0);
+
+    // Encode sRGB in the upscale shader instead of relying on an sRGB
+    // window surface (which only works when the surface was created so)
+    void setShaderEncode(bool shaderEncode) { shaderEncode_ = shaderEncode; }
+    bool shaderEncode() const { return shaderEncode_; }
+
+    float scale() const { return scale_; }
+    int renderWidth() const { return renderWidth_; }
+    int renderHeight() const { return renderHeight_; }
+    float gpuMs() const { return gpuMs_; }
+    float presentMs() const { return presentTimer_.averageMs(); }
+
+    // Full size of the scene target, the render size is the part in use
+    int width() const { return width_; }
+    int height() const { return height_; }
+    GLuint sceneFbo() const { return fbo_; }
+    GLuint sceneTexture() const { return colorTex_; }
+    GLuint sceneDepthTexture() const { return depthTex_; }
+
+private:
+    bool createColorTarget();
+
+    std::unique_ptr<Shader> upscaleShader_;
+    GLint loc_uvScale{-1};
+    GLint loc_texelSize{-1};
+    GLint loc_sharpness{-1};
+    GLint loc_encodeSrgb{-1};
+    GpuTimer presentTimer_;
+
+    int width_{0};
+    int height_{0};
+    int renderWidth_{0};
+    int renderHeight_{0};
+
+    GLuint colorTex_{0};
+    GLuint depthTex_{0};
+    GLuint fbo_{0};
+    GLuint emptyVao_{0};
+
+    bool enabled_{true};
+    int targetFps_{30};
+    float scale_{1.0f};
+    float minScale_{0.5f};
+    float maxScale_{1.0f};
+    float sharpness_{0.3f};
+    float reservedMs_{0.0f};
+    float gpuMs_{0.0f}; // running average of what updateScale() was fed
+    bool shaderEncode_{false};
+    bool hdr_{false};
+};
+
+#endif // DYNAMICRESOLUTION_H
@@ -0,0 +1,97 @@
+#ifndef ENVIRONMENTLIGHT_H
+#define ENVIRONMENTLIGHT_H
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <glad/glad.h>
+#include <glm/vec3.hpp>
+
+#include "Shader.h"
+#include "ShadowMap.h"
+
+// Texture units of the prefiltered environment and the BRDF table, after
+// the shadow map array
+static const int kEnvSpecularTextureUnit = kShadowTextureUnit + 1;
+static const int kBrdfLutTextureUnit = kShadowTextureUnit + 2;
+
+// Image-based ambient lighting, split-sum style: all the integration is
+// done once per environment, so shading costs one cubemap and one 2D
+// fetch plus a few MADs.
+//
+//  - Specular: the environment convolved with the GGX lobe of increasing
+//    roughness, one cubemap mip per roughness step. Filtered importance
+//    sampling (each sample reads a mip matching its solid angle) keeps the
+//    sample count low without fireflies.
+//  - Diffuse: irradiance as 9 spherical harmonics coefficients, projected
+//    on the CPU and already convolved with the cosine lobe.
+//  - The environment-independent half of the split sum, scale and bias to
+//    F0 by (N.V, roughness), in a small 2D table.
+//
+// The source is an equirectangular image (.hdr, or an LDR format taken as
+// sRGB), or a procedural sky when there is none. The prefiltered mips and
+// coefficients are cached on the SD card by source file and generator
+// version, the table once for all environments, so a later run only reads
+// and uploads them.
+class EnvironmentLight
+{
+public:
+    static const int kSpecularSize = 128;  // face size of the roughness 0 mip
+    static const int kSpecularLevels = 6;  // 128 .. 4, roughness 0 .. 1
+    static const int kBrdfLutSize = 128;
+
+    EnvironmentLight() = default;
+    ~EnvironmentLight();
+
+    // Build or load the BRDF table
+    bool init();
+
+    // Build or load the lighting for an equirectangular image, or for the
+    // procedural sky when 'path' is empty. Keeps the previous environment
+    // if the image can't be read.
+    bool load(const std::string& path);
+
+    void setIntensity(float intensity) { intensity_ = intensity; }
+    float intensity() const { return intensity_; }
+    void setEnabled(bool enabled) { enabled_ = enabled; }
+    bool enabled() const { return enabled_; }
+
+    // Uniform locations of a program that includes common/ibl.glsl,
+    // looked up once per link
+    struct Uniforms
+    {
+        GLint irradianceSh{-1};
+        GLint specularMaxLod{-1};
+        GLint intensity{-1};
+    };
+    static Uniforms locate(const Shader& shader);
+
+    // Per-frame uniforms of that program, bound
+    void setUniforms(const Uniforms& loc) const;
+    // Bind the cubemap and the table to their units
+    void bindTextures() const;
+
+private:
+    struct SourceImage
+    {
+        int width;
+        int height;
+        std::vector<float> rgb; // linear, row 0 at the top (+Y)
+    };
+
+    bool readSource(const std::string& path, SourceImage& image) const;
+    static void makeSky(SourceImage& image);
+    static void projectIrradiance(const SourceImage& image, glm::vec3 sh[9]);
+    bool prefilter(const SourceImage& image);
+    bool buildBrdfLut();
+    void createSpecularTexture();
+
+    GLuint specularTex_{0}; // GL_TEXTURE_CUBE_MAP, RGBA16F, kSpecularLevels mips
+    GLuint brdfLut_{0};     // GL_TEXTURE_2D, RG16F
+    glm::vec3 irradianceSh_[9]{};
+    bool loaded_{false}; // the cubemap holds an environment
+    float intensity_{1.0f};
+    bool enabled_{true};
+};
+
+#endif // ENVIRONMENTLIGHT_H
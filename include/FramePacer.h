@@ -0,0 +1,80 @@
+#ifndef FRAMEPACER_H
+#define FRAMEPACER_H
+
+#include <EGL/egl.h>
+#include <switch.h>
+
+// Pacing presets, cycled at runtime
+enum PacingMode
+{
+    PacingMode_Vsync60 = 0, // swap interval 1
+    PacingMode_Vsync30,     // swap interval 2
+    PacingMode_Cap60,       // no vsync, CPU limiter at 60 FPS
+    PacingMode_Cap30,       // no vsync, CPU limiter at 30 FPS
+    PacingMode_Uncapped,    // no vsync, no limiter (GPU/CPU bound timing)
+    PacingMode_Count
+};
+
+const char* pacingModeName(PacingMode mode);
+
+// Frame pacing: swap interval, optional CPU frame limiter and frame time
+// statistics. All timing is done in 64-bit system ticks; seconds are only
+// derived as deltas, so precision doesn't degrade over long sessions.
+class FramePacer
+{
+public:
+    FramePacer() = default;
+
+    void init(EGLDisplay display, EGLSurface surface);
+
+    void setMode(PacingMode mode);
+    PacingMode mode() const { return mode_; }
+    int targetFps() const { return targetFps_; } // 0 when uncapped
+
+    // Sleep until the limiter allows the next frame. Call right before
+    // sampling input so the input is as fresh as possible when rendered.
+    void waitForNextFrame();
+
+    // Start of the frame's CPU work, returns the time since the previous one
+    double beginFrame();
+
+    // eglSwapBuffers, measuring how long the present blocks
+    void present();
+
+    // Print and reset the statistics every 'seconds'
+    void setReportInterval(double seconds) { reportInterval_ = seconds; }
+
+    static u64 ticks() { return armGetSystemTick(); }
+    static double ticksToSeconds(u64 ticks) { return armTicksToNs(ticks) / 1000000000.0; }
+
+private:
+    struct Stats
+    {
+        u64 frames = 0;
+        double sum = 0.0;
+        double sumSq = 0.0;
+        double min = 1e9;
+        double max = 0.0;
+        u64 missed = 0;         // frames longer than 1.5x the target interval
+        double presentSum = 0.0; // time blocked in eglSwapBuffers
+    };
+
+    void report();
+
+    EGLDisplay display_{nullptr};
+    EGLSurface surface_{nullptr};
+
+    PacingMode mode_{PacingMode_Vsync60};
+    int swapInterval_{1};
+    int targetFps_{60};
+    u64 capTicks_{0};       // limiter interval, 0 = off
+    u64 targetTicks_{0};    // expected frame interval for the miss counter
+    u64 deadline_{0};
+
+    u64 lastFrameStart_{0};
+    u64 lastReport_{0};
+    double reportInterval_{10.0};
+    Stats stats_;
+};
+
+#endif // FRAMEPACER_H
@@ -0,0 +1,95 @@
+#ifndef FRAMEPIPELINE_H
+#define FRAMEPIPELINE_H
+
+#include <atomic>
+#include <functional>
+#include <vector>
+#include <glm/vec3.hpp>
+#include <glm/mat4x4.hpp>
+#include <switch.h>
+
+#include "Model.h"
+#include "Culling.h"
+
+// Everything the GL thread needs to draw one frame. Written by the
+// simulation stage, read-only once handed to the GL thread.
+struct FramePacket
+{
+    u64 frame = 0;
+    float dt = 0.0f;
+
+    // Input of this frame, for the toggles handled on the GL thread
+    u64 buttonsDown = 0;
+    u64 buttonsHeld = 0;
+
+    glm::mat4 view{1.0f};
+    glm::mat4 proj{1.0f};
+    glm::mat4 viewProj{1.0f};
+    glm::vec3 cameraPos{0.0f};
+    glm::vec3 lightDir{0.0f, -0.5f, -1.0f};
+
+    // Per scene batch, same order as Scene::batches()
+    struct Batch
+    {
+        // Instance transforms, only filled when they changed since the last
+        // packet; the GL thread keeps the previous upload otherwise
+        bool transformsChanged = false;
+        std::vector<glm::mat4> transforms;
+        std::vector<DrawElementsIndirectCommand> visible; // CPU cull result, CullMode_Cpu only
+    };
+    std::vector<Batch> batches;
+
+    CullMode cullMode = CullMode_Cpu;
+    bool verifyCull = false;
+};
+
+// Two-stage frame pipeline: a worker thread simulates frame N+1 (input,
+// camera, animation, CPU culling) while the GL thread submits frame N.
+//
+// Packets live in a ring of latency + 1 entries. The only synchronization
+// is one semaphore handoff per frame in each direction; a packet is owned
+// by exactly one thread at a time, so nothing inside it needs locking.
+// Latency 1 adds one frame of input latency for full overlap, 2 absorbs
+// more jitter at the cost of another frame. Latency 0 means serial: the
+// pipeline is not started and the caller simulates inline.
+class FramePipeline
+{
+public:
+    using SimulateFn = std::function<void(FramePacket&)>;
+
+    FramePipeline() = default;
+    ~FramePipeline();
+
+    FramePipeline(const FramePipeline&) = delete;
+    FramePipeline& operator=(const FramePipeline&) = delete;
+
+    // Start the worker on 'core' (latency 1 or 2)
+    bool start(int latency, SimulateFn simulate, int core);
+    void stop();
+    bool running() const { return running_; }
+    int latency() const { return latency_; }
+
+    // GL thread: wait for the next simulated packet, then hand it back
+    const FramePacket& acquire();
+    void release();
+
+private:
+    static void threadMain(void* arg);
+    void workerLoop();
+
+    Thread thread_{};
+    Semaphore free_{};
+    Semaphore ready_{};
+    std::vector<FramePacket> packets_;
+    SimulateFn simulate_;
+    int latency_{0};
+    size_t readIndex_{0};
+    std::atomic<bool> running_{false};
+
+    // Time the GL thread spent waiting for the simulation, reported periodically
+    u64 waitTicks_{0};
+    std::atomic<u64> simTicks_{0};
+    u64 frames_{0};
+};
+
+#endif // FRAMEPIPELINE_H
@@ -0,0 +1,40 @@
+#ifndef GPUTIMER_H
+#define GPUTIMER_H
+
+#include <glad/glad.h>
+
+// Non-blocking GPU timing of a range of commands. Uses GL_TIMESTAMP query
+// pairs (not GL_TIME_ELAPSED) so timers can be nested, and keeps a few
+// frames of queries in flight so reading a result never stalls.
+class GpuTimer
+{
+public:
+    GpuTimer() = default;
+    ~GpuTimer();
+
+    GpuTimer(const GpuTimer&) = delete;
+    GpuTimer& operator=(const GpuTimer&) = delete;
+
+    void begin();
+    void end();
+
+    // Latest finished measurement in milliseconds, or -1 before the first
+    float lastMs() const { return lastMs_; }
+
+    // Running average over recent results, smoother for on-screen numbers
+    float averageMs() const { return averageMs_; }
+
+private:
+    void poll();
+
+    static const int kLatency = 4;
+    GLuint queries_[kLatency * 2]{};
+    bool pending_[kLatency]{};
+    int index_{0};
+    bool created_{false};
+
+    float lastMs_{-1.0f};
+    float averageMs_{0.0f};
+};
+
+#endif // GPUTIMER_H
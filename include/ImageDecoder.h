@@ -0,0 +1,50 @@
+#ifndef IMAGEDECODER_H
+#define IMAGEDECODER_H
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+class JobSystem;
+
+enum ImageCodec
+{
+    ImageCodec_None = 0, // not decoded
+    ImageCodec_Jpeg,     // libjpeg-turbo
+    ImageCodec_Png,      // libpng
+    ImageCodec_Stb,      // stb_image fallback
+};
+
+const char* imageCodecName(ImageCodec codec);
+
+// Fast JPEG/PNG decoding. JPEG goes through libjpeg-turbo (NEON IDCT,
+// upsampling and color conversion on the A57), PNG through libpng's
+// simplified API (NEON row filters). Both write straight into the caller's
+// buffer, flipped if asked, with no intermediate copy. Everything else, and
+// anything these libraries reject, is left to stb_image.
+
+bool readFileBytes(const std::string& path, std::vector<unsigned char>& out);
+
+// Size and channel count of a JPEG/PNG in memory, without decoding it
+bool fastImageInfo(const unsigned char* data, size_t size, int& width, int& height, int& channels);
+
+// Decode into 'dst' (width * height * channels bytes, tightly packed rows).
+// 'channels' is 1, 3 or 4. 'flip' stores the rows bottom-up like
+// stbi_set_flip_vertically_on_load. With 'jobs', large JPEGs are split into
+// horizontal bands decoded in parallel. Returns ImageCodec_None when the
+// fast path can't handle the data.
+ImageCodec fastDecodeImage(const unsigned char* data, size_t size, int channels, bool flip,
+                           unsigned char* dst, JobSystem* jobs = nullptr);
+
+// Decode a file into 'pixels' with the fast path (straight into the
+// vector's storage), falling back to stb_image
+bool decodeImageFile(const std::string& path, int channels, bool flip, std::vector<unsigned char>& pixels,
+                     int& width, int& height, JobSystem* jobs = nullptr, ImageCodec* codec = nullptr);
+
+// Same for Image: returns a malloc'd buffer to release with
+// stbi_image_free(), or nullptr. 'fileChannels' is the channel count
+// stored in the file.
+unsigned char* loadImageFile(const std::string& path, int channels, bool flip, int& width, int& height,
+                             int& fileChannels, JobSystem* jobs = nullptr, ImageCodec* codec = nullptr);
+
+#endif // IMAGEDECODER_H
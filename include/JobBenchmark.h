@@ -0,0 +1,9 @@
+#ifndef JOBBENCHMARK_H
+#define JOBBENCHMARK_H
+
+// Microbenchmarks of JobSystem: per-job scheduling overhead, parallelFor
+// overhead and scaling of a culling-like workload from 1 to 3 cores.
+// Prints the results; blocks the calling thread for about a second.
+void runJobBenchmarks();
+
+#endif // JOBBENCHMARK_H
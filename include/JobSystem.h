@@ -0,0 +1,123 @@
+#ifndef JOBSYSTEM_H
+#define JOBSYSTEM_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class JobCounter;
+
+struct Job
+{
+    std::function<void()> fn;
+    JobCounter* counter = nullptr;
+};
+
+// Number of unfinished jobs started with this counter. JobSystem::wait()
+// returns once it drops to zero, and JobSystem::runAfter() can hold jobs
+// back until then, which is how dependencies are expressed.
+//
+// done() turning true doesn't mean the last job let go of the counter yet:
+// only destroy one after JobSystem::wait() on it returned.
+class JobCounter
+{
+public:
+    JobCounter() = default;
+    JobCounter(const JobCounter&) = delete;
+    JobCounter& operator=(const JobCounter&) = delete;
+
+    bool done() const { return pending_.load(std::memory_order_acquire) == 0; }
+
+private:
+    friend class JobSystem;
+
+    std::atomic<int> pending_{0};
+    std::mutex mutex_;
+    std::vector<Job> continuations_; // started when pending_ reaches zero
+};
+
+// Small work-stealing scheduler. Each worker thread is pinned to a core and
+// owns a deque: it pushes and pops its own jobs at the back (LIFO, cache
+// warm) and steals from the front of the others when it runs dry. Threads
+// that are not workers (the GL and simulation threads) submit through a
+// shared queue and help execute jobs while they wait.
+class JobSystem
+{
+public:
+    struct Stats
+    {
+        uint64_t executed = 0;
+        uint64_t stolen = 0;
+    };
+
+    JobSystem() = default;
+    ~JobSystem();
+
+    JobSystem(const JobSystem&) = delete;
+    JobSystem& operator=(const JobSystem&) = delete;
+
+    // Start 'workerCount' workers, worker i pinned to core firstCore + i
+    // (on Switch). workerCount 0 runs everything on the calling thread.
+    bool init(int workerCount, int firstCore = 0);
+    void shutdown();
+    int workerCount() const { return (int)workers_.size(); }
+
+    void run(std::function<void()> fn, JobCounter* counter = nullptr);
+
+    // Long-running work off the frame (streaming decodes). Only idle
+    // workers pick it up: wait() and parallelFor() never run it, so it
+    // can't land inside a frame's critical path.
+    void runBackground(std::function<void()> fn, JobCounter* counter = nullptr);
+
+    // Start 'fn' once 'dependency' has no pending jobs left
+    void runAfter(JobCounter& dependency, std::function<void()> fn, JobCounter* counter = nullptr);
+
+    // Block until 'counter' is done, executing queued jobs meanwhile
+    void wait(JobCounter& counter);
+
+    // Call fn(begin, end) over [0, count) in chunks of at least 'grain'
+    // items, on the workers and the calling thread. Returns when all are done.
+    void parallelFor(size_t count, size_t grain, const std::function<void(size_t, size_t)>& fn);
+
+    Stats stats() const;
+    void resetStats();
+
+private:
+    struct Queue
+    {
+        std::mutex mutex;
+        std::deque<Job> jobs;
+        std::thread thread; // unused for the shared queue
+        std::atomic<uint64_t> executed{0};
+        std::atomic<uint64_t> stolen{0};
+    };
+
+    void workerMain(int index, int core);
+    int currentQueue() const;
+    void submit(Job job);
+    void push(int queue, Job job);
+    bool tryPop(int queue, Job& job);
+    bool tryPopBackground(Job& job);
+    void execute(int queue, Job& job);
+    void finish(JobCounter* counter);
+
+    // workers_[i] belongs to worker i, shared_ takes jobs from other
+    // threads, background_ the ones only idle workers run
+    std::vector<std::unique_ptr<Queue>> workers_;
+    Queue shared_;
+    Queue background_;
+
+    std::atomic<bool> running_{false};
+    std::atomic<int> queued_{0};
+    std::atomic<int> sleeping_{0};
+    std::mutex sleepMutex_;
+    std::condition_variable wake_;
+};
+
+#endif // JOBSYSTEM_H
@@ -0,0 +1,116 @@
+#ifndef LIGHTCLUSTERS_H
+#define LIGHTCLUSTERS_H
+
+#include <memory>
+#include <vector>
+#include <glad/glad.h>
+#include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
+#include <glm/mat4x4.hpp>
+
+#include "Shader.h"
+#include "GpuTimer.h"
+
+enum LightType
+{
+    LightType_Point = 0,
+    LightType_Spot = 1
+};
+
+// std430 layout of one entry in the Lights SSBO (binding 7), matches Light
+// in common/lights.glsl
+struct LightGPU
+{
+    glm::vec4 positionRadius; // world position, range
+    glm::vec4 colorType;      // linear color * intensity, w = LightType
+    glm::vec4 spotDirection;  // xyz = direction the spot points at, w = cos of the outer angle
+    glm::vec4 spotParams;     // x = 1 / (cos inner - cos outer)
+};
+
+LightGPU makePointLight(const glm::vec3& position, const glm::vec3& color, float radius);
+// Angles are half angles in radians
+LightGPU makeSpotLight(const glm::vec3& position, const glm::vec3& color, float radius,
+                       const glm::vec3& direction, float innerAngle, float outerAngle);
+
+// Clustered forward lighting: point and spot lights are assigned to a
+// kGridX x kGridY x kGridZ grid of froxels (screen tiles times exponential
+// depth slices) by light_cull.comp, once per frame. The fragment shader
+// finds its froxel from gl_FragCoord and view depth and only loops over
+// that froxel's list, so shading cost follows the local light density, not
+// the total light count.
+//
+// Lists are fixed-size slots of kMaxLightsPerCluster indices per froxel:
+// no global counter to contend on, and a froxel that overflows just drops
+// its highest-indexed lights.
+class LightClusters
+{
+public:
+    static const int kGridX = 16;
+    static const int kGridY = 9;
+    static const int kGridZ = 24;
+    static const int kClusterCount = kGridX * kGridY * kGridZ;
+    static const int kMaxLightsPerCluster = 64; // MAX_LIGHTS_PER_CLUSTER in common/lights.glsl
+    static const int kMaxLights = 1024;
+
+    LightClusters() = default;
+    ~LightClusters();
+
+    bool init();
+
+    // Replace the light list (clamped to kMaxLights) and upload it
+    void setLights(const std::vector<LightGPU>& lights);
+    size_t lightCount() const { return lightCount_; }
+
+    // Assign the lights to the froxels of this view. Tiles are in NDC, so
+    // the result holds for any render resolution.
+    void cull(const glm::mat4& view, const glm::mat4& proj);
+
+    // Bind the Lights and cluster SSBOs for shading
+    void bind() const;
+
+    // Uniform locations of a program that includes common/lights.glsl,
+    // looked up once per link
+    struct Uniforms
+    {
+        GLint lightCount{-1};
+        GLint grid{-1};
+        GLint depth{-1};
+        GLint tileScale{-1};
+    };
+    static Uniforms locate(const Shader& shader);
+
+    // Per-frame uniforms of that program, bound
+    void setUniforms(const Uniforms& loc) const;
+    // Froxel tile size for the viewport actually rendered, every draw
+    static void setViewport(const Uniforms& loc, int width, int height);
+
+    float cullMs() const { return timer_.averageMs(); }
+
+    // Read the last cull's froxel occupancy back (stalls): average lights
+    // per non-empty froxel, the maximum, and how many froxels overflowed.
+    // Counts include the lights an overflowing froxel dropped.
+    void readStats(float& average, unsigned& maximum, unsigned& overflowed) const;
+
+private:
+    std::unique_ptr<Shader> cullShader_;
+    GLint loc_view{-1};
+    GLint loc_invProj{-1};
+    GLint loc_lightCount{-1};
+    GLint loc_grid{-1};
+    GLint loc_depth{-1};
+
+    GLuint lightSsbo_{0};
+    GLuint countSsbo_{0};
+    GLuint indexSsbo_{0};
+    size_t lightCount_{0};
+
+    // Depth range of the exponential slices, the last one reaches on to
+    // the camera's far plane
+    float near_{1.0f};
+    float far_{100.0f};
+    float cameraFar_{1000.0f};
+
+    GpuTimer timer_;
+};
+
+#endif // LIGHTCLUSTERS_H
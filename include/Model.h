@@ -6,6 +6,7 @@
 #include <glad/glad.h>
 
 #include "tiny_obj_loader.h"
+#include "TextureUtils.h"
 
 struct Vertex {
     float position[3];
@@ -17,59 +18,230 @@ struct Vertex {
 
 struct Submesh
 {
-    int material_id; // -1 for no material
-    size_t first;    // first vertex index in the consolidated vertex array
-    size_t count;    // number of vertices
+    int material_id;   // -1 for no material
+    size_t firstIndex; // first index in the consolidated index array
+    size_t indexCount; // number of indices
+    int baseVertex;    // added to every index of this submesh
+    float boundsMin[3]; // object-space AABB, used for culling
+    float boundsMax[3];
 };
 
+// std430 layout of one entry in the SubmeshBounds SSBO (binding 3, cull.comp)
+struct SubmeshBoundsGPU
+{
+    float boundsMin[4];
+    float boundsMax[4];
+};
+
+// Layout of one glMultiDrawElementsIndirect command (GL 4.3)
+struct DrawElementsIndirectCommand
+{
+    GLuint count;
+    GLuint instanceCount;
+    GLuint firstIndex;
+    GLint  baseVertex;
+    GLuint baseInstance;
+};
+
+// Texture slots. Each slot is one GL_TEXTURE_2D_ARRAY bound to the texture
+// unit with the same number; layer 0 of every array is the 1x1-equivalent
+// white default used for missing maps.
+enum TextureSlot
+{
+    Slot_BaseColor = 0,
+    Slot_ORM,           // occlusion/roughness/metallic packed into r/g/b
+    Slot_Normal,
+    Slot_Count
+};
+
+// Channels of the packed ORM map (glTF order)
+enum OrmChannel
+{
+    Orm_Occlusion = 0,
+    Orm_Roughness,
+    Orm_Metallic,
+    Orm_Count
+};
+
+// std430 layout of one entry in the Materials SSBO (binding 1, fragment.glsl)
+struct MaterialGPU
+{
+    GLuint layers[Slot_Count];
+    GLuint cost; // estimated fragment cost, shown by the shader cost debug view
+};
+
+// Shader permutation features of a material, bit (1 << feature) of a mask.
+// Each one is a #define in fragment.glsl; without it the matching fetches
+// and math are compiled out.
+enum MaterialFeature
+{
+    MaterialFeature_NormalMap = 0, // HAS_NORMAL_MAP: sample and apply the normal map
+    MaterialFeature_Orm,           // HAS_ORM: sample occlusion/roughness/metallic
+    MaterialFeature_Unlit,         // UNLIT: base color only, no lighting
+    MaterialFeature_Count
+};
+
+// #define name of each feature, in MaterialFeature order
+std::vector<std::string> materialFeatureDefines();
+
 // New Material struct
 struct Material
 {
     std::string name;
 
-    GLuint baseColorTex = 0;
+    // Layer of each map inside the model's texture arrays (0 = default white)
+    GLuint baseColorLayer = 0;
 
-    // Optional PBR maps
-    GLuint metallicTex  = 0;
-    GLuint roughnessTex = 0;
-    GLuint aoTex        = 0;
-    GLuint normalTex    = 0;
+    // Optional PBR maps. Occlusion, roughness and metallic share one packed
+    // layer per combination of source maps.
+    GLuint ormLayer       = 0;
+    GLuint normalLayer    = 0;
 
     float baseColorFactor[3] = {1.0f, 1.0f, 1.0f};
     float metallicFactor     = 1.0f;
     float roughnessFactor    = 1.0f;
     float aoFactor           = 1.0f;
+    bool unlit               = false; // MTL illum 0, base color as is
 
     bool isDiffuseOnly() const {
-        return metallicTex == 0 && roughnessTex == 0 && aoTex == 0 && normalTex == 0;
+        return ormLayer == 0 && normalLayer == 0;
     }
+
+    // MaterialFeature mask of the shader variant this material needs
+    unsigned features() const;
+
+    // Rough per-fragment cost of the shader variant with 'features', in
+    // units of one texture fetch. Only used for the shader cost debug view.
+    static GLuint estimatedCost(unsigned features);
+    GLuint estimatedCost() const { return estimatedCost(features()); }
+};
+
+// Source files of one texture array layer. Plain maps (base color,
+// normal) have one RGBA source, packed ORM layers one greyscale map per
+// channel where an empty path means white.
+struct TextureLayerSource
+{
+    std::string path;
+    std::string channelPaths[Orm_Count];
+};
+
+// Layout and sources of one slot's texture array, used by TextureStreamer
+struct TextureArrayInfo
+{
+    int width = 1;          // full resolution of level 0
+    int height = 1;
+    int levels = 1;         // full mip chain
+    int layers = 1;         // including the default layer 0
+    int channels = 4;       // bytes per texel: 4 = GL_RGBA8 / GL_SRGB8_ALPHA8, 1 = GL_R8
+    GLenum internalFormat = GL_RGBA8;
+    bool packed = false;    // layers are built from channelPaths
+    int packedChannel = -1; // R8 packed array: the one ORM channel it holds
+    MipContent content = MipContent_Linear; // how its mips are filtered
+    int residentMip = 0;    // finest level currently in GPU memory
+    std::vector<TextureLayerSource> layerSources; // sources of layers 1..n
+
+    GLenum pixelFormat() const { return channels == 1 ? GL_RED : GL_RGBA; }
 };
 
+class JobSystem;
+
 class Model
 {
 public:
     explicit Model(const std::string& path);
     ~Model();
 
-    bool load();              // Load OBJ + PBR textures
-    bool uploadToGPU();       // Upload vertex buffer
-    void draw(int baseColorLoc, int metallicLoc, int roughnessLoc, int aoLoc, int normalLoc) const; // Draw model with materials
+    // Load OBJ + decode PBR textures. With a job system, maps are decoded and
+    // materials welded in parallel.
+    bool load(JobSystem* jobs = nullptr);
+    // Upload vertex/index buffers, texture arrays and material data. With
+    // maxTextureSize > 0 the arrays only get the mips up to that size and
+    // TextureStreamer brings in the rest.
+    bool uploadToGPU(int maxTextureSize = 0);
+
+    // Bind the VAO, texture arrays, Materials SSBO and SubmeshBounds SSBO.
+    // Drawing is done by a DrawBatch holding the instances of this model.
+    void bind() const;
+
+    // Bind the position-only VAO (tightly packed positions, same indices)
+    // used by depth-only passes.
+    void bindPositionOnly() const;
 
     size_t vertexCount() const { return vertices_.size(); }
+    size_t indexCount() const { return indices_.size(); }
+
+    const std::vector<Submesh>& submeshes() const { return submeshes_; }
+    GLuint boundsBuffer() const { return boundsSsbo_; }
+
+    const TextureArrayInfo& textureInfo(TextureSlot slot) const { return textureInfo_[slot]; }
+    GLuint textureArray(TextureSlot slot) const { return textureArrays_[slot]; }
+
+    // Decode layer 'layer' (1..n) of an array described by 'info' at full
+    // size, in the array's channel layout. Safe to call from any thread.
+    static bool decodeLayer(const TextureArrayInfo& info, int layer,
+                            std::vector<unsigned char>& pixels, int& width, int& height,
+                            JobSystem* jobs = nullptr);
+
+    // Mip chain of a layer at its source size: read from the mip cache
+    // (levels >= firstLevel only), or decoded, filtered and written to the
+    // cache. 'bandDecode' lets large JPEGs use the jobs as well.
+    static bool loadLayerMips(const TextureArrayInfo& info, int layer, int firstLevel, MipChain& chain,
+                              JobSystem* jobs = nullptr, bool bandDecode = false, bool* fromCache = nullptr);
+
+    // Mip chain of a layer stretched to the array size (info.width x
+    // info.height), cached apart from the source-size chain. On a cache
+    // miss 'chain' is fitted from the full source-size chain, which it may
+    // already hold; otherwise it is loaded.
+    static bool loadFittedLayerMips(const TextureArrayInfo& info, int layer, int firstLevel, MipChain& chain,
+                                    JobSystem* jobs = nullptr);
+
+    // Allocate an empty array with the slot's format and sampling state for
+    // levels mip.. of its chain
+    GLuint createTextureArray(TextureSlot slot, int mip) const;
+
+    // Swap in a texture array holding levels residentMip.. of the slot and
+    // delete the old one
+    void replaceTextureArray(TextureSlot slot, GLuint texture, int residentMip);
+
+    // Bounds of all submeshes in object space
+    void bounds(float outMin[3], float outMax[3]) const;
+
+    // Index into the Materials SSBO for a submesh (0 = no material)
+    GLuint gpuMaterialIndex(const Submesh& sm) const
+    {
+        return (sm.material_id >= 0 && sm.material_id < (int)materials_.size()) ? (GLuint)sm.material_id + 1 : 0;
+    }
+
+    // Shader variant features of a submesh's material (0 without one)
+    unsigned materialFeatures(const Submesh& sm) const
+    {
+        GLuint index = gpuMaterialIndex(sm);
+        return index ? materials_[index - 1].features() : 0;
+    }
 
 private:
+    bool uploadTextureArrays(int maxTextureSize);
+
     std::string path_;
     std::vector<Vertex> vertices_;
+    std::vector<GLuint> indices_;
     std::vector<Submesh> submeshes_;
 
     std::vector<Material> materials_; // Replaces tinyobj::material_t
-    std::vector<GLuint> default_textures_; // default 1x1 textures for missing maps
+
+    // Mip chains per slot, index = layer - 1. Released after upload.
+    std::vector<MipChain> slotLayers_[Slot_Count];
 
     // GL objects
     GLuint vao_{0};
     GLuint vbo_{0};
-
-    static GLuint createDefaultTexture(const unsigned char color[4]);
+    GLuint ebo_{0};
+    GLuint positionVao_{0};
+    GLuint positionVbo_{0};
+    GLuint materialSsbo_{0};
+    GLuint boundsSsbo_{0};
+    GLuint textureArrays_[Slot_Count]{};
+    TextureArrayInfo textureInfo_[Slot_Count];
 };
 
-#endif // MODEL_H
\ No newline at end of file
+#endif // MODEL_H
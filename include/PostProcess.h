@@ -0,0 +1,99 @@
+#ifndef POSTPROCESS_H
+#define POSTPROCESS_H
+
+#include <memory>
+#include <glad/glad.h>
+
+#include "Shader.h"
+#include "RenderGraph.h"
+
+enum PostQuality
+{
+    PostQuality_Off = 0, // LDR scene target, presented as it is
+    PostQuality_Low,     // HDR target, tone mapping
+    PostQuality_Medium,  // + FXAA
+    PostQuality_High,    // + bloom
+    PostQuality_Count
+};
+
+const char* postQualityName(PostQuality quality);
+
+// Post-processing chain between the HDR scene target and the upscale:
+//
+//   scene (R11G11B10F) -> bloom down 1/2 .. 1/32 -> bloom up (additive)
+//                      -> tone map (+ bloom) -> FXAA -> present
+//
+// The passes go into the frame's RenderGraph, which allocates their
+// targets from its pool, aliases the ones whose lifetimes don't overlap and
+// invalidates them around their use; each pass is timed there. Every pass
+// runs at the scaled render size inside targets allocated at the full size,
+// like the scene target, so dynamic resolution never reallocates.
+//
+// The tone map writes sRGB-encoded LDR with a perceptual luma in alpha,
+// which is what FXAA edge detection wants.
+class PostProcess
+{
+public:
+    static const int kBloomLevels = 5;
+
+    PostProcess() = default;
+    ~PostProcess();
+
+    // Full size of the scene target
+    bool init(int width, int height);
+
+    void setQuality(PostQuality quality) { quality_ = quality; }
+    PostQuality quality() const { return quality_; }
+    // The scene has to render into an HDR target
+    bool enabled() const { return quality_ != PostQuality_Off; }
+
+    void setExposure(float exposure) { exposure_ = exposure; }
+    float exposure() const { return exposure_; }
+
+    // Add the chain's passes reading 'sceneColor', rendered in its lower-left
+    // renderWidth x renderHeight. FXAA is left out when the scene is already
+    // antialiased (temporally). Returns the texture to present, same layout.
+    RGTexture addPasses(RenderGraph& graph, RGTexture sceneColor, int renderWidth, int renderHeight,
+                        bool antialiased);
+
+private:
+    // A target at 1/divisor of the full size, viewed at that of the render size
+    RGTexture create(RenderGraph& graph, const char* name, int divisor, GLenum format, int renderWidth,
+                     int renderHeight) const;
+    // Sampling uniforms of a source texture: rendered part in UV, texel size
+    static void setSource(const RenderGraph::Context& context, GLint locScale, GLint locTexel, RGTexture source);
+    // Shared state of the fullscreen draws
+    void beginDraw() const;
+    static void endDraw();
+
+    std::unique_ptr<Shader> bloomDownShader_;
+    GLint loc_downScale{-1};
+    GLint loc_downTexel{-1};
+    GLint loc_downPrefilter{-1};
+    GLint loc_downThreshold{-1};
+
+    std::unique_ptr<Shader> bloomUpShader_;
+    GLint loc_upScale{-1};
+    GLint loc_upTexel{-1};
+
+    std::unique_ptr<Shader> toneMapShader_;
+    GLint loc_toneSceneScale{-1};
+    GLint loc_toneSceneTexel{-1};
+    GLint loc_toneBloomScale{-1};
+    GLint loc_toneBloomTexel{-1};
+    GLint loc_toneBloomStrength{-1};
+    GLint loc_toneExposure{-1};
+
+    std::unique_ptr<Shader> fxaaShader_;
+    GLint loc_fxaaScale{-1};
+    GLint loc_fxaaTexel{-1};
+
+    int width_{0};
+    int height_{0};
+    GLuint emptyVao_{0};
+
+    PostQuality quality_{PostQuality_High};
+    float exposure_{1.0f};
+};
+
+#endif // POSTPROCESS_H
@@ -0,0 +1,205 @@
+#ifndef RENDERGRAPH_H
+#define RENDERGRAPH_H
+
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+#include <glad/glad.h>
+
+#include "GpuTimer.h"
+#include "RenderTargetPool.h"
+
+// Handle of a texture within one frame's graph
+typedef int RGTexture;
+static const RGTexture kNoTexture = -1;
+
+// What a pass wants in a texture it writes before it draws
+enum RGLoad
+{
+    RGLoad_Keep = 0, // what earlier passes wrote; cleared if none did
+    RGLoad_Clear,    // the texture's clear value
+    RGLoad_DontCare  // the pass covers it all, contents are invalidated
+};
+
+enum RGPassFlags
+{
+    RGPass_None = 0,
+    RGPass_Scaled = 1 << 0 // runs at the dynamic resolution, counted in scaledMs()
+};
+
+// A texture owned outside the graph
+struct RGImport
+{
+    GLuint texture;
+    GLuint fbo;          // framebuffer it is attached to
+    GLenum attachment;   // GL_NONE: only tracked, never bound, cleared or invalidated
+    RenderTargetDesc desc; // allocated size and format
+    int width;           // part this frame renders to
+    int height;
+    bool persistent;     // read after the frame (window, next frame): writers are never culled,
+                         // contents are never invalidated
+};
+
+// One frame's passes, declared with the textures they read and write.
+//
+// Passes are added every frame in any order that makes sense to read;
+// compile() then
+//
+//  - orders them so every read follows the writes before it in declaration
+//    order (and a write follows the reads of the previous contents),
+//  - culls passes whose output nothing reads, back from the persistent
+//    textures and the passes that declared a side effect,
+//  - gives each transient texture the span of passes that use it, so
+//    execute() takes it from a RenderTargetPool at its first use and hands
+//    it back after its last: transients whose spans don't overlap share
+//    memory,
+//  - turns load requests into the least work: a Keep without an earlier
+//    writer becomes a clear, DontCare an invalidate, and imported
+//    attachments are invalidated after their last use.
+//
+// execute() binds each pass's first written attachment with its viewport
+// and times each pass on its own. A pass that can't run (the pool has no
+// memory for its transient) loses what it writes for the frame; the
+// passes that depend on those contents are skipped after it, unless they
+// read them with a fallback. The graph lives across frames for the
+// pool and the timers; reset() drops the passes and textures.
+class RenderGraph
+{
+public:
+    class Builder;
+    class Context;
+
+    typedef std::function<void(Builder&)> SetupFn;
+    typedef std::function<void(const Context&)> ExecuteFn;
+
+    class Builder
+    {
+    public:
+        // With a 'fallback', a frame where 'texture' wasn't produced (a
+        // pass before it was skipped) reads the fallback in its place:
+        // the Context hands out the fallback for 'texture'
+        void read(RGTexture texture, RGTexture fallback = kNoTexture);
+        void write(RGTexture texture, RGLoad load = RGLoad_Keep);
+        // Never culled, e.g. it draws to the window or reads back
+        void sideEffect();
+
+    private:
+        friend class RenderGraph;
+        Builder(RenderGraph& graph, int pass) : graph_(graph), pass_(pass) {}
+        RenderGraph& graph_;
+        int pass_;
+    };
+
+    class Context
+    {
+    public:
+        GLuint texture(RGTexture texture) const;
+        GLuint fbo(RGTexture texture) const;
+        // Allocated size and format
+        const RenderTargetDesc& desc(RGTexture texture) const;
+        // Part this frame renders to
+        int width(RGTexture texture) const;
+        int height(RGTexture texture) const;
+        // Bind as the render target with its viewport
+        void bind(RGTexture texture) const;
+
+    private:
+        friend class RenderGraph;
+        explicit Context(const RenderGraph& graph) : graph_(graph) {}
+        const RenderGraph& graph_;
+    };
+
+    RenderGraph() = default;
+
+    RenderGraph(const RenderGraph&) = delete;
+    RenderGraph& operator=(const RenderGraph&) = delete;
+
+    // Start declaring a new frame
+    void reset();
+
+    RGTexture import(const std::string& name, const RGImport& import);
+    // A texture that only lives within the frame, allocated at 'desc' and
+    // rendered to in its lower-left width x height
+    RGTexture create(const std::string& name, const RenderTargetDesc& desc, int width, int height);
+    void setClearColor(RGTexture texture, float r, float g, float b, float a);
+    // Allocated size and format, and the part this frame renders to
+    const RenderTargetDesc& desc(RGTexture texture) const { return resources_[texture].import.desc; }
+    int width(RGTexture texture) const { return resources_[texture].import.width; }
+    int height(RGTexture texture) const { return resources_[texture].import.height; }
+
+    // 'setup' runs right away and declares what the pass reads and writes
+    void addPass(const std::string& name, unsigned flags, const SetupFn& setup, const ExecuteFn& execute);
+
+    void compile();
+    void execute();
+
+    // Latest GPU time of this frame's scaled passes
+    float scaledMs() const;
+    // Running average of a pass's GPU time, 0 if it never ran
+    float passMs(const std::string& name) const;
+    // Passes with their times and the memory live during each, what was
+    // culled, and what aliasing saved
+    void printReport() const;
+
+private:
+    struct Resource
+    {
+        std::string name;
+        bool imported;
+        RGImport import;       // imported: all of it; transient: desc and view size
+        float clear[4];
+        RenderTarget* target;  // transient, while acquired
+        int firstUse;          // positions in order_, -1 if unused
+        int lastUse;
+        bool written;          // during execute()
+        bool lost;             // a pass writing it was skipped this frame
+        RGTexture standIn;     // read in its place while lost
+    };
+
+    struct Access
+    {
+        RGTexture texture;
+        bool write;
+        RGLoad load;
+        RGTexture fallback; // reads only
+    };
+
+    struct Pass
+    {
+        std::string name;
+        unsigned flags;
+        std::vector<Access> accesses;
+        ExecuteFn execute;
+        bool sideEffect;
+        bool culled;
+    };
+
+    // The texture a Context hands out for 'texture', its stand-in while lost
+    RGTexture resolve(RGTexture texture) const;
+    bool bindable(const Resource& resource) const;
+    GLuint fboOf(const Resource& resource) const;
+    void order();
+    void cull();
+    void computeLifetimes();
+    void load(Resource& resource, RGLoad load);
+    size_t bytes(const Resource& resource) const;
+
+    std::vector<Resource> resources_;
+    std::vector<Pass> passes_;
+    std::vector<int> order_; // live passes, in execution order
+    RenderTargetPool pool_;
+
+    // Per pass name, so timings survive the passes being declared anew
+    std::map<std::string, std::unique_ptr<GpuTimer>> timers_;
+
+    // Last compile, for the report
+    std::vector<size_t> liveBytes_; // per position in order_
+    size_t peakBytes_{0};
+    size_t transientBytes_{0};
+    int clears_{0};
+    int invalidates_{0};
+};
+
+#endif // RENDERGRAPH_H
@@ -0,0 +1,82 @@
+#ifndef RENDERTARGETPOOL_H
+#define RENDERTARGETPOOL_H
+
+#include <cstddef>
+#include <initializer_list>
+#include <memory>
+#include <vector>
+#include <glad/glad.h>
+
+struct RenderTargetDesc
+{
+    int width;
+    int height;
+    GLenum format; // sized internal format of the color attachment
+
+    bool operator==(const RenderTargetDesc& o) const
+    {
+        return width == o.width && height == o.height && format == o.format;
+    }
+};
+
+// One color texture and the framebuffer it is attached to
+struct RenderTarget
+{
+    RenderTargetDesc desc;
+    GLuint texture;
+    GLuint fbo;
+};
+
+// Bytes per texel of the formats the pool hands out
+size_t renderTargetFormatBytes(GLenum format);
+
+// Tell the driver the listed attachments of 'fbo' hold nothing worth
+// keeping: a tiler skips storing (or loading) them, everything else may
+// drop the memory traffic. Leaves 'fbo' bound.
+void invalidateAttachments(GLuint fbo, std::initializer_list<GLenum> attachments);
+
+// Transient render targets shared by the passes of a frame.
+//
+// acquire() returns a target no one holds; a released target of the same
+// description is handed out again before a new one is allocated, so
+// passes whose lifetimes don't overlap alias the same memory. GL has no
+// way to place textures of different formats in one allocation, so
+// aliasing is by exact description. Release invalidates the contents,
+// and targets idle for kMaxIdleFrames are freed.
+class RenderTargetPool
+{
+public:
+    static const int kMaxIdleFrames = 60;
+
+    RenderTargetPool() = default;
+    ~RenderTargetPool();
+
+    RenderTargetPool(const RenderTargetPool&) = delete;
+    RenderTargetPool& operator=(const RenderTargetPool&) = delete;
+
+    // nullptr if the framebuffer can't be completed
+    RenderTarget* acquire(const RenderTargetDesc& desc);
+    void release(RenderTarget* target);
+
+    // Once per frame, after every target was released
+    void endFrame();
+
+    // Memory of every texture the pool holds
+    size_t allocatedBytes() const;
+    // What the last frame's acquires would have taken without any reuse
+    size_t requestedBytes() const { return lastRequestedBytes_; }
+
+private:
+    struct Entry
+    {
+        RenderTarget target;
+        bool inUse;
+        int idleFrames;
+    };
+
+    std::vector<std::unique_ptr<Entry>> entries_;
+    size_t requestedBytes_{0};
+    size_t lastRequestedBytes_{0};
+};
+
+#endif // RENDERTARGETPOOL_H
@@ -0,0 +1,106 @@
+#ifndef SCENE_H
+#define SCENE_H
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include <glm/vec3.hpp>
+#include <glm/mat4x4.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include "Model.h"
+#include "DrawBatch.h"
+
+class JobSystem;
+
+typedef uint32_t Entity;
+static const Entity kNoEntity = 0xFFFFFFFFu;
+
+// Data-oriented scene: shared Model assets and a flat transform hierarchy
+// of entities stored as structure-of-arrays.
+//
+// Entities are kept in creation order and a parent must exist before its
+// children, so one forward pass propagates dirty flags and parents are
+// always resolved before the children that use them. Local matrices of
+// dirty entities are composed four at a time with SIMD straight from the
+// SoA arrays; world matrices are then scattered into one DrawBatch per
+// model.
+//
+// Threading: assets and batches are GL objects, created and drawn on the GL
+// thread. Entity data belongs to the simulation stage; only the batches'
+// immutable records are read from there (for CPU culling).
+class Scene
+{
+public:
+    Scene() = default;
+    ~Scene();
+
+    Scene(const Scene&) = delete;
+    Scene& operator=(const Scene&) = delete;
+
+    // Load and upload a model, returns its index or -1. Paths already
+    // loaded return the existing index.
+    // 'maxTextureSize' > 0 uploads only the mips up to that size, for
+    // TextureStreamer to fill in later
+    int addModel(const std::string& path, JobSystem* jobs, int maxTextureSize = 0);
+    size_t modelCount() const { return models_.size(); }
+    const Model& model(int index) const { return *models_[index]; }
+    Model& model(int index) { return *models_[index]; }
+
+    // 'model' -1 makes a pure transform node that isn't drawn
+    Entity createEntity(int model, Entity parent = kNoEntity);
+    size_t entityCount() const { return parent_.size(); }
+
+    void setPosition(Entity e, const glm::vec3& p);
+    void setRotation(Entity e, const glm::quat& q);
+    void setScale(Entity e, const glm::vec3& s);
+    const glm::mat4& worldMatrix(Entity e) const { return world_[e]; }
+
+    // (Re)create the per-model batches. Call on the GL thread after the
+    // entities are created, and again whenever entities are added.
+    void buildBatches();
+    const DrawBatchList& batches() const { return batches_; }
+
+    // Recompute the world matrices of dirty entities and their children
+    // and copy them into the batch transform arrays. Returns the number of
+    // matrices recomputed.
+    size_t updateWorld(JobSystem* jobs);
+
+    // Instance transforms of batch 'b' as of the last updateWorld()
+    const std::vector<glm::mat4>& batchTransforms(size_t b) const { return batchTransforms_[b]; }
+
+    // Whether batch 'b' changed since the last call, clears the flag
+    bool takeBatchChanged(size_t b);
+
+    // Report every batch as changed once more, e.g. after packets were dropped
+    void markAllChanged();
+
+private:
+    void growSoA();
+    void composeBlocks(size_t firstBlock, size_t lastBlock);
+
+    std::vector<std::unique_ptr<Model>> models_;
+    std::vector<std::string> modelPaths_;
+    DrawBatchList batches_; // one per model, declared after models_ so it's destroyed first
+
+    // Per entity
+    std::vector<Entity> parent_;
+    std::vector<int> model_;
+    std::vector<uint32_t> instance_; // index in the model's batch
+    std::vector<unsigned char> dirty_;
+    std::vector<glm::mat4> world_;
+
+    // Local transform components, padded to a multiple of 4 entities
+    std::vector<float> px_, py_, pz_;
+    std::vector<float> qx_, qy_, qz_, qw_;
+    std::vector<float> sx_, sy_, sz_;
+
+    bool anyDirty_{false};
+    bool hasHierarchy_{false};
+
+    std::vector<std::vector<glm::mat4>> batchTransforms_;
+    std::vector<unsigned char> batchChanged_;
+};
+
+#endif // SCENE_H
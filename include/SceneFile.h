@@ -0,0 +1,123 @@
+#ifndef SCENEFILE_H
+#define SCENEFILE_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Contents of a scene file, before anything is loaded or instantiated.
+// The records are plain data so the binary variant can read each array
+// with a single fread.
+//
+// Text format (.scene), one statement per line, '#' starts a comment:
+//
+//   model    <path>                         model ids count from 0 in order
+//   instance <model> <x> <y> <z> [yaw <deg>] [pitch <deg>] [roll <deg>]
+//            [scale <s>] [parent <instance>] [spin]
+//   grid     <model> <nx> <nz> <spacing|auto> <x> <y> <z> [scale <s>] [spin]
+//   light    directional <dx> <dy> <dz> <r> <g> <b>
+//   light    point <x> <y> <z> <r> <g> <b> <radius>
+//   light    spot <x> <y> <z> <r> <g> <b> <radius> <dx> <dy> <dz> <outer deg> [inner deg]
+//   camera   <x> <y> <z> <yaw deg> <pitch deg>
+//   environment <path>|sky [intensity]      equirectangular image for ambient light
+//   set      cull cpu|gpu|occlusion
+//   set      prepass off|on|auto
+//   set      dynres on|off
+//   set      fps 30|60
+//   set      texbudget <MB>
+//   set      shadows off|<resolution> [cascades] [distance]
+//   set      post off|low|medium|high [exposure]
+//
+// A value outside these lists, or a number with anything after it, fails
+// the load with the file and line.
+// Relative model and environment paths are resolved against the scene file's directory.
+// 'auto' grid spacing is 1.5x the model's largest extent. Grid cell (i, k)
+// sits at origin + ((i - nx/2) * spacing, 0, k * spacing).
+//
+// Binary format (.sceneb): SceneBinaryHeader, the model paths as
+// NUL-terminated strings (and the environment path, if any), then the instance, grid and light arrays.
+
+struct SceneInstance
+{
+    uint32_t model;
+    int32_t parent;      // index into the instances, -1 for none
+    float position[3];
+    float rotation[4];   // quaternion x, y, z, w
+    float scale[3];
+    uint32_t spin;       // rotates around Y when the animation is on
+};
+
+struct SceneGrid
+{
+    uint32_t model;
+    uint32_t countX;
+    uint32_t countZ;
+    float spacing;       // <= 0 means auto
+    float origin[3];
+    float scale;
+    uint32_t spin;
+};
+
+enum SceneLightType : uint32_t
+{
+    SceneLight_Directional = 0,
+    SceneLight_Point = 1,
+    SceneLight_Spot = 2
+};
+
+struct SceneLight
+{
+    uint32_t type;
+    float vector[3];     // direction or position
+    float color[3];
+    float radius;        // point and spot lights
+    float direction[3];  // spot lights only
+    float outerAngle;    // spot half angles, radians
+    float innerAngle;
+};
+
+struct SceneCamera
+{
+    float position[3];
+    float yaw;           // radians
+    float pitch;         // radians
+};
+
+// -1 keeps the current value
+struct SceneSettings
+{
+    int32_t cullMode = -1;
+    int32_t prepassMode = -1;
+    int32_t dynamicResolution = -1;
+    int32_t targetFps = -1;
+    int32_t textureBudgetMB = -1; // TextureStreamer budget
+    int32_t shadowResolution = -1; // 0 = off
+    int32_t shadowCascades = -1;
+    int32_t shadowDistance = -1;   // view distance covered, world units
+    float environmentIntensity = -1.0f; // scale of the ambient light
+    int32_t postQuality = -1;      // PostQuality
+    float exposure = -1.0f;        // before tone mapping
+};
+
+struct SceneDesc
+{
+    std::vector<std::string> models;
+    std::vector<SceneInstance> instances;
+    std::vector<SceneGrid> grids;
+    std::vector<SceneLight> lights;
+    bool hasCamera = false;
+    SceneCamera camera{};
+    std::string environment;      // empty: the procedural sky
+    SceneSettings settings;
+};
+
+// Load a .scene (text) or .sceneb (binary) file, picked by extension
+bool loadSceneFile(const std::string& path, SceneDesc& desc);
+bool loadSceneText(const std::string& path, SceneDesc& desc);
+bool loadSceneBinary(const std::string& path, SceneDesc& desc);
+bool saveSceneBinary(const std::string& path, const SceneDesc& desc);
+
+// All .scene / .sceneb files in 'dir', sorted by name
+std::vector<std::string> listSceneFiles(const std::string& dir);
+
+#endif // SCENEFILE_H
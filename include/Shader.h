@@ -1,30 +1,95 @@
 #ifndef SHADER_H
 #define SHADER_H
 
+#include <ctime>
+#include <functional>
 #include <string>
+#include <vector>
 #include <glad/glad.h>
 
 class Shader
 {
 public:
-    Shader() = default;
+    Shader();
     ~Shader();
 
+    Shader(const Shader&) = delete;
+    Shader& operator=(const Shader&) = delete;
+
     // Load, compile and link from two GLSL source files. Paths are treated
     // like normal file system paths (e.g. romfs:/shaders/vertex.glsl).
-    bool loadFromFiles(const std::string& vertPath, const std::string& fragPath);
+    // An optional geometry shader is linked in between when geomPath is set.
+    // 'defines' ("#define X\n" lines) is inserted after every #version line.
+    //
+    // Sources may #include "file", relative to the including file; each file
+    // is pasted once per stage. Every file read, includes too, is watched
+    // for hot reload, and the linked program is kept in the ShaderCache.
+    bool loadFromFiles(const std::string& vertPath, const std::string& fragPath,
+                       const std::string& geomPath = std::string(),
+                       const std::string& defines = std::string());
+
+    // Load, compile and link a compute program from a single GLSL file.
+    bool loadComputeFromFile(const std::string& compPath);
+
+    // Runs with the program bound after every successful link, the first
+    // one and every hot reload: the place to look up uniform locations and
+    // set sampler units. Set it before loading.
+    void setOnLink(std::function<void(const Shader&)> onLink) { onLink_ = std::move(onLink); }
+
+    // Rebuild if a source file changed since the last build. The new
+    // program replaces the current one only if it links; otherwise the old
+    // one stays and the error is printed. Returns true when swapped.
+    bool reloadIfChanged();
+
+    // Poll every live Shader for changed sources, returns how many were
+    // swapped. Does nothing without the override directory on the SD card.
+    static int reloadChanged();
 
     void use() const { glUseProgram(program_); }
     GLuint program() const { return program_; }
 
+    // Compile + link time of the current program
+    float buildMs() const { return buildMs_; }
+
     // convenience wrapper
     GLint getUniformLocation(const char* name) const { return glGetUniformLocation(program_, name); }
 
+    // romfs:/shaders/<name> is read from kOverrideDir/<name> when that file
+    // exists, so shaders can be edited on the SD card while the app runs
+    static const char* const kOverrideDir;
+    static std::string resolvePath(const std::string& path);
+
 private:
-    std::string readFile(const std::string& path) const;
-    bool compileShader(GLenum type, const char* source, GLuint& outShader) const;
+    struct WatchedFile
+    {
+        std::string path;     // as requested, resolved again on every poll
+        std::string resolved; // what was actually read
+        time_t mtime;
+    };
+
+    bool build();
+    const std::string& readFile(const std::string& path);
+    // Expand 'path' and its includes into 'out', appending every file to
+    // 'files' (its index is the #line source string number)
+    bool preprocess(const std::string& path, std::string& out, std::vector<std::string>& files);
+    bool compileShader(GLenum type, const char* source, GLuint& outShader,
+                       const std::vector<std::string>& files) const;
+    GLuint linkProgram(const GLuint* shaders, int count) const;
 
     GLuint program_{0};
+
+    // Sources of the current program, kept for rebuilding; watched_ holds
+    // every file it was built from, so an edited include rebuilds exactly
+    // the programs that use it
+    std::string vertPath_;
+    std::string fragPath_;
+    std::string geomPath_;
+    std::string compPath_;
+    std::string defines_;
+    std::vector<WatchedFile> watched_;
+
+    std::function<void(const Shader&)> onLink_;
+    float buildMs_{0.0f};
 };
 
-#endif // SHADER_H
\ No newline at end of file
+#endif // SHADER_H
@@ -0,0 +1,36 @@
+#ifndef SHADERCACHE_H
+#define SHADERCACHE_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <glad/glad.h>
+
+// Linked program binaries on the SD card, so an unchanged program skips
+// compiling and linking on the next run.
+//
+// One file per program in kShaderCacheDir, named after a key that covers
+// the fully preprocessed source of every stage (includes and #defines
+// expanded) and the driver. Editing a shared include therefore changes the
+// key of exactly the programs that include it; the others still hit.
+//
+//   char     magic[4]   "SRPB"
+//   uint32   version
+//   uint64   key
+//   uint32   format     from glGetProgramBinary
+//   uint32   size       bytes of binary that follow
+
+// Key of a program from its stage types and preprocessed sources
+uint64_t programCacheKey(const std::vector<GLenum>& types, const std::vector<std::string>& sources);
+
+// Whether the driver can hand out program binaries at all
+bool programBinariesSupported();
+
+// Load a cached binary into 'program' (created, not linked). False when
+// there is none or the driver rejects it; 'program' must then be rebuilt.
+bool loadProgramBinary(uint64_t key, GLuint program);
+
+// Write the binary of a linked program, replacing any older file atomically
+bool saveProgramBinary(uint64_t key, GLuint program);
+
+#endif // SHADERCACHE_H
@@ -0,0 +1,46 @@
+#ifndef SHADERVARIANTS_H
+#define SHADERVARIANTS_H
+
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "Shader.h"
+
+// Compile-time permutations of one vertex/fragment shader pair. Bit i of a
+// feature mask adds "#define featureDefines[i]" to both stages. A
+// permutation is compiled the first time it is asked for and then cached,
+// so only the ones the loaded materials use are ever built.
+class ShaderVariants
+{
+public:
+    // 'onCompile' runs for every newly linked program, with it bound, to
+    // set uniforms that never change (sampler units); hot reloads included
+    ShaderVariants(const std::string& vertPath, const std::string& fragPath,
+                   std::vector<std::string> featureDefines,
+                   std::function<void(const Shader&)> onCompile = nullptr);
+
+    // Program for 'features', nullptr while it fails to compile (the failure
+    // is cached as well, only a hot reload tries again)
+    const Shader* get(unsigned features);
+
+    // Every program compiled so far, e.g. to set per-frame uniforms
+    void forEach(const std::function<void(unsigned features, const Shader&)>& fn) const;
+
+    size_t compiledCount() const { return variants_.size(); }
+
+    // "HAS_ORM|UNLIT" style name of a mask, for logs
+    std::string describe(unsigned features) const;
+
+private:
+    std::string vertPath_;
+    std::string fragPath_;
+    std::vector<std::string> featureDefines_;
+    std::function<void(const Shader&)> onCompile_;
+
+    std::map<unsigned, std::unique_ptr<Shader>> variants_;
+};
+
+#endif // SHADERVARIANTS_H
@@ -0,0 +1,121 @@
+#ifndef SHADOWMAP_H
+#define SHADOWMAP_H
+
+#include <memory>
+#include <vector>
+#include <glad/glad.h>
+#include <glm/vec3.hpp>
+#include <glm/mat4x4.hpp>
+
+#include "Shader.h"
+#include "GpuTimer.h"
+#include "DrawBatch.h"
+
+class GpuCuller;
+
+// Texture unit of the shadow map array, after the material arrays and Hi-Z
+static const int kShadowTextureUnit = Slot_Count + 1;
+
+// Cascaded shadow maps for the directional light.
+//
+// The camera frustum up to the shadow distance is split into cascades
+// (half logarithmic, half uniform), each covered by an orthographic light
+// view around the bounding sphere of its slice. The sphere keeps the
+// projection size fixed while the camera turns, and its origin is snapped
+// to whole shadow texels, so edges don't shimmer as the camera moves.
+// The light view reaches back toward the light by kCasterDistance, so
+// casters outside the slice still land in its map.
+//
+// Every cascade culls the batches against its own light frustum (on the
+// GPU when a GpuCuller is given) into its own indirect buffers and draws
+// the survivors through the position-only stream, depth only. Each
+// cascade is timed on its own.
+class ShadowMap
+{
+public:
+    static const int kMaxCascades = 4; // MAX_SHADOW_CASCADES in common/shadows.glsl
+
+    ShadowMap() = default;
+    ~ShadowMap();
+
+    bool init(int resolution, int cascadeCount);
+
+    // (Re)allocate the map array, resolution 0 turns shadows off
+    bool setConfig(int resolution, int cascadeCount);
+    int resolution() const { return resolution_; }
+    int cascadeCount() const { return cascadeCount_; }
+
+    // View distance the last cascade ends at
+    void setShadowDistance(float distance) { shadowDistance_ = distance; }
+    float shadowDistance() const { return shadowDistance_; }
+
+    void setEnabled(bool enabled) { enabled_ = enabled; }
+    bool enabled() const { return enabled_ && depthTex_ != 0; }
+
+    // Fit the cascades to the camera, once per frame before render()
+    void update(const glm::mat4& view, const glm::mat4& proj, const glm::vec3& lightDir);
+
+    // Cull and draw the casters of every cascade. Leaves the framebuffer
+    // and viewport as it found them. 'culler' may be nullptr (CPU culling).
+    void render(const DrawBatchList& batches, GpuCuller* culler);
+
+    // Uniform locations of a program that includes common/shadows.glsl,
+    // looked up once per link
+    struct Uniforms
+    {
+        GLint cascadeCount{-1};
+        GLint matrices{-1};
+        GLint cascadeEnds{-1};
+        GLint normalOffset{-1};
+    };
+    static Uniforms locate(const Shader& shader);
+
+    // Per-frame uniforms of that program, bound
+    void setUniforms(const Uniforms& loc) const;
+    // Bind the map array to kShadowTextureUnit
+    void bindTexture() const;
+
+    float cascadeMs(int cascade) const { return timers_[cascade].averageMs(); }
+    float totalMs() const;
+    void printTimings() const;
+
+private:
+    struct Cascade
+    {
+        glm::mat4 viewProj;  // light view-projection the map was drawn with
+        glm::mat4 shadowMtx; // world -> shadow map [0,1] coordinates
+        float splitEnd;      // view depth the cascade ends at
+        float texelWorld;    // world size of one shadow texel
+    };
+
+    // Indirect commands of one batch for one cascade
+    struct CasterList
+    {
+        GLuint buffer;
+        size_t capacity;    // commands the buffer holds
+        GLsizei drawCount;
+    };
+
+    void destroyMaps();
+    void cullCasters(const DrawBatch& batch, CasterList& list, const glm::mat4& viewProj, GpuCuller* culler);
+
+    std::unique_ptr<Shader> shader_;
+    GLint loc_viewMtx{-1};
+    GLint loc_projMtx{-1};
+
+    int resolution_{0};
+    int cascadeCount_{0};
+    float shadowDistance_{60.0f};
+    bool enabled_{true};
+
+    GLuint depthTex_{0}; // GL_TEXTURE_2D_ARRAY, one layer per cascade
+    GLuint fbo_{0};
+
+    Cascade cascades_[kMaxCascades]{};
+    GpuTimer timers_[kMaxCascades];
+
+    std::vector<CasterList> casters_; // [batch * kMaxCascades + cascade]
+    std::vector<DrawElementsIndirectCommand> visible_; // scratch for CPU culling
+};
+
+#endif // SHADOWMAP_H
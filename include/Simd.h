@@ -0,0 +1,35 @@
+#ifndef SIMD_H
+#define SIMD_H
+
+// Minimal 4-wide float vector: NEON on the Switch, SSE2 on x86 hosts, plain
+// C++ elsewhere. Only what the SoA transform and mip filtering code needs.
+
+#if defined(__ARM_NEON)
+#include <arm_neon.h>
+typedef float32x4_t f4;
+static inline f4 load4(const float* p) { return vld1q_f32(p); }
+static inline f4 splat4(float v) { return vdupq_n_f32(v); }
+static inline f4 add4(f4 a, f4 b) { return vaddq_f32(a, b); }
+static inline f4 sub4(f4 a, f4 b) { return vsubq_f32(a, b); }
+static inline f4 mul4(f4 a, f4 b) { return vmulq_f32(a, b); }
+static inline void store4(float* p, f4 v) { vst1q_f32(p, v); }
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+typedef __m128 f4;
+static inline f4 load4(const float* p) { return _mm_loadu_ps(p); }
+static inline f4 splat4(float v) { return _mm_set1_ps(v); }
+static inline f4 add4(f4 a, f4 b) { return _mm_add_ps(a, b); }
+static inline f4 sub4(f4 a, f4 b) { return _mm_sub_ps(a, b); }
+static inline f4 mul4(f4 a, f4 b) { return _mm_mul_ps(a, b); }
+static inline void store4(float* p, f4 v) { _mm_storeu_ps(p, v); }
+#else
+struct f4 { float v[4]; };
+static inline f4 load4(const float* p) { return f4{{p[0], p[1], p[2], p[3]}}; }
+static inline f4 splat4(float s) { return f4{{s, s, s, s}}; }
+static inline f4 add4(f4 a, f4 b) { for (int i = 0; i < 4; ++i) a.v[i] += b.v[i]; return a; }
+static inline f4 sub4(f4 a, f4 b) { for (int i = 0; i < 4; ++i) a.v[i] -= b.v[i]; return a; }
+static inline f4 mul4(f4 a, f4 b) { for (int i = 0; i < 4; ++i) a.v[i] *= b.v[i]; return a; }
+static inline void store4(float* p, f4 v) { for (int i = 0; i < 4; ++i) p[i] = v.v[i]; }
+#endif
+
+#endif // SIMD_H
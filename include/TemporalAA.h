@@ -0,0 +1,104 @@
+#ifndef TEMPORALAA_H
+#define TEMPORALAA_H
+
+#include <memory>
+#include <glad/glad.h>
+#include <glm/mat4x4.hpp>
+#include <glm/vec2.hpp>
+
+#include "Shader.h"
+#include "RenderGraph.h"
+
+// SSBO binding of the benchmark counters, after the clustered lights
+static const int kTaaStatsBinding = 10;
+
+// Temporal anti-aliasing: the projection is offset by a different subpixel
+// amount every frame (Halton 2,3, kJitterPhases long), and one full-screen
+// pass blends the frame into a history of the earlier ones. The history is
+// reprojected with the camera motion, from the depth buffer and last
+// frame's matrices, and clamped to the current neighborhood so what moved
+// away doesn't linger.
+//
+// The history is allocated at the full size like the scene target and
+// holds last frame's render size, so it stays valid while dynamic
+// resolution moves the size: the jitter then also recovers some of the
+// detail a lower resolution loses. The resolve replaces FXAA.
+class TemporalAA
+{
+public:
+    static const int kJitterPhases = 8;
+
+    TemporalAA() = default;
+    ~TemporalAA();
+
+    // Full size of the scene target
+    bool init(int width, int height);
+
+    // Turning it on starts from an empty history
+    void setEnabled(bool enabled);
+    bool enabled() const { return enabled_; }
+
+    // Advance the jitter sequence and offset 'proj' by this frame's subpixel
+    // sample, for a renderWidth x renderHeight viewport
+    glm::mat4 jitter(const glm::mat4& proj, int renderWidth, int renderHeight);
+
+    // Add the resolve pass blending 'sceneColor' into the history, with
+    // 'viewProj' the unjittered matrix the scene was drawn with. Returns the
+    // resolved color, same layout and format as the scene.
+    RGTexture addPass(RenderGraph& graph, RGTexture sceneColor, RGTexture sceneDepth, const glm::mat4& viewProj);
+
+    // Nothing of the history carries over (camera cut, new scene, a frame
+    // drawn without it)
+    void invalidateHistory() { historyValid_ = false; }
+
+    // Count over the next resolve: mean |resolved - current| relative to the
+    // current luma (how much of the output is history: smearing and ghosts
+    // under motion) and the fraction of pixels whose history the clamp
+    // rejected. endMeasure() blocks until the resolve ran.
+    void beginMeasure();
+    bool endMeasure(float& lag, float& clamped);
+
+    // GPU time of the next resolve alone, with a timestamp pair around its
+    // draw. resolveMs() blocks until it ran; -1 if it didn't.
+    void timeNextResolve() { timing_ = true; }
+    double resolveMs();
+
+private:
+    bool createHistory(GLenum format);
+
+    std::unique_ptr<Shader> shader_;
+    GLint loc_uvScale{-1};
+    GLint loc_texelSize{-1};
+    GLint loc_historyScale{-1};
+    GLint loc_reprojection{-1};
+    GLint loc_jitter{-1};
+    GLint loc_feedback{-1};
+    GLint loc_historyValid{-1};
+    GLint loc_measure{-1};
+
+    GLuint history_[2]{}; // ping-pong, GL_TEXTURE_2D in the scene format
+    GLuint fbo_[2]{};
+    GLenum format_{GL_NONE};
+    int current_{0};      // history_ written this frame
+    int historyWidth_{0}; // render size the other one was written at
+    int historyHeight_{0};
+    bool historyValid_{false};
+
+    glm::mat4 previousViewProj_{1.0f};
+    glm::vec2 jitter_{0.0f}; // NDC
+    int phase_{0};
+
+    GLuint statsSsbo_{0};
+    bool measuring_{false};
+
+    GLuint timeQueries_[2]{};
+    bool timing_{false}; // the next resolve is timed
+    bool timed_{false};  // the queries hold one
+
+    int width_{0};
+    int height_{0};
+    GLuint emptyVao_{0};
+    bool enabled_{true};
+};
+
+#endif // TEMPORALAA_H
@@ -0,0 +1,36 @@
+#ifndef TEXTURECACHE_H
+#define TEXTURECACHE_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "TextureUtils.h"
+
+// Baked mip chains on the SD card, so a map is decoded and filtered once
+// and later runs only read and upload its levels.
+//
+// One file per map in kMipCacheDir, named after a key that covers the
+// source files (path, size, modification time), the channel layout, the
+// content type, the size it was stretched to and the filter version.
+// Layout: MipCacheHeader, then every level from the largest down, tightly
+// packed.
+//
+//   char     magic[4]   "SRTX"
+//   uint32   version
+//   uint64   key
+//   int32    width, height, channels, levels
+
+// Key of a map built from 'sources' (one file, or one per packed channel;
+// empty entries are skipped), stretched to width x height when those are
+// set. Returns 0 if a source can't be stat'ed.
+uint64_t mipCacheKey(const std::vector<std::string>& sources, int channels, MipContent content,
+                     int width = 0, int height = 0);
+
+// Read a cached chain, only levels >= firstLevel are filled in
+bool loadMipCache(uint64_t key, MipChain& chain, int firstLevel = 0);
+
+// Write a chain, replacing any older file atomically
+bool saveMipCache(uint64_t key, const MipChain& chain);
+
+#endif // TEXTURECACHE_H
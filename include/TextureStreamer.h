@@ -0,0 +1,92 @@
+#ifndef TEXTURESTREAMER_H
+#define TEXTURESTREAMER_H
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include <glad/glad.h>
+#include <glm/vec3.hpp>
+
+#include "Model.h"
+
+class Scene;
+class JobSystem;
+
+// Mip residency for the models' texture arrays under a memory budget.
+//
+// Models are uploaded with only their coarse mips (kCoarseSize). Every
+// frame the streamer estimates the finest mip each model needs from its
+// nearest instance: texels across the texture vs. pixels the object covers
+// on screen. Finer mips are read from the mip cache (or rebuilt from the
+// source files) in a job, then uploaded as a new, larger array on the GL
+// thread. When resident memory
+// exceeds the budget, arrays are shrunk by one mip at a time
+// (glCopyImageSubData, no CPU work), least recently needed first.
+class TextureStreamer
+{
+public:
+    // Largest mip uploaded at load time
+    static const int kCoarseSize = 64;
+
+    struct Counters
+    {
+        size_t residentBytes = 0;  // what the arrays use now
+        size_t requestedBytes = 0; // what they'd use at the mips the view wants
+        size_t budgetBytes = 0;
+        uint64_t uploads = 0;      // mip upgrades completed
+        uint64_t evictions = 0;    // one-mip downgrades
+        int pending = 0;           // upgrades in flight
+    };
+
+    TextureStreamer() = default;
+    ~TextureStreamer();
+
+    void init(JobSystem* jobs, size_t budgetMB);
+    void setBudgetMB(size_t budgetMB) { budgetBytes_ = budgetMB * 1024 * 1024; }
+
+    // Track the texture arrays of every model in 'scene', drops the old ones
+    void setScene(Scene* scene);
+
+    // Once per frame on the GL thread. 'pixelsPerUnit' is the screen height
+    // in pixels covered by one unit at distance 1 (viewport / (2 tan(fov/2))).
+    void update(const glm::vec3& cameraPos, float pixelsPerUnit);
+
+    const Counters& counters() const { return counters_; }
+
+private:
+    // Decoded pixels for one upgrade, shared with the job producing them
+    struct Pending
+    {
+        TextureArrayInfo info; // layout and sources at the time of the request
+        int mip;               // level the new array starts at
+        std::vector<std::vector<unsigned char>> levels; // levels mip.., all layers each
+        std::atomic<bool> done{false};
+    };
+
+    struct Entry
+    {
+        Model* model;
+        int modelIndex;
+        TextureSlot slot;
+        int coarseMip;
+        int wantedMip;
+        uint64_t lastNeeded; // frame the view last needed the resident mips
+        std::shared_ptr<Pending> pending;
+    };
+
+    size_t bytesAt(const Entry& e, int mip) const;
+    void startUpgrade(Entry& e, int mip);
+    void finishUpgrade(Entry& e);
+    bool evictOne(const Entry* keep, bool onlyUnneeded);
+    void resize(Entry& e, int mip);
+
+    JobSystem* jobs_{nullptr};
+    Scene* scene_{nullptr};
+    std::vector<Entry> entries_;
+    size_t budgetBytes_{0};
+    uint64_t frame_{0};
+    Counters counters_;
+};
+
+#endif // TEXTURESTREAMER_H
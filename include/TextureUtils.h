@@ -0,0 +1,49 @@
+#ifndef TEXTUREUTILS_H
+#define TEXTUREUTILS_H
+
+#include <cstddef>
+#include <vector>
+
+class JobSystem;
+
+// CPU pixel helpers shared by the model loader and the texture streamer.
+// All buffers are tightly packed 8-bit, 'channels' bytes per texel (1 for
+// R8 maps, 4 for RGBA8).
+
+// How a map's values are filtered when building its mips
+enum MipContent
+{
+    MipContent_Linear = 0, // data (ORM): filtered as stored
+    MipContent_Srgb,       // color: filtered in linear light, alpha as stored
+    MipContent_Normal,     // tangent-space normals: filtered, then renormalized
+};
+
+// Full mip chain of one map, levels[0] is width x height
+struct MipChain
+{
+    int width = 0;
+    int height = 0;
+    int channels = 4;
+    std::vector<std::vector<unsigned char>> levels;
+};
+
+// Bilinear resample of src (sw x sh) into dst (dw x dh)
+void resampleU8(const unsigned char* src, int sw, int sh, int channels, unsigned char* dst, int dw, int dh);
+
+// Build the full chain down to 1x1 from 'src'. Each level is filtered from
+// the one above with a separable Kaiser-windowed sinc (wrapping at the
+// edges like GL_REPEAT), rows split over 'jobs'.
+void generateMipChain(const unsigned char* src, int width, int height, int channels, MipContent content,
+                      MipChain& chain, JobSystem* jobs = nullptr);
+
+// Stretch a chain to width x height (arrays need one size for all layers)
+// and rebuild its mips; no-op when it already fits
+void fitMipChain(MipChain& chain, int width, int height, MipContent content, JobSystem* jobs = nullptr);
+
+// Number of levels of a full chain
+int mipLevelCount(int width, int height);
+
+// Size of mip 'level' of a 'size' texel edge, never below 1
+inline int mipSize(int size, int level) { return (size >> level) > 0 ? (size >> level) : 1; }
+
+#endif // TEXTUREUTILS_H
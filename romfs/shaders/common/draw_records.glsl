@@ -0,0 +1,21 @@
+// Per-draw data of DrawBatch, shared by every pass that draws or culls it
+
+// Matches DrawRecordGPU in DrawBatch.h
+struct DrawRecord
+{
+    uint transform;
+    uint material;
+    uint submesh;
+    uint group;
+};
+
+layout(std430, binding = 0) readonly buffer DrawRecords
+{
+    DrawRecord records[];
+};
+
+// Model matrix of every instance
+layout(std430, binding = 2) readonly buffer Transforms
+{
+    mat4 transforms[];
+};
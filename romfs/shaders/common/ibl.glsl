@@ -0,0 +1,36 @@
+// Image-based ambient light, see EnvironmentLight.h. Needs common/brdf.glsl.
+
+uniform mediump samplerCube uEnvSpecular; // GGX-prefiltered, roughness 0 .. 1 over the mips
+uniform mediump sampler2D uBrdfLut;       // split-sum scale, bias to F0 by (N.V, roughness)
+uniform vec3 uIrradianceSH[9];            // diffuse irradiance / PI, cosine-convolved
+uniform float uEnvSpecularMaxLod;         // mip of roughness 1
+uniform float uEnvIntensity;              // 0 = no ambient light
+
+vec3 irradianceSH(vec3 n)
+{
+    return max(uIrradianceSH[0]
+             + uIrradianceSH[1] * n.y + uIrradianceSH[2] * n.z + uIrradianceSH[3] * n.x
+             + uIrradianceSH[4] * (n.x * n.y) + uIrradianceSH[5] * (n.y * n.z)
+             + uIrradianceSH[6] * (3.0 * n.z * n.z - 1.0)
+             + uIrradianceSH[7] * (n.x * n.z) + uIrradianceSH[8] * (n.x * n.x - n.y * n.y), 0.0);
+}
+
+// Ambient light reflected toward V, 'ao' occludes it
+vec3 ambientLighting(vec3 N, vec3 V, vec3 albedo, float roughness, float metallic, float ao)
+{
+    if (uEnvIntensity <= 0.0)
+        return vec3(0.0);
+
+    float NdotV = max(dot(N, V), 1e-4);
+    vec3 F0 = mix(vec3(0.04), albedo, metallic);
+    vec3 F = fresnelSchlickRoughness(NdotV, F0, roughness);
+    vec3 kD = (1.0 - F) * (1.0 - metallic);
+    vec3 diffuse = kD * albedo * irradianceSH(N);
+
+    vec3 R = reflect(-V, N);
+    vec3 prefiltered = textureLod(uEnvSpecular, R, roughness * uEnvSpecularMaxLod).rgb;
+    vec2 brdf = texture(uBrdfLut, vec2(NdotV, roughness)).rg;
+    vec3 specular = prefiltered * (F0 * brdf.x + brdf.y);
+
+    return (diffuse + specular) * ao * uEnvIntensity;
+}
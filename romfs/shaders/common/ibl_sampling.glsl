@@ -0,0 +1,42 @@
+// GGX importance sampling for the offline IBL passes, see EnvironmentLight.h
+
+// Point i of an n-point Hammersley set on the unit square
+vec2 hammersley(uint i, uint n)
+{
+    return vec2(float(i) / float(n), float(bitfieldReverse(i)) * 2.3283064365386963e-10);
+}
+
+// Half vector around +Z distributed like the GGX lobe of 'roughness'
+vec3 importanceSampleGGX(vec2 xi, float roughness)
+{
+    float a = roughness * roughness;
+    float phi = 2.0 * PI * xi.x;
+    float cosTheta = sqrt((1.0 - xi.y) / (1.0 + (a * a - 1.0) * xi.y));
+    float sinTheta = sqrt(1.0 - cosTheta * cosTheta);
+    return vec3(sinTheta * cos(phi), sinTheta * sin(phi), cosTheta);
+}
+
+// Smith-Schlick with the k the split sum uses for image lighting (k = a / 2)
+float geometrySmithIBL(float NdotV, float NdotL, float roughness)
+{
+    float k = roughness * roughness * 0.5;
+    return NdotV / (NdotV * (1.0 - k) + k) * NdotL / (NdotL * (1.0 - k) + k);
+}
+
+// Direction through texel coordinate 'uv' ([-1, 1]) of cube face 'face',
+// in the GL face order and orientation
+vec3 cubeDirection(int face, vec2 uv)
+{
+    if (face == 0) return vec3(1.0, -uv.y, -uv.x);
+    if (face == 1) return vec3(-1.0, -uv.y, uv.x);
+    if (face == 2) return vec3(uv.x, 1.0, uv.y);
+    if (face == 3) return vec3(uv.x, -1.0, -uv.y);
+    if (face == 4) return vec3(uv.x, -uv.y, 1.0);
+    return vec3(-uv.x, -uv.y, -1.0);
+}
+
+// Equirectangular coordinate of a direction, v = 0 is straight up
+vec2 equirectUv(vec3 d)
+{
+    return vec2(atan(d.z, d.x) * (0.5 / PI) + 0.5, acos(clamp(d.y, -1.0, 1.0)) / PI);
+}
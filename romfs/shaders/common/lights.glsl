@@ -0,0 +1,65 @@
+// Point and spot lights and their froxel lists, see LightClusters.h
+
+#define MAX_LIGHTS_PER_CLUSTER 64 // LightClusters::kMaxLightsPerCluster
+
+// light_cull.comp writes the lists, shading only reads them
+#ifndef CLUSTER_LIST_ACCESS
+#define CLUSTER_LIST_ACCESS readonly
+#endif
+
+// Matches LightGPU in LightClusters.h
+struct Light
+{
+    highp vec4 positionRadius; // world position, range
+    highp vec4 colorType;      // linear color * intensity, w = 0 point, 1 spot
+    highp vec4 spotDirection;  // xyz = direction the spot points at, w = cos outer angle
+    highp vec4 spotParams;     // x = 1 / (cos inner - cos outer)
+};
+
+layout(std430, binding = 7) readonly buffer Lights { Light lights[]; };
+// Lights touching each froxel; can exceed MAX_LIGHTS_PER_CLUSTER, readers clamp
+layout(std430, binding = 8) CLUSTER_LIST_ACCESS buffer ClusterCounts { uint clusterCounts[]; };
+// MAX_LIGHTS_PER_CLUSTER slots per froxel
+layout(std430, binding = 9) CLUSTER_LIST_ACCESS buffer ClusterLights { uint clusterLights[]; };
+
+uniform highp uvec3 uClusterGrid;
+uniform highp vec4 uClusterDepth; // slice near, slice far, slices / log(far / near), camera far
+uniform highp uint uLightCount;
+
+// Slice k covers view depths near * (far / near)^(k / slices) up to the
+// next boundary; slice 0 starts at the eye and the last one reaches on to
+// the camera far plane
+highp float clusterSliceStart(uint k)
+{
+    if (k == 0u)
+        return 0.0;
+    if (k >= uClusterGrid.z)
+        return uClusterDepth.w;
+    return uClusterDepth.x * exp(float(k) / uClusterDepth.z);
+}
+
+uint clusterSlice(highp float viewDepth)
+{
+    highp float k = floor(log(max(viewDepth, 1e-4) / uClusterDepth.x) * uClusterDepth.z);
+    return uint(clamp(k, 0.0, float(uClusterGrid.z - 1u)));
+}
+
+// Windowed inverse square falloff, reaches 0 at the light's range
+float lightAttenuation(Light light, highp vec3 worldPos, out vec3 L)
+{
+    highp vec3 toLight = light.positionRadius.xyz - worldPos;
+    highp float d2 = dot(toLight, toLight);
+    L = toLight * inversesqrt(max(d2, 1e-8));
+
+    highp float f = d2 / (light.positionRadius.w * light.positionRadius.w);
+    float window = clamp(1.0 - f * f, 0.0, 1.0);
+    float attenuation = window * window / max(d2, 0.01);
+
+    if (light.colorType.w > 0.5)
+    {
+        float cd = dot(-L, light.spotDirection.xyz);
+        float cone = clamp((cd - light.spotDirection.w) * light.spotParams.x, 0.0, 1.0);
+        attenuation *= cone * cone;
+    }
+    return attenuation;
+}
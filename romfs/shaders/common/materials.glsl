@@ -0,0 +1,13 @@
+// Matches MaterialGPU in Model.h
+struct MaterialData
+{
+    uint baseColorLayer;
+    uint ormLayer;
+    uint normalLayer;
+    uint cost;
+};
+
+layout(std430, binding = 1) readonly buffer Materials
+{
+    MaterialData materials[];
+};
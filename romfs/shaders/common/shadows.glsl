@@ -0,0 +1,26 @@
+// Cascaded shadow map of the directional light, see ShadowMap.h
+
+#define MAX_SHADOW_CASCADES 4 // ShadowMap::kMaxCascades
+
+uniform highp sampler2DArrayShadow uShadowMap;
+uniform highp mat4 uShadowMatrices[MAX_SHADOW_CASCADES]; // world -> shadow map [0,1]
+uniform highp vec4 uCascadeEnds;        // view depth each cascade ends at
+uniform highp vec4 uShadowNormalOffset; // receiver offset along N per cascade, world units
+uniform int uCascadeCount;              // 0 = shadows off
+
+// 1 = lit, 0 = in shadow. 'N' is the geometric normal.
+float shadowFactor(highp vec3 worldPos, vec3 N, highp float viewDepth)
+{
+    if (uCascadeCount == 0 || viewDepth > uCascadeEnds[uCascadeCount - 1])
+        return 1.0;
+
+    int cascade = 0;
+    for (int i = 0; i < uCascadeCount - 1; ++i)
+        cascade += viewDepth > uCascadeEnds[i] ? 1 : 0;
+
+    // Offsetting the receiver by about a texel beats a large depth bias:
+    // no acne on slopes, and contact shadows stay attached
+    highp vec3 p = worldPos + N * uShadowNormalOffset[cascade];
+    highp vec4 s = uShadowMatrices[cascade] * vec4(p, 1.0);
+    return texture(uShadowMap, vec4(s.xy, float(cascade), s.z));
+}
@@ -0,0 +1,14 @@
+#version 320 es
+precision mediump float;
+
+flat in uint vMaterial;
+
+out vec4 fragColor;
+
+#include "common/materials.glsl"
+
+// Every shaded fragment adds its material's estimated cost (additive blending)
+void main()
+{
+    fragColor = vec4(float(materials[vMaterial].cost), 0.0, 0.0, 0.0);
+}
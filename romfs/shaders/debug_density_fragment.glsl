@@ -0,0 +1,16 @@
+#version 320 es
+precision mediump float;
+
+flat in highp float gArea;
+
+out vec4 fragColor;
+
+// Triangles much smaller than a 2x2 quad waste most of the shaded lanes on
+// helper pixels: red < 1 px, yellow ~ 8 px, green >= 64 px.
+void main()
+{
+    float t = clamp(log2(max(gArea, 1.0)) / 6.0, 0.0, 1.0);
+    vec3 color = t < 0.5 ? mix(vec3(1.0, 0.0, 0.0), vec3(1.0, 1.0, 0.0), t * 2.0)
+                         : mix(vec3(1.0, 1.0, 0.0), vec3(0.0, 1.0, 0.0), t * 2.0 - 1.0);
+    fragColor = vec4(color, 1.0);
+}
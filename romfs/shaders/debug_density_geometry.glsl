@@ -0,0 +1,27 @@
+#version 320 es
+precision highp float;
+
+layout(triangles) in;
+layout(triangle_strip, max_vertices = 3) out;
+
+uniform vec2 uViewportSize;
+
+// Screen-space area of the triangle in pixels
+flat out float gArea;
+
+void main()
+{
+    vec2 p[3];
+    for (int i = 0; i < 3; ++i)
+        p[i] = (gl_in[i].gl_Position.xy / max(gl_in[i].gl_Position.w, 1e-5) * 0.5 + 0.5) * uViewportSize;
+
+    float area = abs((p[1].x - p[0].x) * (p[2].y - p[0].y) - (p[2].x - p[0].x) * (p[1].y - p[0].y)) * 0.5;
+
+    for (int i = 0; i < 3; ++i)
+    {
+        gArea = area;
+        gl_Position = gl_in[i].gl_Position;
+        EmitVertex();
+    }
+    EndPrimitive();
+}
@@ -0,0 +1,26 @@
+#version 320 es
+precision mediump float;
+
+in vec2 vUV;
+
+out vec4 fragColor;
+
+uniform highp sampler2D uCounter;
+uniform float uMaxValue; // value mapped to the hot end of the ramp
+uniform vec2 uUVScale;   // part of the counter target covered by the viewport
+
+// black -> blue -> green -> yellow -> red -> white
+vec3 heat(float t)
+{
+    const vec3 ramp[6] = vec3[6](vec3(0.0), vec3(0.0, 0.0, 1.0), vec3(0.0, 1.0, 0.0),
+                                 vec3(1.0, 1.0, 0.0), vec3(1.0, 0.0, 0.0), vec3(1.0));
+    float x = clamp(t, 0.0, 1.0) * 5.0;
+    int i = int(min(floor(x), 4.0));
+    return mix(ramp[i], ramp[i + 1], x - float(i));
+}
+
+void main()
+{
+    float value = texture(uCounter, vUV * uUVScale).r;
+    fragColor = vec4(heat(value / uMaxValue), 1.0);
+}
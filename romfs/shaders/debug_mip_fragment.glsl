@@ -0,0 +1,30 @@
+#version 320 es
+precision mediump float;
+
+in vec2 vTexCoord;
+flat in uint vMaterial;
+
+out vec4 fragColor;
+
+uniform mediump sampler2DArray texBaseColor;
+
+#include "common/materials.glsl"
+
+// Mip level the base color fetch lands on: 0 blue, 1 cyan, 2 green,
+// 3 yellow, 4 red, 5+ magenta. Blue everywhere means the texture is bigger
+// than it needs to be at this distance.
+void main()
+{
+    highp vec2 texel = vTexCoord * vec2(textureSize(texBaseColor, 0).xy);
+    highp vec2 dx = dFdx(texel);
+    highp vec2 dy = dFdy(texel);
+    float lod = max(0.5 * log2(max(dot(dx, dx), dot(dy, dy))), 0.0);
+
+    const vec3 ramp[6] = vec3[6](vec3(0.0, 0.0, 1.0), vec3(0.0, 1.0, 1.0), vec3(0.0, 1.0, 0.0),
+                                 vec3(1.0, 1.0, 0.0), vec3(1.0, 0.0, 0.0), vec3(1.0, 0.0, 1.0));
+    int i = int(min(floor(lod), 4.0));
+    vec3 color = lod >= 5.0 ? ramp[5] : mix(ramp[i], ramp[i + 1], fract(lod));
+
+    vec3 albedo = texture(texBaseColor, vec3(vTexCoord, float(materials[vMaterial].baseColorLayer))).rgb;
+    fragColor = vec4(mix(albedo, color, 0.7), 1.0);
+}
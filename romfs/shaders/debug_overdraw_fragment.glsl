@@ -0,0 +1,10 @@
+#version 320 es
+precision mediump float;
+
+// Every shaded fragment adds one to the counter target (additive blending)
+out vec4 fragColor;
+
+void main()
+{
+    fragColor = vec4(1.0, 0.0, 0.0, 0.0);
+}
@@ -0,0 +1,7 @@
+#version 320 es
+precision mediump float;
+
+// Depth only, color writes are masked off during the pre-pass
+void main()
+{
+}
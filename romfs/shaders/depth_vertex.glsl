@@ -0,0 +1,21 @@
+#version 320 es
+precision highp float;
+
+// Position-only stream, see Model::bindPositionOnly
+layout(location = 0) in vec3 inPosition;
+layout(location = 5) in uint inDrawID;
+
+#include "common/draw_records.glsl"
+
+uniform mat4 uView;
+uniform mat4 uProj;
+
+// Must produce bit-identical depth to vertex.glsl for the GL_EQUAL shading pass
+invariant gl_Position;
+
+void main()
+{
+    mat4 model = transforms[records[inDrawID].transform];
+    vec4 worldPos = model * vec4(inPosition, 1.0);
+    gl_Position = uProj * uView * worldPos;
+}
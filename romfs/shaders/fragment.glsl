@@ -1,106 +1,115 @@
 #version 320 es
 precision mediump float;
 
+// Material variant, #defines inserted by ShaderVariants (see MaterialFeature):
+//   HAS_NORMAL_MAP  sample and apply the normal map
+//   HAS_ORM         sample occlusion/roughness/metallic, else the white default
+//   UNLIT           base color only
+
 in vec2 vTexCoord;
-in vec3 vWorldPos;
+in highp vec3 vWorldPos; // full precision for the shadow lookup
 in vec3 vNormal;
 in vec3 vTangent;
 in vec3 vBitangent;
+flat in uint vMaterial;
 
 out vec4 fragColor;
 
 uniform vec3 uCamPos;
 uniform vec3 uLightDir;   // directional light, should be normalized
 uniform vec3 uLightColor;
+uniform highp mat4 uView; // same as in vertex.glsl, for the cascade depth
 
-uniform sampler2D texBaseColor;
-uniform sampler2D texMetallic;
-uniform sampler2D texRoughness;
-uniform sampler2D texAO;
-uniform sampler2D texNormal;
-
-const float PI = 3.14159265359;
-
-vec3 getNormal()
-{
-    // vec3 n = texture(texNormal, vTexCoord).xyz * 2.0 - 1.0; // normal map
-    // mat3 TBN = mat3(normalize(vTangent), normalize(vBitangent), normalize(vNormal));
-    // return normalize(TBN * n);
-
-    return normalize(vNormal);
-}
+// One texture array per map, the material picks its layer in each
+uniform mediump sampler2DArray texBaseColor;
+uniform mediump sampler2DArray texORM; // r = occlusion, g = roughness, b = metallic
+uniform mediump sampler2DArray texNormal;
 
-// Fresnel Schlick approximation
-vec3 fresnelSchlick(float cosTheta, vec3 F0)
-{
-    return F0 + (1.0 - F0) * pow(1.0 - cosTheta, 5.0);
-}
+#include "common/materials.glsl"
+#include "common/brdf.glsl"
+#include "common/shadows.glsl"
+#include "common/lights.glsl"
+#include "common/ibl.glsl"
 
-// GGX normal distribution
-float distributionGGX(vec3 N, vec3 H, float roughness)
-{
-    float a = roughness * roughness;
-    float a2 = a * a;
-    float NdotH = max(dot(N,H),0.0);
-    float NdotH2 = NdotH*NdotH;
-    float denom = (NdotH2*(a2-1.0)+1.0);
-    return a2 / (PI * denom * denom);
-}
+uniform highp vec2 uClusterTileScale; // froxels per pixel of the rendered viewport
 
-// Geometry (Schlick-GGX)
-float geometrySchlickGGX(float NdotV, float roughness)
+#ifdef HAS_NORMAL_MAP
+// Tangent frame from screen-space derivatives of position and UV, the
+// meshes carry no tangents
+mat3 cotangentFrame(vec3 N, vec3 p, vec2 uv)
 {
-    float r = roughness + 1.0;
-    float k = (r*r)/8.0;
-    return NdotV / (NdotV * (1.0 - k) + k);
+    vec3 dp1 = dFdx(p);
+    vec3 dp2 = dFdy(p);
+    vec2 duv1 = dFdx(uv);
+    vec2 duv2 = dFdy(uv);
+
+    vec3 dp2perp = cross(dp2, N);
+    vec3 dp1perp = cross(N, dp1);
+    vec3 T = dp2perp * duv1.x + dp1perp * duv2.x;
+    vec3 B = dp2perp * duv1.y + dp1perp * duv2.y;
+    float invmax = inversesqrt(max(max(dot(T, T), dot(B, B)), 1e-8));
+    return mat3(T * invmax, B * invmax, N);
 }
+#endif
 
-float geometrySmith(vec3 N, vec3 V, vec3 L, float roughness)
+vec3 getNormal(MaterialData mat)
 {
-    float NdotV = max(dot(N,V),0.0);
-    float NdotL = max(dot(N,L),0.0);
-    return geometrySchlickGGX(NdotV, roughness) * geometrySchlickGGX(NdotL, roughness);
+    vec3 N = normalize(vNormal);
+#ifdef HAS_NORMAL_MAP
+    vec3 n = texture(texNormal, vec3(vTexCoord, float(mat.normalLayer))).xyz * 2.0 - 1.0;
+    N = normalize(cotangentFrame(N, vWorldPos, vTexCoord) * n);
+#endif
+    return N;
 }
 
 void main()
 {
-    vec3 albedo = pow(texture(texBaseColor, vTexCoord).rgb, vec3(2.2)); // sRGB -> linear
-    float metallic = texture(texMetallic, vTexCoord).r;
-    float roughness = texture(texRoughness, vTexCoord).r;
-    float ao = texture(texAO, vTexCoord).r;
-    // float ao = 1.0;
-
-
-    vec3 N = getNormal();
+    MaterialData mat = materials[vMaterial];
+    vec3 albedo = texture(texBaseColor, vec3(vTexCoord, float(mat.baseColorLayer))).rgb; // sRGB format, already linear
+
+#ifdef UNLIT
+    fragColor = vec4(albedo, 1.0);
+#else
+#ifdef HAS_ORM
+    vec3 orm = texture(texORM, vec3(vTexCoord, float(mat.ormLayer))).rgb;
+#else
+    vec3 orm = vec3(1.0); // what the white default layer holds
+#endif
+    float ao = orm.r;
+    float roughness = orm.g;
+    float metallic = orm.b;
+
+    vec3 N = getNormal(mat);
     vec3 V = normalize(uCamPos - vWorldPos);
     vec3 L = normalize(-uLightDir);  // directional light points *to* the surface
-    vec3 H = normalize(V + L);
-
-    // PBR calculations
-    float NDF = distributionGGX(N,H,roughness);
-    float G = geometrySmith(N,V,L,roughness);
-    vec3 F0 = mix(vec3(0.04), albedo, metallic);
-    vec3 F = fresnelSchlick(max(dot(H,V),0.0), F0);
-
-    float NdotL = max(dot(N,L),0.0);
-    float NdotV = max(dot(N,V),0.0);
-
-    vec3 nominator = NDF * G * F;
-    float denominator = 4.0 * NdotV * NdotL + 0.001;
-    vec3 specular = nominator / denominator;
-
-    vec3 kS = F;
-    vec3 kD = (1.0 - kS) * (1.0 - metallic);
-    vec3 diffuse = kD * albedo / PI;
-
-    vec3 radiance = uLightColor;
-    vec3 color = (diffuse + specular) * radiance * NdotL;
-    // color *= ao; // apply AO
-    color = pow(color, vec3(1.0/2.2)); // gamma correction
-
+    highp float viewDepth = -(uView * vec4(vWorldPos, 1.0)).z;
+
+    // Directional light, shadowed
+    vec3 radiance = uLightColor * shadowFactor(vWorldPos, normalize(vNormal), viewDepth);
+    vec3 color = cookTorrance(N, V, L, radiance, albedo, roughness, metallic);
+
+    // Local lights, only the ones assigned to this fragment's froxel
+    if (uLightCount > 0u)
+    {
+        uvec2 tile = min(uvec2(gl_FragCoord.xy * uClusterTileScale), uClusterGrid.xy - 1u);
+        uint cluster = tile.x + uClusterGrid.x * (tile.y + uClusterGrid.y * clusterSlice(viewDepth));
+        uint count = min(clusterCounts[cluster], uint(MAX_LIGHTS_PER_CLUSTER));
+        uint base = cluster * uint(MAX_LIGHTS_PER_CLUSTER);
+        for (uint i = 0u; i < count; ++i)
+        {
+            Light light = lights[clusterLights[base + i]];
+            vec3 Lp;
+            float attenuation = lightAttenuation(light, vWorldPos, Lp);
+            if (attenuation > 0.0)
+                color += cookTorrance(N, V, Lp, light.colorType.rgb * attenuation, albedo, roughness, metallic);
+        }
+    }
+
+    // Ambient from the environment; AO only occludes this part, the direct
+    // lights have their own visibility
+    color += ambientLighting(N, V, albedo, roughness, metallic, ao);
+
+    // Linear out, the sRGB scene target encodes on write
     fragColor = vec4(color, 1.0);
-
-    // fragColor = vec4(texture(texNormal, vTexCoord).xyz, 1.0);
-
-    
+#endif
 }
@@ -0,0 +1,64 @@
+#version 320 es
+precision mediump float;
+
+// One bloom downsample to half size: four bilinear taps one source texel
+// off the center cover a 4x4 box. The first level also drops everything
+// below the threshold.
+in vec2 vUV;
+
+out vec4 fragColor;
+
+uniform sampler2D uSource;
+uniform highp vec2 uUVScale;   // rendered part of the source
+uniform highp vec2 uTexelSize; // one source texel
+uniform bool uPrefilter;
+uniform vec2 uThreshold;       // x = threshold, y = soft knee width
+
+highp vec2 lo;
+highp vec2 hi;
+
+vec3 tap(highp vec2 uv)
+{
+    return texture(uSource, clamp(uv, lo, hi)).rgb;
+}
+
+float luminance(vec3 c)
+{
+    return dot(c, vec3(0.2126, 0.7152, 0.0722));
+}
+
+void main()
+{
+    lo = uTexelSize * 0.5;
+    hi = uUVScale - uTexelSize * 0.5;
+    highp vec2 uv = vUV * uUVScale;
+
+    vec3 a = tap(uv + vec2(-uTexelSize.x, -uTexelSize.y));
+    vec3 b = tap(uv + vec2(uTexelSize.x, -uTexelSize.y));
+    vec3 c = tap(uv + vec2(-uTexelSize.x, uTexelSize.y));
+    vec3 d = tap(uv + vec2(uTexelSize.x, uTexelSize.y));
+
+    vec3 color;
+    if (uPrefilter)
+    {
+        // Taps weighted by 1 / (1 + luma) so a single very bright pixel
+        // can't make the whole block flicker as it moves
+        float wa = 1.0 / (1.0 + luminance(a));
+        float wb = 1.0 / (1.0 + luminance(b));
+        float wc = 1.0 / (1.0 + luminance(c));
+        float wd = 1.0 / (1.0 + luminance(d));
+        color = (a * wa + b * wb + c * wc + d * wd) / (wa + wb + wc + wd);
+
+        // Soft threshold: quadratic over the knee, linear above it
+        float brightness = max(color.r, max(color.g, color.b));
+        float knee = uThreshold.y;
+        float soft = clamp(brightness - uThreshold.x + knee, 0.0, 2.0 * knee);
+        soft = soft * soft / (4.0 * knee + 1e-4);
+        color *= max(soft, brightness - uThreshold.x) / max(brightness, 1e-4);
+    }
+    else
+    {
+        color = (a + b + c + d) * 0.25;
+    }
+    fragColor = vec4(color, 1.0);
+}
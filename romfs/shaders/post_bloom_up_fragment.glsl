@@ -0,0 +1,34 @@
+#version 320 es
+precision mediump float;
+
+// One bloom upsample: a 3x3 tent over the smaller level, blended
+// additively onto the next larger one
+in vec2 vUV;
+
+out vec4 fragColor;
+
+uniform sampler2D uSource;
+uniform highp vec2 uUVScale;   // rendered part of the source
+uniform highp vec2 uTexelSize; // one source texel
+
+highp vec2 lo;
+highp vec2 hi;
+
+vec3 tap(highp vec2 uv)
+{
+    return texture(uSource, clamp(uv, lo, hi)).rgb;
+}
+
+void main()
+{
+    lo = uTexelSize * 0.5;
+    hi = uUVScale - uTexelSize * 0.5;
+    highp vec2 uv = vUV * uUVScale;
+    highp vec2 dx = vec2(uTexelSize.x, 0.0);
+    highp vec2 dy = vec2(0.0, uTexelSize.y);
+
+    vec3 color = tap(uv) * 4.0;
+    color += (tap(uv - dx) + tap(uv + dx) + tap(uv - dy) + tap(uv + dy)) * 2.0;
+    color += tap(uv - dx - dy) + tap(uv + dx - dy) + tap(uv - dx + dy) + tap(uv + dx + dy);
+    fragColor = vec4(color * (1.0 / 16.0), 1.0);
+}
@@ -0,0 +1,123 @@
+#version 320 es
+precision highp float;
+
+// FXAA, after the quality variant of FXAA 3.11: find the local edge from
+// the luma in alpha, search along it both ways for its ends and resample
+// across it by how far this pixel is from the nearer end. A subpixel term
+// softens single-pixel features the edge search can't see.
+in vec2 vUV;
+
+out vec4 fragColor;
+
+uniform mediump sampler2D uSource;
+uniform vec2 uUVScale;   // rendered part of the source
+uniform vec2 uTexelSize; // one source texel
+
+const float kEdgeThreshold = 0.125;     // local contrast needed, relative
+const float kEdgeThresholdMin = 0.0312; // and absolute, keeps dark areas alone
+const float kSubpixel = 0.75;
+const int kSearchSteps = 8;
+const float kSearchStride[kSearchSteps] = float[](1.0, 1.0, 1.0, 1.5, 2.0, 2.0, 4.0, 8.0);
+
+vec2 lo;
+vec2 hi;
+
+float luma(vec2 uv)
+{
+    return textureLod(uSource, clamp(uv, lo, hi), 0.0).a;
+}
+
+void main()
+{
+    lo = uTexelSize * 0.5;
+    hi = uUVScale - uTexelSize * 0.5;
+    vec2 uv = clamp(vUV * uUVScale, lo, hi);
+    vec2 t = uTexelSize;
+
+    vec4 center = textureLod(uSource, uv, 0.0);
+    float lM = center.a;
+    float lN = luma(uv + vec2(0.0, t.y));
+    float lS = luma(uv - vec2(0.0, t.y));
+    float lE = luma(uv + vec2(t.x, 0.0));
+    float lW = luma(uv - vec2(t.x, 0.0));
+
+    float lMax = max(lM, max(max(lN, lS), max(lE, lW)));
+    float lMin = min(lM, min(min(lN, lS), min(lE, lW)));
+    float range = lMax - lMin;
+    if (range < max(kEdgeThresholdMin, lMax * kEdgeThreshold))
+    {
+        fragColor = vec4(center.rgb, 1.0);
+        return;
+    }
+
+    float lNE = luma(uv + vec2(t.x, t.y));
+    float lNW = luma(uv + vec2(-t.x, t.y));
+    float lSE = luma(uv + vec2(t.x, -t.y));
+    float lSW = luma(uv + vec2(-t.x, -t.y));
+
+    // Edge orientation from second derivatives across each axis
+    float edgeH = abs(lNW + lSW - 2.0 * lW) + 2.0 * abs(lN + lS - 2.0 * lM) + abs(lNE + lSE - 2.0 * lE);
+    float edgeV = abs(lNW + lNE - 2.0 * lN) + 2.0 * abs(lW + lE - 2.0 * lM) + abs(lSW + lSE - 2.0 * lS);
+    bool horizontal = edgeH >= edgeV;
+
+    // Which side of the pixel the edge is on
+    float l1 = horizontal ? lS : lW;
+    float l2 = horizontal ? lN : lE;
+    float g1 = abs(l1 - lM);
+    float g2 = abs(l2 - lM);
+    float gradient = 0.25 * max(g1, g2);
+    float stepLength = horizontal ? t.y : t.x;
+    float lEdge;
+    if (g1 >= g2)
+    {
+        stepLength = -stepLength;
+        lEdge = 0.5 * (l1 + lM);
+    }
+    else
+    {
+        lEdge = 0.5 * (l2 + lM);
+    }
+
+    // Walk along the edge, half a pixel toward it, until the luma leaves
+    // the edge's average on both ends
+    vec2 onEdge = uv + (horizontal ? vec2(0.0, stepLength * 0.5) : vec2(stepLength * 0.5, 0.0));
+    vec2 along = horizontal ? vec2(t.x, 0.0) : vec2(0.0, t.y);
+    vec2 uv1 = onEdge - along;
+    vec2 uv2 = onEdge + along;
+    float e1 = luma(uv1) - lEdge;
+    float e2 = luma(uv2) - lEdge;
+    bool done1 = abs(e1) >= gradient;
+    bool done2 = abs(e2) >= gradient;
+    for (int i = 1; i < kSearchSteps && !(done1 && done2); ++i)
+    {
+        if (!done1)
+        {
+            uv1 -= along * kSearchStride[i];
+            e1 = luma(uv1) - lEdge;
+            done1 = abs(e1) >= gradient;
+        }
+        if (!done2)
+        {
+            uv2 += along * kSearchStride[i];
+            e2 = luma(uv2) - lEdge;
+            done2 = abs(e2) >= gradient;
+        }
+    }
+
+    // Blend across the edge by the distance to the nearer end, if that end
+    // really turns the way this pixel does
+    float d1 = horizontal ? uv.x - uv1.x : uv.y - uv1.y;
+    float d2 = horizontal ? uv2.x - uv.x : uv2.y - uv.y;
+    bool nearer1 = d1 < d2;
+    float offset = 0.5 - min(d1, d2) / (d1 + d2);
+    bool turns = ((nearer1 ? e1 : e2) < 0.0) != (lM < lEdge);
+    offset = turns ? offset : 0.0;
+
+    float average = (2.0 * (lN + lS + lE + lW) + lNE + lNW + lSE + lSW) * (1.0 / 12.0);
+    float sub = clamp(abs(average - lM) / range, 0.0, 1.0);
+    sub = (-2.0 * sub + 3.0) * sub * sub;
+    offset = max(offset, sub * sub * kSubpixel);
+
+    vec2 finalUv = uv + (horizontal ? vec2(0.0, offset * stepLength) : vec2(offset * stepLength, 0.0));
+    fragColor = vec4(textureLod(uSource, clamp(finalUv, lo, hi), 0.0).rgb, 1.0);
+}
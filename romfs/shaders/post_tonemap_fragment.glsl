@@ -0,0 +1,39 @@
+#version 320 es
+precision mediump float;
+
+// HDR scene + bloom -> LDR. The target is sRGB, so the output stays
+// linear; alpha carries a perceptual luma for FXAA.
+in vec2 vUV;
+
+out vec4 fragColor;
+
+uniform sampler2D uScene;
+uniform sampler2D uBloom;
+uniform highp vec2 uSceneScale; // rendered part of each source
+uniform highp vec2 uSceneTexel;
+uniform highp vec2 uBloomScale;
+uniform highp vec2 uBloomTexel;
+uniform float uBloomStrength;   // 0 = no bloom
+uniform float uExposure;
+
+// Fit of the ACES filmic curve by Krzysztof Narkowicz
+vec3 acesFilm(vec3 x)
+{
+    return clamp((x * (2.51 * x + 0.03)) / (x * (2.43 * x + 0.59) + 0.14), 0.0, 1.0);
+}
+
+void main()
+{
+    highp vec2 uv = clamp(vUV * uSceneScale, uSceneTexel * 0.5, uSceneScale - uSceneTexel * 0.5);
+    vec3 color = texture(uScene, uv).rgb;
+    if (uBloomStrength > 0.0)
+    {
+        highp vec2 bloomUv = clamp(vUV * uBloomScale, uBloomTexel * 0.5, uBloomScale - uBloomTexel * 0.5);
+        color += texture(uBloom, bloomUv).rgb * uBloomStrength;
+    }
+
+    color = acesFilm(color * uExposure);
+    // FXAA's thresholds assume gamma-like values, sqrt is close enough
+    float luma = sqrt(dot(color, vec3(0.299, 0.587, 0.114)));
+    fragColor = vec4(color, luma);
+}
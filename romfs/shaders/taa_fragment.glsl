@@ -0,0 +1,112 @@
+#version 320 es
+precision highp float;
+
+// Temporal anti-aliasing resolve. The scene was drawn with a subpixel
+// jitter; this blends it into the history of earlier frames, reprojected
+// with the camera motion:
+//
+//  - motion comes from the depth buffer and last frame's matrices, taken
+//    at the nearest depth of the 3x3 so foreground edges move with the
+//    foreground,
+//  - the history is clamped to the min/max box of the current 3x3 in
+//    YCoCg, which rejects what no longer belongs to this pixel (ghosts),
+//  - the blend weights are divided by 1 + luma so bright HDR samples don't
+//    flicker through the average.
+in vec2 vUV;
+
+out vec4 fragColor;
+
+uniform mediump sampler2D uScene;
+uniform sampler2D uDepth;
+uniform mediump sampler2D uHistory;
+uniform vec2 uUVScale;        // rendered part of the scene and the history this frame
+uniform vec2 uTexelSize;      // one texel of either, same allocation
+uniform vec2 uHistoryUVScale; // rendered part of the history last frame
+uniform mat4 uReprojection;   // this frame's clip space to last frame's, unjittered
+uniform vec2 uJitter;         // this frame's subpixel offset in NDC
+uniform float uFeedback;      // history weight
+uniform int uHistoryValid;
+uniform int uMeasure;
+
+// Benchmark counters, only written when uMeasure is set
+layout(std430, binding = 10) buffer TaaStats
+{
+    uint statPixels;
+    uint statLag;     // sum of |resolved - current| / current luma, x1000
+    uint statClamped; // history rejected or moved by the clamp
+};
+
+vec3 toYCoCg(vec3 c)
+{
+    return vec3(dot(c, vec3(0.25, 0.5, 0.25)), dot(c, vec3(0.5, 0.0, -0.5)), dot(c, vec3(-0.25, 0.5, -0.25)));
+}
+
+vec3 fromYCoCg(vec3 c)
+{
+    return vec3(c.x + c.y - c.z, c.x + c.z, c.x - c.y - c.z);
+}
+
+void main()
+{
+    vec2 uv = vUV * uUVScale;
+    vec2 hi = uUVScale - uTexelSize * 0.5;
+
+    vec3 current = vec3(0.0);
+    vec3 boxMin = vec3(1e4);
+    vec3 boxMax = vec3(-1e4);
+    float depth = 1.0;
+    vec2 nearest = vec2(0.0);
+    for (int y = -1; y <= 1; ++y)
+    {
+        for (int x = -1; x <= 1; ++x)
+        {
+            vec2 offset = vec2(x, y);
+            vec2 sampleUv = clamp(uv + offset * uTexelSize, uTexelSize * 0.5, hi);
+            vec3 c = toYCoCg(textureLod(uScene, sampleUv, 0.0).rgb);
+            boxMin = min(boxMin, c);
+            boxMax = max(boxMax, c);
+            if (x == 0 && y == 0)
+                current = c;
+
+            float d = textureLod(uDepth, sampleUv, 0.0).r;
+            if (d < depth)
+            {
+                depth = d;
+                nearest = offset;
+            }
+        }
+    }
+
+    // Where the nearest surface was last frame, both positions unjittered
+    vec2 ndc = (vUV + nearest * uTexelSize / uUVScale) * 2.0 - 1.0 - uJitter;
+    vec4 previous = uReprojection * vec4(ndc, depth * 2.0 - 1.0, 1.0);
+    vec2 velocity = (ndc - previous.xy / previous.w) * 0.5;
+    vec2 historyUv = vUV - velocity;
+
+    bool valid = uHistoryValid != 0 && all(greaterThanEqual(historyUv, vec2(0.0))) &&
+                 all(lessThanEqual(historyUv, vec2(1.0)));
+    vec3 history = current;
+    vec3 clamped = current;
+    if (valid)
+    {
+        vec2 historyHi = uHistoryUVScale - uTexelSize * 0.5;
+        history = toYCoCg(textureLod(uHistory, clamp(historyUv * uHistoryUVScale, uTexelSize * 0.5, historyHi),
+                                     0.0).rgb);
+        clamped = clamp(history, boxMin, boxMax);
+    }
+
+    float feedback = valid ? uFeedback : 0.0;
+    float currentWeight = (1.0 - feedback) / (1.0 + current.x);
+    float historyWeight = feedback / (1.0 + clamped.x);
+    vec3 result = (current * currentWeight + clamped * historyWeight) / (currentWeight + historyWeight);
+    fragColor = vec4(max(fromYCoCg(result), vec3(0.0)), 1.0);
+
+    if (uMeasure != 0)
+    {
+        float lag = min(abs(result.x - current.x) / max(current.x, 0.05), 1.0);
+        atomicAdd(statPixels, 1u);
+        atomicAdd(statLag, uint(lag * 1000.0));
+        if (!valid || distance(history, clamped) > 0.02 * (1.0 + current.x))
+            atomicAdd(statClamped, 1u);
+    }
+}
@@ -0,0 +1,43 @@
+#version 320 es
+precision mediump float;
+
+in vec2 vUV;
+
+out vec4 fragColor;
+
+uniform sampler2D uScene;
+uniform vec2 uUVScale;   // rendered part of the scene target
+uniform vec2 uTexelSize; // one texel of the scene target
+uniform float uSharpness;
+uniform bool uEncodeSrgb; // no sRGB window surface, encode here
+
+// Exact sRGB transfer function, only run once per output pixel
+vec3 linearToSrgb(vec3 c)
+{
+    vec3 lo = c * 12.92;
+    vec3 hi = 1.055 * pow(c, vec3(1.0 / 2.4)) - 0.055;
+    return mix(hi, lo, vec3(lessThanEqual(c, vec3(0.0031308))));
+}
+
+void main()
+{
+    // Stay half a texel inside the rendered rect so bilinear never pulls in
+    // stale pixels from outside the current viewport
+    vec2 lo = uTexelSize * 0.5;
+    vec2 hi = uUVScale - uTexelSize * 0.5;
+    vec2 uv = clamp(vUV * uUVScale, lo, hi);
+
+    vec3 c = texture(uScene, uv).rgb;
+    if (uSharpness > 0.0)
+    {
+        // Unsharp mask on the bilinear result to win back some upscale blur
+        vec3 n = texture(uScene, clamp(uv + vec2(0.0, uTexelSize.y), lo, hi)).rgb;
+        vec3 s = texture(uScene, clamp(uv - vec2(0.0, uTexelSize.y), lo, hi)).rgb;
+        vec3 e = texture(uScene, clamp(uv + vec2(uTexelSize.x, 0.0), lo, hi)).rgb;
+        vec3 w = texture(uScene, clamp(uv - vec2(uTexelSize.x, 0.0), lo, hi)).rgb;
+        c = clamp(c + (4.0 * c - n - s - e - w) * uSharpness * 0.25, 0.0, 1.0);
+    }
+    if (uEncodeSrgb)
+        c = linearToSrgb(c);
+    fragColor = vec4(c, 1.0);
+}
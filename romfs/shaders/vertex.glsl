@@ -1,5 +1,5 @@
 #version 320 es
-precision mediump float;
+precision highp float;
 
 // Vertex attributes
 layout(location = 0) in vec3 inPosition;
@@ -7,6 +7,9 @@ layout(location = 1) in vec3 inNormal;
 layout(location = 2) in vec2 inTexCoord;
 layout(location = 3) in vec3 inTangent;
 layout(location = 4) in vec3 inBitangent;
+layout(location = 5) in uint inDrawID; // per-instance, = baseInstance of the indirect command
+
+#include "common/draw_records.glsl"
 
 // Outputs to fragment shader
 out vec2 vTexCoord;
@@ -14,26 +17,33 @@ out vec3 vWorldPos;
 out vec3 vNormal;
 out vec3 vTangent;
 out vec3 vBitangent;
+flat out uint vMaterial;
 
 // Uniforms
-uniform mat4 uModel; // model matrix
 uniform mat4 uView;  // view matrix
 uniform mat4 uProj;  // projection matrix
 
+// Must match depth_vertex.glsl exactly for the GL_EQUAL pass after a pre-pass
+invariant gl_Position;
+
 void main()
 {
+    DrawRecord rec = records[inDrawID];
+    mat4 model = transforms[rec.transform];
+
     // World-space position
-    vec4 worldPos = uModel * vec4(inPosition, 1.0);
+    vec4 worldPos = model * vec4(inPosition, 1.0);
     vWorldPos = worldPos.xyz;
 
     // Transform normal and tangent/bitangent to world space
-    mat3 normalMatrix = mat3(uModel); // assumes no non-uniform scale
+    mat3 normalMatrix = mat3(model); // assumes no non-uniform scale
     vNormal = normalize(normalMatrix * inNormal);
     vTangent = normalize(normalMatrix * inTangent);
     vBitangent = normalize(normalMatrix * inBitangent);
 
     // Pass UVs
     vTexCoord = inTexCoord;
+    vMaterial = rec.material;
 
     // Clip-space position
     gl_Position = uProj * uView * worldPos;
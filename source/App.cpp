@@ -1,8 +1,13 @@
 #include "App.h"
+#include "JobBenchmark.h"
+#include "DecodeBenchmark.h"
 #include <switch.h>
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 #include <cstdio>
+#include <sys/stat.h>
+#include <cmath>
+#include <algorithm>
 
 #include <EGL/egl.h>    // EGL library
 #include <EGL/eglext.h> // EGL extensions
@@ -12,6 +17,12 @@
 App::App() {}
 App::~App() { shutdown(); }
 
+// sRGB transfer function, for constants written to sRGB targets
+static float srgbToLinear(float c)
+{
+    return c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+}
+
 static void setMesaConfig()
 {
     // optional env tweaks (kept from original sample)
@@ -53,7 +64,17 @@ bool App::initEgl(NWindow* win)
         return false;
     }
 
-    s_surface_ = eglCreateWindowSurface(s_display_, config, win, nullptr);
+    // sRGB window surface so the final pass can write linear values and let
+    // the ROP encode them; without one the upscale shader encodes
+    static const EGLint srgbSurfaceAttributeList[] =
+    {
+        EGL_GL_COLORSPACE_KHR, EGL_GL_COLORSPACE_SRGB_KHR,
+        EGL_NONE
+    };
+    s_surface_ = eglCreateWindowSurface(s_display_, config, win, srgbSurfaceAttributeList);
+    srgbSurface_ = s_surface_ != nullptr;
+    if (!s_surface_)
+        s_surface_ = eglCreateWindowSurface(s_display_, config, win, nullptr);
     if (!s_surface_)
     {
         printf("eglCreateWindowSurface failed: %d\n", eglGetError());
@@ -111,166 +132,1042 @@ bool App::init()
     // Load GL function pointers
     gladLoadGL();
 
-    // Load shaders from files (paths inside romfs)
-    shader_ = std::make_unique<Shader>();
-    if (!shader_->loadFromFiles("romfs:/shaders/vertex.glsl", "romfs:/shaders/fragment.glsl"))
+    // Material shaders are compiled per feature mask the scene's materials
+    // use (see loadScene), the base variant right away to catch errors early
+    materialShaders_ = std::make_unique<ShaderVariants>(
+        "romfs:/shaders/vertex.glsl", "romfs:/shaders/fragment.glsl", materialFeatureDefines(),
+        [this](const Shader& shader) {
+            MaterialUniforms& loc = materialUniforms_[&shader];
+            loc.view = shader.getUniformLocation("uView");
+            loc.proj = shader.getUniformLocation("uProj");
+            loc.cameraPos = shader.getUniformLocation("uCamPos");
+            loc.lightDir = shader.getUniformLocation("uLightDir");
+            loc.lightColor = shader.getUniformLocation("uLightColor");
+            loc.shadows = ShadowMap::locate(shader);
+            loc.lights = LightClusters::locate(shader);
+            loc.environment = EnvironmentLight::locate(shader);
+
+            // Texture arrays are bound to the unit matching their TextureSlot
+            glUniform1i(shader.getUniformLocation("texBaseColor"), Slot_BaseColor);
+            glUniform1i(shader.getUniformLocation("texORM"), Slot_ORM);
+            glUniform1i(shader.getUniformLocation("texNormal"), Slot_Normal);
+            glUniform1i(shader.getUniformLocation("uShadowMap"), kShadowTextureUnit);
+            glUniform1i(shader.getUniformLocation("uEnvSpecular"), kEnvSpecularTextureUnit);
+            glUniform1i(shader.getUniformLocation("uBrdfLut"), kBrdfLutTextureUnit);
+        });
+    if (!materialShaders_->get(0))
     {
         printf("Failed to load/compile/link shaders\n");
         return false;
     }
-    program_ = shader_->program();
-
-    loc_mdlvMtx = glGetUniformLocation(program_, "uModel");
-    loc_viewMtx = glGetUniformLocation(program_, "uView");
-    loc_projMtx = glGetUniformLocation(program_, "uProj");
-
-    loc_cameraPos = glGetUniformLocation(program_, "uCamPos");
-    loc_lightDir = glGetUniformLocation(program_, "uLightDir");
-    loc_lightColor = glGetUniformLocation(program_, "uLightColor");
 
     glEnable(GL_DEPTH_TEST);
     glDepthFunc(GL_LESS);
 
-    // Setup projection uniform
-    glUseProgram(program_);
-    auto projMtx = glm::perspective(90.0f * glm::two_pi<float>() / 360.0f, 1280.0f / 720.0f, 0.01f, 1000.0f);
-    glUniformMatrix4fv(loc_projMtx, 1, GL_FALSE, glm::value_ptr(projMtx));
-
-    auto modelMtx = glm::mat4(1.0f);
-    modelMtx = glm::scale(modelMtx, glm::vec3(0.5f, 0.5f, 0.5f));
-    glUniformMatrix4fv(loc_mdlvMtx, 1, GL_FALSE, glm::value_ptr(modelMtx));
-
-    glUniform3f(loc_cameraPos, camera_.getPosition().x, camera_.getPosition().y, camera_.getPosition().z);
-    glUniform3f(loc_lightDir, 0.0f, -0.5f, -1.0f);
-    glUniform3f(loc_lightColor, 1.0f, 1.0f, 1.0f);
-
-    s_startTicks = armGetSystemTick();
+    s_startTicks = FramePacer::ticks();
+    pacer_.init(s_display_, s_surface_);
 
     // Initialize input here so Camera can use it
     padConfigureInput(1, HidNpadStyleSet_NpadStandard);
     padInitializeDefault(&pad_);
 
-    // Load model
-    model_ = std::make_unique<Model>(modelPath_);
-    if (!model_->load())
+    jobs_ = std::make_unique<JobSystem>();
+    if (!jobs_->init(kJobWorkers))
+        printf("Job workers unavailable, running jobs inline\n");
+
+    culler_ = std::make_unique<GpuCuller>();
+    if (!culler_->init(1280, 720))
     {
-        printf("Failed to load model: %s\n", modelPath_.c_str());
+        printf("GPU culling unavailable, using the CPU path\n");
+        culler_.reset();
+        cullMode_ = CullMode_Cpu;
+    }
+    gpuCullAvailable_ = culler_ != nullptr;
+
+    prepass_ = std::make_unique<DepthPrepass>();
+    if (!prepass_->init())
+        printf("Depth pre-pass unavailable\n");
+
+    lights_ = std::make_unique<LightClusters>();
+    if (!lights_->init())
+    {
+        printf("Clustered lights unavailable\n");
+        lights_.reset();
+    }
+
+    environment_ = std::make_unique<EnvironmentLight>();
+    if (!environment_->init())
+    {
+        printf("Image-based lighting unavailable\n");
+        environment_.reset();
+    }
+
+    shadows_ = std::make_unique<ShadowMap>();
+    if (!shadows_->init(kShadowResolution, kShadowCascades))
+    {
+        printf("Shadows unavailable\n");
+        shadows_.reset();
+    }
+
+    debugViews_ = std::make_unique<DebugViews>();
+    if (!debugViews_->init(1280, 720))
+    {
+        printf("Debug views unavailable\n");
+        debugViews_.reset();
+    }
+
+    dynamicRes_ = std::make_unique<DynamicResolution>();
+    if (!dynamicRes_->init(1280, 720))
+    {
+        printf("Failed to create the scene render target\n");
         return false;
     }
-    if (!model_->uploadToGPU())
+    dynamicRes_->setShaderEncode(!srgbSurface_);
+
+    graph_ = std::make_unique<RenderGraph>();
+
+    post_ = std::make_unique<PostProcess>();
+    if (!post_->init(1280, 720))
     {
-        printf("Failed to upload model to GPU\n");
+        printf("Post-processing unavailable\n");
+        post_.reset();
+    }
+    setPostQuality(kPostQuality);
+
+    taa_ = std::make_unique<TemporalAA>();
+    if (!taa_->init(1280, 720))
+    {
+        printf("Temporal AA unavailable\n");
+        taa_.reset();
+    }
+    printf("sRGB window surface: %s\n", srgbSurface_ ? "yes" : "no, encoding in the upscale pass");
+
+    streamer_ = std::make_unique<TextureStreamer>();
+    streamer_->init(jobs_.get(), kTextureBudgetMB);
+
+    // Scene settings apply to the subsystems above
+    if (!sceneInit())
+        return false;
+
+    pipeline_ = std::make_unique<FramePipeline>();
+
+    return true;
+}
+
+bool App::sceneInit()
+{
+    sceneFiles_ = listSceneFiles("romfs:/scenes");
+    std::vector<std::string> sdScenes = listSceneFiles("/switch/scenes");
+    sceneFiles_.insert(sceneFiles_.end(), sdScenes.begin(), sdScenes.end());
+
+    auto it = std::find(sceneFiles_.begin(), sceneFiles_.end(), defaultScene_);
+    sceneIndex_ = it != sceneFiles_.end() ? (size_t)(it - sceneFiles_.begin()) : 0;
+    for (size_t tried = 0; tried < sceneFiles_.size(); ++tried)
+    {
+        if (loadScene(sceneFiles_[sceneIndex_]))
+            return true;
+        sceneIndex_ = (sceneIndex_ + 1) % sceneFiles_.size();
+    }
+    printf("No loadable scene found\n");
+    return false;
+}
+
+bool App::loadScene(const std::string& path)
+{
+    u64 start = FramePacer::ticks();
+    SceneDesc desc;
+    if (!loadSceneFile(path, desc))
         return false;
+    u64 parsed = FramePacer::ticks();
+
+    auto scene = std::make_unique<Scene>();
+    std::vector<int> models;
+    for (const std::string& modelPath : desc.models)
+    {
+        int model = scene->addModel(modelPath, jobs_.get(), TextureStreamer::kCoarseSize);
+        if (model < 0)
+            return false;
+        models.push_back(model);
+    }
+    u64 modelsLoaded = FramePacer::ticks();
+
+    // Grids become plain instances, auto spacing needs the model bounds
+    for (const SceneGrid& grid : desc.grids)
+    {
+        float spacing = grid.spacing;
+        if (spacing <= 0.0f)
+        {
+            float extent = 1.0f;
+            for (const Submesh& sm : scene->model(models[grid.model]).submeshes())
+            {
+                for (int a = 0; a < 3; ++a)
+                    extent = std::max(extent, sm.boundsMax[a] - sm.boundsMin[a]);
+            }
+            spacing = extent * grid.scale * 1.5f;
+        }
+
+        for (uint32_t z = 0; z < grid.countZ; ++z)
+        {
+            for (uint32_t x = 0; x < grid.countX; ++x)
+            {
+                SceneInstance inst{};
+                inst.model = grid.model;
+                inst.parent = -1;
+                inst.position[0] = grid.origin[0] + ((int)x - (int)grid.countX / 2) * spacing;
+                inst.position[1] = grid.origin[1];
+                inst.position[2] = grid.origin[2] + z * spacing;
+                inst.rotation[3] = 1.0f;
+                inst.scale[0] = inst.scale[1] = inst.scale[2] = grid.scale;
+                inst.spin = grid.spin;
+                desc.instances.push_back(inst);
+            }
+        }
     }
+    desc.grids.clear();
 
+    std::vector<Spinner> spinners;
+    for (size_t i = 0; i < desc.instances.size(); ++i)
+    {
+        const SceneInstance& inst = desc.instances[i];
+        // Instances only reference earlier instances, so entity i is instance i
+        Entity parent = inst.parent >= 0 && (size_t)inst.parent < i ? (Entity)inst.parent : kNoEntity;
+        Entity e = scene->createEntity(models[inst.model], parent);
+        glm::quat rotation(inst.rotation[3], inst.rotation[0], inst.rotation[1], inst.rotation[2]);
+        scene->setPosition(e, glm::vec3(inst.position[0], inst.position[1], inst.position[2]));
+        scene->setRotation(e, rotation);
+        scene->setScale(e, glm::vec3(inst.scale[0], inst.scale[1], inst.scale[2]));
+        if (inst.spin)
+            spinners.push_back({e, (float)((i * 7) % 64) / 64.0f, rotation});
+    }
+    scene->buildBatches();
+
+    // Compile the variants this scene needs now rather than on first draw
+    for (const auto& batch : scene->batches())
+    {
+        for (const DrawGroup& group : batch->groups())
+            materialShaders_->get(group.features);
+    }
+    printf("Shader variants compiled: %zu\n", materialShaders_->compiledCount());
+
+    // Swap in the new scene; the pipeline is stopped so nothing reads the old one
+    streamer_->setScene(nullptr);
+    scene_ = std::move(scene);
+    streamer_->setScene(scene_.get());
+    spinners_ = std::move(spinners);
+
+    bool hasDirectional = false;
+    sceneLights_.clear();
+    for (const SceneLight& light : desc.lights)
+    {
+        glm::vec3 vector(light.vector[0], light.vector[1], light.vector[2]);
+        glm::vec3 color(light.color[0], light.color[1], light.color[2]);
+        if (light.type == SceneLight_Point)
+        {
+            sceneLights_.push_back(makePointLight(vector, color, light.radius));
+        }
+        else if (light.type == SceneLight_Spot)
+        {
+            glm::vec3 direction(light.direction[0], light.direction[1], light.direction[2]);
+            sceneLights_.push_back(makeSpotLight(vector, color, light.radius, direction,
+                                                 light.innerAngle, light.outerAngle));
+        }
+        else if (!hasDirectional)
+        {
+            // The first directional light is the sun, more are ignored
+            lightDir_ = glm::normalize(vector);
+            lightColor_ = color;
+            hasDirectional = true;
+        }
+    }
+    if (lights_)
+        lights_->setLights(sceneLights_);
+    // Scenes often share one environment, it is only rebuilt when it changes
+    if (environment_ && (!environmentLoaded_ || desc.environment != sceneDesc_.environment))
+        environmentLoaded_ = environment_->load(desc.environment);
+    if (desc.hasCamera)
+    {
+        camera_.setPosition(glm::vec3(desc.camera.position[0], desc.camera.position[1], desc.camera.position[2]));
+        camera_.setOrientation(desc.camera.yaw, desc.camera.pitch);
+    }
+
+    const SceneSettings& settings = desc.settings;
+    if (settings.cullMode >= 0 && settings.cullMode < CullMode_Count)
+        cullMode_ = gpuCullAvailable_ ? (CullMode)settings.cullMode : CullMode_Cpu;
+    if (settings.prepassMode >= 0 && settings.prepassMode < PrepassMode_Count && prepass_)
+        prepass_->setMode((PrepassMode)settings.prepassMode);
+    if (settings.dynamicResolution >= 0 && dynamicRes_)
+        dynamicRes_->setEnabled(settings.dynamicResolution != 0);
+    streamer_->setBudgetMB(settings.textureBudgetMB > 0 ? settings.textureBudgetMB : kTextureBudgetMB);
+    if (shadows_)
+    {
+        shadows_->setConfig(settings.shadowResolution >= 0 ? settings.shadowResolution : kShadowResolution,
+                            settings.shadowCascades > 0 ? settings.shadowCascades : kShadowCascades);
+        if (settings.shadowDistance > 0)
+            shadows_->setShadowDistance((float)settings.shadowDistance);
+    }
+    if (post_)
+    {
+        setPostQuality(settings.postQuality >= 0 && settings.postQuality < PostQuality_Count
+                           ? (PostQuality)settings.postQuality : kPostQuality);
+        post_->setExposure(settings.exposure > 0.0f ? settings.exposure : 1.0f);
+    }
+    if (environment_)
+        environment_->setIntensity(settings.environmentIntensity >= 0.0f ? settings.environmentIntensity : 1.0f);
+    if (settings.targetFps == 30 || settings.targetFps == 60)
+    {
+        pacer_.setMode(settings.targetFps == 30 ? PacingMode_Vsync30 : PacingMode_Vsync60);
+        if (dynamicRes_)
+            dynamicRes_->setTargetFps(settings.targetFps);
+    }
+
+    if (taa_)
+        taa_->invalidateHistory();
+
+    sceneDesc_ = std::move(desc);
+    u64 end = FramePacer::ticks();
+    printf("Scene %s: %zu instances, parse %.2f ms, models %.2f ms, instantiate %.2f ms\n", path.c_str(),
+           sceneDesc_.instances.size(),
+           FramePacer::ticksToSeconds(parsed - start) * 1000.0,
+           FramePacer::ticksToSeconds(modelsLoaded - parsed) * 1000.0,
+           FramePacer::ticksToSeconds(end - modelsLoaded) * 1000.0);
     return true;
 }
 
-float App::getTime() const
+void App::exportScene()
+{
+    // Binary copy of the current scene, with every grid already expanded
+    std::string name = sceneFiles_.empty() ? std::string("scene") : sceneFiles_[sceneIndex_];
+    size_t slash = name.find_last_of('/');
+    if (slash != std::string::npos)
+        name = name.substr(slash + 1);
+    name = name.substr(0, name.find('.'));
+
+    mkdir("/switch/scenes", 0777);
+    std::string path = "/switch/scenes/" + name + ".sceneb";
+    if (saveSceneBinary(path, sceneDesc_))
+    {
+        printf("Saved %s\n", path.c_str());
+        if (std::find(sceneFiles_.begin(), sceneFiles_.end(), path) == sceneFiles_.end())
+            sceneFiles_.push_back(path);
+    }
+}
+
+double App::getTime() const
 {
-    u64 elapsed = armGetSystemTick() - s_startTicks;
-    return (elapsed * 625 / 12) / 1000000000.0f;
+    return FramePacer::ticksToSeconds(FramePacer::ticks() - s_startTicks);
 }
 
-void App::sceneUpdate()
+void App::simulate(FramePacket& packet)
 {
-    auto projMtx = glm::perspective(45.0f * glm::two_pi<float>() / 360.0f, 1280.0f / 720.0f, 0.01f, 1000.0f);
+    u64 now = FramePacer::ticks();
+    float dt = simLastTicks_ ? (float)FramePacer::ticksToSeconds(now - simLastTicks_) : 0.0f;
+    simLastTicks_ = now;
+
+    // Sample input as the first thing the frame does
+    padUpdate(&pad_);
+    u64 kDown = padGetButtonsDown(&pad_);
+    u64 held = padGetButtons(&pad_);
+
+    packet.frame = simFrame_++;
+    packet.dt = dt;
+    packet.buttonsDown = kDown;
+    packet.buttonsHeld = held;
+
+    // D-pad moves the sun, unless Y is held (Y+up/left/right are controls)
+    if (!(held & HidNpadButton_Y))
+    {
+        if (held & HidNpadButton_Up)
+            lightDir_.y += lightSpeed_ * dt;
+        if (held & HidNpadButton_Down)
+            lightDir_.y -= lightSpeed_ * dt;
+        if (held & HidNpadButton_Left)
+            lightDir_.x -= lightSpeed_ * dt;
+        if (held & HidNpadButton_Right)
+            lightDir_.x += lightSpeed_ * dt;
+    }
+
+    // Normalize so light direction stays consistent
+    lightDir_ = glm::normalize(lightDir_);
+
+    // Toggle rotation with X button (Y+X exports the scene)
+    if ((kDown & HidNpadButton_X) && !(held & HidNpadButton_Y))
+        rotateModel_ = !rotateModel_;
+
+    // Cycle culling path with L, compare GPU culling against the CPU with R (Y+L, Y+R are handled on the GL thread)
+    if ((kDown & HidNpadButton_L) && !(held & HidNpadButton_Y))
+    {
+        cullMode_ = (CullMode)((cullMode_ + 1) % CullMode_Count);
+        if (!gpuCullAvailable_) cullMode_ = CullMode_Cpu;
+        printf("Culling: %s\n", cullModeName(cullMode_));
+    }
+    packet.verifyCull = (kDown & HidNpadButton_R) && !(held & HidNpadButton_Y);
 
-    auto viewMtx = camera_.getViewMatrix();
+    // Update camera with current pad state
+    camera_.update(&pad_, dt);
 
-    glm::mat4 model{1.0f};
     if (rotateModel_)
-        model = glm::rotate(model, getTime() * glm::two_pi<float>() * 0.234375f / 2.0f, glm::vec3{0.0f, 1.0f, 0.0f});
+    {
+        // Wrap in double before narrowing so the angle stays exact in long sessions
+        double turns = getTime() * 0.234375 / 2.0;
+        for (const Spinner& spinner : spinners_)
+        {
+            double angle = std::fmod(turns + spinner.phase, 1.0) * glm::two_pi<double>();
+            scene_->setRotation(spinner.entity,
+                                glm::angleAxis((float)angle, glm::vec3{0.0f, 1.0f, 0.0f}) * spinner.base);
+        }
+    }
+    scene_->updateWorld(jobs_.get());
+
+    packet.view = camera_.getViewMatrix();
+    packet.proj = glm::perspective(45.0f * glm::two_pi<float>() / 360.0f, 1280.0f / 720.0f, 0.01f, 1000.0f);
+    packet.viewProj = packet.proj * packet.view;
+    packet.cameraPos = camera_.getPosition();
+    packet.lightDir = lightDir_;
+
+    packet.cullMode = cullMode_;
+    Frustum frustum = Frustum::fromMatrix(packet.viewProj);
+    const DrawBatchList& batches = scene_->batches();
+    packet.batches.resize(batches.size());
+    for (size_t b = 0; b < batches.size(); ++b)
+    {
+        FramePacket::Batch& out = packet.batches[b];
+        out.transformsChanged = scene_->takeBatchChanged(b);
+        if (out.transformsChanged)
+            out.transforms = scene_->batchTransforms(b);
+        if (cullMode_ == CullMode_Cpu)
+            batches[b]->cullRecords(frustum, scene_->batchTransforms(b), out.visible, jobs_.get());
+    }
+}
+
+void App::sceneUpdate(const FramePacket& packet)
+{
+    view_ = packet.view;
+    proj_ = packet.proj;
+    viewProj_ = packet.viewProj;
+    frameCullMode_ = packet.cullMode;
+
+    // The render size is picked first, the TAA jitter is a fraction of its
+    // pixels. Only drawing uses the jittered projection; culling, cascades,
+    // light tiles and reprojection work with the stable one.
+    dynamicRes_->beginFrame();
+    drawProj_ = proj_;
+    if (temporalAAActive())
+        drawProj_ = taa_->jitter(proj_, dynamicRes_->renderWidth(), dynamicRes_->renderHeight());
+
+    const DrawBatchList& batches = scene_->batches();
+    for (size_t b = 0; b < batches.size() && b < packet.batches.size(); ++b)
+    {
+        DrawBatch& batch = *batches[b];
+        const FramePacket::Batch& in = packet.batches[b];
+        if (in.transformsChanged)
+        {
+            batch.setTransforms(in.transforms);
+            batch.uploadTransforms();
+        }
+
+        if (packet.cullMode == CullMode_Cpu)
+        {
+            batch.uploadVisible(in.visible);
+        }
+        else
+        {
+            bool occlusion = packet.cullMode == CullMode_GpuOcclusion;
+            culler_->cull(batch, viewProj_, occlusion);
+            if (packet.verifyCull)
+                culler_->verify(batch, viewProj_, occlusion);
+        }
+    }
 
-    glUseProgram(program_);
-    glUniformMatrix4fv(loc_viewMtx, 1, GL_FALSE, glm::value_ptr(viewMtx));
-    glUniformMatrix4fv(loc_projMtx, 1, GL_FALSE, glm::value_ptr(projMtx));
-    glUniformMatrix4fv(loc_mdlvMtx, 1, GL_FALSE, glm::value_ptr(model));
+    if (shadows_)
+        shadows_->update(view_, proj_, packet.lightDir);
+    if (lights_)
+        lights_->cull(view_, proj_);
 
+    // Mips are picked for the resolution actually rendered
+    streamer_->update(packet.cameraPos, 0.5f * dynamicRes_->renderHeight() * proj_[1][1]);
 
-    glUniform3f(loc_cameraPos, camera_.getPosition().x, camera_.getPosition().y, camera_.getPosition().z);
+    // Every compiled variant gets the frame's uniforms, there are only a few
+    materialShaders_->forEach([&](unsigned, const Shader& shader) {
+        const MaterialUniforms& loc = materialUniforms_[&shader];
+        shader.use();
+        glUniformMatrix4fv(loc.view, 1, GL_FALSE, glm::value_ptr(view_));
+        glUniformMatrix4fv(loc.proj, 1, GL_FALSE, glm::value_ptr(drawProj_));
+
+        glUniform3f(loc.cameraPos, packet.cameraPos.x, packet.cameraPos.y, packet.cameraPos.z);
+        glUniform3f(loc.lightDir, packet.lightDir.x, packet.lightDir.y, packet.lightDir.z);
+        glUniform3f(loc.lightColor, lightColor_.x, lightColor_.y, lightColor_.z);
+        if (shadows_)
+            shadows_->setUniforms(loc.shadows);
+        if (lights_)
+            lights_->setUniforms(loc.lights);
+        if (environment_)
+            environment_->setUniforms(loc.environment);
+    });
 }
 
 void App::sceneRender()
 {
-    glClearColor(0x68 / 255.0f, 0xB0 / 255.0f, 0xD8 / 255.0f, 1.0f);
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    // The frame as a graph of passes and the textures they read and write.
+    // The graph culls what nothing ends up reading (post-processing under a
+    // debug view), inserts the clears and invalidates and times each pass.
+    bool debug = debugView_ != DebugView_None && debugViews_;
+    bool drawShadows = shadows_ && shadows_->enabled() && !debug;
+    bool prepass = !debug && prepass_->beginFrame();
 
-    shader_->use();
+    // The scene goes to an offscreen target sized by the GPU time controller
+    int renderWidth = dynamicRes_->renderWidth();
+    int renderHeight = dynamicRes_->renderHeight();
+    RenderTargetDesc sceneDesc{ dynamicRes_->width(), dynamicRes_->height(),
+                                (GLenum)(dynamicRes_->hdr() ? GL_R11F_G11F_B10F : GL_SRGB8_ALPHA8) };
 
-    GLuint baseColor = shader_->getUniformLocation("texBaseColor");
-    GLuint metallic = shader_->getUniformLocation("texMetallic");
-    GLuint roughness = shader_->getUniformLocation("texRoughness");
-    GLuint ao = shader_->getUniformLocation("texAO");
-    GLuint normal = shader_->getUniformLocation("texNormal");
+    graph_->reset();
+    RGTexture sceneColor = graph_->import("scene color", { dynamicRes_->sceneTexture(), dynamicRes_->sceneFbo(),
+        GL_COLOR_ATTACHMENT0, sceneDesc, renderWidth, renderHeight, false });
+    RGTexture sceneDepth = graph_->import("scene depth", { dynamicRes_->sceneDepthTexture(), dynamicRes_->sceneFbo(),
+        GL_DEPTH_STENCIL_ATTACHMENT, { sceneDesc.width, sceneDesc.height, GL_DEPTH24_STENCIL8 }, renderWidth,
+        renderHeight, false });
+    // Linear like every shaded value: the R11G11B10F HDR target stores it
+    // as is, and on the SRGB8_ALPHA8 target FRAMEBUFFER_SRGB encodes
+    // clears the same way it encodes fragments
+    graph_->setClearColor(sceneColor, srgbToLinear(0x68 / 255.0f), srgbToLinear(0xB0 / 255.0f),
+                          srgbToLinear(0xD8 / 255.0f), 1.0f);
 
-    model_->draw(baseColor, metallic, roughness, ao, normal);
+    // Shadow maps first, into their own target. Cascades are culled on the
+    // GPU whenever it can, whatever the camera's cull mode; their time is
+    // budgeted ahead of the scaled scene.
+    RGTexture shadowMap = kNoTexture;
+    if (drawShadows)
+    {
+        shadowMap = graph_->import("shadow map", { 0, 0, GL_NONE, {}, 0, 0, false });
+        graph_->addPass("shadows", RGPass_None,
+            [&](RenderGraph::Builder& builder) { builder.write(shadowMap, RGLoad_DontCare); },
+            [this](const RenderGraph::Context&) { shadows_->render(scene_->batches(), culler_.get()); });
+    }
+    dynamicRes_->setReservedMs(drawShadows ? shadows_->totalMs() : 0.0f);
+
+    if (prepass)
+    {
+        graph_->addPass("depth prepass", RGPass_Scaled,
+            [&](RenderGraph::Builder& builder) { builder.write(sceneDepth, RGLoad_Clear); },
+            [this](const RenderGraph::Context&) { prepass_->renderDepth(scene_->batches(), view_, drawProj_); });
+    }
+
+    graph_->addPass("scene", RGPass_Scaled,
+        [&](RenderGraph::Builder& builder) {
+            builder.read(shadowMap);
+            builder.write(sceneColor, RGLoad_Clear);
+            builder.write(sceneDepth, RGLoad_Keep);
+        },
+        [this, debug, drawShadows, renderWidth, renderHeight](const RenderGraph::Context&) {
+            if (debug)
+            {
+                debugViews_->render(debugView_, scene_->batches(), view_, proj_);
+                return;
+            }
+            if (drawShadows)
+                shadows_->bindTexture();
+            if (environment_)
+                environment_->bindTextures();
+            if (lights_)
+            {
+                // Froxel tiles follow the viewport the controller picked this frame
+                lights_->bind();
+                materialShaders_->forEach([&](unsigned, const Shader& shader) {
+                    shader.use();
+                    LightClusters::setViewport(materialUniforms_[&shader].lights, renderWidth, renderHeight);
+                });
+            }
+            prepass_->beginShading();
+            for (const auto& batch : scene_->batches())
+                batch->draw(*materialShaders_);
+            prepass_->endShading();
+        });
+
+    // Next frame's occlusion test works on this frame's depth
+    if (culler_ && frameCullMode_ == CullMode_GpuOcclusion)
+    {
+        RGTexture hiZ = graph_->import("hi-z", { 0, 0, GL_NONE, {}, 0, 0, true });
+        graph_->addPass("hi-z", RGPass_Scaled,
+            [&](RenderGraph::Builder& builder) {
+                builder.read(sceneDepth);
+                builder.write(hiZ);
+            },
+            [this, sceneDepth](const RenderGraph::Context& context) {
+                culler_->buildHiZ(context.fbo(sceneDepth), context.width(sceneDepth), context.height(sceneDepth));
+            });
+    }
+    else if (culler_)
+        culler_->invalidateHiZ();
+
+    // The TAA resolve takes the place of the scene color for everything
+    // after it. A frame without it breaks the history.
+    RGTexture resolved = sceneColor;
+    if (temporalAAActive())
+        resolved = taa_->addPass(*graph_, sceneColor, sceneDepth, viewProj_);
+    else if (taa_)
+        taa_->invalidateHistory();
+
+    // Post-processing runs at the render size too, so it counts toward the
+    // time the resolution controller sees. Debug views are shown untouched:
+    // the present reads the scene and the chain gets culled.
+    RGTexture output = resolved;
+    if (post_ && post_->enabled())
+        output = post_->addPasses(*graph_, resolved, renderWidth, renderHeight, resolved != sceneColor);
+    if (debug)
+        output = sceneColor;
+
+    // A post chain that couldn't get its targets shows the scene as it is
+    // rather than a black frame
+    RGTexture window = graph_->import("window", { 0, 0, GL_NONE, {}, 0, 0, true });
+    graph_->addPass("present", RGPass_None,
+        [&](RenderGraph::Builder& builder) {
+            builder.read(output, output != resolved ? resolved : kNoTexture);
+            builder.write(window, RGLoad_DontCare);
+        },
+        [this, output](const RenderGraph::Context& context) { dynamicRes_->present(context.texture(output)); });
+
+    graph_->compile();
+    graph_->execute();
+    dynamicRes_->updateScale(graph_->scaledMs());
 }
 
-void App::sceneExit()
+bool App::temporalAAActive() const
 {
-    if (program_)
+    return taa_ && taa_->enabled() && !(debugView_ != DebugView_None && debugViews_);
+}
+
+void App::setPostQuality(PostQuality quality)
+{
+    if (!post_)
+        quality = PostQuality_Off;
+    else
+        post_->setQuality(quality);
+    if (!dynamicRes_->setHdr(quality != PostQuality_Off) && post_)
     {
-        glDeleteProgram(program_);
-        program_ = 0;
+        printf("HDR scene target unavailable\n");
+        post_->setQuality(PostQuality_Off);
+        dynamicRes_->setHdr(false);
     }
 }
 
+void App::runLightBenchmark()
+{
+    if (!lights_)
+    {
+        printf("Light benchmark: clustered lights unavailable\n");
+        return;
+    }
+
+    static const size_t kCounts[] = { 0, 16, 64, 256, 1024 };
+    static const int kFrames = 20;
+    static const float kSpacing = 3.0f;   // spread layout: one light per 3x3 m
+    static const float kDenseSize = 12.0f; // dense layout: all lights in a 12x12 m square
+    static const float kRadius = 4.0f;
+
+    // Fixed resolution, the controller would adapt to the load being measured
+    bool dynamicRes = dynamicRes_->enabled();
+    dynamicRes_->setEnabled(false);
+
+    // Lights go on a horizontal grid just below eye level, in front of the camera
+    glm::mat4 camera = glm::inverse(view_);
+    glm::vec3 eye(camera[3]);
+    glm::vec3 forward = -glm::vec3(camera[2]);
+    forward.y = 0.0f;
+    forward = glm::length(forward) > 1e-3f ? glm::normalize(forward) : glm::vec3(0.0f, 0.0f, -1.0f);
+    glm::vec3 right(-forward.z, 0.0f, forward.x);
+    glm::vec3 origin = eye - glm::vec3(0.0f, 1.0f, 0.0f) + forward * 2.0f;
+
+    GLuint queries[3];
+    glGenQueries(3, queries);
+
+    printf("Light benchmark (%dx%d, %d frames each):\n", dynamicRes_->renderWidth(), dynamicRes_->renderHeight(),
+           kFrames);
+    printf("  lights layout  cull ms  scene ms  avg/froxel  max  overflowed\n");
+    for (int dense = 0; dense < 2; ++dense)
+    {
+        for (size_t count : kCounts)
+        {
+            int side = (int)std::ceil(std::sqrt((float)count));
+            float spacing = dense && side > 1 ? kDenseSize / (float)(side - 1) : kSpacing;
+            std::vector<LightGPU> lights;
+            for (size_t i = 0; i < count; ++i)
+            {
+                float x = ((float)(i % side) - 0.5f * (float)(side - 1)) * spacing;
+                float z = (float)(i / side) * spacing;
+                glm::vec3 position = origin + right * x + forward * z;
+                glm::vec3 color(0.5f + 0.5f * std::sin((float)i), 0.5f + 0.5f * std::sin((float)i + 2.1f),
+                                0.5f + 0.5f * std::sin((float)i + 4.2f));
+                if (i % 4 == 3)
+                    lights.push_back(makeSpotLight(position, color * 4.0f, kRadius, glm::vec3(0.0f, -1.0f, 0.0f),
+                                                   glm::radians(30.0f), glm::radians(40.0f)));
+                else
+                    lights.push_back(makePointLight(position, color * 2.0f, kRadius));
+            }
+            lights_->setLights(lights);
+
+            double cullMs = 0.0;
+            double sceneMs = 0.0;
+            for (int frame = 0; frame < kFrames; ++frame)
+            {
+                glQueryCounter(queries[0], GL_TIMESTAMP);
+                lights_->cull(view_, proj_);
+                glQueryCounter(queries[1], GL_TIMESTAMP);
+                materialShaders_->forEach([&](unsigned, const Shader& shader) {
+                    shader.use();
+                    lights_->setUniforms(materialUniforms_[&shader].lights);
+                });
+                sceneRender();
+                glQueryCounter(queries[2], GL_TIMESTAMP);
+
+                // Blocks until the frame is done, fine for a benchmark
+                GLuint64 t[3];
+                for (int q = 0; q < 3; ++q)
+                    glGetQueryObjectui64v(queries[q], GL_QUERY_RESULT, &t[q]);
+                cullMs += (double)(t[1] - t[0]) / 1e6;
+                sceneMs += (double)(t[2] - t[1]) / 1e6;
+            }
+
+            float average = 0.0f;
+            unsigned maximum = 0;
+            unsigned overflowed = 0;
+            lights_->readStats(average, maximum, overflowed);
+            printf("  %6zu %-6s %8.3f %9.3f %11.1f %4u %11u\n", count, dense ? "dense" : "spread",
+                   cullMs / kFrames, sceneMs / kFrames, average, maximum, overflowed);
+        }
+    }
+
+    glDeleteQueries(3, queries);
+    lights_->setLights(sceneLights_);
+    dynamicRes_->setEnabled(dynamicRes);
+}
+
+void App::runTemporalAABenchmark(const FramePacket& current)
+{
+    if (!taa_)
+    {
+        printf("TAA benchmark: temporal AA unavailable\n");
+        return;
+    }
+
+    static const float kPanDegrees[] = { 0.0f, 0.25f, 1.0f, 4.0f }; // camera yaw per frame
+    static const int kFrames = 30;
+
+    // Fixed resolution, so both runs of a speed draw the same pixels
+    bool dynamicRes = dynamicRes_->enabled();
+    dynamicRes_->setEnabled(false);
+    bool taaEnabled = taa_->enabled();
+
+    // This frame's packet with the camera turned in place every frame.
+    // Transforms are already uploaded; CPU cull results would be for the
+    // original view, so those cull on the GPU when it can.
+    FramePacket packet = current;
+    packet.verifyCull = false;
+    for (FramePacket::Batch& batch : packet.batches)
+        batch.transformsChanged = false;
+    if (packet.cullMode == CullMode_Cpu && gpuCullAvailable_)
+        packet.cullMode = CullMode_Gpu;
+    glm::mat4 baseView = current.view;
+    glm::vec3 eye = current.cameraPos;
+
+    GLuint queries[2];
+    glGenQueries(2, queries);
+
+    printf("TAA benchmark (%dx%d, %d frames each):\n", dynamicRes_->renderWidth(), dynamicRes_->renderHeight(),
+           kFrames);
+    printf("  deg/frame  TAA  frame ms  resolve ms  lag %%  clamped %%\n");
+    for (float pan : kPanDegrees)
+    {
+        for (int taa = 0; taa < 2; ++taa)
+        {
+            taa_->setEnabled(taa != 0);
+            taa_->invalidateHistory();
+
+            // The last frame is counted, atomics and all, so it isn't timed
+            double frameMs = 0.0;
+            double resolveMs = 0.0;
+            int resolves = 0;
+            float lag = 0.0f;
+            float clamped = 0.0f;
+            bool measured = false;
+            for (int frame = 0; frame < kFrames; ++frame)
+            {
+                float angle = glm::radians(pan) * (float)frame;
+                packet.view = baseView * glm::translate(glm::mat4(1.0f), eye) *
+                              glm::rotate(glm::mat4(1.0f), -angle, glm::vec3(0.0f, 1.0f, 0.0f)) *
+                              glm::translate(glm::mat4(1.0f), -eye);
+                packet.viewProj = packet.proj * packet.view;
+
+                bool measure = taa && frame == kFrames - 1;
+                if (measure)
+                    taa_->beginMeasure();
+                else
+                    taa_->timeNextResolve();
+                sceneUpdate(packet);
+                glQueryCounter(queries[0], GL_TIMESTAMP);
+                sceneRender();
+                glQueryCounter(queries[1], GL_TIMESTAMP);
+                if (measure)
+                {
+                    measured = taa_->endMeasure(lag, clamped);
+                    continue;
+                }
+
+                // Blocks until the frame is done, fine for a benchmark
+                GLuint64 t[2];
+                for (int q = 0; q < 2; ++q)
+                    glGetQueryObjectui64v(queries[q], GL_QUERY_RESULT, &t[q]);
+                frameMs += (double)(t[1] - t[0]) / 1e6;
+                double ms = taa_->resolveMs();
+                if (ms >= 0.0)
+                {
+                    resolveMs += ms;
+                    resolves++;
+                }
+            }
+
+            int timed = taa ? kFrames - 1 : kFrames;
+            if (measured && resolves)
+                printf("  %9.2f  on  %8.3f %11.3f %6.1f %10.1f\n", pan, frameMs / timed, resolveMs / resolves,
+                       lag * 100.0f, clamped * 100.0f);
+            else
+                printf("  %9.2f  %-3s %8.3f %11s %6s %10s\n", pan, taa ? "on" : "off", frameMs / timed, "-", "-",
+                       "-");
+        }
+    }
+
+    glDeleteQueries(2, queries);
+    taa_->setEnabled(taaEnabled);
+    taa_->invalidateHistory();
+    dynamicRes_->setEnabled(dynamicRes);
+}
+
+void App::sceneExit()
+{
+    // The simulation thread reads the batch, stop it first
+    pipeline_.reset();
+    jobs_.reset();
+    streamer_.reset();
+    scene_.reset();
+    post_.reset();
+    taa_.reset();
+    graph_.reset();
+    shadows_.reset();
+    lights_.reset();
+    environment_.reset();
+    culler_.reset();
+    prepass_.reset();
+    debugViews_.reset();
+    dynamicRes_.reset();
+    materialShaders_.reset();
+    materialUniforms_.clear();
+}
+
 void App::shutdown()
 {
     sceneExit();
     deinitEgl();
 }
 
-void App::run()
+void App::startPipeline()
 {
-    // pad_ was initialized in init()
-    float lastTime = getTime();
+    pipeline_->stop();
 
-    while (appletMainLoop())
+    // Packets still in flight were dropped, resend every batch's transforms
+    scene_->markAllChanged();
+    if (pipelineLatency_ > 0 &&
+        !pipeline_->start(pipelineLatency_, [this](FramePacket& packet) { simulate(packet); }, kSimulationCore))
+        pipelineLatency_ = 0;
+    if (pipelineLatency_ == 0)
+        printf("Frame pipeline: serial\n");
+}
+
+void App::pollShaderReload()
+{
+    if (++shaderPollFrames_ >= kShaderPollInterval)
     {
-        // Update pad
-        padUpdate(&pad_);
-        u32 kDown = padGetButtonsDown(&pad_);
-        if (kDown & HidNpadButton_Plus)
-            break;
+        shaderPollFrames_ = 0;
+        if (Shader::reloadChanged() > 0)
+        {
+            shaderCompareBeforeMs_ = dynamicRes_->gpuMs();
+            shaderCompareBeforeWidth_ = dynamicRes_->renderWidth();
+            shaderCompareBeforeHeight_ = dynamicRes_->renderHeight();
+            shaderCompareFrames_ = kShaderCompareFrames;
+        }
+    }
 
-       
-        // Time
-        float now = getTime();
-        float dt = now - lastTime;
-        if (dt < 0.0f) dt = 0.0f;
-        lastTime = now;
+    // Dynamic resolution keeps running, so the render size goes with each
+    // time: the two are only like-for-like when the sizes match
+    if (shaderCompareFrames_ > 0 && --shaderCompareFrames_ == 0)
+    {
+        printf("Shader reload: scene GPU time %.2f ms at %dx%d -> %.2f ms at %dx%d\n", shaderCompareBeforeMs_,
+               shaderCompareBeforeWidth_, shaderCompareBeforeHeight_, dynamicRes_->gpuMs(),
+               dynamicRes_->renderWidth(), dynamicRes_->renderHeight());
+    }
+}
 
-         if (padGetButtons(&pad_) & HidNpadButton_Up)
-            lightDir_.y += lightSpeed_ * dt;
-        if (padGetButtons(&pad_) & HidNpadButton_Down)
-            lightDir_.y -= lightSpeed_ * dt;
-        if (padGetButtons(&pad_) & HidNpadButton_Left)
-            lightDir_.x -= lightSpeed_ * dt;
-        if (padGetButtons(&pad_) & HidNpadButton_Right)
-            lightDir_.x += lightSpeed_ * dt;
+bool App::applyControls(const FramePacket& packet)
+{
+    u64 kDown = packet.buttonsDown;
+    if (kDown & HidNpadButton_Plus)
+        return false;
+
+    // Cycle depth pre-pass off / on / auto with B
+    if ((kDown & HidNpadButton_B) && !(packet.buttonsHeld & HidNpadButton_Y))
+    {
+        prepass_->setMode((PrepassMode)((prepass_->mode() + 1) % PrepassMode_Count));
+        printf("Depth pre-pass: %s\n", prepassModeName(prepass_->mode()));
+    }
+
+    // Cycle debug render modes with Minus
+    if ((kDown & HidNpadButton_Minus) && !(packet.buttonsHeld & HidNpadButton_Y))
+    {
+        debugView_ = (DebugView)((debugView_ + 1) % DebugView_Count);
+        printf("Debug view: %s\n", debugViewName(debugView_));
+    }
+
+    // Dynamic resolution on/off with the left stick click, 30/60 FPS target with the right one
+    if ((kDown & HidNpadButton_StickL) && !(packet.buttonsHeld & HidNpadButton_Y))
+    {
+        dynamicRes_->setEnabled(!dynamicRes_->enabled());
+        printf("Dynamic resolution: %s\n", dynamicRes_->enabled() ? "on" : "off");
+    }
+    if ((kDown & HidNpadButton_StickR) && !(packet.buttonsHeld & HidNpadButton_Y))
+    {
+        dynamicRes_->setTargetFps(dynamicRes_->targetFps() == 30 ? 60 : 30);
+        printf("Dynamic resolution target: %d FPS\n", dynamicRes_->targetFps());
+    }
+
+    // Cycle frame pacing with A (Y+A is the camera reset)
+    if ((kDown & HidNpadButton_A) && !(packet.buttonsHeld & HidNpadButton_Y))
+    {
+        pacer_.setMode((PacingMode)((pacer_.mode() + 1) % PacingMode_Count));
+        if (pacer_.targetFps())
+            dynamicRes_->setTargetFps(pacer_.targetFps());
+        printf("Frame pacing: %s\n", pacingModeName(pacer_.mode()));
+    }
+
+    // Final sRGB encode by the sRGB surface or in the upscale shader with
+    // Y+left stick click, to compare the cost of the two
+    if ((kDown & HidNpadButton_StickL) && (packet.buttonsHeld & HidNpadButton_Y))
+    {
+        if (srgbSurface_)
+        {
+            printf("sRGB encode: %s took %.3f ms\n", dynamicRes_->shaderEncode() ? "shader" : "surface",
+                   dynamicRes_->presentMs());
+            dynamicRes_->setShaderEncode(!dynamicRes_->shaderEncode());
+            printf("sRGB encode: %s\n", dynamicRes_->shaderEncode() ? "shader" : "surface");
+        }
+        else
+        {
+            printf("sRGB encode: shader only, no sRGB window surface\n");
+        }
+    }
+
+    // Shadows on/off with Y+right stick click, printing the cascade timings
+    if ((kDown & HidNpadButton_StickR) && (packet.buttonsHeld & HidNpadButton_Y) && shadows_)
+    {
+        shadows_->printTimings();
+        shadows_->setEnabled(!shadows_->enabled());
+        printf("Shadows: %s\n", shadows_->enabled() ? "on" : "off");
+    }
+
+    // Cycle post-processing presets with Y+right, printing the frame's
+    // passes with their timings and memory
+    if ((kDown & HidNpadButton_Right) && (packet.buttonsHeld & HidNpadButton_Y) && post_)
+    {
+        graph_->printReport();
+        setPostQuality((PostQuality)((post_->quality() + 1) % PostQuality_Count));
+        printf("Post-processing: %s\n", postQualityName(post_->quality()));
+    }
+
+    // Temporal AA on/off with Y+up (FXAA takes over when off), its
+    // benchmark with Y+left
+    if ((kDown & HidNpadButton_Up) && (packet.buttonsHeld & HidNpadButton_Y) && taa_)
+    {
+        taa_->setEnabled(!taa_->enabled());
+        printf("Temporal AA: %s\n", taa_->enabled() ? "on" : "off");
+    }
+    if ((kDown & HidNpadButton_Left) && (packet.buttonsHeld & HidNpadButton_Y))
+        runTemporalAABenchmark(packet);
+
+    // Ambient (image-based) light on/off with Y+ZR
+    if ((kDown & HidNpadButton_ZR) && (packet.buttonsHeld & HidNpadButton_Y) && environment_)
+    {
+        environment_->setEnabled(!environment_->enabled());
+        printf("Ambient light: %s\n", environment_->enabled() ? "on" : "off");
+    }
+
+    // Cycle pipeline latency 0 (serial) / 1 / 2 frames with Y+L, applied after this frame
+    if ((kDown & HidNpadButton_L) && (packet.buttonsHeld & HidNpadButton_Y))
+        pipelineLatency_ = (pipelineLatency_ + 1) % (kMaxPipelineLatency + 1);
+
+    // Next scene file with Y+B, binary export of the current one with Y+X,
+    // both applied after this frame
+    if ((kDown & HidNpadButton_B) && (packet.buttonsHeld & HidNpadButton_Y))
+        nextScene_ = true;
+    if ((kDown & HidNpadButton_X) && (packet.buttonsHeld & HidNpadButton_Y))
+        exportScene();
 
-        // Normalize so light direction stays consistent
-        lightDir_ = glm::normalize(lightDir_);
+    // Clustered lighting sweep with Y+ZL
+    if ((kDown & HidNpadButton_ZL) && (packet.buttonsHeld & HidNpadButton_Y))
+        runLightBenchmark();
 
-        // Upload to shader
-        glUseProgram(program_);
-        glUniform3f(loc_lightDir, lightDir_.x, lightDir_.y, lightDir_.z);
+    // Job system microbenchmarks with Y+R, image decode benchmark with Y+Minus
+    if ((kDown & HidNpadButton_R) && (packet.buttonsHeld & HidNpadButton_Y))
+        runJobBenchmarks();
+    if ((kDown & HidNpadButton_Minus) && (packet.buttonsHeld & HidNpadButton_Y))
+        runDecodeBenchmarks(jobs_.get());
 
-                // Toggle rotation with X button
-        if (kDown & HidNpadButton_X)
-            rotateModel_ = !rotateModel_;
+    return true;
+}
+
+void App::run()
+{
+    // pad_ was initialized in init()
+    startPipeline();
+
+    while (appletMainLoop())
+    {
+        // Limiter first so the simulation samples input right before it is used
+        pacer_.waitForNextFrame();
+        pacer_.beginFrame();
+
+        // Pipelined: frame N was simulated on the worker, which is already
+        // busy with N+1. Serial: simulate now, on this thread.
+        const FramePacket* packet = &serialPacket_;
+        if (pipeline_->running())
+            packet = &pipeline_->acquire();
+        else
+            simulate(serialPacket_);
 
+        bool keepRunning = applyControls(*packet);
+        if (keepRunning)
+        {
+            sceneUpdate(*packet);
+            sceneRender();
+        }
 
-        // Update camera with current pad state
-        camera_.update(&pad_, dt);
+        if (pipeline_->running())
+            pipeline_->release();
+        if (!keepRunning)
+            break;
 
-        // Update scene (model + upload model-view matrix)
-        sceneUpdate();
+        pacer_.present();
+        pollShaderReload();
 
-        // Render
-        sceneRender();
-        eglSwapBuffers(s_display_, s_surface_);
+        if (nextScene_ && !sceneFiles_.empty())
+        {
+            nextScene_ = false;
+            pipeline_->stop();
+            size_t previous = sceneIndex_;
+            sceneIndex_ = (sceneIndex_ + 1) % sceneFiles_.size();
+            if (!loadScene(sceneFiles_[sceneIndex_]))
+                sceneIndex_ = previous;
+            startPipeline();
+        }
+        if (pipelineLatency_ != pipeline_->latency())
+            startPipeline();
     }
+
+    pipeline_->stop();
 }
@@ -0,0 +1,293 @@
+#include "Culling.h"
+#include "DrawBatch.h"
+#include <glm/gtc/type_ptr.hpp>
+#include <switch.h>
+#include <cmath>
+#include <cstdio>
+#include <vector>
+
+Frustum Frustum::fromMatrix(const glm::mat4& m)
+{
+    // Gribb/Hartmann plane extraction, glm is column major so row i is m[.][i]
+    glm::vec4 row0(m[0][0], m[1][0], m[2][0], m[3][0]);
+    glm::vec4 row1(m[0][1], m[1][1], m[2][1], m[3][1]);
+    glm::vec4 row2(m[0][2], m[1][2], m[2][2], m[3][2]);
+    glm::vec4 row3(m[0][3], m[1][3], m[2][3], m[3][3]);
+
+    Frustum f;
+    f.planes[0] = row3 + row0; // left
+    f.planes[1] = row3 - row0; // right
+    f.planes[2] = row3 + row1; // bottom
+    f.planes[3] = row3 - row1; // top
+    f.planes[4] = row3 + row2; // near
+    f.planes[5] = row3 - row2; // far
+    for (auto& p : f.planes)
+        p = p / glm::length(glm::vec3(p));
+    return f;
+}
+
+bool Frustum::intersectsAabb(const glm::vec3& center, const glm::vec3& extents) const
+{
+    for (const auto& p : planes)
+    {
+        glm::vec3 n(p);
+        float d = glm::dot(n, center) + p.w;
+        float r = glm::dot(glm::abs(n), extents);
+        if (d + r < 0.0f)
+            return false;
+    }
+    return true;
+}
+
+void transformAabb(const glm::mat4& m, const float bmin[3], const float bmax[3],
+                   glm::vec3& center, glm::vec3& extents)
+{
+    glm::vec3 c((bmin[0] + bmax[0]) * 0.5f, (bmin[1] + bmax[1]) * 0.5f, (bmin[2] + bmax[2]) * 0.5f);
+    glm::vec3 e((bmax[0] - bmin[0]) * 0.5f, (bmax[1] - bmin[1]) * 0.5f, (bmax[2] - bmin[2]) * 0.5f);
+
+    center = glm::vec3(m * glm::vec4(c, 1.0f));
+    extents = glm::abs(glm::vec3(m[0])) * e.x + glm::abs(glm::vec3(m[1])) * e.y + glm::abs(glm::vec3(m[2])) * e.z;
+}
+
+const char* cullModeName(CullMode mode)
+{
+    switch (mode)
+    {
+    case CullMode_Cpu:          return "CPU frustum";
+    case CullMode_Gpu:          return "GPU frustum";
+    case CullMode_GpuOcclusion: return "GPU frustum + Hi-Z";
+    default:                    return "?";
+    }
+}
+
+GpuCuller::~GpuCuller()
+{
+    if (depthFbo_) glDeleteFramebuffers(1, &depthFbo_);
+    if (depthTex_) glDeleteTextures(1, &depthTex_);
+    if (hizTex_) glDeleteTextures(1, &hizTex_);
+    if (counterSsbo_) glDeleteBuffers(1, &counterSsbo_);
+}
+
+bool GpuCuller::init(int width, int height)
+{
+    width_ = width;
+    height_ = height;
+
+    // Locations are looked up again whenever a shader is hot reloaded
+    cullShader_ = std::make_unique<Shader>();
+    cullShader_->setOnLink([this](const Shader& shader) {
+        loc_viewProj = shader.getUniformLocation("uViewProj");
+        loc_planes = shader.getUniformLocation("uPlanes");
+        loc_recordCount = shader.getUniformLocation("uRecordCount");
+        loc_groupFirst = shader.getUniformLocation("uGroupFirst");
+        loc_occlusion = shader.getUniformLocation("uOcclusion");
+        loc_hizSize = shader.getUniformLocation("uHiZSize");
+        loc_hizLevels = shader.getUniformLocation("uHiZLevels");
+        glUniform1i(shader.getUniformLocation("uHiZ"), Slot_Count);
+    });
+    if (!cullShader_->loadComputeFromFile("romfs:/shaders/cull.comp"))
+    {
+        printf("Failed to load cull compute shader\n");
+        return false;
+    }
+    hizShader_ = std::make_unique<Shader>();
+    hizShader_->setOnLink([this](const Shader& shader) {
+        loc_srcIsDepth = shader.getUniformLocation("uSrcIsDepth");
+        loc_srcSize = shader.getUniformLocation("uSrcSize");
+        loc_dstSize = shader.getUniformLocation("uDstSize");
+        glUniform1i(shader.getUniformLocation("uDepth"), Slot_Count);
+    });
+    if (!hizShader_->loadComputeFromFile("romfs:/shaders/hiz.comp"))
+    {
+        printf("Failed to load Hi-Z compute shader\n");
+        return false;
+    }
+
+    // Depth copy target, same format as the EGL surface so it can be blitted
+    glGenTextures(1, &depthTex_);
+    glBindTexture(GL_TEXTURE_2D, depthTex_);
+    glTexStorage2D(GL_TEXTURE_2D, 1, GL_DEPTH24_STENCIL8, width_, height_);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+    glGenFramebuffers(1, &depthFbo_);
+    glBindFramebuffer(GL_FRAMEBUFFER, depthFbo_);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_TEXTURE_2D, depthTex_, 0);
+    GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    if (status != GL_FRAMEBUFFER_COMPLETE)
+    {
+        printf("Hi-Z depth framebuffer incomplete: 0x%x\n", status);
+        return false;
+    }
+
+    hizWidth_ = width_ / 2 > 0 ? width_ / 2 : 1;
+    hizHeight_ = height_ / 2 > 0 ? height_ / 2 : 1;
+    hizLevels_ = 1;
+    for (int s = (hizWidth_ > hizHeight_ ? hizWidth_ : hizHeight_); s > 1; s >>= 1) ++hizLevels_;
+
+    glGenTextures(1, &hizTex_);
+    glBindTexture(GL_TEXTURE_2D, hizTex_);
+    glTexStorage2D(GL_TEXTURE_2D, hizLevels_, GL_R32F, hizWidth_, hizHeight_);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    glGenBuffers(1, &counterSsbo_);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, counterSsbo_);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, kMaxDrawGroups * sizeof(GLuint), nullptr, GL_DYNAMIC_READ);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+    return true;
+}
+
+void GpuCuller::cull(DrawBatch& batch, const glm::mat4& viewProj, bool occlusion)
+{
+    if (batch.recordCount() == 0) return;
+
+    dispatch(batch, viewProj, occlusion && hizValid_, batch.indirectBuffer());
+    batch.setGpuCulled();
+}
+
+void GpuCuller::cull(const DrawBatch& batch, const glm::mat4& viewProj, GLuint outBuffer)
+{
+    if (batch.recordCount() == 0) return;
+
+    // The Hi-Z pyramid is of the camera view, no use for another one
+    dispatch(batch, viewProj, false, outBuffer);
+}
+
+void GpuCuller::dispatch(const DrawBatch& batch, const glm::mat4& viewProj, bool useHiZ, GLuint outBuffer)
+{
+    GLuint recordCount = (GLuint)batch.recordCount();
+
+    // Culled commands must end up with instanceCount = 0
+    GLuint zero = 0;
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, outBuffer);
+    glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, &zero);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, counterSsbo_);
+    glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, &zero);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+    Frustum frustum = Frustum::fromMatrix(viewProj);
+
+    cullShader_->use();
+    glUniformMatrix4fv(loc_viewProj, 1, GL_FALSE, glm::value_ptr(viewProj));
+    glUniform4fv(loc_planes, 6, glm::value_ptr(frustum.planes[0]));
+    glUniform1ui(loc_recordCount, recordCount);
+
+    // Each group compacts into its own range, so it can be drawn with its
+    // own shader variant
+    GLuint groupFirst[kMaxDrawGroups] = {};
+    for (size_t g = 0; g < batch.groups().size() && g < (size_t)kMaxDrawGroups; ++g)
+        groupFirst[g] = batch.groups()[g].firstRecord;
+    glUniform1uiv(loc_groupFirst, kMaxDrawGroups, groupFirst);
+    glUniform1i(loc_occlusion, useHiZ ? 1 : 0);
+    glUniform2f(loc_hizSize, (float)hizWidth_, (float)hizHeight_);
+    glUniform1i(loc_hizLevels, hizLevels_);
+
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, batch.recordBuffer());
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, batch.transformBuffer());
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, batch.model().boundsBuffer());
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, batch.sourceCommandBuffer());
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 5, outBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 6, counterSsbo_);
+
+    // Hi-Z goes on the unit after the material texture arrays
+    glActiveTexture(GL_TEXTURE0 + Slot_Count);
+    glBindTexture(GL_TEXTURE_2D, hizTex_);
+
+    glDispatchCompute((recordCount + 63) / 64, 1, 1);
+    glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT);
+}
+
+void GpuCuller::buildHiZ(GLuint srcFbo, int srcWidth, int srcHeight)
+{
+    GLint prevFbo = 0;
+    glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &prevFbo);
+
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, srcFbo);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, depthFbo_);
+    glBlitFramebuffer(0, 0, srcWidth, srcHeight, 0, 0, width_, height_, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+    glBindFramebuffer(GL_FRAMEBUFFER, (GLuint)prevFbo);
+
+    hizShader_->use();
+    glActiveTexture(GL_TEXTURE0 + Slot_Count);
+    glBindTexture(GL_TEXTURE_2D, depthTex_);
+
+    int srcW = width_, srcH = height_;
+    for (int level = 0; level < hizLevels_; ++level)
+    {
+        int dstW = srcW / 2 > 0 ? srcW / 2 : 1;
+        int dstH = srcH / 2 > 0 ? srcH / 2 : 1;
+
+        glUniform1i(loc_srcIsDepth, level == 0 ? 1 : 0);
+        glUniform2i(loc_srcSize, srcW, srcH);
+        glUniform2i(loc_dstSize, dstW, dstH);
+        if (level > 0)
+            glBindImageTexture(0, hizTex_, level - 1, GL_FALSE, 0, GL_READ_ONLY, GL_R32F);
+        glBindImageTexture(1, hizTex_, level, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+
+        glDispatchCompute((dstW + 7) / 8, (dstH + 7) / 8, 1);
+        glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT | GL_TEXTURE_FETCH_BARRIER_BIT);
+
+        srcW = dstW;
+        srcH = dstH;
+    }
+    hizValid_ = true;
+}
+
+size_t GpuCuller::verify(const DrawBatch& batch, const glm::mat4& viewProj, bool occlusion)
+{
+    size_t recordCount = batch.recordCount();
+
+    GLuint groupCounts[kMaxDrawGroups] = {};
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, counterSsbo_);
+    glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(groupCounts), groupCounts);
+    GLuint visibleCount = 0;
+    for (size_t g = 0; g < batch.groups().size() && g < (size_t)kMaxDrawGroups; ++g)
+        visibleCount += groupCounts[g];
+
+    std::vector<DrawElementsIndirectCommand> gpuCommands(recordCount);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, batch.indirectBuffer());
+    glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, recordCount * sizeof(DrawElementsIndirectCommand), gpuCommands.data());
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+    // Visible commands sit at the start of their group's range
+    std::vector<bool> gpuVisible(recordCount, false);
+    for (size_t g = 0; g < batch.groups().size() && g < (size_t)kMaxDrawGroups; ++g)
+    {
+        const DrawGroup& group = batch.groups()[g];
+        for (GLuint i = group.firstRecord; i < group.firstRecord + groupCounts[g] && i < recordCount; ++i)
+        {
+            if (gpuCommands[i].instanceCount > 0 && gpuCommands[i].baseInstance < recordCount)
+                gpuVisible[gpuCommands[i].baseInstance] = true;
+        }
+    }
+
+    Frustum frustum = Frustum::fromMatrix(viewProj);
+    std::vector<bool> cpuVisible(recordCount, false);
+    u64 start = armGetSystemTick();
+    for (size_t i = 0; i < recordCount; ++i)
+        cpuVisible[i] = batch.recordVisible(i, frustum);
+    u64 cpuNs = armTicksToNs(armGetSystemTick() - start);
+
+    size_t cpuCount = 0, extra = 0, missing = 0;
+    for (size_t i = 0; i < recordCount; ++i)
+    {
+        if (cpuVisible[i]) ++cpuCount;
+        if (gpuVisible[i] && !cpuVisible[i]) ++extra;
+        if (!gpuVisible[i] && cpuVisible[i]) ++missing;
+    }
+
+    // Without occlusion both paths must agree exactly; with it the GPU may
+    // only drop records the CPU frustum test kept.
+    size_t errors = extra + (occlusion ? 0 : missing);
+    printf("Cull verify (%s): records %zu, GPU visible %u, CPU visible %zu, extra %zu, %s %zu -> %s\n",
+           occlusion ? "occlusion" : "frustum", recordCount, visibleCount, cpuCount, extra,
+           occlusion ? "occluded" : "missing", missing, errors == 0 ? "OK" : "MISMATCH");
+    printf("Cull verify: CPU reference took %.1f us for %zu records\n", cpuNs / 1000.0, recordCount);
+    return errors;
+}
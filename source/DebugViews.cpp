@@ -0,0 +1,167 @@
+#include "DebugViews.h"
+#include "DrawBatch.h"
+#include <glm/gtc/type_ptr.hpp>
+#include <cstdio>
+
+// Heat ramp ends at this many shaded fragments per pixel
+static const float kOverdrawMax = 8.0f;
+
+const char* debugViewName(DebugView view)
+{
+    switch (view)
+    {
+    case DebugView_None:            return "off";
+    case DebugView_Overdraw:        return "overdraw";
+    case DebugView_TriangleDensity: return "triangle density";
+    case DebugView_ShaderCost:      return "shader cost";
+    case DebugView_MipLevel:        return "mip level";
+    default:                        return "?";
+    }
+}
+
+DebugViews::~DebugViews()
+{
+    if (counterFbo_) glDeleteFramebuffers(1, &counterFbo_);
+    if (counterTex_) glDeleteTextures(1, &counterTex_);
+    if (counterDepth_) glDeleteTextures(1, &counterDepth_);
+    if (emptyVao_) glDeleteVertexArrays(1, &emptyVao_);
+}
+
+bool DebugViews::init(int width, int height)
+{
+    width_ = width;
+    height_ = height;
+
+    auto load = [](std::unique_ptr<Shader>& shader, const char* vert, const char* frag, const char* geom,
+                   std::function<void(const Shader&)> onLink = nullptr) {
+        shader = std::make_unique<Shader>();
+        shader->setOnLink(std::move(onLink));
+        if (!shader->loadFromFiles(vert, frag, geom ? geom : ""))
+        {
+            printf("Failed to load debug view shader %s\n", frag);
+            return false;
+        }
+        return true;
+    };
+    if (!load(overdrawShader_, "romfs:/shaders/vertex.glsl", "romfs:/shaders/debug_overdraw_fragment.glsl", nullptr) ||
+        !load(densityShader_, "romfs:/shaders/vertex.glsl", "romfs:/shaders/debug_density_fragment.glsl",
+              "romfs:/shaders/debug_density_geometry.glsl") ||
+        !load(costShader_, "romfs:/shaders/vertex.glsl", "romfs:/shaders/debug_cost_fragment.glsl", nullptr) ||
+        !load(mipShader_, "romfs:/shaders/vertex.glsl", "romfs:/shaders/debug_mip_fragment.glsl", nullptr,
+              [](const Shader& shader) {
+                  glUniform1i(shader.getUniformLocation("texBaseColor"), Slot_BaseColor);
+              }) ||
+        !load(heatmapShader_, "romfs:/shaders/fullscreen_vertex.glsl", "romfs:/shaders/debug_heatmap_fragment.glsl", nullptr))
+        return false;
+
+    glGenTextures(1, &counterTex_);
+    glBindTexture(GL_TEXTURE_2D, counterTex_);
+    glTexStorage2D(GL_TEXTURE_2D, 1, GL_R16F, width_, height_);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+    glGenTextures(1, &counterDepth_);
+    glBindTexture(GL_TEXTURE_2D, counterDepth_);
+    glTexStorage2D(GL_TEXTURE_2D, 1, GL_DEPTH_COMPONENT24, width_, height_);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    glGenFramebuffers(1, &counterFbo_);
+    glBindFramebuffer(GL_FRAMEBUFFER, counterFbo_);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, counterTex_, 0);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, counterDepth_, 0);
+    GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    if (status != GL_FRAMEBUFFER_COMPLETE)
+    {
+        printf("Debug counter framebuffer incomplete: 0x%x\n", status);
+        return false;
+    }
+
+    glGenVertexArrays(1, &emptyVao_);
+    return true;
+}
+
+void DebugViews::setMatrices(const Shader& shader, const glm::mat4& viewMtx, const glm::mat4& projMtx) const
+{
+    shader.use();
+    glUniformMatrix4fv(shader.getUniformLocation("uView"), 1, GL_FALSE, glm::value_ptr(viewMtx));
+    glUniformMatrix4fv(shader.getUniformLocation("uProj"), 1, GL_FALSE, glm::value_ptr(projMtx));
+}
+
+void DebugViews::renderCounter(const Shader& shader, const DrawBatchList& batches, const glm::mat4& viewMtx,
+                               const glm::mat4& projMtx, float maxValue)
+{
+    GLint prevFbo = 0;
+    glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &prevFbo);
+
+    // The counter target is full size, only the current viewport is used
+    GLint viewport[4];
+    glGetIntegerv(GL_VIEWPORT, viewport);
+
+    // Count what a forward pass would shade: depth tested front to back as
+    // submitted, every passing fragment adds to the counter
+    glBindFramebuffer(GL_FRAMEBUFFER, counterFbo_);
+    glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_ONE, GL_ONE);
+
+    setMatrices(shader, viewMtx, projMtx);
+    for (const auto& batch : batches)
+        batch->draw();
+
+    glDisable(GL_BLEND);
+    glBindFramebuffer(GL_FRAMEBUFFER, (GLuint)prevFbo);
+
+    glDisable(GL_DEPTH_TEST);
+    heatmapShader_->use();
+    glUniform1i(heatmapShader_->getUniformLocation("uCounter"), 0);
+    glUniform1f(heatmapShader_->getUniformLocation("uMaxValue"), maxValue);
+    glUniform2f(heatmapShader_->getUniformLocation("uUVScale"),
+                (float)viewport[2] / width_, (float)viewport[3] / height_);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, counterTex_);
+    glBindVertexArray(emptyVao_);
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+    glBindVertexArray(0);
+    glEnable(GL_DEPTH_TEST);
+}
+
+void DebugViews::render(DebugView view, const DrawBatchList& batches, const glm::mat4& viewMtx, const glm::mat4& projMtx)
+{
+    // Ramps are picked as display colors, store them without the sRGB
+    // encode so they come out of the final pass unchanged
+    glDisable(GL_FRAMEBUFFER_SRGB);
+
+    switch (view)
+    {
+    case DebugView_Overdraw:
+        renderCounter(*overdrawShader_, batches, viewMtx, projMtx, kOverdrawMax);
+        break;
+    case DebugView_ShaderCost:
+        // Ramp ends at the cost of the full PBR variant shaded kOverdrawMax / 2 times
+        renderCounter(*costShader_, batches, viewMtx, projMtx,
+                      Material::estimatedCost((1u << MaterialFeature_NormalMap) | (1u << MaterialFeature_Orm)) *
+                          kOverdrawMax * 0.5f);
+        break;
+    case DebugView_TriangleDensity:
+    {
+        GLint viewport[4];
+        glGetIntegerv(GL_VIEWPORT, viewport);
+        setMatrices(*densityShader_, viewMtx, projMtx);
+        glUniform2f(densityShader_->getUniformLocation("uViewportSize"), (float)viewport[2], (float)viewport[3]);
+        for (const auto& batch : batches)
+            batch->draw();
+        break;
+    }
+    case DebugView_MipLevel:
+        setMatrices(*mipShader_, viewMtx, projMtx);
+        for (const auto& batch : batches)
+            batch->draw();
+        break;
+    default:
+        break;
+    }
+
+    glEnable(GL_FRAMEBUFFER_SRGB);
+}
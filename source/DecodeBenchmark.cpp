@@ -0,0 +1,180 @@
+#include "DecodeBenchmark.h"
+#include "FramePacer.h"
+#include "ImageDecoder.h"
+#include "JobSystem.h"
+#include "stb_image.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+#include <jpeglib.h>
+#include <png.h>
+
+static const int kSyntheticSizes[] = { 1024, 2048, 4096 };
+static const int kJpegQuality = 90;
+static const double kMinBenchMs = 300.0; // per decoder and input
+static const int kMinRuns = 3;
+
+static double elapsedMs(u64 start)
+{
+    return FramePacer::ticksToSeconds(FramePacer::ticks() - start) * 1000.0;
+}
+
+struct BenchInput
+{
+    std::string name;
+    std::vector<unsigned char> file;
+};
+
+// Texture-like content: smooth gradients, a tiled pattern and noise, so
+// neither codec sees a degenerate image
+static std::vector<unsigned char> syntheticRGB(int size)
+{
+    std::mt19937 rng(size);
+    std::uniform_int_distribution<int> noise(-12, 12);
+    std::vector<unsigned char> rgb((size_t)size * size * 3);
+    for (int y = 0; y < size; ++y)
+    {
+        for (int x = 0; x < size; ++x)
+        {
+            float u = (float)x / size, v = (float)y / size;
+            float pattern = 0.5f + 0.5f * std::sin(u * 60.0f) * std::cos(v * 45.0f);
+            unsigned char* p = &rgb[((size_t)y * size + x) * 3];
+            p[0] = (unsigned char)std::clamp((int)(255.0f * u * pattern) + noise(rng), 0, 255);
+            p[1] = (unsigned char)std::clamp((int)(255.0f * v) + noise(rng), 0, 255);
+            p[2] = (unsigned char)std::clamp((int)(255.0f * pattern) + noise(rng), 0, 255);
+        }
+    }
+    return rgb;
+}
+
+static std::vector<unsigned char> encodeJpeg(const std::vector<unsigned char>& rgb, int size)
+{
+    jpeg_compress_struct cinfo;
+    jpeg_error_mgr err;
+    cinfo.err = jpeg_std_error(&err);
+    jpeg_create_compress(&cinfo);
+
+    unsigned char* out = nullptr;
+    unsigned long outSize = 0;
+    jpeg_mem_dest(&cinfo, &out, &outSize);
+    cinfo.image_width = size;
+    cinfo.image_height = size;
+    cinfo.input_components = 3;
+    cinfo.in_color_space = JCS_RGB;
+    jpeg_set_defaults(&cinfo);
+    jpeg_set_quality(&cinfo, kJpegQuality, TRUE);
+    jpeg_start_compress(&cinfo, TRUE);
+    while (cinfo.next_scanline < cinfo.image_height)
+    {
+        JSAMPROW row = (JSAMPROW)&rgb[(size_t)cinfo.next_scanline * size * 3];
+        jpeg_write_scanlines(&cinfo, &row, 1);
+    }
+    jpeg_finish_compress(&cinfo);
+    jpeg_destroy_compress(&cinfo);
+
+    std::vector<unsigned char> file(out, out + outSize);
+    free(out);
+    return file;
+}
+
+static std::vector<unsigned char> encodePng(const std::vector<unsigned char>& rgb, int size)
+{
+    png_image image;
+    memset(&image, 0, sizeof(image));
+    image.version = PNG_IMAGE_VERSION;
+    image.width = size;
+    image.height = size;
+    image.format = PNG_FORMAT_RGB;
+
+    png_alloc_size_t bytes = 0;
+    std::vector<unsigned char> file;
+    if (png_image_write_to_memory(&image, nullptr, &bytes, 0, rgb.data(), 0, nullptr))
+    {
+        file.resize(bytes);
+        if (!png_image_write_to_memory(&image, file.data(), &bytes, 0, rgb.data(), 0, nullptr))
+            file.clear();
+    }
+    return file;
+}
+
+// Best time of repeated decodes, in ms
+template <typename Fn>
+static double bench(Fn&& decode)
+{
+    double best = 1e9, total = 0.0;
+    for (int run = 0; run < kMinRuns || total < kMinBenchMs; ++run)
+    {
+        u64 start = FramePacer::ticks();
+        if (!decode())
+            return -1.0;
+        double ms = elapsedMs(start);
+        best = std::min(best, ms);
+        total += ms;
+    }
+    return best;
+}
+
+void runDecodeBenchmarks(JobSystem* jobs)
+{
+    std::vector<BenchInput> inputs;
+    BenchInput cat{"cat.jpg", {}};
+    if (readFileBytes("romfs:/cat/cat.jpg", cat.file))
+        inputs.push_back(std::move(cat));
+    for (int size : kSyntheticSizes)
+    {
+        std::vector<unsigned char> rgb = syntheticRGB(size);
+        inputs.push_back({"synthetic " + std::to_string(size) + ".jpg", encodeJpeg(rgb, size)});
+        inputs.push_back({"synthetic " + std::to_string(size) + ".png", encodePng(rgb, size)});
+    }
+
+    printf("Image decode benchmark (RGBA output, best of >= %d runs, MPixel/s):\n", kMinRuns);
+    for (const BenchInput& input : inputs)
+    {
+        int w = 0, h = 0, c = 0;
+        if (input.file.empty() || !fastImageInfo(input.file.data(), input.file.size(), w, h, c))
+        {
+            printf("  %-20s skipped\n", input.name.c_str());
+            continue;
+        }
+
+        std::vector<unsigned char> fast((size_t)w * h * 4), banded((size_t)w * h * 4);
+        unsigned char* stbPixels = nullptr;
+        stbi_set_flip_vertically_on_load(1);
+
+        double stbMs = bench([&] {
+            stbi_image_free(stbPixels);
+            int sw, sh, sc;
+            stbPixels = stbi_load_from_memory(input.file.data(), (int)input.file.size(), &sw, &sh, &sc, 4);
+            return stbPixels != nullptr;
+        });
+        double fastMs = bench([&] {
+            return fastDecodeImage(input.file.data(), input.file.size(), 4, true, fast.data()) != ImageCodec_None;
+        });
+        double bandedMs = bench([&] {
+            return fastDecodeImage(input.file.data(), input.file.size(), 4, true, banded.data(), jobs) != ImageCodec_None;
+        });
+
+        // IDCT rounding may differ by a step or two, PNG must match exactly
+        int maxDiff = -1;
+        if (stbPixels && fastMs >= 0.0)
+        {
+            maxDiff = 0;
+            for (size_t i = 0; i < fast.size(); ++i)
+                maxDiff = std::max(maxDiff, std::abs((int)fast[i] - (int)stbPixels[i]));
+        }
+        bool bandsMatch = bandedMs >= 0.0 && fast == banded;
+        stbi_image_free(stbPixels);
+
+        double mpix = (double)w * h / 1e6;
+        auto rate = [mpix](double ms) { return ms > 0.0 ? mpix / (ms / 1000.0) : 0.0; };
+        printf("  %-20s %4dx%-4d stb %7.1f | fast %7.1f (%.2fx) | %d threads %7.1f (%.2fx) | max diff %d%s\n",
+               input.name.c_str(), w, h, rate(stbMs), rate(fastMs), fastMs > 0.0 ? stbMs / fastMs : 0.0,
+               jobs ? jobs->workerCount() + 1 : 1, rate(bandedMs), bandedMs > 0.0 ? stbMs / bandedMs : 0.0,
+               maxDiff, bandsMatch ? "" : ", BANDS DIFFER");
+    }
+}
@@ -0,0 +1,160 @@
+#include "DepthPrepass.h"
+#include "DrawBatch.h"
+#include <glm/gtc/type_ptr.hpp>
+#include <cstdio>
+
+// Auto mode: keep the pre-pass while more than this many hidden fragments
+// per screen pixel would be shaded without it
+static const float kOverdrawThreshold = 0.25f;
+// Auto mode: frames between probe frames when the pre-pass is off
+static const int kProbeInterval = 120;
+
+const char* prepassModeName(PrepassMode mode)
+{
+    switch (mode)
+    {
+    case PrepassMode_Off:  return "off";
+    case PrepassMode_On:   return "on";
+    case PrepassMode_Auto: return "auto";
+    default:               return "?";
+    }
+}
+
+DepthPrepass::~DepthPrepass()
+{
+    if (depthQueries_[0]) glDeleteQueries(kQueryFrames, depthQueries_);
+    if (shadeQueries_[0]) glDeleteQueries(kQueryFrames, shadeQueries_);
+}
+
+bool DepthPrepass::init()
+{
+    shader_ = std::make_unique<Shader>();
+    shader_->setOnLink([this](const Shader& shader) {
+        loc_viewMtx = shader.getUniformLocation("uView");
+        loc_projMtx = shader.getUniformLocation("uProj");
+    });
+    if (!shader_->loadFromFiles("romfs:/shaders/depth_vertex.glsl", "romfs:/shaders/depth_fragment.glsl"))
+    {
+        printf("Failed to load depth pre-pass shaders\n");
+        return false;
+    }
+
+    glGenQueries(kQueryFrames, depthQueries_);
+    glGenQueries(kQueryFrames, shadeQueries_);
+    return true;
+}
+
+void DepthPrepass::setMode(PrepassMode mode)
+{
+    mode_ = mode;
+    autoUsePrepass_ = true;
+    framesSinceProbe_ = 0;
+}
+
+void DepthPrepass::collectResults()
+{
+    for (int i = 0; i < kQueryFrames; ++i)
+    {
+        if (!pending_[i])
+            continue;
+
+        GLuint available = 0;
+        glGetQueryObjectuiv(shadeQueries_[i], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available)
+            continue;
+
+        GLuint depthSamples = 0, shadeSamples = 0;
+        glGetQueryObjectuiv(depthQueries_[i], GL_QUERY_RESULT, &depthSamples);
+        glGetQueryObjectuiv(shadeQueries_[i], GL_QUERY_RESULT, &shadeSamples);
+        pending_[i] = false;
+
+        overdraw_ = depthSamples > shadeSamples ? (depthSamples - shadeSamples) / pixels_[i] : 0.0f;
+
+        if (mode_ == PrepassMode_Auto)
+        {
+            bool use = overdraw_ > kOverdrawThreshold;
+            if (use != autoUsePrepass_)
+                printf("Depth pre-pass auto: %s (overdraw %.2f)\n", use ? "on" : "off", overdraw_);
+            autoUsePrepass_ = use;
+        }
+    }
+}
+
+bool DepthPrepass::beginFrame()
+{
+    if (shader_)
+        collectResults();
+
+    switch (mode_)
+    {
+    case PrepassMode_Off:
+        active_ = false;
+        break;
+    case PrepassMode_On:
+        active_ = true;
+        break;
+    case PrepassMode_Auto:
+        // A pre-pass frame measures both counts, so with the pre-pass off
+        // one is still run now and then to notice when the scene changes
+        active_ = autoUsePrepass_ || ++framesSinceProbe_ >= kProbeInterval;
+        if (active_)
+            framesSinceProbe_ = 0;
+        break;
+    default:
+        active_ = false;
+        break;
+    }
+    if (!shader_)
+        active_ = false;
+    return active_;
+}
+
+void DepthPrepass::renderDepth(const DrawBatchList& batches, const glm::mat4& view, const glm::mat4& proj)
+{
+    if (!active_)
+        return;
+
+    shader_->use();
+    glUniformMatrix4fv(loc_viewMtx, 1, GL_FALSE, glm::value_ptr(view));
+    glUniformMatrix4fv(loc_projMtx, 1, GL_FALSE, glm::value_ptr(proj));
+
+    glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+    glDepthFunc(GL_LESS);
+    glDepthMask(GL_TRUE);
+
+    // A previous result still in flight in this slot is simply dropped
+    glBeginQuery(GL_SAMPLES_PASSED, depthQueries_[queryIndex_]);
+    for (const auto& batch : batches)
+        batch->drawPositionOnly();
+    glEndQuery(GL_SAMPLES_PASSED);
+
+    glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+}
+
+void DepthPrepass::beginShading()
+{
+    if (!active_)
+        return;
+
+    glDepthFunc(GL_EQUAL);
+    glDepthMask(GL_FALSE);
+    glBeginQuery(GL_SAMPLES_PASSED, shadeQueries_[queryIndex_]);
+}
+
+void DepthPrepass::endShading()
+{
+    if (!active_)
+        return;
+
+    glEndQuery(GL_SAMPLES_PASSED);
+
+    // Normalize by the viewport, it changes with dynamic resolution
+    GLint viewport[4];
+    glGetIntegerv(GL_VIEWPORT, viewport);
+    pixels_[queryIndex_] = (float)viewport[2] * (float)viewport[3];
+    pending_[queryIndex_] = true;
+    queryIndex_ = (queryIndex_ + 1) % kQueryFrames;
+
+    glDepthFunc(GL_LESS);
+    glDepthMask(GL_TRUE);
+}
@@ -0,0 +1,55 @@
+#include "DiskCache.h"
+#include <sys/stat.h>
+
+void hashBytes(uint64_t& hash, const void* data, size_t size)
+{
+    // FNV-1a
+    const unsigned char* p = (const unsigned char*)data;
+    for (size_t i = 0; i < size; ++i)
+    {
+        hash ^= p[i];
+        hash *= 1099511628211ull;
+    }
+}
+
+bool hashFileStamp(uint64_t& hash, const std::string& path)
+{
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0)
+        return false;
+    int64_t size = (int64_t)st.st_size, mtime = (int64_t)st.st_mtime;
+    hashBytes(hash, path.data(), path.size() + 1);
+    hashBytes(hash, &size, sizeof(size));
+    hashBytes(hash, &mtime, sizeof(mtime));
+    return true;
+}
+
+std::string cacheFilePath(const char* dir, uint64_t key, const char* ext)
+{
+    char name[40];
+    snprintf(name, sizeof(name), "/%016llx.%s", (unsigned long long)key, ext);
+    return std::string(dir) + name;
+}
+
+bool writeCacheFile(const char* dir, const std::string& path, const std::function<bool(FILE*)>& write)
+{
+    mkdir(dir, 0777);
+    std::string tmpPath = path + ".tmp";
+    FILE* f = fopen(tmpPath.c_str(), "wb");
+    if (!f)
+        return false;
+
+    bool ok = write(f);
+    ok = fclose(f) == 0 && ok;
+    if (ok)
+    {
+        remove(path.c_str());
+        ok = rename(tmpPath.c_str(), path.c_str()) == 0;
+    }
+    if (!ok)
+    {
+        remove(tmpPath.c_str());
+        printf("Failed to write cache file %s\n", path.c_str());
+    }
+    return ok;
+}
@@ -0,0 +1,261 @@
+#include "DrawBatch.h"
+#include "Culling.h"
+#include "JobSystem.h"
+#include "ShaderVariants.h"
+#include <cstdio>
+
+DrawBatch::DrawBatch(const Model& model) : model_(model)
+{
+    glGenBuffers(1, &drawIdVbo_);
+    glGenBuffers(1, &recordSsbo_);
+    glGenBuffers(1, &transformSsbo_);
+    glGenBuffers(1, &sourceCommandSsbo_);
+    glGenBuffers(1, &indirectBuffer_);
+}
+
+DrawBatch::~DrawBatch()
+{
+    GLuint buffers[] = { drawIdVbo_, recordSsbo_, transformSsbo_, sourceCommandSsbo_, indirectBuffer_ };
+    glDeleteBuffers(5, buffers);
+}
+
+void DrawBatch::setInstanceCount(size_t count)
+{
+    transforms_.assign(count, glm::mat4(1.0f));
+    records_.clear();
+    commands_.clear();
+    groups_.clear();
+
+    // One group per shader variant used by the model's submeshes
+    const auto& submeshes = model_.submeshes();
+    std::vector<GLuint> submeshGroup(submeshes.size());
+    for (size_t s = 0; s < submeshes.size(); ++s)
+    {
+        unsigned features = model_.materialFeatures(submeshes[s]);
+        size_t g = 0;
+        while (g < groups_.size() && groups_[g].features != features)
+            ++g;
+        if (g == groups_.size())
+            groups_.push_back(DrawGroup{features, 0, 0, 0, 0});
+        submeshGroup[s] = (GLuint)g;
+    }
+
+    for (size_t g = 0; g < groups_.size(); ++g)
+    {
+        groups_[g].firstRecord = (GLuint)records_.size();
+        for (size_t inst = 0; inst < count; ++inst)
+        {
+            for (size_t s = 0; s < submeshes.size(); ++s)
+            {
+                if (submeshGroup[s] != g)
+                    continue;
+                const Submesh& sm = submeshes[s];
+
+                DrawRecordGPU rec{};
+                rec.transform = (GLuint)inst;
+                rec.material = model_.gpuMaterialIndex(sm);
+                rec.submesh = (GLuint)s;
+                rec.group = (GLuint)g;
+
+                // GL 4.3 has no gl_DrawID, so every command gets baseInstance =
+                // record index and a per-instance attribute holding 0..N-1 turns
+                // that back into the record index in the vertex shader.
+                DrawElementsIndirectCommand cmd{};
+                cmd.count = (GLuint)sm.indexCount;
+                cmd.instanceCount = 1;
+                cmd.firstIndex = (GLuint)sm.firstIndex;
+                cmd.baseVertex = sm.baseVertex;
+                cmd.baseInstance = (GLuint)records_.size();
+
+                records_.push_back(rec);
+                commands_.push_back(cmd);
+            }
+        }
+        groups_[g].recordCount = (GLuint)records_.size() - groups_[g].firstRecord;
+    }
+
+    std::vector<GLuint> drawIds(records_.size());
+    for (size_t i = 0; i < drawIds.size(); ++i)
+        drawIds[i] = (GLuint)i;
+
+    glBindBuffer(GL_ARRAY_BUFFER, drawIdVbo_);
+    glBufferData(GL_ARRAY_BUFFER, drawIds.size()*sizeof(GLuint), drawIds.data(), GL_STATIC_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, recordSsbo_);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, records_.size()*sizeof(DrawRecordGPU), records_.data(), GL_STATIC_DRAW);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, sourceCommandSsbo_);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, commands_.size()*sizeof(DrawElementsIndirectCommand), commands_.data(), GL_STATIC_DRAW);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, transformSsbo_);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, transforms_.size()*sizeof(glm::mat4), nullptr, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+    // Start out drawing everything
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, indirectBuffer_);
+    glBufferData(GL_DRAW_INDIRECT_BUFFER, commands_.size()*sizeof(DrawElementsIndirectCommand), commands_.data(), GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+    setGpuCulled();
+
+    printf("DrawBatch: %zu instances, %zu records, %zu shader variants\n", count, records_.size(), groups_.size());
+}
+
+void DrawBatch::uploadTransforms()
+{
+    if (transforms_.empty()) return;
+
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, transformSsbo_);
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, transforms_.size()*sizeof(glm::mat4), transforms_.data());
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
+
+bool DrawBatch::recordVisible(size_t i, const Frustum& frustum, const std::vector<glm::mat4>& transforms) const
+{
+    const DrawRecordGPU& rec = records_[i];
+    const Submesh& sm = model_.submeshes()[rec.submesh];
+
+    glm::vec3 center, extents;
+    transformAabb(transforms[rec.transform], sm.boundsMin, sm.boundsMax, center, extents);
+    return frustum.intersectsAabb(center, extents);
+}
+
+// Below this many records a parallel cull costs more than it saves
+static const size_t kParallelCullRecords = 512;
+static const size_t kCullGrain = 128;
+
+size_t DrawBatch::cullRecords(const Frustum& frustum, const std::vector<glm::mat4>& transforms,
+                              std::vector<DrawElementsIndirectCommand>& visible, JobSystem* jobs) const
+{
+    visible.clear();
+    if (!jobs || jobs->workerCount() == 0 || records_.size() < kParallelCullRecords)
+    {
+        for (size_t i = 0; i < records_.size(); ++i)
+        {
+            if (recordVisible(i, frustum, transforms))
+                visible.push_back(commands_[i]);
+        }
+        return visible.size();
+    }
+
+    // Test in parallel into flags, then compact in record order
+    visibleFlags_.resize(records_.size());
+    jobs->parallelFor(records_.size(), kCullGrain, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i)
+            visibleFlags_[i] = recordVisible(i, frustum, transforms) ? 1 : 0;
+    });
+    for (size_t i = 0; i < records_.size(); ++i)
+    {
+        if (visibleFlags_[i])
+            visible.push_back(commands_[i]);
+    }
+    return visible.size();
+}
+
+void DrawBatch::uploadVisible(const std::vector<DrawElementsIndirectCommand>& visible)
+{
+    if (!visible.empty())
+    {
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, indirectBuffer_);
+        glBufferSubData(GL_DRAW_INDIRECT_BUFFER, 0, visible.size()*sizeof(DrawElementsIndirectCommand), visible.data());
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+    }
+    drawCount_ = (GLsizei)visible.size();
+
+    // 'visible' keeps record order, so each group is one run of it
+    size_t i = 0;
+    for (DrawGroup& group : groups_)
+    {
+        group.drawFirst = (GLuint)i;
+        GLuint end = group.firstRecord + group.recordCount;
+        while (i < visible.size() && visible[i].baseInstance < end)
+            ++i;
+        group.drawCount = (GLsizei)(i - group.drawFirst);
+    }
+}
+
+void DrawBatch::setGpuCulled()
+{
+    drawCount_ = (GLsizei)records_.size();
+    for (DrawGroup& group : groups_)
+    {
+        group.drawFirst = group.firstRecord;
+        group.drawCount = (GLsizei)group.recordCount;
+    }
+}
+
+size_t DrawBatch::cullCpu(const Frustum& frustum)
+{
+    cullRecords(frustum, transforms_, visible_);
+    uploadVisible(visible_);
+    return visible_.size();
+}
+
+void DrawBatch::draw() const
+{
+    if (drawCount_ == 0) return;
+
+    model_.bind();
+    bindDrawState();
+    submit(indirectBuffer_, 0, drawCount_);
+    glBindVertexArray(0);
+}
+
+void DrawBatch::draw(ShaderVariants& variants) const
+{
+    if (drawCount_ == 0) return;
+
+    model_.bind();
+    bindDrawState();
+    for (const DrawGroup& group : groups_)
+    {
+        if (group.drawCount == 0)
+            continue;
+        const Shader* shader = variants.get(group.features);
+        if (!shader)
+            continue;
+        shader->use();
+        submit(indirectBuffer_, group.drawFirst, group.drawCount);
+    }
+    glBindVertexArray(0);
+}
+
+void DrawBatch::drawPositionOnly() const
+{
+    if (drawCount_ == 0) return;
+
+    // One shader for every group: a single submit over all their ranges
+    model_.bindPositionOnly();
+    bindDrawState();
+    submit(indirectBuffer_, 0, drawCount_);
+    glBindVertexArray(0);
+}
+
+void DrawBatch::drawPositionOnly(GLuint indirectBuffer, GLsizei drawCount) const
+{
+    if (drawCount == 0) return;
+
+    model_.bindPositionOnly();
+    bindDrawState();
+    submit(indirectBuffer, 0, drawCount);
+    glBindVertexArray(0);
+}
+
+void DrawBatch::bindDrawState() const
+{
+    // The draw id attribute lives in this batch, point the bound VAO at it
+    glBindBuffer(GL_ARRAY_BUFFER, drawIdVbo_);
+    glEnableVertexAttribArray(5);
+    glVertexAttribIPointer(5, 1, GL_UNSIGNED_INT, sizeof(GLuint), (void*)0);
+    glVertexAttribDivisor(5, 1);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, recordSsbo_);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, transformSsbo_);
+}
+
+void DrawBatch::submit(GLuint indirectBuffer, GLuint first, GLsizei count) const
+{
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, indirectBuffer);
+    glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT,
+                                (const void*)(first * sizeof(DrawElementsIndirectCommand)), count, 0);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+}
@@ -0,0 +1,154 @@
+#include "DynamicResolution.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+// Aim below the frame budget, CPU work and the upscale pass need room too
+static const float kBudgetFraction = 0.85f;
+// No change while the GPU time is within this fraction of the budget
+static const float kDeadband = 0.05f;
+// Fraction of the error corrected per frame, avoids oscillating
+static const float kDamping = 0.2f;
+
+DynamicResolution::~DynamicResolution()
+{
+    if (fbo_) glDeleteFramebuffers(1, &fbo_);
+    if (colorTex_) glDeleteTextures(1, &colorTex_);
+    if (depthTex_) glDeleteTextures(1, &depthTex_);
+    if (emptyVao_) glDeleteVertexArrays(1, &emptyVao_);
+}
+
+bool DynamicResolution::init(int width, int height)
+{
+    width_ = width;
+    height_ = height;
+    renderWidth_ = width;
+    renderHeight_ = height;
+
+    upscaleShader_ = std::make_unique<Shader>();
+    upscaleShader_->setOnLink([this](const Shader& shader) {
+        glUniform1i(shader.getUniformLocation("uScene"), 0);
+        loc_uvScale = shader.getUniformLocation("uUVScale");
+        loc_texelSize = shader.getUniformLocation("uTexelSize");
+        loc_sharpness = shader.getUniformLocation("uSharpness");
+        loc_encodeSrgb = shader.getUniformLocation("uEncodeSrgb");
+    });
+    if (!upscaleShader_->loadFromFiles("romfs:/shaders/fullscreen_vertex.glsl", "romfs:/shaders/upscale_fragment.glsl"))
+    {
+        printf("Failed to load upscale shader\n");
+        return false;
+    }
+
+    glGenTextures(1, &depthTex_);
+    glBindTexture(GL_TEXTURE_2D, depthTex_);
+    glTexStorage2D(GL_TEXTURE_2D, 1, GL_DEPTH24_STENCIL8, width_, height_);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    glGenFramebuffers(1, &fbo_);
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo_);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_TEXTURE_2D, depthTex_, 0);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    if (!createColorTarget())
+        return false;
+
+    glGenVertexArrays(1, &emptyVao_);
+    return true;
+}
+
+bool DynamicResolution::createColorTarget()
+{
+    if (colorTex_)
+        glDeleteTextures(1, &colorTex_);
+
+    glGenTextures(1, &colorTex_);
+    glBindTexture(GL_TEXTURE_2D, colorTex_);
+    glTexStorage2D(GL_TEXTURE_2D, 1, hdr_ ? GL_R11F_G11F_B10F : GL_SRGB8_ALPHA8, width_, height_);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo_);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, colorTex_, 0);
+    GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    if (status != GL_FRAMEBUFFER_COMPLETE)
+    {
+        printf("Scene framebuffer incomplete: 0x%x\n", status);
+        return false;
+    }
+    return true;
+}
+
+bool DynamicResolution::setHdr(bool hdr)
+{
+    if (hdr == hdr_)
+        return true;
+    hdr_ = hdr;
+    return createColorTarget();
+}
+
+void DynamicResolution::setEnabled(bool enabled)
+{
+    enabled_ = enabled;
+    if (!enabled_)
+        scale_ = maxScale_;
+}
+
+void DynamicResolution::updateScale(float gpuMs)
+{
+    if (gpuMs <= 0.0f)
+        return;
+    gpuMs_ = gpuMs_ > 0.0f ? gpuMs_ * 0.9f + gpuMs * 0.1f : gpuMs;
+    if (!enabled_)
+        return;
+
+    // Fixed-cost passes eat into the budget, but never more than half of it
+    float budget = 1000.0f / targetFps_ * kBudgetFraction;
+    budget = std::max(budget - reservedMs_, budget * 0.5f);
+    if (std::fabs(gpuMs - budget) < budget * kDeadband)
+        return;
+
+    // GPU time goes roughly with the pixel count, i.e. with scale^2
+    float desired = scale_ * std::sqrt(budget / gpuMs);
+    scale_ += (desired - scale_) * kDamping;
+    if (scale_ < minScale_) scale_ = minScale_;
+    if (scale_ > maxScale_) scale_ = maxScale_;
+}
+
+void DynamicResolution::beginFrame()
+{
+    // Even sizes keep the upscale footprint symmetric
+    renderWidth_ = ((int)(width_ * scale_ + 0.5f)) & ~1;
+    renderHeight_ = ((int)(height_ * scale_ + 0.5f)) & ~1;
+    glEnable(GL_FRAMEBUFFER_SRGB);
+}
+
+void DynamicResolution::present(GLuint texture)
+{
+    presentTimer_.begin();
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glViewport(0, 0, width_, height_);
+    glDisable(GL_DEPTH_TEST);
+    if (shaderEncode_)
+        glDisable(GL_FRAMEBUFFER_SRGB);
+
+    upscaleShader_->use();
+    glUniform2f(loc_uvScale, (float)renderWidth_ / width_, (float)renderHeight_ / height_);
+    glUniform2f(loc_texelSize, 1.0f / width_, 1.0f / height_);
+    glUniform1f(loc_sharpness, renderWidth_ < width_ ? sharpness_ : 0.0f);
+    glUniform1i(loc_encodeSrgb, shaderEncode_ ? 1 : 0);
+
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, texture ? texture : colorTex_);
+    glBindVertexArray(emptyVao_);
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+    glBindVertexArray(0);
+
+    glEnable(GL_DEPTH_TEST);
+    glEnable(GL_FRAMEBUFFER_SRGB);
+    presentTimer_.end();
+}
@@ -0,0 +1,436 @@
+#include "EnvironmentLight.h"
+#include "DiskCache.h"
+#include "FramePacer.h"
+#include "TextureUtils.h"
+#include "stb_image.h"
+#include <glm/glm.hpp>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+static const char kIblCacheDir[] = "/switch/iblcache";
+static const char kMagic[4] = { 'S', 'R', 'I', 'B' };
+static const uint32_t kVersion = 1;
+// Bump when the prefilter, projection or sky output changes, old files then miss
+static const uint32_t kGeneratorVersion = 1;
+
+static const uint32_t kPrefilterSamples = 64;
+static const uint32_t kBrdfLutSamples = 512;
+// SH projection reads at most this many columns of the source
+static const int kShColumns = 256;
+static const int kSkyWidth = 256;
+static const int kSkyHeight = 128;
+
+static const float kPi = 3.14159265359f;
+
+// Layout of a cache file: this header, then 'size' bytes of payload
+struct IblCacheHeader
+{
+    char magic[4];
+    uint32_t version;
+    uint64_t key;
+    uint32_t size;
+};
+
+// Key of an environment: the source file (path, size, modification time)
+// or the sky, and everything the generator output depends on
+static uint64_t environmentKey(const std::string& path)
+{
+    uint64_t hash = kCacheHashSeed;
+    if (path.empty())
+    {
+        hashBytes(hash, "sky", 4);
+    }
+    else if (!hashFileStamp(hash, path))
+    {
+        return 0;
+    }
+    uint32_t params[4] = { (uint32_t)EnvironmentLight::kSpecularSize, (uint32_t)EnvironmentLight::kSpecularLevels,
+                           kPrefilterSamples, kGeneratorVersion };
+    hashBytes(hash, params, sizeof(params));
+    return cacheKey(hash);
+}
+
+static uint64_t brdfLutKey()
+{
+    uint64_t hash = kCacheHashSeed;
+    uint32_t params[4] = { (uint32_t)EnvironmentLight::kBrdfLutSize, kBrdfLutSamples, kGeneratorVersion, 0 };
+    hashBytes(hash, "brdf", 5);
+    hashBytes(hash, params, sizeof(params));
+    return cacheKey(hash);
+}
+
+static bool loadCache(uint64_t key, std::vector<unsigned char>& payload, size_t expectedSize)
+{
+    if (!key)
+        return false;
+    FILE* f = fopen(cacheFilePath(kIblCacheDir, key, "srib").c_str(), "rb");
+    if (!f)
+        return false;
+
+    IblCacheHeader header;
+    bool ok = fread(&header, sizeof(header), 1, f) == 1 && memcmp(header.magic, kMagic, 4) == 0 &&
+              header.version == kVersion && header.key == key && header.size == expectedSize;
+    if (ok)
+    {
+        payload.resize(header.size);
+        ok = fread(payload.data(), 1, payload.size(), f) == payload.size();
+    }
+    fclose(f);
+    return ok;
+}
+
+static bool saveCache(uint64_t key, const std::vector<unsigned char>& payload)
+{
+    if (!key)
+        return false;
+    IblCacheHeader header;
+    memcpy(header.magic, kMagic, 4);
+    header.version = kVersion;
+    header.key = key;
+    header.size = (uint32_t)payload.size();
+    return writeCacheFile(kIblCacheDir, cacheFilePath(kIblCacheDir, key, "srib"), [&](FILE* f) {
+        return fwrite(&header, sizeof(header), 1, f) == 1 &&
+               fwrite(payload.data(), 1, payload.size(), f) == payload.size();
+    });
+}
+
+// Bytes of the specular cubemap, RGBA16F, all faces of all levels
+static size_t specularBytes()
+{
+    size_t bytes = 0;
+    for (int level = 0; level < EnvironmentLight::kSpecularLevels; ++level)
+    {
+        size_t size = (size_t)mipSize(EnvironmentLight::kSpecularSize, level);
+        bytes += 6 * size * size * 4 * sizeof(uint16_t);
+    }
+    return bytes;
+}
+
+static double elapsedMs(u64 start)
+{
+    return FramePacer::ticksToSeconds(FramePacer::ticks() - start) * 1000.0;
+}
+
+EnvironmentLight::~EnvironmentLight()
+{
+    if (specularTex_) glDeleteTextures(1, &specularTex_);
+    if (brdfLut_) glDeleteTextures(1, &brdfLut_);
+}
+
+bool EnvironmentLight::init()
+{
+    // Filtering across cube faces, core GL leaves it off
+    glEnable(GL_TEXTURE_CUBE_MAP_SEAMLESS);
+
+    glGenTextures(1, &brdfLut_);
+    glBindTexture(GL_TEXTURE_2D, brdfLut_);
+    glTexStorage2D(GL_TEXTURE_2D, 1, GL_RG16F, kBrdfLutSize, kBrdfLutSize);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+    size_t lutBytes = (size_t)kBrdfLutSize * kBrdfLutSize * 2 * sizeof(uint16_t);
+    std::vector<unsigned char> payload;
+    if (loadCache(brdfLutKey(), payload, lutBytes))
+    {
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, kBrdfLutSize, kBrdfLutSize, GL_RG, GL_HALF_FLOAT, payload.data());
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        return true;
+    }
+    glBindTexture(GL_TEXTURE_2D, 0);
+    return buildBrdfLut();
+}
+
+bool EnvironmentLight::buildBrdfLut()
+{
+    u64 start = FramePacer::ticks();
+    Shader shader;
+    if (!shader.loadComputeFromFile("romfs:/shaders/ibl_brdf.comp"))
+    {
+        printf("Failed to load BRDF table shader\n");
+        return false;
+    }
+
+    shader.use();
+    glUniform1i(shader.getUniformLocation("uSize"), kBrdfLutSize);
+    glUniform1ui(shader.getUniformLocation("uSampleCount"), kBrdfLutSamples);
+    glBindImageTexture(0, brdfLut_, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RG16F);
+    glDispatchCompute((kBrdfLutSize + 7) / 8, (kBrdfLutSize + 7) / 8, 1);
+    glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT | GL_TEXTURE_UPDATE_BARRIER_BIT);
+    glBindImageTexture(0, 0, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RG16F);
+
+    std::vector<unsigned char> payload((size_t)kBrdfLutSize * kBrdfLutSize * 2 * sizeof(uint16_t));
+    glBindTexture(GL_TEXTURE_2D, brdfLut_);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glGetTexImage(GL_TEXTURE_2D, 0, GL_RG, GL_HALF_FLOAT, payload.data());
+    glPixelStorei(GL_PACK_ALIGNMENT, 4);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    saveCache(brdfLutKey(), payload);
+
+    printf("BRDF table: built in %.1f ms\n", elapsedMs(start));
+    return true;
+}
+
+void EnvironmentLight::createSpecularTexture()
+{
+    if (specularTex_)
+        return;
+    glGenTextures(1, &specularTex_);
+    glBindTexture(GL_TEXTURE_CUBE_MAP, specularTex_);
+    glTexStorage2D(GL_TEXTURE_CUBE_MAP, kSpecularLevels, GL_RGBA16F, kSpecularSize, kSpecularSize);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAX_LEVEL, kSpecularLevels - 1);
+    glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+}
+
+bool EnvironmentLight::load(const std::string& path)
+{
+    u64 start = FramePacer::ticks();
+    const char* name = path.empty() ? "sky" : path.c_str();
+    uint64_t key = environmentKey(path);
+    createSpecularTexture();
+
+    // Cache hit: the coefficients, then every face of every mip
+    size_t shBytes = sizeof(irradianceSh_);
+    std::vector<unsigned char> payload;
+    if (loadCache(key, payload, shBytes + specularBytes()))
+    {
+        memcpy(irradianceSh_, payload.data(), shBytes);
+        const unsigned char* p = payload.data() + shBytes;
+        glBindTexture(GL_TEXTURE_CUBE_MAP, specularTex_);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        for (int level = 0; level < kSpecularLevels; ++level)
+        {
+            int size = mipSize(kSpecularSize, level);
+            for (int face = 0; face < 6; ++face)
+            {
+                glTexSubImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, level, 0, 0, size, size, GL_RGBA,
+                                GL_HALF_FLOAT, p);
+                p += (size_t)size * size * 4 * sizeof(uint16_t);
+            }
+        }
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+        printf("Environment %s: cached, %.1f ms\n", name, elapsedMs(start));
+        loaded_ = true;
+        return true;
+    }
+
+    SourceImage image;
+    if (path.empty())
+    {
+        makeSky(image);
+    }
+    else if (!readSource(path, image))
+    {
+        printf("Failed to load environment %s\n", path.c_str());
+        return false;
+    }
+
+    glm::vec3 sh[9];
+    projectIrradiance(image, sh);
+    if (!prefilter(image))
+        return false;
+    std::copy(sh, sh + 9, irradianceSh_);
+
+    // Read the result back for the next run
+    payload.resize(shBytes + specularBytes());
+    memcpy(payload.data(), irradianceSh_, shBytes);
+    unsigned char* p = payload.data() + shBytes;
+    glBindTexture(GL_TEXTURE_CUBE_MAP, specularTex_);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    for (int level = 0; level < kSpecularLevels; ++level)
+    {
+        int size = mipSize(kSpecularSize, level);
+        for (int face = 0; face < 6; ++face)
+        {
+            glGetTexImage(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, level, GL_RGBA, GL_HALF_FLOAT, p);
+            p += (size_t)size * size * 4 * sizeof(uint16_t);
+        }
+    }
+    glPixelStorei(GL_PACK_ALIGNMENT, 4);
+    glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+    saveCache(key, payload);
+    loaded_ = true;
+
+    printf("Environment %s: %dx%d prefiltered in %.1f ms\n", name, image.width, image.height, elapsedMs(start));
+    return true;
+}
+
+bool EnvironmentLight::readSource(const std::string& path, SourceImage& image) const
+{
+    // LDR files are converted with stb's default 2.2 gamma, close to sRGB.
+    // stb's flip flag is a global that texture decodes on the job threads
+    // set to 1, so load flipped like they do and put the rows back top-down.
+    int channels = 0;
+    stbi_set_flip_vertically_on_load(1);
+    float* data = stbi_loadf(path.c_str(), &image.width, &image.height, &channels, 3);
+    if (!data)
+        return false;
+    size_t rowFloats = (size_t)image.width * 3;
+    image.rgb.resize(rowFloats * image.height);
+    for (int y = 0; y < image.height; ++y)
+    {
+        const float* src = data + (size_t)(image.height - 1 - y) * rowFloats;
+        std::copy(src, src + rowFloats, &image.rgb[(size_t)y * rowFloats]);
+    }
+    stbi_image_free(data);
+    return true;
+}
+
+void EnvironmentLight::makeSky(SourceImage& image)
+{
+    // The horizon is the clear color of App::sceneRender, in linear
+    const glm::vec3 zenith(0.08f, 0.22f, 0.60f);
+    const glm::vec3 horizon(0.138f, 0.434f, 0.686f);
+    const glm::vec3 ground(0.10f, 0.09f, 0.08f);
+
+    image.width = kSkyWidth;
+    image.height = kSkyHeight;
+    image.rgb.resize((size_t)kSkyWidth * kSkyHeight * 3);
+    for (int y = 0; y < kSkyHeight; ++y)
+    {
+        float up = std::cos(((float)y + 0.5f) / (float)kSkyHeight * kPi);
+        glm::vec3 color = up >= 0.0f ? glm::mix(horizon, zenith, std::sqrt(up))
+                                     : glm::mix(horizon, ground, std::min(-up * 8.0f, 1.0f));
+        for (int x = 0; x < kSkyWidth; ++x)
+        {
+            float* p = &image.rgb[((size_t)y * kSkyWidth + x) * 3];
+            p[0] = color.x;
+            p[1] = color.y;
+            p[2] = color.z;
+        }
+    }
+}
+
+void EnvironmentLight::projectIrradiance(const SourceImage& image, glm::vec3 sh[9])
+{
+    // Radiance projected onto the first 9 real SH basis functions, over a
+    // grid of at most kShColumns columns, each sample weighted by its
+    // solid angle
+    int step = std::max(1, image.width / kShColumns);
+    int columns = image.width / step;
+    int rows = std::max(1, image.height / step);
+    float cellAngle = (2.0f * kPi / (float)columns) * (kPi / (float)rows);
+
+    glm::vec3 L[9];
+    for (glm::vec3& l : L)
+        l = glm::vec3(0.0f);
+    for (int r = 0; r < rows; ++r)
+    {
+        float theta = ((float)r + 0.5f) / (float)rows * kPi;
+        float sinTheta = std::sin(theta);
+        float weight = cellAngle * sinTheta;
+        int y = std::min((int)(((float)r + 0.5f) / (float)rows * (float)image.height), image.height - 1);
+        for (int c = 0; c < columns; ++c)
+        {
+            // Same mapping as equirectUv in common/ibl_sampling.glsl
+            float phi = ((float)c + 0.5f) / (float)columns * 2.0f * kPi - kPi;
+            glm::vec3 d(sinTheta * std::cos(phi), std::cos(theta), sinTheta * std::sin(phi));
+            int x = std::min((int)(((float)c + 0.5f) / (float)columns * (float)image.width), image.width - 1);
+            const float* p = &image.rgb[((size_t)y * image.width + x) * 3];
+            glm::vec3 radiance = glm::vec3(p[0], p[1], p[2]) * weight;
+
+            L[0] += radiance * 0.282095f;
+            L[1] += radiance * (0.488603f * d.y);
+            L[2] += radiance * (0.488603f * d.z);
+            L[3] += radiance * (0.488603f * d.x);
+            L[4] += radiance * (1.092548f * d.x * d.y);
+            L[5] += radiance * (1.092548f * d.y * d.z);
+            L[6] += radiance * (0.315392f * (3.0f * d.z * d.z - 1.0f));
+            L[7] += radiance * (1.092548f * d.x * d.z);
+            L[8] += radiance * (0.546274f * (d.x * d.x - d.y * d.y));
+        }
+    }
+
+    // Convolved with the clamped cosine (pi, 2pi/3, pi/4 per band) and
+    // divided by pi, with the basis constants folded in, so irradianceSH in
+    // common/ibl.glsl is a plain polynomial in N
+    static const float basis[9] = { 0.282095f, 0.488603f, 0.488603f, 0.488603f, 1.092548f,
+                                    1.092548f, 0.315392f, 1.092548f, 0.546274f };
+    static const float band[9] = { 1.0f, 2.0f / 3.0f, 2.0f / 3.0f, 2.0f / 3.0f, 0.25f, 0.25f, 0.25f, 0.25f, 0.25f };
+    for (int i = 0; i < 9; ++i)
+        sh[i] = L[i] * (basis[i] * band[i]);
+}
+
+bool EnvironmentLight::prefilter(const SourceImage& image)
+{
+    Shader shader;
+    if (!shader.loadComputeFromFile("romfs:/shaders/ibl_prefilter.comp"))
+    {
+        printf("Failed to load environment prefilter shader\n");
+        return false;
+    }
+
+    // Source with a full mip chain for the filtered importance sampling
+    GLuint source = 0;
+    glGenTextures(1, &source);
+    glBindTexture(GL_TEXTURE_2D, source);
+    glTexStorage2D(GL_TEXTURE_2D, mipLevelCount(image.width, image.height), GL_RGB16F, image.width, image.height);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, image.width, image.height, GL_RGB, GL_FLOAT, image.rgb.data());
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glGenerateMipmap(GL_TEXTURE_2D);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+    shader.use();
+    glUniform1i(shader.getUniformLocation("uSource"), 0);
+    glUniform1ui(shader.getUniformLocation("uSampleCount"), kPrefilterSamples);
+    glUniform1f(shader.getUniformLocation("uSourceTexelSolidAngle"),
+                4.0f * kPi / ((float)image.width * (float)image.height));
+    GLint locFaceSize = shader.getUniformLocation("uFaceSize");
+    GLint locRoughness = shader.getUniformLocation("uRoughness");
+
+    glActiveTexture(GL_TEXTURE0);
+    for (int level = 0; level < kSpecularLevels; ++level)
+    {
+        int size = mipSize(kSpecularSize, level);
+        glUniform1i(locFaceSize, size);
+        glUniform1f(locRoughness, (float)level / (float)(kSpecularLevels - 1));
+        glBindImageTexture(0, specularTex_, level, GL_TRUE, 0, GL_WRITE_ONLY, GL_RGBA16F);
+        glDispatchCompute((size + 7) / 8, (size + 7) / 8, 6);
+    }
+    glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT | GL_TEXTURE_UPDATE_BARRIER_BIT);
+    glBindImageTexture(0, 0, 0, GL_TRUE, 0, GL_WRITE_ONLY, GL_RGBA16F);
+
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glDeleteTextures(1, &source);
+    return true;
+}
+
+EnvironmentLight::Uniforms EnvironmentLight::locate(const Shader& shader)
+{
+    Uniforms loc;
+    loc.irradianceSh = shader.getUniformLocation("uIrradianceSH");
+    loc.specularMaxLod = shader.getUniformLocation("uEnvSpecularMaxLod");
+    loc.intensity = shader.getUniformLocation("uEnvIntensity");
+    return loc;
+}
+
+void EnvironmentLight::setUniforms(const Uniforms& loc) const
+{
+    glUniform3fv(loc.irradianceSh, 9, &irradianceSh_[0].x);
+    glUniform1f(loc.specularMaxLod, (float)(kSpecularLevels - 1));
+    glUniform1f(loc.intensity, enabled_ && loaded_ ? intensity_ : 0.0f);
+}
+
+void EnvironmentLight::bindTextures() const
+{
+    glActiveTexture(GL_TEXTURE0 + kEnvSpecularTextureUnit);
+    glBindTexture(GL_TEXTURE_CUBE_MAP, specularTex_);
+    glActiveTexture(GL_TEXTURE0 + kBrdfLutTextureUnit);
+    glBindTexture(GL_TEXTURE_2D, brdfLut_);
+    glActiveTexture(GL_TEXTURE0);
+}
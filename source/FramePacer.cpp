@@ -0,0 +1,122 @@
+#include "FramePacer.h"
+#include <cmath>
+#include <cstdio>
+
+// The limiter sleeps until this close to the deadline, then yields
+static const u64 kSpinNs = 500000;
+
+const char* pacingModeName(PacingMode mode)
+{
+    switch (mode)
+    {
+    case PacingMode_Vsync60:  return "vsync 60";
+    case PacingMode_Vsync30:  return "vsync 30";
+    case PacingMode_Cap60:    return "limiter 60";
+    case PacingMode_Cap30:    return "limiter 30";
+    case PacingMode_Uncapped: return "uncapped";
+    default:                  return "?";
+    }
+}
+
+void FramePacer::init(EGLDisplay display, EGLSurface surface)
+{
+    display_ = display;
+    surface_ = surface;
+    lastFrameStart_ = ticks();
+    lastReport_ = lastFrameStart_;
+    setMode(mode_);
+}
+
+void FramePacer::setMode(PacingMode mode)
+{
+    mode_ = mode;
+
+    int& fps = targetFps_;
+    switch (mode_)
+    {
+    case PacingMode_Vsync60:  swapInterval_ = 1; capTicks_ = 0; fps = 60; break;
+    case PacingMode_Vsync30:  swapInterval_ = 2; capTicks_ = 0; fps = 30; break;
+    case PacingMode_Cap60:    swapInterval_ = 0; fps = 60; capTicks_ = armNsToTicks(1000000000ull / 60); break;
+    case PacingMode_Cap30:    swapInterval_ = 0; fps = 30; capTicks_ = armNsToTicks(1000000000ull / 30); break;
+    default:                  swapInterval_ = 0; capTicks_ = 0; fps = 0; break;
+    }
+    targetTicks_ = fps ? armNsToTicks(1000000000ull / fps) : 0;
+    deadline_ = 0;
+
+    if (display_)
+        eglSwapInterval(display_, swapInterval_);
+
+    stats_ = Stats{};
+    lastReport_ = ticks();
+}
+
+void FramePacer::waitForNextFrame()
+{
+    if (capTicks_ == 0)
+        return;
+
+    u64 now = ticks();
+    if (deadline_ == 0 || now > deadline_ + capTicks_)
+    {
+        // First frame or fell more than a frame behind: don't try to catch up
+        deadline_ = now;
+        return;
+    }
+
+    if (now < deadline_)
+    {
+        u64 remainingNs = armTicksToNs(deadline_ - now);
+        if (remainingNs > kSpinNs)
+            svcSleepThread((s64)(remainingNs - kSpinNs));
+        while (ticks() < deadline_)
+            svcSleepThread(0); // yield
+    }
+    deadline_ += capTicks_;
+}
+
+double FramePacer::beginFrame()
+{
+    u64 now = ticks();
+    u64 delta = now - lastFrameStart_;
+    lastFrameStart_ = now;
+
+    double seconds = ticksToSeconds(delta);
+    stats_.frames++;
+    stats_.sum += seconds;
+    stats_.sumSq += seconds * seconds;
+    if (seconds < stats_.min) stats_.min = seconds;
+    if (seconds > stats_.max) stats_.max = seconds;
+    if (targetTicks_ && delta > targetTicks_ + targetTicks_ / 2)
+        stats_.missed++;
+
+    if (ticksToSeconds(now - lastReport_) >= reportInterval_)
+    {
+        report();
+        stats_ = Stats{};
+        lastReport_ = now;
+    }
+    return seconds;
+}
+
+void FramePacer::present()
+{
+    u64 start = ticks();
+    eglSwapBuffers(display_, surface_);
+    stats_.presentSum += ticksToSeconds(ticks() - start);
+}
+
+void FramePacer::report()
+{
+    if (stats_.frames < 2)
+        return;
+
+    double n = (double)stats_.frames;
+    double avg = stats_.sum / n;
+    double variance = stats_.sumSq / n - avg * avg;
+    double jitter = variance > 0.0 ? std::sqrt(variance) : 0.0;
+
+    printf("Frame pacing (%s): %.1f FPS, avg %.2f ms, min %.2f ms, max %.2f ms, jitter %.2f ms, "
+           "missed %llu, present wait %.2f ms\n",
+           pacingModeName(mode_), 1.0 / avg, avg * 1000.0, stats_.min * 1000.0, stats_.max * 1000.0,
+           jitter * 1000.0, (unsigned long long)stats_.missed, stats_.presentSum / n * 1000.0);
+}
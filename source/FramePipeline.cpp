@@ -0,0 +1,103 @@
+#include "FramePipeline.h"
+#include "FramePacer.h"
+#include <cstdio>
+
+static const size_t kStackSize = 0x10000;
+static const int kThreadPriority = 0x2C;
+static const u64 kReportFrames = 600;
+
+FramePipeline::~FramePipeline()
+{
+    stop();
+}
+
+bool FramePipeline::start(int latency, SimulateFn simulate, int core)
+{
+    stop();
+    if (latency < 1)
+        return false;
+
+    latency_ = latency;
+    simulate_ = std::move(simulate);
+    packets_.assign(latency_ + 1, FramePacket{});
+    readIndex_ = 0;
+    waitTicks_ = frames_ = 0;
+    simTicks_ = 0;
+
+    // Every packet starts out free for the worker
+    semaphoreInit(&free_, packets_.size());
+    semaphoreInit(&ready_, 0);
+
+    running_ = true;
+    Result rc = threadCreate(&thread_, threadMain, this, nullptr, kStackSize, kThreadPriority, core);
+    if (R_SUCCEEDED(rc))
+        rc = threadStart(&thread_);
+    if (R_FAILED(rc))
+    {
+        printf("Failed to start the simulation thread: 0x%x\n", rc);
+        threadClose(&thread_);
+        running_ = false;
+        latency_ = 0;
+        return false;
+    }
+    printf("Frame pipeline: latency %d, simulation on core %d\n", latency_, core);
+    return true;
+}
+
+void FramePipeline::stop()
+{
+    if (!running_)
+        return;
+
+    // Wake the worker if it waits for a free packet, it exits on the check
+    running_ = false;
+    semaphoreSignal(&free_);
+    threadWaitForExit(&thread_);
+    threadClose(&thread_);
+    latency_ = 0;
+}
+
+void FramePipeline::threadMain(void* arg)
+{
+    static_cast<FramePipeline*>(arg)->workerLoop();
+}
+
+void FramePipeline::workerLoop()
+{
+    size_t writeIndex = 0;
+    for (;;)
+    {
+        semaphoreWait(&free_);
+        if (!running_)
+            break;
+
+        u64 start = FramePacer::ticks();
+        simulate_(packets_[writeIndex]);
+        simTicks_ += FramePacer::ticks() - start;
+
+        writeIndex = (writeIndex + 1) % packets_.size();
+        semaphoreSignal(&ready_);
+    }
+}
+
+const FramePacket& FramePipeline::acquire()
+{
+    u64 start = FramePacer::ticks();
+    semaphoreWait(&ready_);
+    waitTicks_ += FramePacer::ticks() - start;
+    return packets_[readIndex_];
+}
+
+void FramePipeline::release()
+{
+    readIndex_ = (readIndex_ + 1) % packets_.size();
+    semaphoreSignal(&free_);
+
+    if (++frames_ == kReportFrames)
+    {
+        printf("Frame pipeline: simulation %.2f ms, GL thread waited %.2f ms per frame\n",
+               FramePacer::ticksToSeconds(simTicks_.exchange(0)) * 1000.0 / frames_,
+               FramePacer::ticksToSeconds(waitTicks_) * 1000.0 / frames_);
+        waitTicks_ = frames_ = 0;
+    }
+}
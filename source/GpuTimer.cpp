@@ -0,0 +1,56 @@
+#include "GpuTimer.h"
+
+GpuTimer::~GpuTimer()
+{
+    if (created_)
+        glDeleteQueries(kLatency * 2, queries_);
+}
+
+void GpuTimer::poll()
+{
+    for (int i = 0; i < kLatency; ++i)
+    {
+        // Always look at the oldest slot first so results arrive in order
+        int slot = (index_ + i) % kLatency;
+        if (!pending_[slot])
+            continue;
+
+        GLuint available = 0;
+        glGetQueryObjectuiv(queries_[slot * 2 + 1], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available)
+            break;
+
+        GLuint64 start = 0, stop = 0;
+        glGetQueryObjectui64v(queries_[slot * 2], GL_QUERY_RESULT, &start);
+        glGetQueryObjectui64v(queries_[slot * 2 + 1], GL_QUERY_RESULT, &stop);
+        pending_[slot] = false;
+
+        lastMs_ = (stop - start) / 1000000.0f;
+        averageMs_ = averageMs_ > 0.0f ? averageMs_ * 0.9f + lastMs_ * 0.1f : lastMs_;
+    }
+}
+
+void GpuTimer::begin()
+{
+    if (!created_)
+    {
+        glGenQueries(kLatency * 2, queries_);
+        created_ = true;
+    }
+
+    poll();
+
+    // All slots still in flight: drop the oldest measurement
+    pending_[index_] = false;
+    glQueryCounter(queries_[index_ * 2], GL_TIMESTAMP);
+}
+
+void GpuTimer::end()
+{
+    if (!created_)
+        return;
+
+    glQueryCounter(queries_[index_ * 2 + 1], GL_TIMESTAMP);
+    pending_[index_] = true;
+    index_ = (index_ + 1) % kLatency;
+}
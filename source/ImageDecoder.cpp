@@ -0,0 +1,359 @@
+#include "ImageDecoder.h"
+#include "JobSystem.h"
+#include "stb_image.h"
+#include <algorithm>
+#include <csetjmp>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <jpeglib.h>
+#include <png.h>
+
+// Band decoding only pays off for large images with cores to spare: every
+// band entropy-decodes the rows above it again (jpeg_skip_scanlines skips
+// only upsampling, IDCT and color conversion), so the total work grows
+static const int kBandMinPixels = 2048 * 2048;
+static const int kBandMinRows = 256;
+
+const char* imageCodecName(ImageCodec codec)
+{
+    switch (codec)
+    {
+    case ImageCodec_None: return "none";
+    case ImageCodec_Jpeg: return "libjpeg-turbo";
+    case ImageCodec_Png:  return "libpng";
+    case ImageCodec_Stb:  return "stb_image";
+    default:              return "?";
+    }
+}
+
+bool readFileBytes(const std::string& path, std::vector<unsigned char>& out)
+{
+    FILE* f = fopen(path.c_str(), "rb");
+    if (!f)
+        return false;
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    out.resize(size > 0 ? (size_t)size : 0);
+    bool ok = size > 0 && fread(out.data(), 1, out.size(), f) == out.size();
+    fclose(f);
+    return ok;
+}
+
+static bool isJpeg(const unsigned char* data, size_t size)
+{
+    return size > 3 && data[0] == 0xFF && data[1] == 0xD8 && data[2] == 0xFF;
+}
+
+static bool isPng(const unsigned char* data, size_t size)
+{
+    static const unsigned char kSignature[8] = { 0x89, 'P', 'N', 'G', 0x0D, 0x0A, 0x1A, 0x0A };
+    // Signature plus the whole IHDR chunk (length, type, 13 bytes, CRC)
+    return size >= 33 && memcmp(data, kSignature, 8) == 0;
+}
+
+// libjpeg reports errors through error_exit, which must not return;
+// jump back to the setjmp of the decode instead of exit()
+struct JpegError
+{
+    jpeg_error_mgr mgr;
+    jmp_buf jump;
+};
+
+static void jpegErrorExit(j_common_ptr cinfo)
+{
+    JpegError* err = (JpegError*)cinfo->err;
+    char message[JMSG_LENGTH_MAX];
+    cinfo->err->format_message(cinfo, message);
+    printf("JPEG decode: %s\n", message);
+    longjmp(err->jump, 1);
+}
+
+static void jpegSilent(j_common_ptr, int) {}
+
+// One decompressor over the whole stream, writing output rows
+// [firstRow, endRow) to dst. No C++ objects live across the setjmp.
+static bool decodeJpegRows(const unsigned char* data, size_t size, int channels, bool flip,
+                           unsigned char* dst, int firstRow, int endRow)
+{
+    jpeg_decompress_struct cinfo;
+    JpegError err;
+    cinfo.err = jpeg_std_error(&err.mgr);
+    err.mgr.error_exit = jpegErrorExit;
+    err.mgr.emit_message = jpegSilent;
+    if (setjmp(err.jump))
+    {
+        jpeg_destroy_decompress(&cinfo);
+        return false;
+    }
+
+    jpeg_create_decompress(&cinfo);
+    jpeg_mem_src(&cinfo, data, (unsigned long)size);
+    jpeg_read_header(&cinfo, TRUE);
+    if (cinfo.jpeg_color_space == JCS_CMYK || cinfo.jpeg_color_space == JCS_YCCK)
+    {
+        jpeg_destroy_decompress(&cinfo);
+        return false;
+    }
+#ifdef JCS_EXTENSIONS
+    cinfo.out_color_space = channels == 1 ? JCS_GRAYSCALE : channels == 3 ? JCS_EXT_RGB : JCS_EXT_RGBA;
+#else
+    if (channels == 4)
+    {
+        jpeg_destroy_decompress(&cinfo);
+        return false;
+    }
+    cinfo.out_color_space = channels == 1 ? JCS_GRAYSCALE : JCS_RGB;
+#endif
+    cinfo.dct_method = JDCT_ISLOW; // same precision as stb_image, SIMD in libjpeg-turbo
+    jpeg_start_decompress(&cinfo);
+
+    int height = (int)cinfo.output_height;
+    size_t stride = (size_t)cinfo.output_width * channels;
+    if (firstRow > 0)
+    {
+#if defined(LIBJPEG_TURBO_VERSION_NUMBER) && LIBJPEG_TURBO_VERSION_NUMBER >= 1005000
+        jpeg_skip_scanlines(&cinfo, (JDIMENSION)firstRow);
+#else
+        jpeg_abort_decompress(&cinfo);
+        jpeg_destroy_decompress(&cinfo);
+        return false;
+#endif
+    }
+
+    JSAMPROW rows[16];
+    while ((int)cinfo.output_scanline < endRow)
+    {
+        int count = std::min(endRow - (int)cinfo.output_scanline, 16);
+        for (int i = 0; i < count; ++i)
+        {
+            int y = (int)cinfo.output_scanline + i;
+            rows[i] = dst + (size_t)(flip ? height - 1 - y : y) * stride;
+        }
+        jpeg_read_scanlines(&cinfo, rows, (JDIMENSION)count);
+    }
+
+    if ((int)cinfo.output_scanline == height)
+        jpeg_finish_decompress(&cinfo);
+    else
+        jpeg_abort_decompress(&cinfo);
+    jpeg_destroy_decompress(&cinfo);
+    return true;
+}
+
+static bool jpegInfo(const unsigned char* data, size_t size, int& width, int& height, int& channels, bool& progressive)
+{
+    jpeg_decompress_struct cinfo;
+    JpegError err;
+    cinfo.err = jpeg_std_error(&err.mgr);
+    err.mgr.error_exit = jpegErrorExit;
+    err.mgr.emit_message = jpegSilent;
+    if (setjmp(err.jump))
+    {
+        jpeg_destroy_decompress(&cinfo);
+        return false;
+    }
+
+    jpeg_create_decompress(&cinfo);
+    jpeg_mem_src(&cinfo, data, (unsigned long)size);
+    jpeg_read_header(&cinfo, TRUE);
+    width = (int)cinfo.image_width;
+    height = (int)cinfo.image_height;
+    channels = cinfo.num_components;
+    progressive = jpeg_has_multiple_scans(&cinfo);
+    jpeg_destroy_decompress(&cinfo);
+    return true;
+}
+
+static bool decodeJpeg(const unsigned char* data, size_t size, int channels, bool flip,
+                       unsigned char* dst, JobSystem* jobs)
+{
+    int width, height, fileChannels;
+    bool progressive;
+    if (!jpegInfo(data, size, width, height, fileChannels, progressive))
+        return false;
+
+    // Progressive files have every coefficient buffered before output, a
+    // band would redo all of that work
+    int bands = 1;
+#if defined(LIBJPEG_TURBO_VERSION_NUMBER) && LIBJPEG_TURBO_VERSION_NUMBER >= 1005000
+    if (jobs && !progressive && width * height >= kBandMinPixels)
+        bands = std::max(1, std::min(jobs->workerCount() + 1, height / kBandMinRows));
+#endif
+    if (bands == 1)
+        return decodeJpegRows(data, size, channels, flip, dst, 0, height);
+
+    int bandRows = (height + bands - 1) / bands;
+    std::vector<unsigned char> ok(bands, 0);
+    jobs->parallelFor((size_t)bands, 1, [&](size_t begin, size_t end) {
+        for (size_t b = begin; b < end; ++b)
+        {
+            int first = (int)b * bandRows;
+            ok[b] = decodeJpegRows(data, size, channels, flip, dst, first, std::min(first + bandRows, height));
+        }
+    });
+    return std::find(ok.begin(), ok.end(), 0) == ok.end();
+}
+
+// True if a gAMA chunk comes before the image data. The simplified API
+// would apply it, stb ignores it; for normal, roughness and metallic maps
+// the stored values are what counts, so such files go to stb.
+static bool pngHasGamma(const unsigned char* data, size_t size)
+{
+    size_t offset = 8;
+    while (offset + 8 <= size)
+    {
+        size_t length = ((size_t)data[offset] << 24) | (data[offset + 1] << 16) | (data[offset + 2] << 8) |
+                        data[offset + 3];
+        const unsigned char* type = data + offset + 4;
+        if (memcmp(type, "gAMA", 4) == 0)
+            return true;
+        if (memcmp(type, "IDAT", 4) == 0)
+            return false;
+        offset += 12 + length;
+    }
+    return false;
+}
+
+static bool decodePng(const unsigned char* data, size_t size, int channels, bool flip, unsigned char* dst)
+{
+    if (pngHasGamma(data, size))
+        return false;
+
+    png_image image;
+    memset(&image, 0, sizeof(image));
+    image.version = PNG_IMAGE_VERSION;
+    if (!png_image_begin_read_from_memory(&image, data, size))
+    {
+        printf("PNG decode: %s\n", image.message);
+        return false;
+    }
+
+    image.format = channels == 1 ? PNG_FORMAT_GRAY : channels == 3 ? PNG_FORMAT_RGB : PNG_FORMAT_RGBA;
+    // 16-bit files without colorspace chunks would otherwise count as linear
+    // and be re-encoded to sRGB; like stb, take the top bits as they are
+    image.flags |= PNG_IMAGE_FLAG_16BIT_sRGB;
+    // A negative stride makes libpng store the rows bottom-up
+    png_int_32 stride = (png_int_32)(image.width * channels);
+    if (!png_image_finish_read(&image, nullptr, dst, flip ? -stride : stride, nullptr))
+    {
+        printf("PNG decode: %s\n", image.message);
+        png_image_free(&image);
+        return false;
+    }
+    return true;
+}
+
+bool fastImageInfo(const unsigned char* data, size_t size, int& width, int& height, int& channels)
+{
+    if (isJpeg(data, size))
+    {
+        bool progressive;
+        return jpegInfo(data, size, width, height, channels, progressive);
+    }
+    if (isPng(data, size))
+    {
+        // IHDR is always the first chunk: width, height, bit depth, color type
+        auto be32 = [](const unsigned char* p) {
+            return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | (uint32_t)p[3];
+        };
+        uint32_t w = be32(data + 16), h = be32(data + 20);
+        if (w > INT32_MAX || h > INT32_MAX)
+            return false;
+        width = (int)w;
+        height = (int)h;
+        switch (data[25])
+        {
+        case 0:  channels = 1; break; // grey
+        case 4:  channels = 2; break; // grey + alpha
+        case 6:  channels = 4; break; // RGBA
+        default: channels = 3; break; // RGB, palette
+        }
+        return width > 0 && height > 0;
+    }
+    return false;
+}
+
+ImageCodec fastDecodeImage(const unsigned char* data, size_t size, int channels, bool flip,
+                           unsigned char* dst, JobSystem* jobs)
+{
+    if (channels != 1 && channels != 3 && channels != 4)
+        return ImageCodec_None;
+    if (isJpeg(data, size))
+        return decodeJpeg(data, size, channels, flip, dst, jobs) ? ImageCodec_Jpeg : ImageCodec_None;
+    if (isPng(data, size))
+        return decodePng(data, size, channels, flip, dst) ? ImageCodec_Png : ImageCodec_None;
+    return ImageCodec_None;
+}
+
+bool decodeImageFile(const std::string& path, int channels, bool flip, std::vector<unsigned char>& pixels,
+                     int& width, int& height, JobSystem* jobs, ImageCodec* codec)
+{
+    if (codec)
+        *codec = ImageCodec_None;
+
+    std::vector<unsigned char> file;
+    if (!readFileBytes(path, file))
+        return false;
+
+    int fileChannels = 0;
+    if (fastImageInfo(file.data(), file.size(), width, height, fileChannels))
+    {
+        pixels.resize((size_t)width * height * channels);
+        ImageCodec used = fastDecodeImage(file.data(), file.size(), channels, flip, pixels.data(), jobs);
+        if (used != ImageCodec_None)
+        {
+            if (codec)
+                *codec = used;
+            return true;
+        }
+    }
+
+    // stb keeps the flip flag in a global, shared with decodes running on
+    // other threads, so every stb load in this tree asks for flip = 1
+    stbi_set_flip_vertically_on_load(flip ? 1 : 0);
+    unsigned char* data = stbi_load_from_memory(file.data(), (int)file.size(), &width, &height, &fileChannels, channels);
+    if (!data)
+        return false;
+    pixels.assign(data, data + (size_t)width * height * channels);
+    stbi_image_free(data);
+    if (codec)
+        *codec = ImageCodec_Stb;
+    return true;
+}
+
+unsigned char* loadImageFile(const std::string& path, int channels, bool flip, int& width, int& height,
+                             int& fileChannels, JobSystem* jobs, ImageCodec* codec)
+{
+    if (codec)
+        *codec = ImageCodec_None;
+
+    std::vector<unsigned char> file;
+    if (!readFileBytes(path, file))
+        return nullptr;
+
+    if (channels > 0 && fastImageInfo(file.data(), file.size(), width, height, fileChannels))
+    {
+        // malloc to match STBI_FREE, the caller can't tell which path ran
+        unsigned char* pixels = (unsigned char*)malloc((size_t)width * height * channels);
+        if (pixels)
+        {
+            ImageCodec used = fastDecodeImage(file.data(), file.size(), channels, flip, pixels, jobs);
+            if (used != ImageCodec_None)
+            {
+                if (codec)
+                    *codec = used;
+                return pixels;
+            }
+            free(pixels);
+        }
+    }
+
+    stbi_set_flip_vertically_on_load(flip ? 1 : 0);
+    unsigned char* pixels = stbi_load_from_memory(file.data(), (int)file.size(), &width, &height, &fileChannels, channels);
+    if (pixels && codec)
+        *codec = ImageCodec_Stb;
+    return pixels;
+}
@@ -0,0 +1,83 @@
+#include "JobBenchmark.h"
+#include "JobSystem.h"
+#include "Culling.h"
+#include "FramePacer.h"
+#include <glm/gtc/matrix_transform.hpp>
+#include <algorithm>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+static const int kMaxCores = 3;
+static const int kEmptyJobs = 20000;
+static const int kParallelForCalls = 1000;
+static const size_t kCullItems = 100000;
+static const int kRepeats = 5;
+
+static double elapsedMs(u64 start)
+{
+    return FramePacer::ticksToSeconds(FramePacer::ticks() - start) * 1000.0;
+}
+
+void runJobBenchmarks()
+{
+    // Scaling workload: world-space AABB + frustum test, what cullRecords does per record
+    std::mt19937 rng(1234);
+    std::uniform_real_distribution<float> pos(-50.0f, 50.0f);
+    std::vector<glm::mat4> transforms(kCullItems);
+    for (glm::mat4& m : transforms)
+        m = glm::rotate(glm::translate(glm::mat4(1.0f), glm::vec3(pos(rng), pos(rng), pos(rng))),
+                        pos(rng), glm::vec3(0.0f, 1.0f, 0.0f));
+    const float bmin[3] = {-1.0f, -1.0f, -1.0f};
+    const float bmax[3] = {1.0f, 1.0f, 1.0f};
+    glm::mat4 viewProj = glm::perspective(glm::radians(45.0f), 16.0f / 9.0f, 0.01f, 1000.0f) *
+                         glm::lookAt(glm::vec3(0.0f, 0.0f, -60.0f), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+    Frustum frustum = Frustum::fromMatrix(viewProj);
+    std::vector<unsigned char> visible(kCullItems);
+
+    double baselineMs = 0.0;
+    printf("Job system benchmark:\n");
+    for (int cores = 1; cores <= kMaxCores; ++cores)
+    {
+        // The calling thread is one of the cores, workers take the next ones
+        JobSystem jobs;
+        if (!jobs.init(cores - 1, 1))
+            continue;
+
+        u64 start = FramePacer::ticks();
+        JobCounter counter;
+        for (int i = 0; i < kEmptyJobs; ++i)
+            jobs.run([] {}, &counter);
+        jobs.wait(counter);
+        double perJobNs = elapsedMs(start) * 1000000.0 / kEmptyJobs;
+
+        start = FramePacer::ticks();
+        for (int i = 0; i < kParallelForCalls; ++i)
+            jobs.parallelFor(64, 1, [](size_t, size_t) {});
+        double perForUs = elapsedMs(start) * 1000.0 / kParallelForCalls;
+
+        jobs.resetStats();
+        double bestMs = 1e9;
+        for (int r = 0; r < kRepeats; ++r)
+        {
+            start = FramePacer::ticks();
+            jobs.parallelFor(kCullItems, 256, [&](size_t begin, size_t end) {
+                for (size_t i = begin; i < end; ++i)
+                {
+                    glm::vec3 center, extents;
+                    transformAabb(transforms[i], bmin, bmax, center, extents);
+                    visible[i] = frustum.intersectsAabb(center, extents) ? 1 : 0;
+                }
+            });
+            bestMs = std::min(bestMs, elapsedMs(start));
+        }
+        if (cores == 1)
+            baselineMs = bestMs;
+
+        JobSystem::Stats stats = jobs.stats();
+        printf("  %d core%s: %.0f ns/job, %.1f us/parallelFor, cull %zu items %.2f ms (%.2fx), %llu jobs, %llu stolen\n",
+               cores, cores == 1 ? " " : "s", perJobNs, perForUs, kCullItems, bestMs,
+               bestMs > 0.0 ? baselineMs / bestMs : 0.0,
+               (unsigned long long)stats.executed, (unsigned long long)stats.stolen);
+    }
+}
@@ -0,0 +1,337 @@
+#include "JobSystem.h"
+#include <algorithm>
+#include <cstdio>
+
+#ifdef __SWITCH__
+#include <switch.h>
+#endif
+
+// Workers sit just below the main thread's priority so they never delay
+// GL submission on a shared core
+static const int kWorkerPriority = 0x2D;
+
+// Worker identity of the calling thread, -1 outside of any worker
+static thread_local const JobSystem* tls_system = nullptr;
+static thread_local int tls_index = -1;
+
+JobSystem::~JobSystem()
+{
+    shutdown();
+}
+
+bool JobSystem::init(int workerCount, int firstCore)
+{
+    shutdown();
+
+    shared_.jobs.clear();
+    background_.jobs.clear();
+    queued_ = 0;
+    running_ = true;
+    for (int i = 0; i < workerCount; ++i)
+        workers_.push_back(std::make_unique<Queue>());
+    for (int i = 0; i < workerCount; ++i)
+    {
+        try
+        {
+            workers_[i]->thread = std::thread(&JobSystem::workerMain, this, i, firstCore + i);
+        }
+        catch (const std::exception& e)
+        {
+            printf("Failed to start job worker %d: %s\n", i, e.what());
+            shutdown();
+            return false;
+        }
+    }
+    return true;
+}
+
+void JobSystem::shutdown()
+{
+    if (!running_)
+        return;
+
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex_);
+        running_ = false;
+    }
+    wake_.notify_all();
+    for (auto& worker : workers_)
+    {
+        if (worker->thread.joinable())
+            worker->thread.join();
+    }
+    workers_.clear();
+}
+
+void JobSystem::workerMain(int index, int core)
+{
+#ifdef __SWITCH__
+    svcSetThreadCoreMask(CUR_THREAD_HANDLE, core, 1u << core);
+    svcSetThreadPriority(CUR_THREAD_HANDLE, kWorkerPriority);
+#else
+    (void)core;
+#endif
+    tls_system = this;
+    tls_index = index;
+
+    while (running_)
+    {
+        Job job;
+        if (tryPop(index, job) || tryPopBackground(job))
+        {
+            execute(index, job);
+            continue;
+        }
+
+        // Announce the sleep before checking for work, push() checks
+        // sleeping_ after queueing, so one of the two always sees the other
+        std::unique_lock<std::mutex> lock(sleepMutex_);
+        sleeping_++;
+        wake_.wait(lock, [this] { return !running_ || queued_ > 0; });
+        sleeping_--;
+    }
+}
+
+int JobSystem::currentQueue() const
+{
+    return tls_system == this ? tls_index : -1;
+}
+
+void JobSystem::push(int queue, Job job)
+{
+    Queue& q = queue >= 0 ? *workers_[queue] : shared_;
+    {
+        std::lock_guard<std::mutex> lock(q.mutex);
+        q.jobs.push_back(std::move(job));
+    }
+    queued_++;
+
+    if (sleeping_ > 0)
+    {
+        { std::lock_guard<std::mutex> lock(sleepMutex_); }
+        wake_.notify_one();
+    }
+}
+
+bool JobSystem::tryPop(int queue, Job& job)
+{
+    // Own jobs newest first
+    if (queue >= 0)
+    {
+        Queue& own = *workers_[queue];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.jobs.empty())
+        {
+            job = std::move(own.jobs.back());
+            own.jobs.pop_back();
+            queued_--;
+            return true;
+        }
+    }
+
+    // Then submissions from outside the pool, oldest first
+    {
+        std::lock_guard<std::mutex> lock(shared_.mutex);
+        if (!shared_.jobs.empty())
+        {
+            job = std::move(shared_.jobs.front());
+            shared_.jobs.pop_front();
+            queued_--;
+            return true;
+        }
+    }
+
+    // Then steal the oldest job of another worker
+    int count = (int)workers_.size();
+    for (int i = 1; i <= count; ++i)
+    {
+        int victim = (std::max(queue, 0) + i) % count;
+        if (victim == queue)
+            continue;
+
+        Queue& other = *workers_[victim];
+        std::lock_guard<std::mutex> lock(other.mutex);
+        if (!other.jobs.empty())
+        {
+            job = std::move(other.jobs.front());
+            other.jobs.pop_front();
+            queued_--;
+            (queue >= 0 ? *workers_[queue] : shared_).stolen++;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool JobSystem::tryPopBackground(Job& job)
+{
+    std::lock_guard<std::mutex> lock(background_.mutex);
+    if (background_.jobs.empty())
+        return false;
+    job = std::move(background_.jobs.front());
+    background_.jobs.pop_front();
+    queued_--;
+    return true;
+}
+
+void JobSystem::execute(int queue, Job& job)
+{
+    job.fn();
+    (queue >= 0 ? *workers_[queue] : shared_).executed++;
+    finish(job.counter);
+}
+
+void JobSystem::finish(JobCounter* counter)
+{
+    if (!counter)
+        return;
+
+    // Not the last job: a plain decrement, the count can't reach zero here
+    int pending = counter->pending_.load(std::memory_order_relaxed);
+    while (pending > 1)
+    {
+        if (counter->pending_.compare_exchange_weak(pending, pending - 1, std::memory_order_acq_rel))
+            return;
+    }
+
+    // Last one: the count drops under the lock, so runAfter() can't slip a
+    // continuation in after the list was taken. wait() takes the lock once
+    // more before it returns, so the counter (often on the waiter's stack)
+    // outlives the unlock below.
+    std::vector<Job> ready;
+    {
+        std::lock_guard<std::mutex> lock(counter->mutex_);
+        if (counter->pending_.fetch_sub(1, std::memory_order_acq_rel) == 1)
+            ready.swap(counter->continuations_);
+    }
+    for (Job& job : ready)
+        submit(std::move(job));
+}
+
+void JobSystem::submit(Job job)
+{
+    if (workers_.empty())
+    {
+        // No workers: run inline so callers don't have to special-case it
+        execute(-1, job);
+        return;
+    }
+    push(currentQueue(), std::move(job));
+}
+
+void JobSystem::run(std::function<void()> fn, JobCounter* counter)
+{
+    if (counter)
+        counter->pending_.fetch_add(1, std::memory_order_relaxed);
+
+    submit(Job{std::move(fn), counter});
+}
+
+void JobSystem::runBackground(std::function<void()> fn, JobCounter* counter)
+{
+    if (counter)
+        counter->pending_.fetch_add(1, std::memory_order_relaxed);
+
+    Job job{std::move(fn), counter};
+    if (workers_.empty())
+    {
+        execute(-1, job);
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(background_.mutex);
+        background_.jobs.push_back(std::move(job));
+    }
+    queued_++;
+
+    if (sleeping_ > 0)
+    {
+        { std::lock_guard<std::mutex> lock(sleepMutex_); }
+        wake_.notify_one();
+    }
+}
+
+void JobSystem::runAfter(JobCounter& dependency, std::function<void()> fn, JobCounter* counter)
+{
+    if (counter)
+        counter->pending_.fetch_add(1, std::memory_order_relaxed);
+
+    Job job{std::move(fn), counter};
+    {
+        // finish() takes the list under the same lock after the count hit
+        // zero, so the job is either queued here or picked up there
+        std::lock_guard<std::mutex> lock(dependency.mutex_);
+        if (!dependency.done())
+        {
+            dependency.continuations_.push_back(std::move(job));
+            return;
+        }
+    }
+    submit(std::move(job));
+}
+
+void JobSystem::wait(JobCounter& counter)
+{
+    int queue = currentQueue();
+    while (!counter.done())
+    {
+        Job job;
+        if (tryPop(queue, job))
+            execute(queue, job);
+        else
+            std::this_thread::yield();
+    }
+
+    // The last finish() may still be unlocking; the caller is free to
+    // destroy the counter only after that
+    std::lock_guard<std::mutex> lock(counter.mutex_);
+}
+
+void JobSystem::parallelFor(size_t count, size_t grain, const std::function<void(size_t, size_t)>& fn)
+{
+    if (count == 0)
+        return;
+
+    // A few chunks per thread so stealing can even out uneven chunks
+    size_t threads = workers_.size() + 1;
+    size_t chunks = std::min((count + std::max<size_t>(grain, 1) - 1) / std::max<size_t>(grain, 1), threads * 4);
+    if (chunks <= 1 || workers_.empty())
+    {
+        fn(0, count);
+        return;
+    }
+
+    size_t chunkSize = (count + chunks - 1) / chunks;
+    JobCounter counter;
+    for (size_t begin = chunkSize; begin < count; begin += chunkSize)
+    {
+        size_t end = std::min(begin + chunkSize, count);
+        run([&fn, begin, end] { fn(begin, end); }, &counter);
+    }
+    fn(0, std::min(chunkSize, count));
+    wait(counter);
+}
+
+JobSystem::Stats JobSystem::stats() const
+{
+    Stats s;
+    s.executed = shared_.executed;
+    s.stolen = shared_.stolen;
+    for (const auto& worker : workers_)
+    {
+        s.executed += worker->executed;
+        s.stolen += worker->stolen;
+    }
+    return s;
+}
+
+void JobSystem::resetStats()
+{
+    shared_.executed = 0;
+    shared_.stolen = 0;
+    for (auto& worker : workers_)
+    {
+        worker->executed = 0;
+        worker->stolen = 0;
+    }
+}
@@ -0,0 +1,171 @@
+#include "LightClusters.h"
+#include <glm/gtc/type_ptr.hpp>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+// Slices end here at most, the last one takes everything behind
+static const float kClusterFar = 100.0f;
+// Where the exponential series starts, the camera near plane would waste
+// slices on the first few centimetres
+static const float kClusterNear = 1.0f;
+
+LightGPU makePointLight(const glm::vec3& position, const glm::vec3& color, float radius)
+{
+    LightGPU light{};
+    light.positionRadius = glm::vec4(position, radius);
+    light.colorType = glm::vec4(color, (float)LightType_Point);
+    return light;
+}
+
+LightGPU makeSpotLight(const glm::vec3& position, const glm::vec3& color, float radius,
+                       const glm::vec3& direction, float innerAngle, float outerAngle)
+{
+    float cosOuter = std::cos(outerAngle);
+    float cosInner = std::cos(std::min(innerAngle, outerAngle));
+
+    LightGPU light{};
+    light.positionRadius = glm::vec4(position, radius);
+    light.colorType = glm::vec4(color, (float)LightType_Spot);
+    light.spotDirection = glm::vec4(glm::normalize(direction), cosOuter);
+    light.spotParams = glm::vec4(1.0f / std::max(cosInner - cosOuter, 1e-4f), 0.0f, 0.0f, 0.0f);
+    return light;
+}
+
+LightClusters::~LightClusters()
+{
+    GLuint buffers[] = { lightSsbo_, countSsbo_, indexSsbo_ };
+    if (lightSsbo_)
+        glDeleteBuffers(3, buffers);
+}
+
+bool LightClusters::init()
+{
+    cullShader_ = std::make_unique<Shader>();
+    cullShader_->setOnLink([this](const Shader& shader) {
+        loc_view = shader.getUniformLocation("uView");
+        loc_invProj = shader.getUniformLocation("uInvProj");
+        loc_lightCount = shader.getUniformLocation("uLightCount");
+        loc_grid = shader.getUniformLocation("uClusterGrid");
+        loc_depth = shader.getUniformLocation("uClusterDepth");
+    });
+    if (!cullShader_->loadComputeFromFile("romfs:/shaders/light_cull.comp"))
+    {
+        printf("Failed to load light culling shader\n");
+        return false;
+    }
+
+    glGenBuffers(1, &lightSsbo_);
+    glGenBuffers(1, &countSsbo_);
+    glGenBuffers(1, &indexSsbo_);
+
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, lightSsbo_);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, kMaxLights * sizeof(LightGPU), nullptr, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, countSsbo_);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, kClusterCount * sizeof(GLuint), nullptr, GL_DYNAMIC_COPY);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, indexSsbo_);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, (size_t)kClusterCount * kMaxLightsPerCluster * sizeof(GLuint), nullptr,
+                 GL_DYNAMIC_COPY);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+    printf("Light clusters: %dx%dx%d, %.1f MB of lists\n", kGridX, kGridY, kGridZ,
+           (double)kClusterCount * kMaxLightsPerCluster * sizeof(GLuint) / (1024.0 * 1024.0));
+    return true;
+}
+
+void LightClusters::setLights(const std::vector<LightGPU>& lights)
+{
+    lightCount_ = std::min(lights.size(), (size_t)kMaxLights);
+    if (lights.size() > lightCount_)
+        printf("Light clusters: %zu lights, only the first %d are used\n", lights.size(), kMaxLights);
+    if (lightCount_ == 0)
+        return;
+
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, lightSsbo_);
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, lightCount_ * sizeof(LightGPU), lights.data());
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
+
+void LightClusters::cull(const glm::mat4& view, const glm::mat4& proj)
+{
+    // Near and far plane of a glm::perspective projection
+    cameraFar_ = proj[3][2] / (proj[2][2] + 1.0f);
+    near_ = kClusterNear;
+    far_ = std::min(kClusterFar, cameraFar_);
+    if (lightCount_ == 0)
+        return;
+
+    timer_.begin();
+    cullShader_->use();
+    glm::mat4 invProj = glm::inverse(proj);
+    glUniformMatrix4fv(loc_view, 1, GL_FALSE, glm::value_ptr(view));
+    glUniformMatrix4fv(loc_invProj, 1, GL_FALSE, glm::value_ptr(invProj));
+    glUniform1ui(loc_lightCount, (GLuint)lightCount_);
+    glUniform3ui(loc_grid, kGridX, kGridY, kGridZ);
+    glUniform4f(loc_depth, near_, far_, kGridZ / std::log(far_ / near_), cameraFar_);
+
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 7, lightSsbo_);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 8, countSsbo_);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 9, indexSsbo_);
+
+    // One invocation per froxel, every froxel writes its own count
+    glDispatchCompute((kClusterCount + 63) / 64, 1, 1);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+    timer_.end();
+}
+
+void LightClusters::bind() const
+{
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 7, lightSsbo_);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 8, countSsbo_);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 9, indexSsbo_);
+}
+
+LightClusters::Uniforms LightClusters::locate(const Shader& shader)
+{
+    Uniforms loc;
+    loc.lightCount = shader.getUniformLocation("uLightCount");
+    loc.grid = shader.getUniformLocation("uClusterGrid");
+    loc.depth = shader.getUniformLocation("uClusterDepth");
+    loc.tileScale = shader.getUniformLocation("uClusterTileScale");
+    return loc;
+}
+
+void LightClusters::setUniforms(const Uniforms& loc) const
+{
+    glUniform1ui(loc.lightCount, (GLuint)lightCount_);
+    glUniform3ui(loc.grid, kGridX, kGridY, kGridZ);
+    glUniform4f(loc.depth, near_, far_, kGridZ / std::log(far_ / near_), cameraFar_);
+}
+
+void LightClusters::setViewport(const Uniforms& loc, int width, int height)
+{
+    glUniform2f(loc.tileScale, (float)kGridX / width, (float)kGridY / height);
+}
+
+void LightClusters::readStats(float& average, unsigned& maximum, unsigned& overflowed) const
+{
+    average = 0.0f;
+    maximum = 0;
+    overflowed = 0;
+    if (lightCount_ == 0)
+        return;
+
+    std::vector<GLuint> counts(kClusterCount);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, countSsbo_);
+    glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, counts.size() * sizeof(GLuint), counts.data());
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+    size_t used = 0, total = 0;
+    for (GLuint count : counts)
+    {
+        if (count == 0)
+            continue;
+        ++used;
+        total += count;
+        maximum = std::max(maximum, (unsigned)count);
+        if (count > (GLuint)kMaxLightsPerCluster)
+            ++overflowed;
+    }
+    average = used ? (float)total / used : 0.0f;
+}
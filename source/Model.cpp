@@ -1,26 +1,67 @@
 #include "Model.h"
+#include "JobSystem.h"
+#include "TextureUtils.h"
+#include "ImageDecoder.h"
+#include "TextureCache.h"
 #define TINYOBJLOADER_IMPLEMENTATION
 #include <tiny_obj_loader.h>
 #include <unordered_map>
+#include <algorithm>
+#include <memory>
 #include <cstdio>
 #include <string>
-#include "Image.h"
+
+std::vector<std::string> materialFeatureDefines()
+{
+    return { "HAS_NORMAL_MAP", "HAS_ORM", "UNLIT" };
+}
+
+unsigned Material::features() const
+{
+    if (unlit)
+        return 1u << MaterialFeature_Unlit;
+
+    unsigned mask = 0;
+    if (normalLayer != 0)
+        mask |= 1u << MaterialFeature_NormalMap;
+    if (ormLayer != 0)
+        mask |= 1u << MaterialFeature_Orm;
+    return mask;
+}
+
+GLuint Material::estimatedCost(unsigned features)
+{
+    // fragment.glsl always samples the base color. Lit variants evaluate
+    // GGX, Smith and Schlick for the directional light, counted as about
+    // four fetches, plus one fetch per optional map (occlusion, roughness
+    // and metallic in a single packed fetch). The clustered local lights
+    // are left out: their loop costs the same for every material and
+    // scales with the froxel's light count, which a per-material number
+    // can't know.
+    GLuint cost = 1;
+    if (features & (1u << MaterialFeature_Unlit))
+        return cost;
+    cost += 4;
+    if (features & (1u << MaterialFeature_Orm))
+        cost += 1;
+    if (features & (1u << MaterialFeature_NormalMap))
+        cost += 1;
+    return cost;
+}
 
 Model::Model(const std::string& path) : path_(path) {}
 
 Model::~Model()
 {
     if (vbo_) glDeleteBuffers(1, &vbo_);
+    if (ebo_) glDeleteBuffers(1, &ebo_);
+    if (positionVbo_) glDeleteBuffers(1, &positionVbo_);
+    if (positionVao_) glDeleteVertexArrays(1, &positionVao_);
+    if (materialSsbo_) glDeleteBuffers(1, &materialSsbo_);
+    if (boundsSsbo_) glDeleteBuffers(1, &boundsSsbo_);
     if (vao_) glDeleteVertexArrays(1, &vao_);
 
-    for (auto& mat : materials_)
-    {
-        if (mat.baseColorTex) glDeleteTextures(1, &mat.baseColorTex);
-        if (mat.metallicTex)  glDeleteTextures(1, &mat.metallicTex);
-        if (mat.roughnessTex) glDeleteTextures(1, &mat.roughnessTex);
-        if (mat.aoTex)        glDeleteTextures(1, &mat.aoTex);
-        if (mat.normalTex)    glDeleteTextures(1, &mat.normalTex);
-    }
+    glDeleteTextures(Slot_Count, textureArrays_);
 }
 
 static std::string getDirname(const std::string& path)
@@ -29,21 +70,7 @@ static std::string getDirname(const std::string& path)
     return (p == std::string::npos) ? std::string() : path.substr(0, p + 1);
 }
 
-GLuint Model::createDefaultTexture(const unsigned char color[4])
-{
-    GLuint tex;
-    glGenTextures(1, &tex);
-    glBindTexture(GL_TEXTURE_2D, tex);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, color);
-    glBindTexture(GL_TEXTURE_2D, 0);
-    return tex;
-}
-
-bool Model::load()
+bool Model::load(JobSystem* jobs)
 {
     tinyobj::ObjReaderConfig reader_config;
     reader_config.triangulate = true;
@@ -64,10 +91,39 @@ bool Model::load()
     const auto& shapes = reader.GetShapes();
     const auto& tinyMaterials = reader.GetMaterials();
 
-    // Convert tinyobj materials to our Material struct
+    // Convert tinyobj materials to our Material struct. Textures are only
+    // decoded here; every map goes into a layer of its slot's texture array
+    // in uploadToGPU(). Maps shared between materials share a layer, and so
+    // do identical occlusion/roughness/metallic combinations.
     materials_.resize(tinyMaterials.size());
     std::string baseDir = getDirname(path_);
-    unsigned char white[4] = { 255,255,255,255 };
+    std::unordered_map<std::string, GLuint> layerKeys[Slot_Count];
+    std::vector<TextureLayerSource> slotSources[Slot_Count];
+    auto resolve = [&](const std::string& fname) {
+        if (fname.empty() || fname[0] == '/' || baseDir.empty())
+            return fname;
+        return baseDir + fname;
+    };
+    // Register a layer by key, returns its provisional layer (0 = default).
+    // Decoding happens below, all layers at once.
+    auto addLayer = [&](TextureSlot slot, const std::string& key, const TextureLayerSource& source) -> GLuint {
+        auto it = layerKeys[slot].find(key);
+        if (it != layerKeys[slot].end())
+            return it->second;
+
+        slotSources[slot].push_back(source);
+        GLuint layer = (GLuint)slotSources[slot].size();
+        layerKeys[slot][key] = layer;
+        return layer;
+    };
+    auto loadTex = [&](TextureSlot slot, const std::string& fname) -> GLuint {
+        if (fname.empty()) return 0;
+        TextureLayerSource source;
+        source.path = resolve(fname);
+        return addLayer(slot, source.path, source);
+    };
+
+    bool ormChannelUsed[Orm_Count] = {};
     for (size_t i = 0; i < tinyMaterials.size(); ++i)
     {
         const auto& tmat = tinyMaterials[i];
@@ -80,48 +136,179 @@ bool Model::load()
         mat.metallicFactor = tmat.metallic;
         mat.roughnessFactor = tmat.roughness;
         mat.aoFactor = 1.0f;
-
-        // Load textures if they exist
-        auto loadTex = [&](const std::string& fname) -> GLuint {
-            if (fname.empty()) return createDefaultTexture(white);
-            std::string texPath = fname;
-            if (texPath[0] != '/' && !baseDir.empty()) texPath = baseDir + texPath;
-            Image img(texPath, 4);
-            if (img.data())
-            {
-                GLuint tex = 0;
-                glGenTextures(1, &tex);
-                glBindTexture(GL_TEXTURE_2D, tex);
-                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-                glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, img.width(), img.height(), 0, GL_RGBA, GL_UNSIGNED_BYTE, img.data());
-                glGenerateMipmap(GL_TEXTURE_2D);
-                glBindTexture(GL_TEXTURE_2D, 0);
-                return tex;
-            }
-            return createDefaultTexture(white);
-        };
+        mat.unlit = tmat.illum == 0;
 
         printf("Found BaseColor at %s\n", tmat.diffuse_texname.c_str());
-        mat.baseColorTex = loadTex(tmat.diffuse_texname);
+        mat.baseColorLayer = loadTex(Slot_BaseColor, tmat.diffuse_texname);
 
         printf("Found Metallic at %s\n", tmat.metallic_texname.c_str());
-        mat.metallicTex  = loadTex(tmat.metallic_texname);
-        
         printf("Found Roughness at %s\n", tmat.roughness_texname.c_str());
-        mat.roughnessTex = loadTex(tmat.roughness_texname);
-        
         printf("Found AO at %s\n", tmat.ambient_texname.c_str());
-        mat.aoTex        = loadTex(tmat.ambient_texname);
-        
+        TextureLayerSource orm;
+        orm.channelPaths[Orm_Occlusion] = resolve(tmat.ambient_texname);
+        orm.channelPaths[Orm_Roughness] = resolve(tmat.roughness_texname);
+        orm.channelPaths[Orm_Metallic] = resolve(tmat.metallic_texname);
+        std::string ormKey;
+        for (int c = 0; c < Orm_Count; ++c)
+        {
+            ormKey += orm.channelPaths[c] + "|";
+            ormChannelUsed[c] = ormChannelUsed[c] || !orm.channelPaths[c].empty();
+        }
+        if (!orm.channelPaths[Orm_Occlusion].empty() || !orm.channelPaths[Orm_Roughness].empty() ||
+            !orm.channelPaths[Orm_Metallic].empty())
+            mat.ormLayer = addLayer(Slot_ORM, ormKey, orm);
+
         printf("Found Normal at %s\n", tmat.normal_texname.c_str());
-        mat.normalTex    = loadTex(tmat.normal_texname);
+        mat.normalLayer    = loadTex(Slot_Normal, tmat.normal_texname);
+    }
+
+    // The ORM array is packed RGBA8, or R8 when the model only ever uses one
+    // of the three maps; a swizzle then puts it in its channel and reads the
+    // others as white
+    TextureArrayInfo& ormInfo = textureInfo_[Slot_ORM];
+    ormInfo.packed = true;
+    int ormUsed = 0;
+    for (int c = 0; c < Orm_Count; ++c)
+    {
+        if (ormChannelUsed[c])
+        {
+            ormUsed++;
+            ormInfo.packedChannel = c;
+        }
     }
+    if (ormUsed == 1)
+    {
+        ormInfo.channels = 1;
+        ormInfo.internalFormat = GL_R8;
+    }
+    else
+    {
+        ormInfo.packedChannel = -1;
+    }
+
+    // Base color is sampled through an sRGB format: decoded to linear in the
+    // texture unit before filtering, the shader gets linear values for free
+    textureInfo_[Slot_BaseColor].content = MipContent_Srgb;
+    textureInfo_[Slot_BaseColor].internalFormat = GL_SRGB8_ALPHA8;
+    textureInfo_[Slot_ORM].content = MipContent_Linear;
+    textureInfo_[Slot_Normal].content = MipContent_Normal;
 
-    // Build vertices and submeshes
-    std::unordered_map<int, std::vector<Vertex>> temp;
+    // Mip chains of every unique layer, one job per layer: from the mip
+    // cache, or decoded and filtered on the CPU the first time
+    struct Decode
+    {
+        TextureSlot slot;
+        size_t index;
+        bool ok;
+        bool cached;
+        MipChain chain;
+    };
+    std::vector<Decode> decodes;
+    for (int slot = 0; slot < Slot_Count; ++slot)
+    {
+        textureInfo_[slot].layerSources = slotSources[slot];
+        for (size_t i = 0; i < slotSources[slot].size(); ++i)
+            decodes.push_back({(TextureSlot)slot, i, false, false, MipChain{}});
+    }
+
+    // With fewer layers than threads, large JPEGs are also split into bands
+    bool bandDecode = jobs && decodes.size() <= (size_t)jobs->workerCount();
+    auto decode = [&](size_t begin, size_t end) {
+        for (size_t d = begin; d < end; ++d)
+        {
+            Decode& dec = decodes[d];
+            dec.ok = loadLayerMips(textureInfo_[dec.slot], (int)dec.index + 1, 0, dec.chain, jobs, bandDecode,
+                                   &dec.cached);
+        }
+    };
+    if (jobs)
+        jobs->parallelFor(decodes.size(), 1, decode);
+    else
+        decode(0, decodes.size());
+
+    // Keep the layers that decoded, materials using a failed one get the default layer
+    std::vector<GLuint> layerRemap[Slot_Count];
+    for (int slot = 0; slot < Slot_Count; ++slot)
+    {
+        layerRemap[slot].assign(slotSources[slot].size() + 1, 0);
+        textureInfo_[slot].layerSources.clear();
+    }
+    size_t cachedLayers = 0;
+    for (Decode& d : decodes)
+    {
+        if (!d.ok)
+            continue;
+        cachedLayers += d.cached ? 1 : 0;
+        slotLayers_[d.slot].push_back(std::move(d.chain));
+        textureInfo_[d.slot].layerSources.push_back(slotSources[d.slot][d.index]);
+        layerRemap[d.slot][d.index + 1] = (GLuint)slotLayers_[d.slot].size();
+    }
+    for (Material& mat : materials_)
+    {
+        mat.baseColorLayer = layerRemap[Slot_BaseColor][mat.baseColorLayer];
+        mat.ormLayer       = layerRemap[Slot_ORM][mat.ormLayer];
+        mat.normalLayer    = layerRemap[Slot_Normal][mat.normalLayer];
+    }
+
+    // The array takes the size of the largest map in the slot, smaller maps
+    // are stretched (and their mips rebuilt, or read from the mip cache
+    // at that size) so every material fits in one array
+    std::vector<std::pair<TextureSlot, size_t>> unfit;
+    size_t layerCount = 0;
+    for (int slot = 0; slot < Slot_Count; ++slot)
+    {
+        TextureArrayInfo& info = textureInfo_[slot];
+        info.width = info.height = 1;
+        for (const MipChain& chain : slotLayers_[slot])
+        {
+            info.width = std::max(info.width, chain.width);
+            info.height = std::max(info.height, chain.height);
+        }
+        for (size_t i = 0; i < slotLayers_[slot].size(); ++i)
+        {
+            const MipChain& chain = slotLayers_[slot][i];
+            if (chain.width != info.width || chain.height != info.height)
+                unfit.push_back({(TextureSlot)slot, i});
+        }
+        layerCount += slotLayers_[slot].size();
+    }
+    auto fit = [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i)
+        {
+            TextureSlot slot = unfit[i].first;
+            size_t index = unfit[i].second;
+            loadFittedLayerMips(textureInfo_[slot], (int)index + 1, 0, slotLayers_[slot][index], jobs);
+        }
+    };
+    if (jobs)
+        jobs->parallelFor(unfit.size(), 1, fit);
+    else
+        fit(0, unfit.size());
+    printf("Texture layers: %zu from the mip cache, %zu baked, %zu stretched\n", cachedLayers,
+           layerCount - cachedLayers, unfit.size());
+
+    // Build vertices, indices and submeshes. Corners that share the same
+    // position/normal/texcoord indices within a material are welded so the
+    // submesh can be drawn indexed. Every material is welded by its own job.
+    struct IndexKey
+    {
+        int v, n, t;
+        bool operator==(const IndexKey& o) const { return v == o.v && n == o.n && t == o.t; }
+    };
+    struct IndexKeyHash
+    {
+        size_t operator()(const IndexKey& k) const
+        {
+            return ((size_t)k.v * 73856093u) ^ ((size_t)k.n * 19349663u) ^ ((size_t)k.t * 83492791u);
+        }
+    };
+    struct Group
+    {
+        std::vector<Vertex> vertices;
+        std::vector<GLuint> indices;
+        float boundsMin[3];
+        float boundsMax[3];
+    };
     auto copyVec3 = [](int idx, const std::vector<float>& data, const float def[3], float out[3]){
         if (idx >= 0){ out[0]=data[3*idx]; out[1]=data[3*idx+1]; out[2]=data[3*idx+2]; }
         else { out[0]=def[0]; out[1]=def[1]; out[2]=def[2]; }
@@ -130,53 +317,326 @@ bool Model::load()
         if (idx >= 0){ out[0]=data[2*idx]; out[1]=data[2*idx+1]; }
         else { out[0]=def[0]; out[1]=def[1]; }
     };
-    float defPos[3] = {0,0,0}, defNormal[3]={0,0,1}, defTex[2]={0,0};
+    const float defPos[3] = {0,0,0}, defNormal[3]={0,0,1}, defTex[2]={0,0};
 
+    // groups[matid + 1], the first one collects faces without a material.
+    // One pass sorts the faces into their groups, then each group welds
+    // only its own faces.
+    struct Face
+    {
+        const tinyobj::index_t* indices;
+        size_t count;
+    };
+    std::vector<Group> groups(materials_.size() + 1);
+    std::vector<std::vector<Face>> faces(groups.size());
     for (const auto& shape : shapes)
     {
         size_t index_offset = 0;
         for (size_t f = 0; f < shape.mesh.num_face_vertices.size(); ++f)
         {
             int matid = (f < shape.mesh.material_ids.size()) ? shape.mesh.material_ids[f] : -1;
+            if (matid < -1 || matid >= (int)materials_.size()) matid = -1;
             size_t fv = shape.mesh.num_face_vertices[f];
-            for (size_t v=0; v<fv; ++v)
-            {
-                tinyobj::index_t idx = shape.mesh.indices[index_offset+v];
-                Vertex vert{};
-                copyVec3(idx.vertex_index, attrib.vertices, defPos, vert.position);
-                copyVec3(idx.normal_index, attrib.normals, defNormal, vert.normal);
-                copyVec2(idx.texcoord_index, attrib.texcoords, defTex, vert.texcoord);
-                temp[matid].push_back(vert);
-            }
+            faces[matid + 1].push_back({shape.mesh.indices.data() + index_offset, fv});
             index_offset += fv;
         }
     }
 
+    auto weld = [&](size_t begin, size_t end) {
+        for (size_t g = begin; g < end; ++g)
+        {
+            Group& group = groups[g];
+            std::unordered_map<IndexKey, GLuint, IndexKeyHash> lookup;
+
+            for (const Face& face : faces[g])
+            {
+                for (size_t v=0; v<face.count; ++v)
+                {
+                    const tinyobj::index_t& idx = face.indices[v];
+                    IndexKey key{idx.vertex_index, idx.normal_index, idx.texcoord_index};
+                    auto it = lookup.find(key);
+                    if (it != lookup.end())
+                    {
+                        group.indices.push_back(it->second);
+                        continue;
+                    }
+
+                    Vertex vert{};
+                    copyVec3(idx.vertex_index, attrib.vertices, defPos, vert.position);
+                    copyVec3(idx.normal_index, attrib.normals, defNormal, vert.normal);
+                    copyVec2(idx.texcoord_index, attrib.texcoords, defTex, vert.texcoord);
+                    GLuint newIndex = (GLuint)group.vertices.size();
+                    group.vertices.push_back(vert);
+                    lookup.emplace(key, newIndex);
+                    group.indices.push_back(newIndex);
+                }
+            }
+
+            if (group.vertices.empty())
+                continue;
+            for (int a = 0; a < 3; ++a)
+            {
+                group.boundsMin[a] = group.boundsMax[a] = group.vertices[0].position[a];
+                for (const Vertex& v : group.vertices)
+                {
+                    if (v.position[a] < group.boundsMin[a]) group.boundsMin[a] = v.position[a];
+                    if (v.position[a] > group.boundsMax[a]) group.boundsMax[a] = v.position[a];
+                }
+            }
+        }
+    };
+    if (jobs)
+        jobs->parallelFor(groups.size(), 1, weld);
+    else
+        weld(0, groups.size());
+
     vertices_.clear();
+    indices_.clear();
     submeshes_.clear();
-    auto addSubmesh = [&](int matid){
-        auto it = temp.find(matid);
-        if(it != temp.end() && !it->second.empty()){
-            Submesh sm{matid, vertices_.size(), it->second.size()};
-            vertices_.insert(vertices_.end(), it->second.begin(), it->second.end());
-            submeshes_.push_back(sm);
+    for (size_t g = 0; g < groups.size(); ++g)
+    {
+        const Group& group = groups[g];
+        if (group.indices.empty())
+            continue;
+
+        Submesh sm{(int)g - 1, indices_.size(), group.indices.size(), (int)vertices_.size(), {}, {}};
+        for (int a = 0; a < 3; ++a)
+        {
+            sm.boundsMin[a] = group.boundsMin[a];
+            sm.boundsMax[a] = group.boundsMax[a];
         }
+        vertices_.insert(vertices_.end(), group.vertices.begin(), group.vertices.end());
+        indices_.insert(indices_.end(), group.indices.begin(), group.indices.end());
+        submeshes_.push_back(sm);
+    }
+
+    printf("Model loaded: %s (%zu vertices, %zu indices, %zu submeshes, %zu materials)\n",
+           path_.c_str(), vertices_.size(), indices_.size(), submeshes_.size(), materials_.size());
+
+    return true;
+}
+
+bool Model::decodeLayer(const TextureArrayInfo& info, int layer,
+                        std::vector<unsigned char>& pixels, int& width, int& height, JobSystem* jobs)
+{
+    // Maps are decoded straight into 'pixels', no Image in between
+    const TextureLayerSource& source = info.layerSources[layer - 1];
+    if (!info.packed || info.channels == 1)
+    {
+        const std::string& path = info.packed ? source.channelPaths[info.packedChannel] : source.path;
+        if (decodeImageFile(path, info.channels, true, pixels, width, height, jobs))
+            return true;
+        printf("Failed to load image: %s\n", path.c_str());
+        return false;
+    }
+
+    // Packed RGBA: one greyscale map per channel, all stretched to the
+    // largest of them. A map that fails to load reads as white.
+    struct Map
+    {
+        std::vector<unsigned char> pixels;
+        int width = 0, height = 0;
     };
-    addSubmesh(-1);
-    for (size_t i=0;i<materials_.size();++i) addSubmesh(i);
+    Map maps[Orm_Count];
+    width = height = 0;
+    for (int c = 0; c < Orm_Count; ++c)
+    {
+        const std::string& path = source.channelPaths[c];
+        if (path.empty())
+            continue;
+        if (!decodeImageFile(path, 1, true, maps[c].pixels, maps[c].width, maps[c].height, jobs))
+        {
+            printf("Failed to load image: %s\n", path.c_str());
+            maps[c].pixels.clear();
+            continue;
+        }
+        width = std::max(width, maps[c].width);
+        height = std::max(height, maps[c].height);
+    }
+    if (width == 0)
+        return false;
+
+    pixels.assign((size_t)width * height * 4, 255);
+    std::vector<unsigned char> scratch;
+    for (int c = 0; c < Orm_Count; ++c)
+    {
+        const Map& map = maps[c];
+        if (map.pixels.empty())
+            continue;
+        const unsigned char* src = map.pixels.data();
+        if (map.width != width || map.height != height)
+        {
+            scratch.resize((size_t)width * height);
+            resampleU8(map.pixels.data(), map.width, map.height, 1, scratch.data(), width, height);
+            src = scratch.data();
+        }
+        for (size_t i = 0; i < (size_t)width * height; ++i)
+            pixels[i * 4 + c] = src[i];
+    }
+    return true;
+}
+
+// Source files a layer is decoded from, what its mip cache key covers
+static std::vector<std::string> layerFiles(const TextureArrayInfo& info, int layer)
+{
+    const TextureLayerSource& source = info.layerSources[layer - 1];
+    std::vector<std::string> files;
+    if (info.packed && info.channels == 1)
+        files.push_back(source.channelPaths[info.packedChannel]);
+    else if (info.packed)
+        files.assign(source.channelPaths, source.channelPaths + Orm_Count);
+    else
+        files.push_back(source.path);
+    return files;
+}
+
+bool Model::loadLayerMips(const TextureArrayInfo& info, int layer, int firstLevel, MipChain& chain,
+                          JobSystem* jobs, bool bandDecode, bool* fromCache)
+{
+    uint64_t key = mipCacheKey(layerFiles(info, layer), info.channels, info.content);
+    bool cached = loadMipCache(key, chain, firstLevel);
+    if (fromCache)
+        *fromCache = cached;
+    if (cached)
+        return true;
+
+    std::vector<unsigned char> pixels;
+    int width = 0, height = 0;
+    if (!decodeLayer(info, layer, pixels, width, height, bandDecode ? jobs : nullptr))
+        return false;
+    generateMipChain(pixels.data(), width, height, info.channels, info.content, chain, jobs);
+    saveMipCache(key, chain);
+    return true;
+}
+
+bool Model::loadFittedLayerMips(const TextureArrayInfo& info, int layer, int firstLevel, MipChain& chain,
+                                JobSystem* jobs)
+{
+    uint64_t key = mipCacheKey(layerFiles(info, layer), info.channels, info.content, info.width, info.height);
+    MipChain fitted;
+    if (loadMipCache(key, fitted, firstLevel) && fitted.width == info.width && fitted.height == info.height)
+    {
+        chain = std::move(fitted);
+        return true;
+    }
+
+    bool full = chain.width > 0 && !chain.levels.empty() && !chain.levels[0].empty();
+    if (!full && !loadLayerMips(info, layer, 0, chain, jobs))
+        return false;
+    fitMipChain(chain, info.width, info.height, info.content, jobs);
+    saveMipCache(key, chain);
+    return true;
+}
+
+GLuint Model::createTextureArray(TextureSlot slot, int mip) const
+{
+    const TextureArrayInfo& info = textureInfo_[slot];
+
+    GLuint texture = 0;
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, texture);
+    glTexStorage3D(GL_TEXTURE_2D_ARRAY, info.levels - mip, info.internalFormat,
+                   mipSize(info.width, mip), mipSize(info.height, mip), info.layers);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    if (info.channels == 1 && info.packedChannel >= 0)
+    {
+        GLint swizzle[4] = { GL_ONE, GL_ONE, GL_ONE, GL_ONE };
+        swizzle[info.packedChannel] = GL_RED;
+        glTexParameteriv(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_SWIZZLE_RGBA, swizzle);
+    }
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+    return texture;
+}
+
+bool Model::uploadTextureArrays(int maxTextureSize)
+{
+    // Chains were sized to the array in load(), levels are uploaded as they
+    // are, no glGenerateMipmap
+    std::vector<unsigned char> white;
+    for (int slot = 0; slot < Slot_Count; ++slot)
+    {
+        const std::vector<MipChain>& layers = slotLayers_[slot];
+        TextureArrayInfo& info = textureInfo_[slot];
+        int w = info.width, h = info.height;
+        info.layers = (int)layers.size() + 1;
+        info.levels = mipLevelCount(w, h);
+
+        // Streaming starts from the coarse end of the chain
+        int mip = 0;
+        if (maxTextureSize > 0)
+        {
+            while (mip + 1 < info.levels && (mipSize(w, mip) > maxTextureSize || mipSize(h, mip) > maxTextureSize))
+                ++mip;
+        }
+        info.residentMip = mip;
+
+        textureArrays_[slot] = createTextureArray((TextureSlot)slot, mip);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, textureArrays_[slot]);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1); // R8 rows aren't 4-byte aligned
+
+        for (int level = mip; level < info.levels; ++level)
+        {
+            int lw = mipSize(w, level), lh = mipSize(h, level);
 
-    printf("Model loaded: %s (%zu vertices, %zu submeshes, %zu materials)\n",
-           path_.c_str(), vertices_.size(), submeshes_.size(), materials_.size());
+            // Layer 0: white default for materials without this map
+            white.assign((size_t)lw * lh * info.channels, 255);
+            glTexSubImage3D(GL_TEXTURE_2D_ARRAY, level - mip, 0, 0, 0, lw, lh, 1, info.pixelFormat(), GL_UNSIGNED_BYTE, white.data());
 
+            for (size_t i = 0; i < layers.size(); ++i)
+            {
+                glTexSubImage3D(GL_TEXTURE_2D_ARRAY, level - mip, 0, 0, (GLint)i + 1, lw, lh, 1, info.pixelFormat(),
+                                GL_UNSIGNED_BYTE, layers[i].levels[level].data());
+            }
+        }
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+        printf("Texture array %d: %dx%d, %d layers, %s, resident from mip %d\n", slot, w, h, info.layers,
+               info.channels == 1 ? "R8" : "RGBA8", mip);
+
+        // CPU copies are no longer needed
+        slotLayers_[slot].clear();
+    }
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
     return true;
 }
 
-bool Model::uploadToGPU()
+void Model::replaceTextureArray(TextureSlot slot, GLuint texture, int residentMip)
 {
-    if(vertices_.empty()) return false;
+    glDeleteTextures(1, &textureArrays_[slot]);
+    textureArrays_[slot] = texture;
+    textureInfo_[slot].residentMip = residentMip;
+}
+
+void Model::bounds(float outMin[3], float outMax[3]) const
+{
+    for (int a = 0; a < 3; ++a)
+    {
+        outMin[a] = submeshes_.empty() ? 0.0f : submeshes_[0].boundsMin[a];
+        outMax[a] = submeshes_.empty() ? 0.0f : submeshes_[0].boundsMax[a];
+    }
+    for (const Submesh& sm : submeshes_)
+    {
+        for (int a = 0; a < 3; ++a)
+        {
+            if (sm.boundsMin[a] < outMin[a]) outMin[a] = sm.boundsMin[a];
+            if (sm.boundsMax[a] > outMax[a]) outMax[a] = sm.boundsMax[a];
+        }
+    }
+}
+
+bool Model::uploadToGPU(int maxTextureSize)
+{
+    if(vertices_.empty() || indices_.empty()) return false;
+
+    if (!uploadTextureArrays(maxTextureSize))
+        return false;
 
     glGenVertexArrays(1, &vao_);
     glGenBuffers(1, &vbo_);
+    glGenBuffers(1, &ebo_);
 
     glBindVertexArray(vao_);
     glBindBuffer(GL_ARRAY_BUFFER, vbo_);
@@ -191,33 +651,83 @@ bool Model::uploadToGPU()
     glEnableVertexAttribArray(2);
     glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, texcoord));
 
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo_);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices_.size()*sizeof(GLuint), indices_.data(), GL_STATIC_DRAW);
+
     glBindBuffer(GL_ARRAY_BUFFER, 0);
     glBindVertexArray(0);
 
-    return true;
-}
+    // Position-only stream for depth passes: 12 bytes per vertex instead of
+    // sizeof(Vertex), so the pre-pass fetches a fraction of the bandwidth.
+    std::vector<float> positions(vertices_.size() * 3);
+    for (size_t i = 0; i < vertices_.size(); ++i)
+    {
+        positions[i * 3 + 0] = vertices_[i].position[0];
+        positions[i * 3 + 1] = vertices_[i].position[1];
+        positions[i * 3 + 2] = vertices_[i].position[2];
+    }
 
-void Model::draw(int baseColorLoc, int metallicLoc, int roughnessLoc, int aoLoc, int normalLoc) const
-{
-    if(vao_==0 || vertices_.empty()) return;
+    glGenVertexArrays(1, &positionVao_);
+    glGenBuffers(1, &positionVbo_);
+    glBindVertexArray(positionVao_);
+    glBindBuffer(GL_ARRAY_BUFFER, positionVbo_);
+    glBufferData(GL_ARRAY_BUFFER, positions.size()*sizeof(float), positions.data(), GL_STATIC_DRAW);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo_);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindVertexArray(0);
 
-    glBindVertexArray(vao_);
+    std::vector<MaterialGPU> gpuMaterials(materials_.size() + 1, MaterialGPU{});
+    for (size_t i = 0; i < materials_.size(); ++i)
+    {
+        const Material& mat = materials_[i];
+        MaterialGPU& g = gpuMaterials[i + 1];
+        g.layers[Slot_BaseColor] = mat.baseColorLayer;
+        g.layers[Slot_ORM]       = mat.ormLayer;
+        g.layers[Slot_Normal]    = mat.normalLayer;
+        g.cost = mat.estimatedCost();
+    }
+    gpuMaterials[0].cost = Material{}.estimatedCost();
 
-    for(const auto& sm: submeshes_)
+    glGenBuffers(1, &materialSsbo_);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, materialSsbo_);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, gpuMaterials.size()*sizeof(MaterialGPU), gpuMaterials.data(), GL_STATIC_DRAW);
+
+    std::vector<SubmeshBoundsGPU> bounds(submeshes_.size());
+    for (size_t i = 0; i < submeshes_.size(); ++i)
     {
-        const Material* mat = (sm.material_id >= 0 && sm.material_id < (int)materials_.size())
-                              ? &materials_[sm.material_id] : nullptr;
-        if(mat)
+        for (int a = 0; a < 3; ++a)
         {
-            if(baseColorLoc>=0){ glActiveTexture(GL_TEXTURE0); glBindTexture(GL_TEXTURE_2D, mat->baseColorTex); glUniform1i(baseColorLoc, 0); }
-            if(metallicLoc>=0){ glActiveTexture(GL_TEXTURE1); glBindTexture(GL_TEXTURE_2D, mat->metallicTex); glUniform1i(metallicLoc, 1); }
-            if(roughnessLoc>=0){ glActiveTexture(GL_TEXTURE2); glBindTexture(GL_TEXTURE_2D, mat->roughnessTex); glUniform1i(roughnessLoc, 2); }
-            if(aoLoc>=0){ glActiveTexture(GL_TEXTURE3); glBindTexture(GL_TEXTURE_2D, mat->aoTex); glUniform1i(aoLoc, 3); }
-            if(normalLoc>=0){ glActiveTexture(GL_TEXTURE4); glBindTexture(GL_TEXTURE_2D, mat->normalTex); glUniform1i(normalLoc, 4); }
+            bounds[i].boundsMin[a] = submeshes_[i].boundsMin[a];
+            bounds[i].boundsMax[a] = submeshes_[i].boundsMax[a];
         }
+        bounds[i].boundsMin[3] = bounds[i].boundsMax[3] = 0.0f;
+    }
 
-        glDrawArrays(GL_TRIANGLES, (GLint)sm.first, (GLsizei)sm.count);
+    glGenBuffers(1, &boundsSsbo_);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, boundsSsbo_);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, bounds.size()*sizeof(SubmeshBoundsGPU), bounds.data(), GL_STATIC_DRAW);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+    return true;
+}
+
+void Model::bind() const
+{
+    // Texture unit N holds the array of slot N, see TextureSlot
+    for (int slot = 0; slot < Slot_Count; ++slot)
+    {
+        glActiveTexture(GL_TEXTURE0 + slot);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, textureArrays_[slot]);
     }
 
-    glBindVertexArray(0);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, materialSsbo_);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, boundsSsbo_);
+    glBindVertexArray(vao_);
+}
+
+void Model::bindPositionOnly() const
+{
+    glBindVertexArray(positionVao_);
 }
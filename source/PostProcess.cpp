@@ -0,0 +1,221 @@
+#include "PostProcess.h"
+#include <algorithm>
+#include <cstdio>
+#include <string>
+
+// Bloom starts at this luminance, blending in over the knee below it
+static const float kBloomThreshold = 1.0f;
+static const float kBloomKnee = 0.5f;
+// Weight of the summed bloom levels added to the scene
+static const float kBloomStrength = 0.15f;
+
+const char* postQualityName(PostQuality quality)
+{
+    switch (quality)
+    {
+    case PostQuality_Off:    return "off";
+    case PostQuality_Low:    return "low (tone map)";
+    case PostQuality_Medium: return "medium (tone map, FXAA)";
+    case PostQuality_High:   return "high (bloom, tone map, FXAA)";
+    default:                 return "?";
+    }
+}
+
+PostProcess::~PostProcess()
+{
+    if (emptyVao_) glDeleteVertexArrays(1, &emptyVao_);
+}
+
+bool PostProcess::init(int width, int height)
+{
+    width_ = width;
+    height_ = height;
+
+    static const char* const kVertex = "romfs:/shaders/fullscreen_vertex.glsl";
+
+    bloomDownShader_ = std::make_unique<Shader>();
+    bloomDownShader_->setOnLink([this](const Shader& shader) {
+        glUniform1i(shader.getUniformLocation("uSource"), 0);
+        loc_downScale = shader.getUniformLocation("uUVScale");
+        loc_downTexel = shader.getUniformLocation("uTexelSize");
+        loc_downPrefilter = shader.getUniformLocation("uPrefilter");
+        loc_downThreshold = shader.getUniformLocation("uThreshold");
+    });
+
+    bloomUpShader_ = std::make_unique<Shader>();
+    bloomUpShader_->setOnLink([this](const Shader& shader) {
+        glUniform1i(shader.getUniformLocation("uSource"), 0);
+        loc_upScale = shader.getUniformLocation("uUVScale");
+        loc_upTexel = shader.getUniformLocation("uTexelSize");
+    });
+
+    toneMapShader_ = std::make_unique<Shader>();
+    toneMapShader_->setOnLink([this](const Shader& shader) {
+        glUniform1i(shader.getUniformLocation("uScene"), 0);
+        glUniform1i(shader.getUniformLocation("uBloom"), 1);
+        loc_toneSceneScale = shader.getUniformLocation("uSceneScale");
+        loc_toneSceneTexel = shader.getUniformLocation("uSceneTexel");
+        loc_toneBloomScale = shader.getUniformLocation("uBloomScale");
+        loc_toneBloomTexel = shader.getUniformLocation("uBloomTexel");
+        loc_toneBloomStrength = shader.getUniformLocation("uBloomStrength");
+        loc_toneExposure = shader.getUniformLocation("uExposure");
+    });
+
+    fxaaShader_ = std::make_unique<Shader>();
+    fxaaShader_->setOnLink([this](const Shader& shader) {
+        glUniform1i(shader.getUniformLocation("uSource"), 0);
+        loc_fxaaScale = shader.getUniformLocation("uUVScale");
+        loc_fxaaTexel = shader.getUniformLocation("uTexelSize");
+    });
+
+    if (!bloomDownShader_->loadFromFiles(kVertex, "romfs:/shaders/post_bloom_down_fragment.glsl") ||
+        !bloomUpShader_->loadFromFiles(kVertex, "romfs:/shaders/post_bloom_up_fragment.glsl") ||
+        !toneMapShader_->loadFromFiles(kVertex, "romfs:/shaders/post_tonemap_fragment.glsl") ||
+        !fxaaShader_->loadFromFiles(kVertex, "romfs:/shaders/post_fxaa_fragment.glsl"))
+    {
+        printf("Failed to load post-processing shaders\n");
+        return false;
+    }
+
+    glGenVertexArrays(1, &emptyVao_);
+    return true;
+}
+
+RGTexture PostProcess::create(RenderGraph& graph, const char* name, int divisor, GLenum format, int renderWidth,
+                              int renderHeight) const
+{
+    // Allocated for the full size, so the pool keeps matching while the
+    // render size moves; the view is the scaled part, rounded up
+    RenderTargetDesc desc{ std::max(1, width_ / divisor), std::max(1, height_ / divisor), format };
+    return graph.create(name, desc, std::max(1, (renderWidth + divisor - 1) / divisor),
+                        std::max(1, (renderHeight + divisor - 1) / divisor));
+}
+
+void PostProcess::setSource(const RenderGraph::Context& context, GLint locScale, GLint locTexel, RGTexture source)
+{
+    const RenderTargetDesc& desc = context.desc(source);
+    glUniform2f(locScale, (float)context.width(source) / desc.width, (float)context.height(source) / desc.height);
+    glUniform2f(locTexel, 1.0f / desc.width, 1.0f / desc.height);
+}
+
+void PostProcess::beginDraw() const
+{
+    glDisable(GL_DEPTH_TEST);
+    glBindVertexArray(emptyVao_);
+    glActiveTexture(GL_TEXTURE0);
+}
+
+void PostProcess::endDraw()
+{
+    glBindVertexArray(0);
+    glEnable(GL_DEPTH_TEST);
+}
+
+RGTexture PostProcess::addPasses(RenderGraph& graph, RGTexture sceneColor, int renderWidth, int renderHeight,
+                                 bool antialiased)
+{
+    // Bloom: a chain of half-size downsamples, the first one keeping only
+    // what is above the threshold, then back up, each level added onto the
+    // next larger one. levels[0] ends up with the sum.
+    RGTexture bloom = kNoTexture;
+    if (quality_ >= PostQuality_High)
+    {
+        std::vector<RGTexture> levels;
+        for (int i = 0; i < kBloomLevels; ++i)
+        {
+            std::string name = "bloom 1/" + std::to_string(2 << i);
+            levels.push_back(create(graph, name.c_str(), 2 << i, GL_R11F_G11F_B10F, renderWidth, renderHeight));
+        }
+
+        graph.addPass("bloom down", RGPass_Scaled,
+            [&](RenderGraph::Builder& builder) {
+                builder.read(sceneColor);
+                for (RGTexture level : levels)
+                    builder.write(level, RGLoad_DontCare);
+            },
+            [this, sceneColor, levels](const RenderGraph::Context& context) {
+                beginDraw();
+                bloomDownShader_->use();
+                glUniform2f(loc_downThreshold, kBloomThreshold, kBloomKnee);
+                RGTexture source = sceneColor;
+                for (size_t i = 0; i < levels.size(); ++i)
+                {
+                    context.bind(levels[i]);
+                    setSource(context, loc_downScale, loc_downTexel, source);
+                    glUniform1i(loc_downPrefilter, i == 0 ? 1 : 0);
+                    glBindTexture(GL_TEXTURE_2D, context.texture(source));
+                    glDrawArrays(GL_TRIANGLES, 0, 3);
+                    source = levels[i];
+                }
+                endDraw();
+            });
+
+        graph.addPass("bloom up", RGPass_Scaled,
+            [&](RenderGraph::Builder& builder) {
+                for (size_t i = 1; i < levels.size(); ++i)
+                    builder.read(levels[i]);
+                for (size_t i = 0; i + 1 < levels.size(); ++i)
+                    builder.write(levels[i], RGLoad_Keep);
+            },
+            [this, levels](const RenderGraph::Context& context) {
+                beginDraw();
+                bloomUpShader_->use();
+                glEnable(GL_BLEND);
+                glBlendFunc(GL_ONE, GL_ONE);
+                for (size_t i = levels.size() - 1; i > 0; --i)
+                {
+                    context.bind(levels[i - 1]);
+                    setSource(context, loc_upScale, loc_upTexel, levels[i]);
+                    glBindTexture(GL_TEXTURE_2D, context.texture(levels[i]));
+                    glDrawArrays(GL_TRIANGLES, 0, 3);
+                }
+                glDisable(GL_BLEND);
+                endDraw();
+            });
+        bloom = levels[0];
+    }
+
+    // Tone map into LDR. Without bloom the scene is bound twice with zero
+    // strength, cheaper than another program variant.
+    RGTexture ldr = create(graph, "LDR", 1, GL_SRGB8_ALPHA8, renderWidth, renderHeight);
+    graph.addPass("tone map", RGPass_Scaled,
+        [&](RenderGraph::Builder& builder) {
+            builder.read(sceneColor);
+            builder.read(bloom);
+            builder.write(ldr, RGLoad_DontCare);
+        },
+        [this, sceneColor, bloom](const RenderGraph::Context& context) {
+            beginDraw();
+            toneMapShader_->use();
+            RGTexture bloomSource = bloom != kNoTexture ? bloom : sceneColor;
+            setSource(context, loc_toneSceneScale, loc_toneSceneTexel, sceneColor);
+            setSource(context, loc_toneBloomScale, loc_toneBloomTexel, bloomSource);
+            glUniform1f(loc_toneBloomStrength, bloom != kNoTexture ? kBloomStrength : 0.0f);
+            glUniform1f(loc_toneExposure, exposure_);
+            glBindTexture(GL_TEXTURE_2D, context.texture(sceneColor));
+            glActiveTexture(GL_TEXTURE1);
+            glBindTexture(GL_TEXTURE_2D, context.texture(bloomSource));
+            glActiveTexture(GL_TEXTURE0);
+            glDrawArrays(GL_TRIANGLES, 0, 3);
+            endDraw();
+        });
+
+    if (quality_ < PostQuality_Medium || antialiased)
+        return ldr;
+
+    RGTexture aa = create(graph, "FXAA", 1, GL_SRGB8_ALPHA8, renderWidth, renderHeight);
+    graph.addPass("FXAA", RGPass_Scaled,
+        [&](RenderGraph::Builder& builder) {
+            builder.read(ldr);
+            builder.write(aa, RGLoad_DontCare);
+        },
+        [this, ldr](const RenderGraph::Context& context) {
+            beginDraw();
+            fxaaShader_->use();
+            setSource(context, loc_fxaaScale, loc_fxaaTexel, ldr);
+            glBindTexture(GL_TEXTURE_2D, context.texture(ldr));
+            glDrawArrays(GL_TRIANGLES, 0, 3);
+            endDraw();
+        });
+    return aa;
+}
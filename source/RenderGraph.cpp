@@ -0,0 +1,500 @@
+#include "RenderGraph.h"
+#include <algorithm>
+#include <cstdio>
+
+static double toMB(size_t bytes)
+{
+    return bytes / (1024.0 * 1024.0);
+}
+
+void RenderGraph::Builder::read(RGTexture texture, RGTexture fallback)
+{
+    if (texture == kNoTexture)
+        return;
+    graph_.passes_[pass_].accesses.push_back({ texture, false, RGLoad_Keep, fallback });
+    // An ordinary read too, so it is ordered, kept alive and not culled
+    if (fallback != kNoTexture)
+        graph_.passes_[pass_].accesses.push_back({ fallback, false, RGLoad_Keep, kNoTexture });
+}
+
+void RenderGraph::Builder::write(RGTexture texture, RGLoad load)
+{
+    if (texture != kNoTexture)
+        graph_.passes_[pass_].accesses.push_back({ texture, true, load, kNoTexture });
+}
+
+void RenderGraph::Builder::sideEffect()
+{
+    graph_.passes_[pass_].sideEffect = true;
+}
+
+GLuint RenderGraph::Context::texture(RGTexture texture) const
+{
+    const Resource& resource = graph_.resources_[graph_.resolve(texture)];
+    if (resource.imported)
+        return resource.import.texture;
+    return resource.target ? resource.target->texture : 0;
+}
+
+GLuint RenderGraph::Context::fbo(RGTexture texture) const
+{
+    return graph_.fboOf(graph_.resources_[graph_.resolve(texture)]);
+}
+
+const RenderTargetDesc& RenderGraph::Context::desc(RGTexture texture) const
+{
+    return graph_.desc(graph_.resolve(texture));
+}
+
+int RenderGraph::Context::width(RGTexture texture) const
+{
+    return graph_.width(graph_.resolve(texture));
+}
+
+int RenderGraph::Context::height(RGTexture texture) const
+{
+    return graph_.height(graph_.resolve(texture));
+}
+
+void RenderGraph::Context::bind(RGTexture texture) const
+{
+    const Resource& resource = graph_.resources_[graph_.resolve(texture)];
+    glBindFramebuffer(GL_FRAMEBUFFER, graph_.fboOf(resource));
+    glViewport(0, 0, resource.import.width, resource.import.height);
+}
+
+void RenderGraph::reset()
+{
+    resources_.clear();
+    passes_.clear();
+    order_.clear();
+}
+
+RGTexture RenderGraph::import(const std::string& name, const RGImport& import)
+{
+    Resource resource{};
+    resource.name = name;
+    resource.imported = true;
+    resource.import = import;
+    resource.clear[3] = 1.0f;
+    resources_.push_back(resource);
+    return (RGTexture)resources_.size() - 1;
+}
+
+RGTexture RenderGraph::create(const std::string& name, const RenderTargetDesc& desc, int width, int height)
+{
+    Resource resource{};
+    resource.name = name;
+    resource.imported = false;
+    resource.import.attachment = GL_COLOR_ATTACHMENT0;
+    resource.import.desc = desc;
+    resource.import.width = std::min(width, desc.width);
+    resource.import.height = std::min(height, desc.height);
+    resource.clear[3] = 1.0f;
+    resources_.push_back(resource);
+    return (RGTexture)resources_.size() - 1;
+}
+
+void RenderGraph::setClearColor(RGTexture texture, float r, float g, float b, float a)
+{
+    float* clear = resources_[texture].clear;
+    clear[0] = r;
+    clear[1] = g;
+    clear[2] = b;
+    clear[3] = a;
+}
+
+void RenderGraph::addPass(const std::string& name, unsigned flags, const SetupFn& setup, const ExecuteFn& execute)
+{
+    Pass pass{};
+    pass.name = name;
+    pass.flags = flags;
+    pass.execute = execute;
+    passes_.push_back(pass);
+
+    Builder builder(*this, (int)passes_.size() - 1);
+    setup(builder);
+}
+
+RGTexture RenderGraph::resolve(RGTexture texture) const
+{
+    const Resource& resource = resources_[texture];
+    return resource.lost && resource.standIn != kNoTexture ? resource.standIn : texture;
+}
+
+bool RenderGraph::bindable(const Resource& resource) const
+{
+    return !resource.imported || resource.import.attachment != GL_NONE;
+}
+
+GLuint RenderGraph::fboOf(const Resource& resource) const
+{
+    if (resource.imported)
+        return resource.import.fbo;
+    return resource.target ? resource.target->fbo : 0;
+}
+
+size_t RenderGraph::bytes(const Resource& resource) const
+{
+    const RenderTargetDesc& desc = resource.import.desc;
+    return (size_t)desc.width * desc.height * renderTargetFormatBytes(desc.format);
+}
+
+void RenderGraph::cull()
+{
+    // Backwards from what survives the frame: a pass is needed if it has a
+    // side effect or writes contents a needed pass reads. Writes that don't
+    // keep the old contents end the need for them.
+    std::vector<bool> needed(resources_.size(), false);
+    for (int p = (int)passes_.size() - 1; p >= 0; --p)
+    {
+        Pass& pass = passes_[p];
+        bool live = pass.sideEffect;
+        for (const Access& access : pass.accesses)
+        {
+            const Resource& resource = resources_[access.texture];
+            if (access.write && (needed[access.texture] || (resource.imported && resource.import.persistent)))
+                live = true;
+        }
+        pass.culled = !live;
+        if (!live)
+            continue;
+
+        for (const Access& access : pass.accesses)
+        {
+            if (access.write && access.load != RGLoad_Keep)
+                needed[access.texture] = false;
+        }
+        for (const Access& access : pass.accesses)
+        {
+            if (!access.write || access.load == RGLoad_Keep)
+                needed[access.texture] = true;
+        }
+    }
+}
+
+void RenderGraph::order()
+{
+    // Dependencies between the live passes: a read waits for the write
+    // declared before it, a write for the reads of the contents it replaces
+    size_t passCount = passes_.size();
+    std::vector<std::vector<int>> successors(passCount);
+    std::vector<int> pending(passCount, 0);
+    std::vector<int> lastWriter(resources_.size(), -1);
+    std::vector<std::vector<int>> readers(resources_.size());
+    auto addEdge = [&](int from, int to) {
+        if (from < 0 || from == to)
+            return;
+        successors[from].push_back(to);
+        ++pending[to];
+    };
+
+    std::vector<int> users(resources_.size(), 0);
+    for (size_t p = 0; p < passCount; ++p)
+    {
+        if (passes_[p].culled)
+            continue;
+        for (const Access& access : passes_[p].accesses)
+        {
+            ++users[access.texture];
+            if (access.write)
+                continue;
+            addEdge(lastWriter[access.texture], (int)p);
+            readers[access.texture].push_back((int)p);
+        }
+        for (const Access& access : passes_[p].accesses)
+        {
+            if (!access.write)
+                continue;
+            addEdge(lastWriter[access.texture], (int)p);
+            for (int reader : readers[access.texture])
+                addEdge(reader, (int)p);
+            lastWriter[access.texture] = (int)p;
+            readers[access.texture].clear();
+        }
+    }
+
+    // Of the passes ready to run, take the one that frees the most
+    // transient memory (or takes the least), so targets are held for as
+    // short a span as the dependencies allow. Declaration order breaks ties.
+    std::vector<bool> scheduled(passCount, false);
+    std::vector<bool> started(resources_.size(), false);
+    order_.clear();
+    for (;;)
+    {
+        int best = -1;
+        long long bestGain = 0;
+        for (size_t p = 0; p < passCount; ++p)
+        {
+            if (passes_[p].culled || scheduled[p] || pending[p] > 0)
+                continue;
+            long long gain = 0;
+            std::vector<int> seen;
+            for (const Access& access : passes_[p].accesses)
+            {
+                const Resource& resource = resources_[access.texture];
+                if (resource.imported ||
+                    std::find(seen.begin(), seen.end(), access.texture) != seen.end())
+                    continue;
+                seen.push_back(access.texture);
+                int uses = 0;
+                for (const Access& other : passes_[p].accesses)
+                    uses += other.texture == access.texture ? 1 : 0;
+                if (!started[access.texture])
+                    gain -= (long long)bytes(resource);
+                if (users[access.texture] == uses)
+                    gain += (long long)bytes(resource);
+            }
+            if (best < 0 || gain > bestGain)
+            {
+                best = (int)p;
+                bestGain = gain;
+            }
+        }
+        if (best < 0)
+            break;
+
+        scheduled[best] = true;
+        order_.push_back(best);
+        for (const Access& access : passes_[best].accesses)
+        {
+            started[access.texture] = true;
+            --users[access.texture];
+        }
+        for (int next : successors[best])
+            --pending[next];
+    }
+}
+
+void RenderGraph::computeLifetimes()
+{
+    for (Resource& resource : resources_)
+    {
+        resource.firstUse = -1;
+        resource.lastUse = -1;
+    }
+    for (size_t i = 0; i < order_.size(); ++i)
+    {
+        for (const Access& access : passes_[order_[i]].accesses)
+        {
+            Resource& resource = resources_[access.texture];
+            if (resource.firstUse < 0)
+                resource.firstUse = (int)i;
+            resource.lastUse = (int)i;
+        }
+    }
+
+    liveBytes_.assign(order_.size(), 0);
+    transientBytes_ = 0;
+    for (const Resource& resource : resources_)
+    {
+        if (resource.imported || resource.firstUse < 0)
+            continue;
+        transientBytes_ += bytes(resource);
+        for (int i = resource.firstUse; i <= resource.lastUse; ++i)
+            liveBytes_[i] += bytes(resource);
+    }
+    peakBytes_ = liveBytes_.empty() ? 0 : *std::max_element(liveBytes_.begin(), liveBytes_.end());
+}
+
+void RenderGraph::compile()
+{
+    cull();
+    order();
+    computeLifetimes();
+}
+
+void RenderGraph::load(Resource& resource, RGLoad load)
+{
+    if (!bindable(resource))
+        return;
+
+    // Nothing earlier this frame wrote it and it didn't survive the last
+    // one, so there is nothing to keep
+    if (load == RGLoad_Keep)
+    {
+        if (resource.written || (resource.imported && resource.import.persistent))
+            return;
+        load = RGLoad_Clear;
+    }
+
+    GLenum attachment = resource.import.attachment;
+    if (load == RGLoad_DontCare)
+    {
+        invalidateAttachments(fboOf(resource), { attachment });
+        ++invalidates_;
+        return;
+    }
+
+    glBindFramebuffer(GL_FRAMEBUFFER, fboOf(resource));
+    if (attachment == GL_DEPTH_STENCIL_ATTACHMENT)
+    {
+        glClearBufferfi(GL_DEPTH_STENCIL, 0, 1.0f, 0);
+    }
+    else if (attachment == GL_DEPTH_ATTACHMENT)
+    {
+        float depth = 1.0f;
+        glClearBufferfv(GL_DEPTH, 0, &depth);
+    }
+    else
+    {
+        glClearBufferfv(GL_COLOR, (GLint)(attachment - GL_COLOR_ATTACHMENT0), resource.clear);
+    }
+    ++clears_;
+}
+
+void RenderGraph::execute()
+{
+    clears_ = 0;
+    invalidates_ = 0;
+    for (Resource& resource : resources_)
+    {
+        resource.target = nullptr;
+        resource.written = false;
+        resource.lost = false;
+        resource.standIn = kNoTexture;
+    }
+
+    Context context(*this);
+    for (size_t i = 0; i < order_.size(); ++i)
+    {
+        Pass& pass = passes_[order_[i]];
+
+        // Contents a skipped pass should have produced are lost, and so is
+        // everything computed from them: passes reading them (or drawing
+        // over them) are skipped as well, unless they named a fallback
+        bool ready = true;
+        for (const Access& access : pass.accesses)
+        {
+            Resource& resource = resources_[access.texture];
+            if (!resource.lost || (access.write && access.load != RGLoad_Keep))
+                continue;
+            if (access.fallback != kNoTexture && !resources_[access.fallback].lost)
+            {
+                resource.standIn = access.fallback;
+                continue;
+            }
+            printf("Render graph: %s was not produced, skipping %s\n", resource.name.c_str(), pass.name.c_str());
+            ready = false;
+        }
+
+        for (const Access& access : pass.accesses)
+        {
+            Resource& resource = resources_[access.texture];
+            if (!ready || resource.imported || resource.target)
+                continue;
+            resource.target = pool_.acquire(resource.import.desc);
+            if (!resource.target)
+            {
+                printf("Render graph: no target for %s, skipping %s\n", resource.name.c_str(), pass.name.c_str());
+                ready = false;
+            }
+        }
+
+        if (!ready)
+        {
+            for (const Access& access : pass.accesses)
+            {
+                if (access.write)
+                    resources_[access.texture].lost = true;
+            }
+        }
+        else
+        {
+            int bound = kNoTexture;
+            for (const Access& access : pass.accesses)
+            {
+                if (!access.write)
+                    continue;
+                Resource& resource = resources_[access.texture];
+                load(resource, access.load);
+                if (bound == kNoTexture && bindable(resource))
+                    bound = access.texture;
+            }
+            for (const Access& access : pass.accesses)
+            {
+                if (!access.write)
+                    continue;
+                resources_[access.texture].written = true;
+                resources_[access.texture].lost = false;
+            }
+            if (bound != kNoTexture)
+                context.bind(bound);
+
+            std::unique_ptr<GpuTimer>& timer = timers_[pass.name];
+            if (!timer)
+                timer = std::make_unique<GpuTimer>();
+            timer->begin();
+            pass.execute(context);
+            timer->end();
+        }
+
+        // Contents no later pass reads: transients go back to the pool
+        // (which invalidates them), imported attachments are invalidated
+        for (Resource& resource : resources_)
+        {
+            if (resource.lastUse != (int)i)
+                continue;
+            if (!resource.imported)
+            {
+                pool_.release(resource.target);
+                resource.target = nullptr;
+                ++invalidates_;
+            }
+            else if (bindable(resource) && !resource.import.persistent)
+            {
+                invalidateAttachments(resource.import.fbo, { resource.import.attachment });
+                ++invalidates_;
+            }
+        }
+    }
+
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    pool_.endFrame();
+}
+
+float RenderGraph::scaledMs() const
+{
+    float total = 0.0f;
+    for (int p : order_)
+    {
+        if (!(passes_[p].flags & RGPass_Scaled))
+            continue;
+        auto it = timers_.find(passes_[p].name);
+        if (it != timers_.end() && it->second->lastMs() > 0.0f)
+            total += it->second->lastMs();
+    }
+    return total;
+}
+
+float RenderGraph::passMs(const std::string& name) const
+{
+    auto it = timers_.find(name);
+    return it != timers_.end() ? it->second->averageMs() : 0.0f;
+}
+
+void RenderGraph::printReport() const
+{
+    float totalMs = 0.0f;
+    printf("Render graph: %zu passes, %zu culled, %d clears, %d invalidates\n", order_.size(),
+           passes_.size() - order_.size(), clears_, invalidates_);
+    printf("  pass            GPU ms  live MB\n");
+    for (size_t i = 0; i < order_.size(); ++i)
+    {
+        const Pass& pass = passes_[order_[i]];
+        auto it = timers_.find(pass.name);
+        float ms = it != timers_.end() ? it->second->averageMs() : 0.0f;
+        totalMs += ms;
+        printf("  %-14s %7.2f %8.1f%s\n", pass.name.c_str(), ms, toMB(liveBytes_[i]),
+               (pass.flags & RGPass_Scaled) ? "  scaled" : "");
+    }
+    printf("  total          %7.2f\n", totalMs);
+
+    for (const Pass& pass : passes_)
+    {
+        if (pass.culled)
+            printf("  culled: %s\n", pass.name.c_str());
+    }
+    printf("  transients %.1f MB at peak, %.1f MB without aliasing, pool holds %.1f MB\n", toMB(peakBytes_),
+           toMB(transientBytes_), toMB(pool_.allocatedBytes()));
+}
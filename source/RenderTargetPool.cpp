@@ -0,0 +1,124 @@
+#include "RenderTargetPool.h"
+#include <cstdio>
+
+size_t renderTargetFormatBytes(GLenum format)
+{
+    switch (format)
+    {
+    case GL_RGBA16F:
+    case GL_RG32F:
+        return 8;
+    case GL_R8:
+        return 1;
+    case GL_RG8:
+    case GL_R16F:
+        return 2;
+    default: // GL_R11F_G11F_B10F, GL_SRGB8_ALPHA8, GL_RGBA8, GL_RG16F, GL_R32F
+        return 4;
+    }
+}
+
+void invalidateAttachments(GLuint fbo, std::initializer_list<GLenum> attachments)
+{
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    glInvalidateFramebuffer(GL_FRAMEBUFFER, (GLsizei)attachments.size(), attachments.begin());
+}
+
+RenderTargetPool::~RenderTargetPool()
+{
+    for (const auto& entry : entries_)
+    {
+        glDeleteFramebuffers(1, &entry->target.fbo);
+        glDeleteTextures(1, &entry->target.texture);
+    }
+}
+
+RenderTarget* RenderTargetPool::acquire(const RenderTargetDesc& desc)
+{
+    requestedBytes_ += (size_t)desc.width * desc.height * renderTargetFormatBytes(desc.format);
+    for (const auto& entry : entries_)
+    {
+        if (!entry->inUse && entry->target.desc == desc)
+        {
+            entry->inUse = true;
+            entry->idleFrames = 0;
+            return &entry->target;
+        }
+    }
+
+    auto entry = std::make_unique<Entry>();
+    entry->target.desc = desc;
+    entry->inUse = true;
+    entry->idleFrames = 0;
+
+    glGenTextures(1, &entry->target.texture);
+    glBindTexture(GL_TEXTURE_2D, entry->target.texture);
+    glTexStorage2D(GL_TEXTURE_2D, 1, desc.format, desc.width, desc.height);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    glGenFramebuffers(1, &entry->target.fbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, entry->target.fbo);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, entry->target.texture, 0);
+    GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    if (status != GL_FRAMEBUFFER_COMPLETE)
+    {
+        printf("Render target %dx%d format 0x%x incomplete: 0x%x\n", desc.width, desc.height, desc.format, status);
+        glDeleteFramebuffers(1, &entry->target.fbo);
+        glDeleteTextures(1, &entry->target.texture);
+        return nullptr;
+    }
+
+    entries_.push_back(std::move(entry));
+    return &entries_.back()->target;
+}
+
+void RenderTargetPool::release(RenderTarget* target)
+{
+    if (!target)
+        return;
+    for (const auto& entry : entries_)
+    {
+        if (&entry->target == target)
+        {
+            // Whoever gets it next overwrites it, nothing needs to survive
+            invalidateAttachments(target->fbo, { GL_COLOR_ATTACHMENT0 });
+            glBindFramebuffer(GL_FRAMEBUFFER, 0);
+            entry->inUse = false;
+            return;
+        }
+    }
+}
+
+void RenderTargetPool::endFrame()
+{
+    lastRequestedBytes_ = requestedBytes_;
+    requestedBytes_ = 0;
+    for (size_t i = 0; i < entries_.size(); )
+    {
+        Entry& entry = *entries_[i];
+        if (!entry.inUse && ++entry.idleFrames > kMaxIdleFrames)
+        {
+            glDeleteFramebuffers(1, &entry.target.fbo);
+            glDeleteTextures(1, &entry.target.texture);
+            entries_.erase(entries_.begin() + i);
+            continue;
+        }
+        ++i;
+    }
+}
+
+size_t RenderTargetPool::allocatedBytes() const
+{
+    size_t bytes = 0;
+    for (const auto& entry : entries_)
+    {
+        const RenderTargetDesc& d = entry->target.desc;
+        bytes += (size_t)d.width * d.height * renderTargetFormatBytes(d.format);
+    }
+    return bytes;
+}
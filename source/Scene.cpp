@@ -0,0 +1,229 @@
+#include "Scene.h"
+#include "JobSystem.h"
+#include "Simd.h"
+#include <cstdio>
+
+// Blocks of 4 entities composed per parallelFor chunk
+static const size_t kComposeGrain = 64;
+
+Scene::~Scene()
+{
+    // Batches reference the models
+    batches_.clear();
+    models_.clear();
+}
+
+int Scene::addModel(const std::string& path, JobSystem* jobs, int maxTextureSize)
+{
+    for (size_t i = 0; i < modelPaths_.size(); ++i)
+    {
+        if (modelPaths_[i] == path)
+            return (int)i;
+    }
+
+    auto model = std::make_unique<Model>(path);
+    if (!model->load(jobs))
+    {
+        printf("Failed to load model: %s\n", path.c_str());
+        return -1;
+    }
+    if (!model->uploadToGPU(maxTextureSize))
+    {
+        printf("Failed to upload model to GPU: %s\n", path.c_str());
+        return -1;
+    }
+    models_.push_back(std::move(model));
+    modelPaths_.push_back(path);
+    return (int)models_.size() - 1;
+}
+
+void Scene::growSoA()
+{
+    // Keep the component arrays a multiple of 4 so every SIMD block is full
+    size_t padded = (parent_.size() + 3) & ~(size_t)3;
+    if (px_.size() >= padded)
+        return;
+
+    for (auto* v : { &px_, &py_, &pz_, &qx_, &qy_, &qz_ })
+        v->resize(padded, 0.0f);
+    for (auto* v : { &qw_, &sx_, &sy_, &sz_ })
+        v->resize(padded, 1.0f);
+}
+
+Entity Scene::createEntity(int model, Entity parent)
+{
+    Entity e = (Entity)parent_.size();
+    if (parent != kNoEntity && parent >= e)
+    {
+        printf("Scene: parent %u doesn't exist yet, entity %u made a root\n", parent, e);
+        parent = kNoEntity;
+    }
+
+    parent_.push_back(parent);
+    model_.push_back(model >= 0 && model < (int)models_.size() ? model : -1);
+    instance_.push_back(0);
+    dirty_.push_back(1);
+    world_.push_back(glm::mat4(1.0f));
+    growSoA();
+
+    anyDirty_ = true;
+    if (parent != kNoEntity)
+        hasHierarchy_ = true;
+    return e;
+}
+
+void Scene::setPosition(Entity e, const glm::vec3& p)
+{
+    px_[e] = p.x; py_[e] = p.y; pz_[e] = p.z;
+    dirty_[e] = 1;
+    anyDirty_ = true;
+}
+
+void Scene::setRotation(Entity e, const glm::quat& q)
+{
+    qx_[e] = q.x; qy_[e] = q.y; qz_[e] = q.z; qw_[e] = q.w;
+    dirty_[e] = 1;
+    anyDirty_ = true;
+}
+
+void Scene::setScale(Entity e, const glm::vec3& s)
+{
+    sx_[e] = s.x; sy_[e] = s.y; sz_[e] = s.z;
+    dirty_[e] = 1;
+    anyDirty_ = true;
+}
+
+void Scene::buildBatches()
+{
+    std::vector<size_t> counts(models_.size(), 0);
+    for (size_t e = 0; e < parent_.size(); ++e)
+    {
+        if (model_[e] >= 0)
+            instance_[e] = (uint32_t)counts[model_[e]]++;
+    }
+
+    batches_.clear();
+    batchTransforms_.assign(models_.size(), std::vector<glm::mat4>());
+    batchChanged_.assign(models_.size(), 1);
+    for (size_t m = 0; m < models_.size(); ++m)
+    {
+        batches_.push_back(std::make_unique<DrawBatch>(*models_[m]));
+        batches_.back()->setInstanceCount(counts[m]);
+        batchTransforms_[m].resize(counts[m], glm::mat4(1.0f));
+    }
+
+    // Refill the batch arrays from scratch
+    for (size_t e = 0; e < parent_.size(); ++e)
+        dirty_[e] = 1;
+    anyDirty_ = true;
+
+    printf("Scene: %zu entities, %zu models\n", parent_.size(), models_.size());
+}
+
+void Scene::composeBlocks(size_t firstBlock, size_t lastBlock)
+{
+    const f4 one = splat4(1.0f);
+    const f4 two = splat4(2.0f);
+    size_t count = parent_.size();
+
+    for (size_t block = firstBlock; block < lastBlock; ++block)
+    {
+        size_t base = block * 4;
+        if (!(dirty_[base] | (base + 1 < count && dirty_[base + 1]) |
+              (base + 2 < count && dirty_[base + 2]) | (base + 3 < count && dirty_[base + 3])))
+            continue;
+
+        // T * R * S for four entities at once, same result as glm::mat3_cast
+        f4 x = load4(&qx_[base]), y = load4(&qy_[base]), z = load4(&qz_[base]), w = load4(&qw_[base]);
+        f4 sx = load4(&sx_[base]), sy = load4(&sy_[base]), sz = load4(&sz_[base]);
+
+        f4 xx = mul4(x, x), yy = mul4(y, y), zz = mul4(z, z);
+        f4 xy = mul4(x, y), xz = mul4(x, z), yz = mul4(y, z);
+        f4 wx = mul4(w, x), wy = mul4(w, y), wz = mul4(w, z);
+
+        float m[12][4];
+        store4(m[0],  mul4(sub4(one, mul4(two, add4(yy, zz))), sx));
+        store4(m[1],  mul4(mul4(two, add4(xy, wz)), sx));
+        store4(m[2],  mul4(mul4(two, sub4(xz, wy)), sx));
+        store4(m[3],  mul4(mul4(two, sub4(xy, wz)), sy));
+        store4(m[4],  mul4(sub4(one, mul4(two, add4(xx, zz))), sy));
+        store4(m[5],  mul4(mul4(two, add4(yz, wx)), sy));
+        store4(m[6],  mul4(mul4(two, add4(xz, wy)), sz));
+        store4(m[7],  mul4(mul4(two, sub4(yz, wx)), sz));
+        store4(m[8],  mul4(sub4(one, mul4(two, add4(xx, yy))), sz));
+        store4(m[9],  load4(&px_[base]));
+        store4(m[10], load4(&py_[base]));
+        store4(m[11], load4(&pz_[base]));
+
+        for (size_t lane = 0; lane < 4 && base + lane < count; ++lane)
+        {
+            // Clean neighbours keep their world matrix, it may include a parent
+            if (!dirty_[base + lane])
+                continue;
+            glm::mat4& out = world_[base + lane];
+            out[0] = glm::vec4(m[0][lane], m[1][lane], m[2][lane], 0.0f);
+            out[1] = glm::vec4(m[3][lane], m[4][lane], m[5][lane], 0.0f);
+            out[2] = glm::vec4(m[6][lane], m[7][lane], m[8][lane], 0.0f);
+            out[3] = glm::vec4(m[9][lane], m[10][lane], m[11][lane], 1.0f);
+        }
+    }
+}
+
+size_t Scene::updateWorld(JobSystem* jobs)
+{
+    if (!anyDirty_)
+        return 0;
+
+    size_t count = parent_.size();
+
+    // Children of dirty parents are dirty too; parents come first
+    if (hasHierarchy_)
+    {
+        for (size_t e = 0; e < count; ++e)
+        {
+            if (parent_[e] != kNoEntity && dirty_[parent_[e]])
+                dirty_[e] = 1;
+        }
+    }
+
+    // Local matrices, 4 entities per SIMD block
+    size_t blocks = (count + 3) / 4;
+    if (jobs)
+        jobs->parallelFor(blocks, kComposeGrain, [this](size_t begin, size_t end) { composeBlocks(begin, end); });
+    else
+        composeBlocks(0, blocks);
+
+    // Parent transforms, in order so every parent is final before its children
+    size_t updated = 0;
+    for (size_t e = 0; e < count; ++e)
+    {
+        if (!dirty_[e])
+            continue;
+        if (parent_[e] != kNoEntity)
+            world_[e] = world_[parent_[e]] * world_[e];
+
+        int m = model_[e];
+        if (m >= 0 && m < (int)batchTransforms_.size())
+        {
+            batchTransforms_[m][instance_[e]] = world_[e];
+            batchChanged_[m] = 1;
+        }
+        dirty_[e] = 0;
+        updated++;
+    }
+    anyDirty_ = false;
+    return updated;
+}
+
+bool Scene::takeBatchChanged(size_t b)
+{
+    bool changed = batchChanged_[b] != 0;
+    batchChanged_[b] = 0;
+    return changed;
+}
+
+void Scene::markAllChanged()
+{
+    for (auto& changed : batchChanged_)
+        changed = 1;
+}
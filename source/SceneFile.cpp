@@ -0,0 +1,386 @@
+#include "SceneFile.h"
+#include <glm/gtc/quaternion.hpp>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <dirent.h>
+#include <initializer_list>
+
+static const char kBinaryMagic[4] = { 'S', 'R', 'S', 'C' };
+static const uint32_t kBinaryVersion = 6;
+
+struct SceneBinaryHeader
+{
+    char magic[4];
+    uint32_t version;
+    uint32_t modelCount;
+    uint32_t instanceCount;
+    uint32_t gridCount;
+    uint32_t lightCount;
+    uint32_t pathBytes;  // size of the NUL-terminated path block
+    uint32_t hasCamera;
+    uint32_t hasEnvironment; // last string of the path block
+    SceneCamera camera;
+    SceneSettings settings;
+};
+
+static bool endsWith(const std::string& s, const char* suffix)
+{
+    size_t n = strlen(suffix);
+    return s.size() >= n && s.compare(s.size() - n, n, suffix) == 0;
+}
+
+// Index of 'word' in 'words', -1 if it isn't one of them
+static int findWord(const char* word, std::initializer_list<const char*> words)
+{
+    int index = 0;
+    for (const char* w : words)
+    {
+        if (!strcmp(word, w))
+            return index;
+        index++;
+    }
+    return -1;
+}
+
+static std::string directoryOf(const std::string& path)
+{
+    size_t slash = path.find_last_of('/');
+    return slash == std::string::npos ? std::string() : path.substr(0, slash + 1);
+}
+
+bool loadSceneFile(const std::string& path, SceneDesc& desc)
+{
+    if (endsWith(path, ".sceneb"))
+        return loadSceneBinary(path, desc);
+    return loadSceneText(path, desc);
+}
+
+bool loadSceneText(const std::string& path, SceneDesc& desc)
+{
+    FILE* f = fopen(path.c_str(), "r");
+    if (!f)
+    {
+        printf("Scene file not found: %s\n", path.c_str());
+        return false;
+    }
+
+    desc = SceneDesc{};
+    std::string baseDir = directoryOf(path);
+    char line[512];
+    int lineNumber = 0;
+    bool ok = true;
+
+    while (ok && fgets(line, sizeof(line), f))
+    {
+        lineNumber++;
+        if (char* hash = strchr(line, '#'))
+            *hash = '\0';
+
+        // Split on whitespace in place
+        char* tokens[32];
+        int count = 0;
+        for (char* tok = strtok(line, " \t\r\n"); tok && count < 32; tok = strtok(nullptr, " \t\r\n"))
+            tokens[count++] = tok;
+        if (count == 0)
+            continue;
+
+        auto fail = [&](const std::string& what) {
+            if (ok)
+                printf("%s:%d: %s\n", path.c_str(), lineNumber, what.c_str());
+            ok = false;
+        };
+        // Numbers must be the whole token, "1.5m" or "x" fail the line
+        auto num = [&](int i) {
+            char* end = nullptr;
+            float value = strtof(tokens[i], &end);
+            if (end == tokens[i] || *end != '\0')
+                fail(std::string("expected a number, got '") + tokens[i] + "'");
+            return value;
+        };
+        auto integer = [&](int i, long minimum) {
+            char* end = nullptr;
+            long value = strtol(tokens[i], &end, 10);
+            if (end == tokens[i] || *end != '\0')
+                fail(std::string("expected an integer, got '") + tokens[i] + "'");
+            else if (value < minimum || value > INT32_MAX)
+                fail(std::string("out of range: ") + tokens[i]);
+            return (int32_t)value;
+        };
+        // One of 'words' or fail, returns its index
+        auto word = [&](const char* value, std::initializer_list<const char*> words) {
+            int index = findWord(value, words);
+            if (index < 0)
+            {
+                std::string expected;
+                for (const char* w : words)
+                    expected += expected.empty() ? w : std::string("|") + w;
+                fail(std::string("unknown value '") + value + "' for " + tokens[1] + ", expected " + expected);
+            }
+            return index;
+        };
+        const char* cmd = tokens[0];
+
+        if (!strcmp(cmd, "model") && count >= 2)
+        {
+            std::string modelPath = tokens[1];
+            if (modelPath[0] != '/' && modelPath.find(':') == std::string::npos)
+                modelPath = baseDir + modelPath;
+            desc.models.push_back(modelPath);
+        }
+        else if (!strcmp(cmd, "instance") && count >= 5)
+        {
+            SceneInstance inst{};
+            inst.model = (uint32_t)integer(1, 0);
+            inst.parent = -1;
+            for (int a = 0; a < 3; ++a)
+            {
+                inst.position[a] = num(2 + a);
+                inst.scale[a] = 1.0f;
+            }
+            float yaw = 0.0f, pitch = 0.0f, roll = 0.0f;
+            for (int i = 5; i < count; ++i)
+            {
+                bool hasValue = i + 1 < count;
+                if (!strcmp(tokens[i], "spin")) inst.spin = 1;
+                else if (!strcmp(tokens[i], "yaw") && hasValue) yaw = num(++i);
+                else if (!strcmp(tokens[i], "pitch") && hasValue) pitch = num(++i);
+                else if (!strcmp(tokens[i], "roll") && hasValue) roll = num(++i);
+                else if (!strcmp(tokens[i], "scale") && hasValue) inst.scale[0] = inst.scale[1] = inst.scale[2] = num(++i);
+                else if (!strcmp(tokens[i], "parent") && hasValue) inst.parent = integer(++i, -1);
+                else { fail("unknown instance option"); break; }
+            }
+            glm::quat q(glm::vec3(glm::radians(pitch), glm::radians(yaw), glm::radians(roll)));
+            inst.rotation[0] = q.x; inst.rotation[1] = q.y; inst.rotation[2] = q.z; inst.rotation[3] = q.w;
+            if (inst.parent >= (int32_t)desc.instances.size())
+                fail("parent must be an earlier instance");
+            desc.instances.push_back(inst);
+        }
+        else if (!strcmp(cmd, "grid") && count >= 8)
+        {
+            SceneGrid grid{};
+            grid.model = (uint32_t)integer(1, 0);
+            grid.countX = (uint32_t)integer(2, 0);
+            grid.countZ = (uint32_t)integer(3, 0);
+            grid.spacing = strcmp(tokens[4], "auto") ? num(4) : 0.0f;
+            for (int a = 0; a < 3; ++a)
+                grid.origin[a] = num(5 + a);
+            grid.scale = 1.0f;
+            for (int i = 8; i < count; ++i)
+            {
+                if (!strcmp(tokens[i], "spin")) grid.spin = 1;
+                else if (!strcmp(tokens[i], "scale") && i + 1 < count) grid.scale = num(++i);
+                else { fail("unknown grid option"); break; }
+            }
+            desc.grids.push_back(grid);
+        }
+        else if (!strcmp(cmd, "light") && count >= 8)
+        {
+            SceneLight light{};
+            // Same order as SceneLightType
+            int type = findWord(tokens[1], { "directional", "point", "spot" });
+            if (type < 0)
+                fail(std::string("unknown light type '") + tokens[1] + "', expected directional|point|spot");
+            light.type = type < 0 ? SceneLight_Directional : (uint32_t)type;
+            for (int a = 0; a < 3; ++a)
+            {
+                light.vector[a] = num(2 + a);
+                light.color[a] = num(5 + a);
+            }
+            if (light.type != SceneLight_Directional)
+            {
+                if (count < 9)
+                    fail(std::string(tokens[1]) + " light needs a radius");
+                light.radius = count >= 9 ? num(8) : 0.0f;
+            }
+            if (light.type == SceneLight_Spot)
+            {
+                if (count < 13)
+                    fail("spot light needs a direction and an angle");
+                for (int a = 0; a < 3 && count >= 13; ++a)
+                    light.direction[a] = num(9 + a);
+                light.outerAngle = count >= 13 ? glm::radians(num(12)) : 0.0f;
+                light.innerAngle = count >= 14 ? glm::radians(num(13)) : light.outerAngle * 0.8f;
+            }
+            desc.lights.push_back(light);
+        }
+        else if (!strcmp(cmd, "camera") && count >= 6)
+        {
+            for (int a = 0; a < 3; ++a)
+                desc.camera.position[a] = num(1 + a);
+            desc.camera.yaw = glm::radians(num(4));
+            desc.camera.pitch = glm::radians(num(5));
+            desc.hasCamera = true;
+        }
+        else if (!strcmp(cmd, "environment") && count >= 2)
+        {
+            std::string envPath = tokens[1];
+            if (envPath == "sky")
+                envPath.clear();
+            else if (envPath[0] != '/' && envPath.find(':') == std::string::npos)
+                envPath = baseDir + envPath;
+            desc.environment = envPath;
+            if (count >= 3)
+                desc.settings.environmentIntensity = num(2);
+        }
+        else if (!strcmp(cmd, "set") && count >= 3)
+        {
+            const char* key = tokens[1];
+            const char* value = tokens[2];
+            // A rejected value fails the load instead of picking a default
+            if (!strcmp(key, "cull"))
+                desc.settings.cullMode = word(value, { "cpu", "gpu", "occlusion" });
+            else if (!strcmp(key, "prepass"))
+                desc.settings.prepassMode = word(value, { "off", "on", "auto" });
+            else if (!strcmp(key, "dynres"))
+                desc.settings.dynamicResolution = word(value, { "off", "on" });
+            else if (!strcmp(key, "fps"))
+                desc.settings.targetFps = word(value, { "30", "60" }) == 1 ? 60 : 30;
+            else if (!strcmp(key, "texbudget"))
+                desc.settings.textureBudgetMB = integer(2, 0);
+            else if (!strcmp(key, "shadows"))
+            {
+                desc.settings.shadowResolution = !strcmp(value, "off") ? 0 : integer(2, 0);
+                if (count >= 4)
+                    desc.settings.shadowCascades = integer(3, 1);
+                if (count >= 5)
+                    desc.settings.shadowDistance = integer(4, 1);
+            }
+            else if (!strcmp(key, "post"))
+            {
+                desc.settings.postQuality = word(value, { "off", "low", "medium", "high" });
+                if (count >= 4)
+                    desc.settings.exposure = num(3);
+            }
+            else
+                fail("unknown setting");
+        }
+        else
+        {
+            fail("unknown or incomplete statement");
+        }
+    }
+    fclose(f);
+
+    for (const SceneInstance& inst : desc.instances)
+        if (inst.model >= desc.models.size()) { printf("%s: instance uses undefined model %u\n", path.c_str(), inst.model); ok = false; break; }
+    for (const SceneGrid& grid : desc.grids)
+        if (grid.model >= desc.models.size()) { printf("%s: grid uses undefined model %u\n", path.c_str(), grid.model); ok = false; break; }
+    return ok;
+}
+
+bool loadSceneBinary(const std::string& path, SceneDesc& desc)
+{
+    FILE* f = fopen(path.c_str(), "rb");
+    if (!f)
+    {
+        printf("Scene file not found: %s\n", path.c_str());
+        return false;
+    }
+
+    desc = SceneDesc{};
+    SceneBinaryHeader header{};
+    bool ok = fread(&header, sizeof(header), 1, f) == 1 &&
+              memcmp(header.magic, kBinaryMagic, 4) == 0 && header.version == kBinaryVersion;
+    if (!ok)
+    {
+        printf("Not a version %u binary scene: %s\n", kBinaryVersion, path.c_str());
+        fclose(f);
+        return false;
+    }
+
+    std::vector<char> paths(header.pathBytes);
+    desc.instances.resize(header.instanceCount);
+    desc.grids.resize(header.gridCount);
+    desc.lights.resize(header.lightCount);
+    ok = (paths.empty() || fread(paths.data(), paths.size(), 1, f) == 1) &&
+         (desc.instances.empty() || fread(desc.instances.data(), sizeof(SceneInstance), desc.instances.size(), f) == desc.instances.size()) &&
+         (desc.grids.empty() || fread(desc.grids.data(), sizeof(SceneGrid), desc.grids.size(), f) == desc.grids.size()) &&
+         (desc.lights.empty() || fread(desc.lights.data(), sizeof(SceneLight), desc.lights.size(), f) == desc.lights.size());
+    fclose(f);
+    if (!ok || (!paths.empty() && paths.back() != '\0'))
+    {
+        printf("Truncated binary scene: %s\n", path.c_str());
+        return false;
+    }
+
+    for (size_t pos = 0; pos < paths.size() && desc.models.size() < header.modelCount; )
+    {
+        desc.models.emplace_back(&paths[pos]);
+        pos += desc.models.back().size() + 1;
+    }
+    if (header.hasEnvironment)
+    {
+        size_t pos = 0;
+        for (const std::string& model : desc.models)
+            pos += model.size() + 1;
+        if (pos < paths.size())
+            desc.environment = &paths[pos];
+    }
+    desc.hasCamera = header.hasCamera != 0;
+    desc.camera = header.camera;
+    desc.settings = header.settings;
+
+    for (const SceneInstance& inst : desc.instances)
+        if (inst.model >= desc.models.size()) return false;
+    for (const SceneGrid& grid : desc.grids)
+        if (grid.model >= desc.models.size()) return false;
+    return true;
+}
+
+bool saveSceneBinary(const std::string& path, const SceneDesc& desc)
+{
+    std::vector<char> paths;
+    for (const std::string& model : desc.models)
+        paths.insert(paths.end(), model.c_str(), model.c_str() + model.size() + 1);
+    if (!desc.environment.empty())
+        paths.insert(paths.end(), desc.environment.c_str(), desc.environment.c_str() + desc.environment.size() + 1);
+
+    SceneBinaryHeader header{};
+    memcpy(header.magic, kBinaryMagic, 4);
+    header.version = kBinaryVersion;
+    header.modelCount = (uint32_t)desc.models.size();
+    header.instanceCount = (uint32_t)desc.instances.size();
+    header.gridCount = (uint32_t)desc.grids.size();
+    header.lightCount = (uint32_t)desc.lights.size();
+    header.pathBytes = (uint32_t)paths.size();
+    header.hasCamera = desc.hasCamera ? 1 : 0;
+    header.hasEnvironment = desc.environment.empty() ? 0 : 1;
+    header.camera = desc.camera;
+    header.settings = desc.settings;
+
+    FILE* f = fopen(path.c_str(), "wb");
+    if (!f)
+    {
+        printf("Failed to create %s\n", path.c_str());
+        return false;
+    }
+    bool ok = fwrite(&header, sizeof(header), 1, f) == 1 &&
+              (paths.empty() || fwrite(paths.data(), paths.size(), 1, f) == 1) &&
+              (desc.instances.empty() || fwrite(desc.instances.data(), sizeof(SceneInstance), desc.instances.size(), f) == desc.instances.size()) &&
+              (desc.grids.empty() || fwrite(desc.grids.data(), sizeof(SceneGrid), desc.grids.size(), f) == desc.grids.size()) &&
+              (desc.lights.empty() || fwrite(desc.lights.data(), sizeof(SceneLight), desc.lights.size(), f) == desc.lights.size());
+    fclose(f);
+    if (!ok)
+        printf("Failed to write %s\n", path.c_str());
+    return ok;
+}
+
+std::vector<std::string> listSceneFiles(const std::string& dir)
+{
+    std::vector<std::string> files;
+    DIR* d = opendir(dir.c_str());
+    if (!d)
+        return files;
+
+    while (dirent* entry = readdir(d))
+    {
+        std::string name = entry->d_name;
+        if (endsWith(name, ".scene") || endsWith(name, ".sceneb"))
+            files.push_back(dir + "/" + name);
+    }
+    closedir(d);
+    std::sort(files.begin(), files.end());
+    return files;
+}
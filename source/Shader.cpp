@@ -1,6 +1,11 @@
 #include "Shader.h"
+#include "ShaderCache.h"
+#include <switch.h>
+#include <sys/stat.h>
+#include <algorithm>
 #include <fstream>
 #include <sstream>
+#include <unordered_map>
 #include <cstdio>
 
 static std::string readFileImpl(const std::string& path)
@@ -13,8 +18,75 @@ static std::string readFileImpl(const std::string& path)
     return ss.str();
 }
 
+// #defines must follow the #version line, which has to come first. The
+// #line after them keeps compiler messages on the file's own numbering.
+static void insertDefines(std::string& source, const std::string& defines)
+{
+    if (defines.empty())
+        return;
+    size_t pos = 0;
+    if (source.compare(0, 8, "#version") == 0)
+    {
+        pos = source.find('\n');
+        pos = pos == std::string::npos ? source.size() : pos + 1;
+    }
+    source.insert(pos, pos ? defines + "#line 2 0\n" : defines + "#line 1 0\n");
+}
+
+static const char* stageName(GLenum type)
+{
+    switch (type)
+    {
+    case GL_VERTEX_SHADER:   return "vertex";
+    case GL_FRAGMENT_SHADER: return "fragment";
+    case GL_GEOMETRY_SHADER: return "geometry";
+    case GL_COMPUTE_SHADER:  return "compute";
+    default:                 return "?";
+    }
+}
+
+// File contents shared by every program that reads them, so an include used
+// by all material variants comes off storage once. Keyed by requested path,
+// valid while the resolved path and mtime match.
+struct CachedSource
+{
+    std::string resolved;
+    time_t mtime;
+    std::string text;
+};
+
+static std::unordered_map<std::string, CachedSource>& sourceCache()
+{
+    static std::unordered_map<std::string, CachedSource> cache;
+    return cache;
+}
+
+const char* const Shader::kOverrideDir = "/switch/shaders";
+static const char kRomfsShaderDir[] = "romfs:/shaders/";
+
+// Every live Shader, for reloadChanged()
+static std::vector<Shader*>& liveShaders()
+{
+    static std::vector<Shader*> shaders;
+    return shaders;
+}
+
+static time_t fileMtime(const std::string& path)
+{
+    struct stat st;
+    return stat(path.c_str(), &st) == 0 ? st.st_mtime : 0;
+}
+
+Shader::Shader()
+{
+    liveShaders().push_back(this);
+}
+
 Shader::~Shader()
 {
+    auto& shaders = liveShaders();
+    shaders.erase(std::remove(shaders.begin(), shaders.end(), this), shaders.end());
+
     if (program_)
     {
         glDeleteProgram(program_);
@@ -22,15 +94,101 @@ Shader::~Shader()
     }
 }
 
-std::string Shader::readFile(const std::string& path) const
+std::string Shader::resolvePath(const std::string& path)
 {
-    return readFileImpl(path);
+    const size_t prefix = sizeof(kRomfsShaderDir) - 1;
+    if (path.compare(0, prefix, kRomfsShaderDir) != 0)
+        return path;
+    std::string override = std::string(kOverrideDir) + "/" + path.substr(prefix);
+    struct stat st;
+    return stat(override.c_str(), &st) == 0 ? override : path;
+}
+
+const std::string& Shader::readFile(const std::string& path)
+{
+    WatchedFile file;
+    file.path = path;
+    file.resolved = resolvePath(path);
+    file.mtime = fileMtime(file.resolved);
+    bool watched = false;
+    for (const WatchedFile& w : watched_)
+        watched = watched || w.path == path;
+    if (!watched)
+        watched_.push_back(file);
+
+    CachedSource& cached = sourceCache()[path];
+    if (cached.resolved != file.resolved || cached.mtime != file.mtime || cached.text.empty())
+    {
+        cached.resolved = file.resolved;
+        cached.mtime = file.mtime;
+        cached.text = readFileImpl(file.resolved);
+    }
+    return cached.text;
 }
 
-bool Shader::compileShader(GLenum type, const char* source, GLuint& outShader) const
+bool Shader::preprocess(const std::string& path, std::string& out, std::vector<std::string>& files)
+{
+    const std::string& text = readFile(path);
+    if (text.empty())
+    {
+        printf("Failed to read shader source: %s\n", path.c_str());
+        return false;
+    }
+
+    const int index = (int)files.size();
+    files.push_back(path);
+    const std::string dir = path.substr(0, path.rfind('/') + 1);
+
+    out.reserve(out.size() + text.size());
+    int line = 1;
+    for (size_t pos = 0; pos < text.size(); ++line)
+    {
+        size_t end = text.find('\n', pos);
+        if (end == std::string::npos)
+            end = text.size();
+
+        size_t first = text.find_first_not_of(" \t", pos);
+        if (first < end && text.compare(first, 8, "#include") == 0)
+        {
+            size_t open = text.find('"', first);
+            size_t close = open < end ? text.find('"', open + 1) : std::string::npos;
+            if (open >= end || close >= end)
+            {
+                printf("%s:%d: expected #include \"file\"\n", path.c_str(), line);
+                return false;
+            }
+
+            // Every file goes in once per stage, which also ends cycles
+            std::string name = dir + text.substr(open + 1, close - open - 1);
+            if (std::find(files.begin(), files.end(), name) == files.end())
+            {
+                out += "#line 1 " + std::to_string(files.size()) + "\n";
+                if (!preprocess(name, out, files))
+                {
+                    printf("  included from %s:%d\n", path.c_str(), line);
+                    return false;
+                }
+                out += "#line " + std::to_string(line + 1) + " " + std::to_string(index) + "\n";
+            }
+            else
+            {
+                out += '\n';
+            }
+        }
+        else
+        {
+            out.append(text, pos, end - pos);
+            out += '\n';
+        }
+        pos = end + 1;
+    }
+    return true;
+}
+
+bool Shader::compileShader(GLenum type, const char* source, GLuint& outShader,
+                           const std::vector<std::string>& files) const
 {
     GLint success;
-    GLchar info[1024];
     GLuint sh = glCreateShader(type);
     if (!sh)
     {
@@ -42,8 +200,15 @@ bool Shader::compileShader(GLenum type, const char* source, GLuint& outShader) c
     glGetShaderiv(sh, GL_COMPILE_STATUS, &success);
     if (success == GL_FALSE)
     {
-        glGetShaderInfoLog(sh, sizeof(info), nullptr, info);
-        printf("Shader compile error: %s\n", info);
+        // The whole log, a fixed buffer cut long error lists short
+        GLint length = 0;
+        glGetShaderiv(sh, GL_INFO_LOG_LENGTH, &length);
+        std::string info(length > 0 ? length : 1, '\0');
+        glGetShaderInfoLog(sh, (GLsizei)info.size(), nullptr, &info[0]);
+        printf("Shader compile error (%s): %s\n", stageName(type), info.c_str());
+        // Messages are "<source string>:<line>", the string is the file
+        for (size_t i = 0; i < files.size(); ++i)
+            printf("  source %zu: %s\n", i, files[i].c_str());
         glDeleteShader(sh);
         return false;
     }
@@ -51,51 +216,171 @@ bool Shader::compileShader(GLenum type, const char* source, GLuint& outShader) c
     return true;
 }
 
-bool Shader::loadFromFiles(const std::string& vertPath, const std::string& fragPath)
+bool Shader::loadFromFiles(const std::string& vertPath, const std::string& fragPath,
+                           const std::string& geomPath, const std::string& defines)
+{
+    vertPath_ = vertPath;
+    fragPath_ = fragPath;
+    geomPath_ = geomPath;
+    compPath_.clear();
+    defines_ = defines;
+    return build();
+}
+
+bool Shader::loadComputeFromFile(const std::string& compPath)
 {
-    std::string vertSrc = readFile(vertPath);
-    if (vertSrc.empty())
+    vertPath_.clear();
+    fragPath_.clear();
+    geomPath_.clear();
+    compPath_ = compPath;
+    defines_.clear();
+    return build();
+}
+
+bool Shader::build()
+{
+    u64 start = armGetSystemTick();
+    watched_.clear();
+
+    std::vector<GLenum> types;
+    std::vector<std::string> paths;
+    if (!compPath_.empty())
     {
-        printf("Failed to read vertex shader: %s\n", vertPath.c_str());
-        return false;
+        types = { GL_COMPUTE_SHADER };
+        paths = { compPath_ };
     }
-    std::string fragSrc = readFile(fragPath);
-    if (fragSrc.empty())
+    else
     {
-        printf("Failed to read fragment shader: %s\n", fragPath.c_str());
-        return false;
+        types = { GL_VERTEX_SHADER, GL_FRAGMENT_SHADER };
+        paths = { vertPath_, fragPath_ };
+        if (!geomPath_.empty())
+        {
+            types.push_back(GL_GEOMETRY_SHADER);
+            paths.push_back(geomPath_);
+        }
     }
 
-    GLuint vsh = 0, fsh = 0;
-    if (!compileShader(GL_VERTEX_SHADER, vertSrc.c_str(), vsh))
-        return false;
-    if (!compileShader(GL_FRAGMENT_SHADER, fragSrc.c_str(), fsh))
+    // Sources with includes and #defines expanded; 'files' maps each
+    // stage's source string numbers back to file names
+    std::vector<std::string> sources(types.size());
+    std::vector<std::vector<std::string>> files(types.size());
+    for (size_t i = 0; i < types.size(); ++i)
+    {
+        if (!preprocess(paths[i], sources[i], files[i]))
+        {
+            printf("Failed to read %s shader: %s\n", stageName(types[i]), paths[i].c_str());
+            return false;
+        }
+        insertDefines(sources[i], defines_);
+    }
+
+    // Same sources and driver as a previous run: no compile at all
+    uint64_t key = programCacheKey(types, sources);
+    GLuint program = glCreateProgram();
+    bool cached = loadProgramBinary(key, program);
+    if (!cached)
     {
-        glDeleteShader(vsh);
+        glDeleteProgram(program);
+
+        GLuint shaders[3] = { 0, 0, 0 };
+        for (size_t i = 0; i < types.size(); ++i)
+        {
+            if (!compileShader(types[i], sources[i].c_str(), shaders[i], files[i]))
+            {
+                for (size_t j = 0; j < i; ++j)
+                    glDeleteShader(shaders[j]);
+                return false;
+            }
+        }
+        program = linkProgram(shaders, (int)types.size());
+        if (!program)
+            return false;
+        saveProgramBinary(key, program);
+    }
+
+    // Only a program that linked replaces the current one
+    if (program_)
+        glDeleteProgram(program_);
+    program_ = program;
+    buildMs_ = armTicksToNs(armGetSystemTick() - start) / 1000000.0f;
+
+    std::string flags;
+    for (size_t pos = 0; (pos = defines_.find("#define ", pos)) != std::string::npos; pos += 8)
+        flags += " " + defines_.substr(pos + 8, defines_.find('\n', pos) - pos - 8);
+    printf("Shader %s in %.2f ms: %s%s\n", cached ? "loaded from cache" : "built", buildMs_,
+           paths[types.size() > 1 ? 1 : 0].c_str(), flags.c_str());
+
+    glUseProgram(program_);
+    if (onLink_)
+        onLink_(*this);
+    return true;
+}
+
+bool Shader::reloadIfChanged()
+{
+    bool changed = false;
+    for (const WatchedFile& file : watched_)
+    {
+        std::string resolved = resolvePath(file.path);
+        if (resolved != file.resolved || fileMtime(resolved) != file.mtime)
+        {
+            printf("Shader source changed: %s\n", resolved.c_str());
+            changed = true;
+            break;
+        }
+    }
+    if (!changed)
         return false;
+
+    // A failed build keeps the old program, the new mtimes are remembered
+    // so it is retried on the next edit rather than on every poll
+    if (build())
+        return true;
+    printf("Shader reload failed, keeping the previous program\n");
+    return false;
+}
+
+int Shader::reloadChanged()
+{
+    struct stat st;
+    if (stat(kOverrideDir, &st) != 0)
+        return 0;
+
+    int reloaded = 0;
+    for (Shader* shader : liveShaders())
+    {
+        if (shader->reloadIfChanged())
+            ++reloaded;
     }
+    return reloaded;
+}
 
-    program_ = glCreateProgram();
-    glAttachShader(program_, vsh);
-    glAttachShader(program_, fsh);
-    glLinkProgram(program_);
+GLuint Shader::linkProgram(const GLuint* shaders, int count) const
+{
+    GLuint program = glCreateProgram();
+    for (int i = 0; i < count; ++i)
+        glAttachShader(program, shaders[i]);
+    if (programBinariesSupported())
+        glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    glLinkProgram(program);
 
     GLint success = GL_FALSE;
-    glGetProgramiv(program_, GL_LINK_STATUS, &success);
+    glGetProgramiv(program, GL_LINK_STATUS, &success);
     if (success == GL_FALSE)
     {
-        char buf[1024];
-        glGetProgramInfoLog(program_, sizeof(buf), nullptr, buf);
-        printf("Shader link error: %s\n", buf);
-        glDeleteShader(vsh);
-        glDeleteShader(fsh);
-        glDeleteProgram(program_);
-        program_ = 0;
-        return false;
+        GLint length = 0;
+        glGetProgramiv(program, GL_INFO_LOG_LENGTH, &length);
+        std::string info(length > 0 ? length : 1, '\0');
+        glGetProgramInfoLog(program, (GLsizei)info.size(), nullptr, &info[0]);
+        printf("Shader link error: %s\n", info.c_str());
+        for (int i = 0; i < count; ++i)
+            glDeleteShader(shaders[i]);
+        glDeleteProgram(program);
+        return 0;
     }
 
     // shaders attached to the program can be deleted after linking
-    glDeleteShader(vsh);
-    glDeleteShader(fsh);
-    return true;
+    for (int i = 0; i < count; ++i)
+        glDeleteShader(shaders[i]);
+    return program;
 }
@@ -0,0 +1,104 @@
+#include "ShaderCache.h"
+#include "DiskCache.h"
+#include <cstdio>
+#include <cstring>
+
+static const char kShaderCacheDir[] = "/switch/shadercache";
+static const char kMagic[4] = { 'S', 'R', 'P', 'B' };
+static const uint32_t kVersion = 1;
+
+struct ProgramCacheHeader
+{
+    char magic[4];
+    uint32_t version;
+    uint64_t key;
+    uint32_t format;
+    uint32_t size;
+};
+
+uint64_t programCacheKey(const std::vector<GLenum>& types, const std::vector<std::string>& sources)
+{
+    uint64_t hash = kCacheHashSeed;
+
+    // A driver update invalidates every binary
+    const char* strings[] = { (const char*)glGetString(GL_RENDERER), (const char*)glGetString(GL_VERSION) };
+    for (const char* s : strings)
+    {
+        if (s)
+            hashBytes(hash, s, strlen(s) + 1);
+    }
+
+    for (size_t i = 0; i < types.size() && i < sources.size(); ++i)
+    {
+        uint32_t type = types[i];
+        hashBytes(hash, &type, sizeof(type));
+        hashBytes(hash, sources[i].data(), sources[i].size());
+    }
+    return cacheKey(hash);
+}
+
+bool programBinariesSupported()
+{
+    static int formats = -1;
+    if (formats < 0)
+    {
+        GLint count = 0;
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &count);
+        formats = count;
+    }
+    return formats > 0;
+}
+
+bool loadProgramBinary(uint64_t key, GLuint program)
+{
+    if (!programBinariesSupported())
+        return false;
+    FILE* f = fopen(cacheFilePath(kShaderCacheDir, key, "srpb").c_str(), "rb");
+    if (!f)
+        return false;
+
+    ProgramCacheHeader header;
+    std::vector<unsigned char> binary;
+    bool ok = fread(&header, sizeof(header), 1, f) == 1 && memcmp(header.magic, kMagic, 4) == 0 &&
+              header.version == kVersion && header.key == key && header.size > 0;
+    if (ok)
+    {
+        binary.resize(header.size);
+        ok = fread(binary.data(), 1, binary.size(), f) == binary.size();
+    }
+    fclose(f);
+    if (!ok)
+        return false;
+
+    glProgramBinary(program, header.format, binary.data(), (GLsizei)binary.size());
+    GLint linked = GL_FALSE;
+    glGetProgramiv(program, GL_LINK_STATUS, &linked);
+    return linked == GL_TRUE;
+}
+
+bool saveProgramBinary(uint64_t key, GLuint program)
+{
+    if (!programBinariesSupported())
+        return false;
+
+    GLint length = 0;
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0)
+        return false;
+    std::vector<unsigned char> binary(length);
+    GLenum format = 0;
+    glGetProgramBinary(program, length, &length, &format, binary.data());
+    if (length <= 0)
+        return false;
+
+    ProgramCacheHeader header;
+    memcpy(header.magic, kMagic, 4);
+    header.version = kVersion;
+    header.key = key;
+    header.format = format;
+    header.size = (uint32_t)length;
+    return writeCacheFile(kShaderCacheDir, cacheFilePath(kShaderCacheDir, key, "srpb"), [&](FILE* f) {
+        return fwrite(&header, sizeof(header), 1, f) == 1 &&
+               fwrite(binary.data(), 1, (size_t)length, f) == (size_t)length;
+    });
+}
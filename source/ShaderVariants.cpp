@@ -0,0 +1,59 @@
+#include "ShaderVariants.h"
+#include <cstdio>
+
+ShaderVariants::ShaderVariants(const std::string& vertPath, const std::string& fragPath,
+                               std::vector<std::string> featureDefines,
+                               std::function<void(const Shader&)> onCompile)
+    : vertPath_(vertPath), fragPath_(fragPath), featureDefines_(std::move(featureDefines)),
+      onCompile_(std::move(onCompile))
+{
+}
+
+const Shader* ShaderVariants::get(unsigned features)
+{
+    auto it = variants_.find(features);
+    if (it != variants_.end())
+        return it->second->program() ? it->second.get() : nullptr;
+
+    std::string defines;
+    for (size_t i = 0; i < featureDefines_.size(); ++i)
+    {
+        if (features & (1u << i))
+            defines += "#define " + featureDefines_[i] + "\n";
+    }
+
+    auto shader = std::make_unique<Shader>();
+    shader->setOnLink(onCompile_);
+    bool ok = shader->loadFromFiles(vertPath_, fragPath_, std::string(), defines);
+    if (!ok)
+        printf("Failed to compile shader variant %s of %s\n", describe(features).c_str(), fragPath_.c_str());
+
+    // A failed variant is kept too: it is not retried every frame, and a
+    // hot reload of its sources can still bring it to life
+    const Shader* result = ok ? shader.get() : nullptr;
+    variants_[features] = std::move(shader);
+    return result;
+}
+
+void ShaderVariants::forEach(const std::function<void(unsigned features, const Shader&)>& fn) const
+{
+    for (const auto& v : variants_)
+    {
+        if (v.second->program())
+            fn(v.first, *v.second);
+    }
+}
+
+std::string ShaderVariants::describe(unsigned features) const
+{
+    std::string name;
+    for (size_t i = 0; i < featureDefines_.size(); ++i)
+    {
+        if (!(features & (1u << i)))
+            continue;
+        if (!name.empty())
+            name += "|";
+        name += featureDefines_[i];
+    }
+    return name.empty() ? "base" : name;
+}
@@ -0,0 +1,322 @@
+#include "ShadowMap.h"
+#include "Culling.h"
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/type_ptr.hpp>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+// How far each light view reaches back toward the light past its slice
+static const float kCasterDistance = 100.0f;
+// Blend of logarithmic (1) and uniform (0) split distances
+static const float kSplitLambda = 0.5f;
+// Start of the logarithmic split series, the camera near plane is far too
+// close for it
+static const float kMinLogNear = 0.1f;
+// Raster depth bias against acne, on top of the normal offset in the shader
+static const float kSlopeBias = 1.5f;
+static const float kConstantBias = 2.0f;
+// Receiver offset along the normal, in shadow texels of its cascade
+static const float kNormalOffsetTexels = 1.5f;
+
+ShadowMap::~ShadowMap()
+{
+    destroyMaps();
+    for (const CasterList& list : casters_)
+        glDeleteBuffers(1, &list.buffer);
+}
+
+bool ShadowMap::init(int resolution, int cascadeCount)
+{
+    // Same shaders as the depth pre-pass: position-only stream, no color
+    shader_ = std::make_unique<Shader>();
+    shader_->setOnLink([this](const Shader& shader) {
+        loc_viewMtx = shader.getUniformLocation("uView");
+        loc_projMtx = shader.getUniformLocation("uProj");
+    });
+    if (!shader_->loadFromFiles("romfs:/shaders/depth_vertex.glsl", "romfs:/shaders/depth_fragment.glsl"))
+    {
+        printf("Failed to load shadow map shaders\n");
+        return false;
+    }
+    return setConfig(resolution, cascadeCount);
+}
+
+void ShadowMap::destroyMaps()
+{
+    if (fbo_) glDeleteFramebuffers(1, &fbo_);
+    if (depthTex_) glDeleteTextures(1, &depthTex_);
+    fbo_ = 0;
+    depthTex_ = 0;
+}
+
+bool ShadowMap::setConfig(int resolution, int cascadeCount)
+{
+    cascadeCount = std::max(1, std::min(cascadeCount, kMaxCascades));
+    if (resolution > 0)
+        resolution = std::max(256, std::min(resolution, 4096));
+    if (resolution == resolution_ && cascadeCount == cascadeCount_ && (depthTex_ || resolution == 0))
+        return true;
+
+    destroyMaps();
+    resolution_ = resolution > 0 ? resolution : 0;
+    cascadeCount_ = cascadeCount;
+    if (resolution_ == 0)
+    {
+        printf("Shadows: off\n");
+        return true;
+    }
+
+    // Linear filtering of a compare texture is a 2x2 PCF for free
+    static const float border[4] = { 1.0f, 1.0f, 1.0f, 1.0f };
+    glGenTextures(1, &depthTex_);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, depthTex_);
+    glTexStorage3D(GL_TEXTURE_2D_ARRAY, 1, GL_DEPTH_COMPONENT24, resolution_, resolution_, cascadeCount_);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
+    glTexParameterfv(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_BORDER_COLOR, border);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+    glGenFramebuffers(1, &fbo_);
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo_);
+    glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, depthTex_, 0, 0);
+    glDrawBuffer(GL_NONE);
+    glReadBuffer(GL_NONE);
+    GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    if (status != GL_FRAMEBUFFER_COMPLETE)
+    {
+        printf("Shadow map framebuffer incomplete: 0x%x\n", status);
+        destroyMaps();
+        return false;
+    }
+
+    printf("Shadows: %d cascades of %dx%d, %.1f MB\n", cascadeCount_, resolution_, resolution_,
+           (double)resolution_ * resolution_ * 4 * cascadeCount_ / (1024.0 * 1024.0));
+    return true;
+}
+
+void ShadowMap::update(const glm::mat4& view, const glm::mat4& proj, const glm::vec3& lightDir)
+{
+    if (!enabled())
+        return;
+
+    // Near and far plane of a glm::perspective projection
+    float zNear = proj[3][2] / (proj[2][2] - 1.0f);
+    float zFar = proj[3][2] / (proj[2][2] + 1.0f);
+    float end = std::min(shadowDistance_, zFar);
+    float logNear = std::max(zNear, kMinLogNear);
+
+    // Frustum corners on the near and far plane; a point at view depth d
+    // lies at the same fraction along each edge
+    glm::mat4 invViewProj = glm::inverse(proj * view);
+    glm::vec3 nearCorners[4], farCorners[4];
+    for (int i = 0; i < 4; ++i)
+    {
+        float x = (i & 1) ? 1.0f : -1.0f;
+        float y = (i & 2) ? 1.0f : -1.0f;
+        glm::vec4 n = invViewProj * glm::vec4(x, y, -1.0f, 1.0f);
+        glm::vec4 f = invViewProj * glm::vec4(x, y, 1.0f, 1.0f);
+        nearCorners[i] = glm::vec3(n) / n.w;
+        farCorners[i] = glm::vec3(f) / f.w;
+    }
+
+    glm::vec3 up = std::fabs(lightDir.y) > 0.99f ? glm::vec3(0.0f, 0.0f, 1.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+    glm::mat4 lightView = glm::lookAt(glm::vec3(0.0f), lightDir, up);
+    glm::mat4 bias = glm::translate(glm::mat4(1.0f), glm::vec3(0.5f)) * glm::scale(glm::mat4(1.0f), glm::vec3(0.5f));
+
+    float splitStart = zNear;
+    for (int c = 0; c < cascadeCount_; ++c)
+    {
+        float fraction = (float)(c + 1) / cascadeCount_;
+        float logSplit = logNear * std::pow(end / logNear, fraction);
+        float uniformSplit = zNear + (end - zNear) * fraction;
+        float splitEnd = kSplitLambda * logSplit + (1.0f - kSplitLambda) * uniformSplit;
+
+        glm::vec3 corners[8];
+        float t0 = (splitStart - zNear) / (zFar - zNear);
+        float t1 = (splitEnd - zNear) / (zFar - zNear);
+        glm::vec3 center(0.0f);
+        for (int i = 0; i < 4; ++i)
+        {
+            corners[i] = nearCorners[i] + (farCorners[i] - nearCorners[i]) * t0;
+            corners[i + 4] = nearCorners[i] + (farCorners[i] - nearCorners[i]) * t1;
+            center += corners[i] + corners[i + 4];
+        }
+        center /= 8.0f;
+
+        // The sphere only depends on the slice's shape, not on where the
+        // camera looks, so the projection never changes size
+        float radius = 0.0f;
+        for (const glm::vec3& corner : corners)
+            radius = std::max(radius, glm::length(corner - center));
+        radius = std::ceil(radius * 16.0f) / 16.0f;
+
+        // Snap the origin to whole texels; two spare texels keep the
+        // sphere covered after the snap
+        float texel = 2.0f * radius / (resolution_ - 2);
+        float halfSize = 0.5f * texel * resolution_;
+        glm::vec3 origin = glm::vec3(lightView * glm::vec4(center, 1.0f));
+        origin.x = std::floor(origin.x / texel) * texel;
+        origin.y = std::floor(origin.y / texel) * texel;
+
+        glm::mat4 lightProj = glm::ortho(origin.x - halfSize, origin.x + halfSize,
+                                         origin.y - halfSize, origin.y + halfSize,
+                                         -origin.z - radius - kCasterDistance, -origin.z + radius);
+
+        Cascade& cascade = cascades_[c];
+        cascade.viewProj = lightProj * lightView;
+        cascade.shadowMtx = bias * cascade.viewProj;
+        cascade.splitEnd = splitEnd;
+        cascade.texelWorld = texel;
+        splitStart = splitEnd;
+    }
+}
+
+void ShadowMap::cullCasters(const DrawBatch& batch, CasterList& list, const glm::mat4& viewProj, GpuCuller* culler)
+{
+    size_t records = batch.recordCount();
+    if (list.capacity < records)
+    {
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, list.buffer);
+        glBufferData(GL_DRAW_INDIRECT_BUFFER, records * sizeof(DrawElementsIndirectCommand), nullptr, GL_DYNAMIC_DRAW);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+        list.capacity = records;
+    }
+
+    if (culler)
+    {
+        // Compacted per group with the tail zeroed, submitted whole
+        culler->cull(batch, viewProj, list.buffer);
+        list.drawCount = (GLsizei)records;
+        return;
+    }
+
+    batch.cullRecords(Frustum::fromMatrix(viewProj), batch.transforms(), visible_);
+    if (!visible_.empty())
+    {
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, list.buffer);
+        glBufferSubData(GL_DRAW_INDIRECT_BUFFER, 0, visible_.size() * sizeof(DrawElementsIndirectCommand), visible_.data());
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+    }
+    list.drawCount = (GLsizei)visible_.size();
+}
+
+void ShadowMap::render(const DrawBatchList& batches, GpuCuller* culler)
+{
+    if (!enabled())
+        return;
+
+    while (casters_.size() < batches.size() * kMaxCascades)
+    {
+        CasterList list{};
+        glGenBuffers(1, &list.buffer);
+        casters_.push_back(list);
+    }
+
+    GLint prevFbo = 0;
+    GLint viewport[4];
+    glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &prevFbo);
+    glGetIntegerv(GL_VIEWPORT, viewport);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo_);
+    glViewport(0, 0, resolution_, resolution_);
+    glDepthFunc(GL_LESS);
+    glDepthMask(GL_TRUE);
+    glEnable(GL_POLYGON_OFFSET_FILL);
+    glPolygonOffset(kSlopeBias, kConstantBias);
+
+    const glm::mat4 identity(1.0f);
+    for (int c = 0; c < cascadeCount_; ++c)
+    {
+        const Cascade& cascade = cascades_[c];
+        timers_[c].begin();
+
+        glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, depthTex_, 0, c);
+        glClear(GL_DEPTH_BUFFER_BIT);
+
+        // Cull every batch first, then draw, to switch programs once
+        for (size_t b = 0; b < batches.size(); ++b)
+            cullCasters(*batches[b], casters_[b * kMaxCascades + c], cascade.viewProj, culler);
+
+        shader_->use();
+        glUniformMatrix4fv(loc_viewMtx, 1, GL_FALSE, glm::value_ptr(identity));
+        glUniformMatrix4fv(loc_projMtx, 1, GL_FALSE, glm::value_ptr(cascade.viewProj));
+        for (size_t b = 0; b < batches.size(); ++b)
+        {
+            const CasterList& list = casters_[b * kMaxCascades + c];
+            batches[b]->drawPositionOnly(list.buffer, list.drawCount);
+        }
+
+        timers_[c].end();
+    }
+
+    glDisable(GL_POLYGON_OFFSET_FILL);
+    glBindFramebuffer(GL_FRAMEBUFFER, (GLuint)prevFbo);
+    glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+}
+
+ShadowMap::Uniforms ShadowMap::locate(const Shader& shader)
+{
+    Uniforms loc;
+    loc.cascadeCount = shader.getUniformLocation("uCascadeCount");
+    loc.matrices = shader.getUniformLocation("uShadowMatrices");
+    loc.cascadeEnds = shader.getUniformLocation("uCascadeEnds");
+    loc.normalOffset = shader.getUniformLocation("uShadowNormalOffset");
+    return loc;
+}
+
+void ShadowMap::setUniforms(const Uniforms& loc) const
+{
+    int count = enabled() ? cascadeCount_ : 0;
+    glUniform1i(loc.cascadeCount, count);
+    if (count == 0)
+        return;
+
+    glm::mat4 matrices[kMaxCascades];
+    float ends[kMaxCascades] = {};
+    float offsets[kMaxCascades] = {};
+    for (int c = 0; c < count; ++c)
+    {
+        matrices[c] = cascades_[c].shadowMtx;
+        ends[c] = cascades_[c].splitEnd;
+        offsets[c] = cascades_[c].texelWorld * kNormalOffsetTexels;
+    }
+    glUniformMatrix4fv(loc.matrices, count, GL_FALSE, glm::value_ptr(matrices[0]));
+    glUniform4fv(loc.cascadeEnds, 1, ends);
+    glUniform4fv(loc.normalOffset, 1, offsets);
+}
+
+void ShadowMap::bindTexture() const
+{
+    glActiveTexture(GL_TEXTURE0 + kShadowTextureUnit);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, depthTex_);
+    glActiveTexture(GL_TEXTURE0);
+}
+
+float ShadowMap::totalMs() const
+{
+    if (!enabled())
+        return 0.0f;
+    float total = 0.0f;
+    for (int c = 0; c < cascadeCount_; ++c)
+        total += timers_[c].averageMs();
+    return total;
+}
+
+void ShadowMap::printTimings() const
+{
+    if (!enabled())
+    {
+        printf("Shadows: off\n");
+        return;
+    }
+    printf("Shadows %dx%d, %d cascades, %.2f ms GPU:\n", resolution_, resolution_, cascadeCount_, totalMs());
+    for (int c = 0; c < cascadeCount_; ++c)
+        printf("  cascade %d: up to %.1f, texel %.3f, %.2f ms\n", c, cascades_[c].splitEnd,
+               cascades_[c].texelWorld, timers_[c].averageMs());
+}
@@ -0,0 +1,233 @@
+#include "TemporalAA.h"
+#include <cstdio>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+// Weight of the history in the blend: about the last 10 frames contribute
+static const float kFeedback = 0.9f;
+
+static float halton(int index, int base)
+{
+    float result = 0.0f;
+    float fraction = 1.0f / base;
+    for (int i = index; i > 0; i /= base)
+    {
+        result += fraction * (i % base);
+        fraction /= base;
+    }
+    return result;
+}
+
+TemporalAA::~TemporalAA()
+{
+    glDeleteFramebuffers(2, fbo_);
+    glDeleteTextures(2, history_);
+    if (statsSsbo_) glDeleteBuffers(1, &statsSsbo_);
+    if (timeQueries_[0]) glDeleteQueries(2, timeQueries_);
+    if (emptyVao_) glDeleteVertexArrays(1, &emptyVao_);
+}
+
+bool TemporalAA::init(int width, int height)
+{
+    width_ = width;
+    height_ = height;
+
+    shader_ = std::make_unique<Shader>();
+    shader_->setOnLink([this](const Shader& shader) {
+        glUniform1i(shader.getUniformLocation("uScene"), 0);
+        glUniform1i(shader.getUniformLocation("uDepth"), 1);
+        glUniform1i(shader.getUniformLocation("uHistory"), 2);
+        loc_uvScale = shader.getUniformLocation("uUVScale");
+        loc_texelSize = shader.getUniformLocation("uTexelSize");
+        loc_historyScale = shader.getUniformLocation("uHistoryUVScale");
+        loc_reprojection = shader.getUniformLocation("uReprojection");
+        loc_jitter = shader.getUniformLocation("uJitter");
+        loc_feedback = shader.getUniformLocation("uFeedback");
+        loc_historyValid = shader.getUniformLocation("uHistoryValid");
+        loc_measure = shader.getUniformLocation("uMeasure");
+    });
+    if (!shader_->loadFromFiles("romfs:/shaders/fullscreen_vertex.glsl", "romfs:/shaders/taa_fragment.glsl"))
+    {
+        printf("Failed to load TAA shader\n");
+        return false;
+    }
+
+    GLuint zero[3] = { 0, 0, 0 };
+    glGenBuffers(1, &statsSsbo_);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, statsSsbo_);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(zero), zero, GL_DYNAMIC_READ);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+    glGenQueries(2, timeQueries_);
+    glGenVertexArrays(1, &emptyVao_);
+    return true;
+}
+
+bool TemporalAA::createHistory(GLenum format)
+{
+    glDeleteFramebuffers(2, fbo_);
+    glDeleteTextures(2, history_);
+    format_ = format;
+    historyValid_ = false;
+
+    glGenTextures(2, history_);
+    glGenFramebuffers(2, fbo_);
+    for (int i = 0; i < 2; ++i)
+    {
+        glBindTexture(GL_TEXTURE_2D, history_[i]);
+        glTexStorage2D(GL_TEXTURE_2D, 1, format, width_, height_);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+        glBindFramebuffer(GL_FRAMEBUFFER, fbo_[i]);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, history_[i], 0);
+        GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+        if (status != GL_FRAMEBUFFER_COMPLETE)
+        {
+            printf("TAA history framebuffer incomplete: 0x%x\n", status);
+            glBindFramebuffer(GL_FRAMEBUFFER, 0);
+            glBindTexture(GL_TEXTURE_2D, 0);
+            format_ = GL_NONE;
+            return false;
+        }
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    return true;
+}
+
+void TemporalAA::setEnabled(bool enabled)
+{
+    if (enabled && !enabled_)
+        historyValid_ = false;
+    enabled_ = enabled;
+}
+
+glm::mat4 TemporalAA::jitter(const glm::mat4& proj, int renderWidth, int renderHeight)
+{
+    // Halton from index 1, 0 would put a sample on the pixel corner
+    phase_ = (phase_ + 1) % kJitterPhases;
+    float x = halton(phase_ + 1, 2) - 0.5f;
+    float y = halton(phase_ + 1, 3) - 0.5f;
+    jitter_ = glm::vec2(x * 2.0f / renderWidth, y * 2.0f / renderHeight);
+
+    // A translation in clip space shifts NDC by the same amount whatever the depth
+    return glm::translate(glm::mat4(1.0f), glm::vec3(jitter_.x, jitter_.y, 0.0f)) * proj;
+}
+
+RGTexture TemporalAA::addPass(RenderGraph& graph, RGTexture sceneColor, RGTexture sceneDepth,
+                              const glm::mat4& viewProj)
+{
+    const RenderTargetDesc& desc = graph.desc(sceneColor);
+    if (desc.format != format_ && !createHistory(desc.format))
+        return sceneColor;
+
+    int renderWidth = graph.width(sceneColor);
+    int renderHeight = graph.height(sceneColor);
+    int previous = current_;
+    current_ ^= 1;
+
+    // Both persistent: last frame's is read, this frame's is read next frame
+    RGImport history{ history_[previous], fbo_[previous], GL_COLOR_ATTACHMENT0, desc, historyWidth_, historyHeight_,
+                     true };
+    RGTexture historyIn = graph.import("TAA history", history);
+    history.texture = history_[current_];
+    history.fbo = fbo_[current_];
+    history.width = renderWidth;
+    history.height = renderHeight;
+    RGTexture historyOut = graph.import("TAA output", history);
+
+    glm::mat4 reprojection = previousViewProj_ * glm::inverse(viewProj);
+    glm::vec2 historyScale((float)historyWidth_ / desc.width, (float)historyHeight_ / desc.height);
+    bool valid = historyValid_;
+    bool measure = measuring_;
+    bool time = timing_;
+    timing_ = false;
+
+    graph.addPass("temporal AA", RGPass_Scaled,
+        [&](RenderGraph::Builder& builder) {
+            builder.read(sceneColor);
+            builder.read(sceneDepth);
+            builder.read(historyIn);
+            builder.write(historyOut, RGLoad_DontCare);
+        },
+        [this, sceneColor, sceneDepth, historyIn, desc, renderWidth, renderHeight, historyScale, reprojection, valid,
+         measure, time](const RenderGraph::Context& context) {
+            glDisable(GL_DEPTH_TEST);
+            glBindVertexArray(emptyVao_);
+            shader_->use();
+            glUniform2f(loc_uvScale, (float)renderWidth / desc.width, (float)renderHeight / desc.height);
+            glUniform2f(loc_texelSize, 1.0f / desc.width, 1.0f / desc.height);
+            glUniform2f(loc_historyScale, historyScale.x, historyScale.y);
+            glUniformMatrix4fv(loc_reprojection, 1, GL_FALSE, glm::value_ptr(reprojection));
+            glUniform2f(loc_jitter, jitter_.x, jitter_.y);
+            glUniform1f(loc_feedback, kFeedback);
+            glUniform1i(loc_historyValid, valid ? 1 : 0);
+            glUniform1i(loc_measure, measure ? 1 : 0);
+            glBindBufferBase(GL_SHADER_STORAGE_BUFFER, kTaaStatsBinding, statsSsbo_);
+
+            glActiveTexture(GL_TEXTURE0);
+            glBindTexture(GL_TEXTURE_2D, context.texture(sceneColor));
+            glActiveTexture(GL_TEXTURE1);
+            glBindTexture(GL_TEXTURE_2D, context.texture(sceneDepth));
+            glActiveTexture(GL_TEXTURE2);
+            glBindTexture(GL_TEXTURE_2D, context.texture(historyIn));
+            glActiveTexture(GL_TEXTURE0);
+            if (time)
+                glQueryCounter(timeQueries_[0], GL_TIMESTAMP);
+            glDrawArrays(GL_TRIANGLES, 0, 3);
+            if (time)
+            {
+                glQueryCounter(timeQueries_[1], GL_TIMESTAMP);
+                timed_ = true;
+            }
+
+            glBindVertexArray(0);
+            glEnable(GL_DEPTH_TEST);
+        });
+
+    previousViewProj_ = viewProj;
+    historyWidth_ = renderWidth;
+    historyHeight_ = renderHeight;
+    historyValid_ = true;
+    return historyOut;
+}
+
+void TemporalAA::beginMeasure()
+{
+    GLuint zero[3] = { 0, 0, 0 };
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, statsSsbo_);
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(zero), zero);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    measuring_ = true;
+}
+
+bool TemporalAA::endMeasure(float& lag, float& clamped)
+{
+    measuring_ = false;
+    GLuint stats[3];
+    glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, statsSsbo_);
+    glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(stats), stats);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+    if (stats[0] == 0)
+        return false;
+    lag = stats[1] / 1000.0f / stats[0];
+    clamped = (float)stats[2] / stats[0];
+    return true;
+}
+
+double TemporalAA::resolveMs()
+{
+    timing_ = false;
+    if (!timed_)
+        return -1.0;
+    timed_ = false;
+    GLuint64 t[2];
+    for (int q = 0; q < 2; ++q)
+        glGetQueryObjectui64v(timeQueries_[q], GL_QUERY_RESULT, &t[q]);
+    return (double)(t[1] - t[0]) / 1e6;
+}
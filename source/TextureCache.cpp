@@ -0,0 +1,96 @@
+#include "TextureCache.h"
+#include "DiskCache.h"
+#include <cstdio>
+#include <cstring>
+
+static const char kMipCacheDir[] = "/switch/texcache";
+static const char kMagic[4] = { 'S', 'R', 'T', 'X' };
+static const uint32_t kVersion = 1;
+// Bump when generateMipChain's output changes, old files then miss
+static const uint32_t kFilterVersion = 1;
+
+struct MipCacheHeader
+{
+    char magic[4];
+    uint32_t version;
+    uint64_t key;
+    int32_t width;
+    int32_t height;
+    int32_t channels;
+    int32_t levels;
+};
+
+uint64_t mipCacheKey(const std::vector<std::string>& sources, int channels, MipContent content, int width,
+                     int height)
+{
+    uint64_t hash = kCacheHashSeed;
+    for (const std::string& source : sources)
+    {
+        if (source.empty())
+        {
+            hashBytes(hash, "-", 1);
+            continue;
+        }
+        if (!hashFileStamp(hash, source))
+            return 0;
+    }
+    int32_t params[5] = { channels, (int32_t)content, (int32_t)kFilterVersion, width, height };
+    hashBytes(hash, params, sizeof(params));
+    return cacheKey(hash);
+}
+
+bool loadMipCache(uint64_t key, MipChain& chain, int firstLevel)
+{
+    if (!key)
+        return false;
+    FILE* f = fopen(cacheFilePath(kMipCacheDir, key, "srtx").c_str(), "rb");
+    if (!f)
+        return false;
+
+    MipCacheHeader header;
+    bool ok = fread(&header, sizeof(header), 1, f) == 1 && memcmp(header.magic, kMagic, 4) == 0 &&
+              header.version == kVersion && header.key == key && header.width > 0 && header.height > 0 &&
+              header.channels > 0 && header.channels <= 4 &&
+              header.levels == mipLevelCount(header.width, header.height);
+    if (ok)
+    {
+        chain.width = header.width;
+        chain.height = header.height;
+        chain.channels = header.channels;
+        chain.levels.assign(header.levels, std::vector<unsigned char>());
+        for (int level = 0; level < header.levels && ok; ++level)
+        {
+            size_t bytes = (size_t)mipSize(header.width, level) * mipSize(header.height, level) * header.channels;
+            if (level < firstLevel)
+            {
+                ok = fseek(f, (long)bytes, SEEK_CUR) == 0;
+                continue;
+            }
+            chain.levels[level].resize(bytes);
+            ok = fread(chain.levels[level].data(), 1, bytes, f) == bytes;
+        }
+    }
+    fclose(f);
+    return ok;
+}
+
+bool saveMipCache(uint64_t key, const MipChain& chain)
+{
+    if (!key)
+        return false;
+
+    MipCacheHeader header;
+    memcpy(header.magic, kMagic, 4);
+    header.version = kVersion;
+    header.key = key;
+    header.width = chain.width;
+    header.height = chain.height;
+    header.channels = chain.channels;
+    header.levels = (int32_t)chain.levels.size();
+    return writeCacheFile(kMipCacheDir, cacheFilePath(kMipCacheDir, key, "srtx"), [&](FILE* f) {
+        bool ok = fwrite(&header, sizeof(header), 1, f) == 1;
+        for (const std::vector<unsigned char>& level : chain.levels)
+            ok = ok && fwrite(level.data(), 1, level.size(), f) == level.size();
+        return ok;
+    });
+}
@@ -0,0 +1,268 @@
+#include "TextureStreamer.h"
+#include "Scene.h"
+#include "JobSystem.h"
+#include "TextureUtils.h"
+#include <glm/geometric.hpp>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+// Extra mips to keep: >0 trades sharpness for memory
+static const float kMipBias = 0.0f;
+static const uint64_t kReportFrames = 600;
+static const uint64_t kUnneededFrames = 60; // frames before over-resident mips count as unused
+
+TextureStreamer::~TextureStreamer()
+{
+    // Jobs still running only hold their own Pending, nothing to wait for
+    entries_.clear();
+}
+
+void TextureStreamer::init(JobSystem* jobs, size_t budgetMB)
+{
+    jobs_ = jobs;
+    setBudgetMB(budgetMB);
+}
+
+void TextureStreamer::setScene(Scene* scene)
+{
+    scene_ = scene;
+    entries_.clear();
+    if (!scene_)
+        return;
+
+    for (size_t m = 0; m < scene_->modelCount(); ++m)
+    {
+        Model& model = scene_->model((int)m);
+        for (int slot = 0; slot < Slot_Count; ++slot)
+        {
+            const TextureArrayInfo& info = model.textureInfo((TextureSlot)slot);
+            if (info.layerSources.empty())
+                continue; // only the default layer, nothing to stream
+            Entry e{};
+            e.model = &model;
+            e.modelIndex = (int)m;
+            e.slot = (TextureSlot)slot;
+            e.coarseMip = info.residentMip;
+            e.wantedMip = info.residentMip;
+            entries_.push_back(e);
+        }
+    }
+}
+
+size_t TextureStreamer::bytesAt(const Entry& e, int mip) const
+{
+    const TextureArrayInfo& info = e.model->textureInfo(e.slot);
+    size_t bytes = 0;
+    for (int level = mip; level < info.levels; ++level)
+        bytes += (size_t)mipSize(info.width, level) * mipSize(info.height, level) * info.channels;
+    return bytes * info.layers;
+}
+
+void TextureStreamer::resize(Entry& e, int mip)
+{
+    // Keep the levels both arrays have, copied on the GPU
+    const TextureArrayInfo& info = e.model->textureInfo(e.slot);
+    int oldMip = info.residentMip;
+
+    GLuint texture = e.model->createTextureArray(e.slot, mip);
+    for (int level = std::max(mip, oldMip); level < info.levels; ++level)
+    {
+        glCopyImageSubData(e.model->textureArray(e.slot), GL_TEXTURE_2D_ARRAY, level - oldMip, 0, 0, 0,
+                           texture, GL_TEXTURE_2D_ARRAY, level - mip, 0, 0, 0,
+                           mipSize(info.width, level), mipSize(info.height, level), info.layers);
+    }
+    e.model->replaceTextureArray(e.slot, texture, mip);
+}
+
+void TextureStreamer::startUpgrade(Entry& e, int mip)
+{
+    auto pending = std::make_shared<Pending>();
+    pending->info = e.model->textureInfo(e.slot);
+    pending->mip = mip;
+    e.pending = pending;
+
+    JobSystem* jobs = jobs_;
+    auto decode = [pending, jobs] {
+        const TextureArrayInfo& info = pending->info;
+        pending->levels.resize(info.levels - pending->mip);
+        for (int level = pending->mip; level < info.levels; ++level) // layer 0 stays white
+            pending->levels[level - pending->mip].assign(
+                (size_t)mipSize(info.width, level) * mipSize(info.height, level) * info.channels * info.layers, 255);
+
+        MipChain chain;
+        for (int layer = 1; layer < info.layers; ++layer)
+        {
+            if (!Model::loadLayerMips(info, layer, pending->mip, chain, jobs))
+                continue;
+            if (chain.width != info.width || chain.height != info.height)
+            {
+                // Stretched layer, cached at the array size by Model::load
+                chain = MipChain();
+                if (!Model::loadFittedLayerMips(info, layer, pending->mip, chain, jobs))
+                    continue;
+            }
+            for (int level = pending->mip; level < info.levels; ++level)
+            {
+                const std::vector<unsigned char>& src = chain.levels[level];
+                std::vector<unsigned char>& dst = pending->levels[level - pending->mip];
+                std::copy(src.begin(), src.end(), dst.begin() + src.size() * layer);
+            }
+        }
+        pending->done = true;
+    };
+
+    // Background queue: a frame waiting on its own jobs must never end up
+    // running a whole decode
+    if (jobs_)
+        jobs_->runBackground(decode);
+    else
+        decode();
+}
+
+void TextureStreamer::finishUpgrade(Entry& e)
+{
+    std::shared_ptr<Pending> pending = std::move(e.pending);
+
+    // New array at the finer mip: copy the levels the old array already
+    // has, upload the ones above them
+    const TextureArrayInfo& info = e.model->textureInfo(e.slot);
+    int oldMip = info.residentMip;
+    int mip = pending->mip;
+    if (mip >= oldMip)
+        return; // evicted meanwhile to a level the job doesn't improve on
+
+    resize(e, mip);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, e.model->textureArray(e.slot));
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    for (int level = mip; level < oldMip; ++level)
+    {
+        glTexSubImage3D(GL_TEXTURE_2D_ARRAY, level - mip, 0, 0, 0, mipSize(info.width, level), mipSize(info.height, level),
+                        info.layers, info.pixelFormat(), GL_UNSIGNED_BYTE, pending->levels[level - mip].data());
+    }
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+    counters_.uploads++;
+}
+
+bool TextureStreamer::evictOne(const Entry* keep, bool onlyUnneeded)
+{
+    // Prefer arrays holding finer mips than the view wants, then the least
+    // recently needed
+    Entry* victim = nullptr;
+    for (Entry& e : entries_)
+    {
+        int resident = e.model->textureInfo(e.slot).residentMip;
+        if (&e == keep || resident >= e.coarseMip)
+            continue;
+        bool unneeded = resident < e.wantedMip;
+        if (onlyUnneeded && !unneeded && frame_ - e.lastNeeded < kUnneededFrames)
+            continue;
+        if (!victim)
+        {
+            victim = &e;
+            continue;
+        }
+        bool victimUnneeded = victim->model->textureInfo(victim->slot).residentMip < victim->wantedMip;
+        if ((unneeded && !victimUnneeded) || (unneeded == victimUnneeded && e.lastNeeded < victim->lastNeeded))
+            victim = &e;
+    }
+    if (!victim)
+        return false;
+
+    int resident = victim->model->textureInfo(victim->slot).residentMip;
+    counters_.residentBytes -= bytesAt(*victim, resident) - bytesAt(*victim, resident + 1);
+    resize(*victim, resident + 1);
+    counters_.evictions++;
+    return true;
+}
+
+void TextureStreamer::update(const glm::vec3& cameraPos, float pixelsPerUnit)
+{
+    frame_++;
+    if (!scene_)
+        return;
+
+    // Screen size of each model's nearest instance (batch index = model index)
+    std::vector<float> modelPixels(scene_->modelCount(), 0.0f);
+    const DrawBatchList& batches = scene_->batches();
+    for (size_t m = 0; m < batches.size(); ++m)
+    {
+        const DrawBatch& batch = *batches[m];
+        float bmin[3], bmax[3];
+        batch.model().bounds(bmin, bmax);
+        float radius = 0.5f * glm::length(glm::vec3(bmax[0] - bmin[0], bmax[1] - bmin[1], bmax[2] - bmin[2]));
+
+        for (size_t i = 0; i < batch.instanceCount(); ++i)
+        {
+            const glm::mat4& t = batch.transform(i);
+            float scale = std::max(glm::length(glm::vec3(t[0])), std::max(glm::length(glm::vec3(t[1])), glm::length(glm::vec3(t[2]))));
+            float distance = std::max(glm::length(glm::vec3(t[3]) - cameraPos) - radius * scale, 0.05f);
+            modelPixels[m] = std::max(modelPixels[m], 2.0f * radius * scale / distance * pixelsPerUnit);
+        }
+    }
+
+    counters_.residentBytes = counters_.requestedBytes = 0;
+    counters_.pending = 0;
+    counters_.budgetBytes = budgetBytes_;
+    for (Entry& e : entries_)
+    {
+        const TextureArrayInfo& info = e.model->textureInfo(e.slot);
+        // Texels across the texture vs. pixels across the object
+        float pixels = e.modelIndex < (int)modelPixels.size() ? modelPixels[e.modelIndex] : 0.0f;
+        float texels = (float)std::max(info.width, info.height);
+        int wanted = pixels > 0.0f ? (int)std::floor(std::log2(texels / pixels) + kMipBias) : e.coarseMip;
+        e.wantedMip = std::min(std::max(wanted, 0), e.coarseMip);
+        if (e.wantedMip >= info.residentMip)
+            e.lastNeeded = frame_;
+
+        if (e.pending && e.pending->done)
+            finishUpgrade(e);
+
+        counters_.residentBytes += bytesAt(e, e.model->textureInfo(e.slot).residentMip);
+        counters_.requestedBytes += bytesAt(e, e.wantedMip);
+        if (e.pending)
+            counters_.pending++;
+    }
+
+    // Over budget: shrink until it fits or nothing is left above coarse
+    while (counters_.residentBytes > budgetBytes_ && evictOne(nullptr, false))
+        ;
+
+    // One upgrade in flight at a time, the one missing the most mips
+    if (counters_.pending == 0)
+    {
+        Entry* best = nullptr;
+        for (Entry& e : entries_)
+        {
+            int missing = e.model->textureInfo(e.slot).residentMip - e.wantedMip;
+            if (missing > 0 && (!best || missing > best->model->textureInfo(best->slot).residentMip - best->wantedMip))
+                best = &e;
+        }
+        if (best)
+        {
+            int resident = best->model->textureInfo(best->slot).residentMip;
+            int target = best->wantedMip;
+
+            // Make room from arrays the view doesn't need, else settle for
+            // the finest mip that fits
+            while (target < resident && counters_.residentBytes + bytesAt(*best, target) - bytesAt(*best, resident) > budgetBytes_)
+            {
+                if (!evictOne(best, true))
+                    target++;
+            }
+            if (target < resident)
+            {
+                startUpgrade(*best, target);
+                counters_.pending++;
+            }
+        }
+    }
+
+    if (frame_ % kReportFrames == 0)
+    {
+        printf("Texture streaming: resident %.1f MB, requested %.1f MB, budget %.1f MB, %llu uploads, %llu evictions\n",
+               counters_.residentBytes / 1048576.0, counters_.requestedBytes / 1048576.0, budgetBytes_ / 1048576.0,
+               (unsigned long long)counters_.uploads, (unsigned long long)counters_.evictions);
+    }
+}
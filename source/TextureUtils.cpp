@@ -0,0 +1,274 @@
+#include "TextureUtils.h"
+#include "JobSystem.h"
+#include "Simd.h"
+#include <algorithm>
+#include <cmath>
+
+void resampleU8(const unsigned char* src, int sw, int sh, int channels, unsigned char* dst, int dw, int dh)
+{
+    for (int y = 0; y < dh; ++y)
+    {
+        float fy = (dh > 1) ? (float)y * (sh - 1) / (dh - 1) : 0.0f;
+        int y0 = (int)fy;
+        int y1 = (y0 + 1 < sh) ? y0 + 1 : y0;
+        float ty = fy - y0;
+        for (int x = 0; x < dw; ++x)
+        {
+            float fx = (dw > 1) ? (float)x * (sw - 1) / (dw - 1) : 0.0f;
+            int x0 = (int)fx;
+            int x1 = (x0 + 1 < sw) ? x0 + 1 : x0;
+            float tx = fx - x0;
+            for (int c = 0; c < channels; ++c)
+            {
+                float a = src[(y0 * sw + x0) * channels + c] * (1.0f - tx) + src[(y0 * sw + x1) * channels + c] * tx;
+                float b = src[(y1 * sw + x0) * channels + c] * (1.0f - tx) + src[(y1 * sw + x1) * channels + c] * tx;
+                dst[(y * dw + x) * channels + c] = (unsigned char)(a * (1.0f - ty) + b * ty + 0.5f);
+            }
+        }
+    }
+}
+
+// Kaiser window parameter and filter support in destination texels
+static const float kKaiserAlpha = 4.0f;
+static const float kFilterRadius = 2.0f;
+// Destination rows per parallelFor chunk
+static const size_t kRowGrain = 16;
+static const int kSrgbEncodeSize = 4096;
+
+int mipLevelCount(int width, int height)
+{
+    int levels = 1;
+    for (int s = std::max(width, height); s > 1; s >>= 1) ++levels;
+    return levels;
+}
+
+static float besselI0(float x)
+{
+    float sum = 1.0f, term = 1.0f;
+    for (int k = 1; k < 16; ++k)
+    {
+        term *= (x * 0.5f / k) * (x * 0.5f / k);
+        sum += term;
+    }
+    return sum;
+}
+
+static float kaiserSinc(float t)
+{
+    // t in destination texels
+    float x = t / kFilterRadius;
+    if (x <= -1.0f || x >= 1.0f)
+        return 0.0f;
+    float window = besselI0(kKaiserAlpha * std::sqrt(1.0f - x * x)) / besselI0(kKaiserAlpha);
+    float pt = 3.14159265f * t;
+    float sinc = std::fabs(pt) < 1e-5f ? 1.0f : std::sin(pt) / pt;
+    return sinc * window;
+}
+
+// Taps of every destination texel along one axis. Source indices are not
+// wrapped yet, weights are normalized.
+struct FilterAxis
+{
+    std::vector<int> first;
+    std::vector<int> count;
+    std::vector<float> weights; // count[i] entries per texel, starting at offset[i]
+    std::vector<int> offset;
+};
+
+static FilterAxis buildFilterAxis(int srcSize, int dstSize)
+{
+    FilterAxis axis;
+    float scale = (float)srcSize / dstSize;
+    float support = kFilterRadius * scale;
+    for (int d = 0; d < dstSize; ++d)
+    {
+        float center = (d + 0.5f) * scale - 0.5f;
+        int first = (int)std::floor(center - support) + 1;
+        int last = (int)std::ceil(center + support) - 1;
+        if (srcSize == dstSize)
+            first = last = d;
+
+        axis.first.push_back(first);
+        axis.count.push_back(last - first + 1);
+        axis.offset.push_back((int)axis.weights.size());
+        float sum = 0.0f;
+        for (int i = first; i <= last; ++i)
+        {
+            float w = srcSize == dstSize ? 1.0f : kaiserSinc((i - center) / scale);
+            axis.weights.push_back(w);
+            sum += w;
+        }
+        for (int i = 0; i <= last - first; ++i)
+            axis.weights[axis.offset.back() + i] /= sum;
+    }
+    return axis;
+}
+
+static inline int wrapIndex(int i, int size)
+{
+    i %= size;
+    return i < 0 ? i + size : i;
+}
+
+struct MipCodec
+{
+    float decode[4][256];              // per channel: stored byte -> filter space
+    unsigned char srgbEncode[kSrgbEncodeSize + 1];
+    bool srgb[4] = {};
+    bool normal = false;
+    int channels = 4;
+
+    MipCodec(int channelCount, MipContent content) : channels(channelCount)
+    {
+        normal = content == MipContent_Normal && channels >= 3;
+        int srgbChannels = content == MipContent_Srgb ? (channels >= 3 ? 3 : 1) : 0;
+        for (int c = 0; c < channels; ++c)
+        {
+            srgb[c] = c < srgbChannels;
+            for (int v = 0; v < 256; ++v)
+            {
+                float f = v / 255.0f;
+                if (srgb[c])
+                    f = f <= 0.04045f ? f / 12.92f : std::pow((f + 0.055f) / 1.055f, 2.4f);
+                else if (normal && c < 3)
+                    f = f * 2.0f - 1.0f;
+                decode[c][v] = f;
+            }
+        }
+        for (int i = 0; i <= kSrgbEncodeSize; ++i)
+        {
+            float f = (float)i / kSrgbEncodeSize;
+            f = f <= 0.0031308f ? f * 12.92f : 1.055f * std::pow(f, 1.0f / 2.4f) - 0.055f;
+            srgbEncode[i] = (unsigned char)(f * 255.0f + 0.5f);
+        }
+    }
+
+    static unsigned char toByte(float f)
+    {
+        return (unsigned char)(std::min(std::max(f, 0.0f), 1.0f) * 255.0f + 0.5f);
+    }
+
+    void encodeTexel(const float* in, unsigned char* out) const
+    {
+        float v[4] = { in[0], channels > 1 ? in[1] : 0.0f, channels > 2 ? in[2] : 0.0f, channels > 3 ? in[3] : 0.0f };
+        if (normal)
+        {
+            // Averaging shortens the vectors, put them back on the sphere
+            float len = std::sqrt(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+            float inv = len > 1e-6f ? 1.0f / len : 0.0f;
+            for (int c = 0; c < 3; ++c)
+                v[c] = len > 1e-6f ? v[c] * inv * 0.5f + 0.5f : (c == 2 ? 1.0f : 0.5f);
+        }
+        for (int c = 0; c < channels; ++c)
+        {
+            if (srgb[c])
+                out[c] = srgbEncode[(int)(std::min(std::max(v[c], 0.0f), 1.0f) * kSrgbEncodeSize + 0.5f)];
+            else
+                out[c] = toByte(v[c]);
+        }
+    }
+};
+
+// One level from the one above: horizontal pass into float rows (decoded
+// to filter space), vertical pass, encode
+static void downsample(const MipCodec& codec, const unsigned char* src, int sw, int sh,
+                       unsigned char* dst, int dw, int dh, JobSystem* jobs)
+{
+    const int ch = codec.channels;
+    FilterAxis ax = buildFilterAxis(sw, dw);
+    FilterAxis ay = buildFilterAxis(sh, dh);
+    const size_t rowFloats = (size_t)dw * ch;
+
+    auto filterRows = [&](size_t yBegin, size_t yEnd) {
+        // Source rows this chunk touches, unwrapped, each filtered once
+        int rowFirst = ay.first[yBegin];
+        int rowLast = ay.first[yEnd - 1] + ay.count[yEnd - 1] - 1;
+        std::vector<float> rows((size_t)(rowLast - rowFirst + 1) * rowFloats);
+        std::vector<float> texels((size_t)sw * ch);
+
+        for (int r = rowFirst; r <= rowLast; ++r)
+        {
+            const unsigned char* in = src + (size_t)wrapIndex(r, sh) * sw * ch;
+            for (int i = 0; i < sw * ch; ++i)
+                texels[i] = codec.decode[i % ch][in[i]];
+
+            float* out = &rows[(size_t)(r - rowFirst) * rowFloats];
+            for (int x = 0; x < dw; ++x)
+            {
+                const float* w = &ax.weights[ax.offset[x]];
+                if (ch == 4)
+                {
+                    f4 acc = splat4(0.0f);
+                    for (int t = 0; t < ax.count[x]; ++t)
+                        acc = add4(acc, mul4(load4(&texels[(size_t)wrapIndex(ax.first[x] + t, sw) * 4]), splat4(w[t])));
+                    store4(&out[(size_t)x * 4], acc);
+                }
+                else
+                {
+                    for (int c = 0; c < ch; ++c)
+                    {
+                        float acc = 0.0f;
+                        for (int t = 0; t < ax.count[x]; ++t)
+                            acc += texels[(size_t)wrapIndex(ax.first[x] + t, sw) * ch + c] * w[t];
+                        out[(size_t)x * ch + c] = acc;
+                    }
+                }
+            }
+        }
+
+        std::vector<float> acc(rowFloats);
+        for (size_t y = yBegin; y < yEnd; ++y)
+        {
+            std::fill(acc.begin(), acc.end(), 0.0f);
+            const float* w = &ay.weights[ay.offset[y]];
+            for (int t = 0; t < ay.count[y]; ++t)
+            {
+                const float* row = &rows[(size_t)(ay.first[y] + t - rowFirst) * rowFloats];
+                f4 wt = splat4(w[t]);
+                size_t i = 0;
+                for (; i + 4 <= rowFloats; i += 4)
+                    store4(&acc[i], add4(load4(&acc[i]), mul4(load4(&row[i]), wt)));
+                for (; i < rowFloats; ++i)
+                    acc[i] += row[i] * w[t];
+            }
+
+            unsigned char* out = dst + y * rowFloats;
+            for (int x = 0; x < dw; ++x)
+                codec.encodeTexel(&acc[(size_t)x * ch], out + (size_t)x * ch);
+        }
+    };
+
+    if (jobs)
+        jobs->parallelFor((size_t)dh, kRowGrain, filterRows);
+    else
+        filterRows(0, (size_t)dh);
+}
+
+void generateMipChain(const unsigned char* src, int width, int height, int channels, MipContent content,
+                      MipChain& chain, JobSystem* jobs)
+{
+    MipCodec codec(channels, content);
+    chain.width = width;
+    chain.height = height;
+    chain.channels = channels;
+    chain.levels.resize(mipLevelCount(width, height));
+    chain.levels[0].assign(src, src + (size_t)width * height * channels);
+
+    for (size_t level = 1; level < chain.levels.size(); ++level)
+    {
+        int sw = mipSize(width, (int)level - 1), sh = mipSize(height, (int)level - 1);
+        int dw = mipSize(width, (int)level), dh = mipSize(height, (int)level);
+        chain.levels[level].resize((size_t)dw * dh * channels);
+        downsample(codec, chain.levels[level - 1].data(), sw, sh, chain.levels[level].data(), dw, dh, jobs);
+    }
+}
+
+void fitMipChain(MipChain& chain, int width, int height, MipContent content, JobSystem* jobs)
+{
+    if (chain.width == width && chain.height == height)
+        return;
+
+    std::vector<unsigned char> resized((size_t)width * height * chain.channels);
+    resampleU8(chain.levels[0].data(), chain.width, chain.height, chain.channels, resized.data(), width, height);
+    generateMipChain(resized.data(), width, height, chain.channels, content, chain, jobs);
+}
@@ -0,0 +1,298 @@
+#!/usr/bin/env python3
+"""Offline validation of every shader program and permutation.
+
+Runs each program the app builds through glslang on the host: the sources
+are expanded the way Shader::build does it (#include once per stage, the
+variant #defines after #version), compiled and linked. Any error fails
+with a non-zero exit status, so a broken shader stops the build instead of
+showing up on device.
+
+For programs that also translate to SPIR-V, a report of instruction counts
+per stage is written; the others show "n/a". Only the GL compile and link
+gate the run: glslang refuses to translate ES sources for OpenGL SPIR-V,
+so with most versions every row is "n/a". The counts are of unoptimized
+SPIR-V, not of the Maxwell ISA the driver finally emits, so they are a
+relative measure: good for catching a variant that grew, not for absolute
+costs. With --baseline the report is compared against an older one and
+stages whose ALU or texture count grew more than --tolerance percent are
+listed (and fail the run with --strict).
+
+Usage: shadercheck.py [--glslang PATH] [--report FILE] [--baseline FILE]
+                      [--tolerance PCT] [--strict]
+"""
+
+import argparse
+import os
+import re
+import shutil
+import struct
+import subprocess
+import sys
+import tempfile
+
+ROOT = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+SHADER_DIR = os.path.join(ROOT, "romfs", "shaders")
+
+STAGE_EXT = {"vert": ".vert", "geom": ".geom", "frag": ".frag", "comp": ".comp"}
+
+
+def material_feature_defines():
+    """Feature #defines in MaterialFeature order, read from materialFeatureDefines()."""
+    with open(os.path.join(ROOT, "source", "Model.cpp")) as f:
+        source = f.read()
+    m = re.search(r"materialFeatureDefines\(\)\s*\{\s*return\s*\{([^}]*)\}", source)
+    if not m:
+        sys.exit("shadercheck: materialFeatureDefines() not found in source/Model.cpp")
+    return re.findall(r'"([^"]+)"', m.group(1))
+
+
+def programs():
+    """(name, {stage: file}, defines) of every program the app links.
+
+    Mirrors the loadFromFiles/loadComputeFromFile calls in App, DepthPrepass,
+    DynamicResolution, DebugViews, Culling, ShadowMap, LightClusters,
+    EnvironmentLight, PostProcess and TemporalAA; the material program is
+    expanded to every feature mask ShaderVariants can be asked for.
+    """
+    result = []
+    features = material_feature_defines()
+    for mask in range(1 << len(features)):
+        names = [features[i] for i in range(len(features)) if mask & (1 << i)]
+        defines = "".join("#define %s\n" % n for n in names)
+        result.append(("material[%s]" % ("|".join(names) or "base"),
+                       {"vert": "vertex.glsl", "frag": "fragment.glsl"}, defines))
+
+    result += [
+        ("depth", {"vert": "depth_vertex.glsl", "frag": "depth_fragment.glsl"}, ""),
+        ("upscale", {"vert": "fullscreen_vertex.glsl", "frag": "upscale_fragment.glsl"}, ""),
+        ("debug_overdraw", {"vert": "vertex.glsl", "frag": "debug_overdraw_fragment.glsl"}, ""),
+        ("debug_density", {"vert": "vertex.glsl", "geom": "debug_density_geometry.glsl",
+                           "frag": "debug_density_fragment.glsl"}, ""),
+        ("debug_cost", {"vert": "vertex.glsl", "frag": "debug_cost_fragment.glsl"}, ""),
+        ("debug_mip", {"vert": "vertex.glsl", "frag": "debug_mip_fragment.glsl"}, ""),
+        ("post_bloom_down", {"vert": "fullscreen_vertex.glsl", "frag": "post_bloom_down_fragment.glsl"}, ""),
+        ("post_bloom_up", {"vert": "fullscreen_vertex.glsl", "frag": "post_bloom_up_fragment.glsl"}, ""),
+        ("post_tonemap", {"vert": "fullscreen_vertex.glsl", "frag": "post_tonemap_fragment.glsl"}, ""),
+        ("post_fxaa", {"vert": "fullscreen_vertex.glsl", "frag": "post_fxaa_fragment.glsl"}, ""),
+        ("taa", {"vert": "fullscreen_vertex.glsl", "frag": "taa_fragment.glsl"}, ""),
+        ("debug_heatmap", {"vert": "fullscreen_vertex.glsl", "frag": "debug_heatmap_fragment.glsl"}, ""),
+        ("cull", {"comp": "cull.comp"}, ""),
+        ("hiz", {"comp": "hiz.comp"}, ""),
+        ("light_cull", {"comp": "light_cull.comp"}, ""),
+        ("ibl_prefilter", {"comp": "ibl_prefilter.comp"}, ""),
+        ("ibl_brdf", {"comp": "ibl_brdf.comp"}, ""),
+    ]
+    return result
+
+
+def preprocess(path, files):
+    """Expand #include "file" like Shader::preprocess, each file once per stage."""
+    with open(path) as f:
+        lines = f.read().split("\n")
+    if lines and lines[-1] == "":
+        lines.pop()
+
+    index = len(files)
+    files.append(path)
+    out = []
+    for number, line in enumerate(lines, 1):
+        stripped = line.lstrip(" \t")
+        if not stripped.startswith("#include"):
+            out.append(line + "\n")
+            continue
+
+        m = re.match(r'#include\s*"([^"]*)"', stripped)
+        if not m:
+            raise ValueError('%s:%d: expected #include "file"' % (path, number))
+        name = os.path.normpath(os.path.join(os.path.dirname(path), m.group(1)))
+        if name in files:
+            out.append("\n")
+            continue
+        if not os.path.exists(name):
+            raise ValueError("%s:%d: cannot open %s" % (path, number, name))
+        out.append("#line 1 %d\n" % len(files))
+        out.append(preprocess(name, files))
+        out.append("#line %d %d\n" % (number + 1, index))
+    return "".join(out)
+
+
+def insert_defines(source, defines):
+    """Same as insertDefines in Shader.cpp."""
+    if not defines:
+        return source
+    if source.startswith("#version"):
+        end = source.find("\n")
+        pos = len(source) if end < 0 else end + 1
+        return source[:pos] + defines + "#line 2 0\n" + source[pos:]
+    return defines + "#line 1 0\n" + source
+
+
+def map_errors(text, files):
+    """Rewrite glslang's "ERROR: <string>:<line>:" into file names."""
+    def repl(m):
+        string = int(m.group(2))
+        name = os.path.relpath(files[string], ROOT) if string < len(files) else m.group(2)
+        return "%s %s:%s:" % (m.group(1), name, m.group(3))
+    return re.sub(r"(ERROR:|WARNING:) (\d+):(\d+):", repl, text)
+
+
+# SPIR-V opcodes, grouped by what they cost on the GPU
+TEXTURE_OPS = set(range(87, 99)) | set(range(305, 321))  # OpImageSample* .. OpImageRead, sparse
+ALU_OPS = ({12}                         # OpExtInst: GLSL.std.450 math
+           | set(range(109, 125))       # conversions
+           | set(range(126, 153))       # arithmetic
+           | set(range(154, 206))       # relational, logical, select, bit ops
+           | set(range(207, 216)))      # derivatives
+BRANCH_OPS = {250, 251, 252}            # OpBranchConditional, OpSwitch, OpKill
+MEMORY_OPS = {61, 62}                   # OpLoad, OpStore
+
+
+def count_spirv(path):
+    with open(path, "rb") as f:
+        data = f.read()
+    words = struct.unpack("<%dI" % (len(data) // 4), data)
+    if not words or words[0] != 0x07230203:
+        return None
+    counts = {"alu": 0, "tex": 0, "branch": 0, "mem": 0, "total": 0}
+    in_function = False
+    i = 5
+    while i < len(words):
+        opcode = words[i] & 0xFFFF
+        length = words[i] >> 16
+        if length == 0:
+            break
+        if opcode == 54:    # OpFunction
+            in_function = True
+        elif opcode == 56:  # OpFunctionEnd
+            in_function = False
+        elif in_function:
+            # Function bodies only, declarations and debug info are free
+            counts["total"] += 1
+            if opcode in ALU_OPS:
+                counts["alu"] += 1
+            elif opcode in TEXTURE_OPS:
+                counts["tex"] += 1
+            elif opcode in BRANCH_OPS:
+                counts["branch"] += 1
+            elif opcode in MEMORY_OPS:
+                counts["mem"] += 1
+        i += length
+    return counts
+
+
+def check_program(glslang, name, stages, defines, tmp):
+    """Returns (ok, {stage: counts or None}, error text)."""
+    paths = []
+    file_tables = {}
+    for stage, filename in stages.items():
+        files = []
+        try:
+            source = preprocess(os.path.join(SHADER_DIR, filename), files)
+        except (OSError, ValueError) as e:
+            return False, {}, str(e)
+        source = insert_defines(source, defines)
+        path = os.path.join(tmp, name.replace("|", "_").replace("[", "_").replace("]", "") + STAGE_EXT[stage])
+        with open(path, "w") as f:
+            f.write(source)
+        paths.append(path)
+        file_tables[stage] = files
+
+    # Front end of each stage, then the link: this is the pass/fail gate.
+    # Stages are compiled alone first so errors map to the right file table.
+    for stage, path in zip(stages, paths):
+        result = subprocess.run([glslang, path], capture_output=True, text=True, cwd=tmp)
+        if result.returncode != 0:
+            return False, {}, map_errors(result.stdout + result.stderr, file_tables[stage])
+    result = subprocess.run([glslang, "-l"] + paths, capture_output=True, text=True, cwd=tmp)
+    if result.returncode != 0:
+        return False, {}, result.stdout + result.stderr
+
+    # SPIR-V for the counts only. The GL compile and link above are the
+    # gate; glslang rejects ES sources for OpenGL SPIR-V, so a failure here
+    # says nothing about the shader and just loses the report.
+    counts = {}
+    result = subprocess.run([glslang, "-G", "--auto-map-locations", "--auto-map-bindings", "-l"] + paths,
+                            capture_output=True, text=True, cwd=tmp)
+    for stage in stages:
+        spv = os.path.join(tmp, stage + ".spv")
+        counts[stage] = count_spirv(spv) if result.returncode == 0 and os.path.exists(spv) else None
+        if os.path.exists(spv):
+            os.remove(spv)
+    return True, counts, ""
+
+
+def read_report(path):
+    """{(program, stage): counts} of a report written by this script."""
+    table = {}
+    with open(path) as f:
+        for line in f:
+            fields = line.split()
+            if len(fields) != 7 or fields[0].startswith("#") or not fields[2].isdigit():
+                continue
+            table[(fields[0], fields[1])] = dict(zip(("alu", "tex", "branch", "mem", "total"),
+                                                     map(int, fields[2:])))
+    return table
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n")[0])
+    parser.add_argument("--glslang", default=os.environ.get("GLSLANG", "glslangValidator"))
+    parser.add_argument("--report", help="write the instruction count report here")
+    parser.add_argument("--baseline", help="earlier report to compare against")
+    parser.add_argument("--tolerance", type=float, default=10.0, help="allowed growth in percent")
+    parser.add_argument("--strict", action="store_true", help="fail when a stage grew past the tolerance")
+    args = parser.parse_args()
+
+    glslang = shutil.which(args.glslang)
+    if not glslang:
+        sys.exit("shadercheck: %s not found (set GLSLANG)" % args.glslang)
+
+    failed = 0
+    rows = []
+    with tempfile.TemporaryDirectory() as tmp:
+        for name, stages, defines in programs():
+            ok, counts, error = check_program(glslang, name, stages, defines, tmp)
+            if not ok:
+                failed += 1
+                print("FAIL %s\n%s" % (name, error.rstrip()))
+                continue
+            for stage, c in counts.items():
+                rows.append((name, stage, c))
+
+    lines = ["# program stage alu tex branch mem total"]
+    for name, stage, c in rows:
+        if c is None:
+            lines.append("%-40s %-5s n/a" % (name, stage))
+        else:
+            lines.append("%-40s %-5s %5d %4d %6d %4d %6d" % (name, stage, c["alu"], c["tex"], c["branch"],
+                                                              c["mem"], c["total"]))
+    report = "\n".join(lines) + "\n"
+    print(report, end="")
+    if args.report:
+        with open(args.report, "w") as f:
+            f.write(report)
+
+    grown = 0
+    if args.baseline and os.path.exists(args.baseline):
+        baseline = read_report(args.baseline)
+        for name, stage, c in rows:
+            old = baseline.get((name, stage))
+            if c is None or old is None:
+                continue
+            for key in ("alu", "tex"):
+                limit = old[key] * (1.0 + args.tolerance / 100.0)
+                if c[key] > limit and c[key] > old[key]:
+                    grown += 1
+                    print("GREW %s %s %s: %d -> %d" % (name, stage, key, old[key], c[key]))
+
+    if failed:
+        print("shadercheck: %d program(s) failed" % failed)
+        return 1
+    if grown and args.strict:
+        print("shadercheck: %d count(s) grew more than %.0f%%" % (grown, args.tolerance))
+        return 1
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())